@@ -4,6 +4,7 @@
 #include <stdexcept>
 #include <random>
 #include <fstream>
+#include <cstdio>
 #include <string>
 #include <map>
 #include <unordered_map>
@@ -12,6 +13,24 @@
 #include <cstdint>
 #include <algorithm>
 #include <regex>
+#include <charconv>
+#include <cstring>
+#include <cctype>
+#include <array>
+#include <mutex>
+#include <type_traits>
+
+#ifdef EPIWORLD_USE_MPI
+    #include <mpi.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #define EPIWORLD_HAS_MMAP
+#endif
 
 #ifndef EPIWORLD_HPP
 #define EPIWORLD_HPP
@@ -89,6 +108,9 @@ class Tools_const;
 template<typename TSeq = EPI_DEFAULT_TSEQ>
 class Entity;
 
+template<typename TSeq = EPI_DEFAULT_TSEQ>
+class DistributedModel;
+
 template<typename TSeq = EPI_DEFAULT_TSEQ>
 using VirusPtr = std::shared_ptr< Virus< TSeq > >;
 
@@ -486,6 +508,24 @@ struct vecHasher {
 template<typename Ta = epiworld_double, typename Tb = epiworld_fast_uint> 
 using MapVec_type = std::unordered_map< std::vector< Ta >, Tb, vecHasher<Ta>>;
 
+/**
+ * @brief Mixes a value into a 64-bit hash
+ * 
+ * @details Uses the finalizer of splitmix64, so changing a single bit of
+ * either `hash` or `x` changes about half of the bits of the result. The
+ * order of the calls matters, which makes it good for rolling hashes.
+ */
+inline std::uint64_t hash_combine64(std::uint64_t hash, std::uint64_t x) noexcept
+{
+
+    x += hash + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    
+    return x ^ (x >> 31);
+
+}
+
 /**
  * @name Default sequence initializers
  * 
@@ -569,71 +609,100 @@ inline bool IN(const Ta & a, const std::vector< Ta > & b) noexcept
  * @details 
  * The sampling function will draw one of `{-1, 0,...,probs.size() - 1}` in a
  * weighted fashion. The probabilities are drawn given that either one or none
- * of the cases is drawn; in the latter returns -1.
+ * of the cases is drawn; in the latter returns -1. If one or more
+ * probabilities are one, one of those is drawn uniformly.
+ * 
+ * The kernel over `probs[0], ..., probs[n - 1]` takes the uniform draw `r`
+ * from the caller, so it doesn't use the model and is safe to call from
+ * multiple threads. Since the probability of `i` given none or a single
+ * event is proportional to the odds `probs[i] / (1 - probs[i])` (and the
+ * probability of none to 1), it makes two passes over the data and needs
+ * no buffer: the first sums the odds, and the second finds where `r`
+ * falls in their cumulative sum.
+ * 
+ * The other versions draw `r` from `m`; `roulette(nelements, m)` samples from
+ * the first `nelements` entries of the model's buffer `m->array_double_tmp`.
  * 
  * @param probs Vector of probabilities.
+ * @param n Number of probabilities.
+ * @param r Random uniform number in [0, 1).
  * @param m A `Model`. This is used to draw random uniform numbers.
  * @return int If -1 then it means that none got sampled, otherwise the index
  * of the entry that got drawn.
  */
-template<typename TSeq, typename TDbl>
+///@{
+template<typename TDbl>
 inline int roulette(
-    const std::vector< TDbl > & probs,
-    Model<TSeq> * m
-    )
+    const TDbl * probs,
+    size_t n,
+    double r
+    ) noexcept
 {
 
-    // Step 1: Computing the prob on none 
-    TDbl p_none = 1.0;
-    std::vector< int > certain_infection;
-    certain_infection.reserve(probs.size());
+    if (n == 0u)
+        return -1;
 
-    for (epiworld_fast_uint p = 0u; p < probs.size(); ++p)
+    // Step 1: Total odds (and number of certain events)
+    double odds = 0.0;
+    size_t ncertain = 0u;
+    #ifdef _OPENMP
+    #pragma omp simd reduction(+:odds,ncertain)
+    #endif
+    for (size_t p = 0u; p < n; ++p)
     {
-        p_none *= (1.0 - probs[p]);
-
-        if (probs[p] > (1 - 1e-100))
-            certain_infection.push_back(p);
-        
+        double p_i = static_cast< double >(probs[p]);
+        bool certain = p_i >= 1.0;
+        ncertain += certain ? 1u : 0u;
+        odds     += certain ? 0.0 : (p_i / (1.0 - p_i));
     }
 
-    TDbl r = static_cast<TDbl>(m->runif());
-    // If there are one or more probs that go close to 1, sample
-    // uniformly
-    if (certain_infection.size() > 0)
-        return certain_infection[std::floor(r * certain_infection.size())];
-
-    // Step 2: Calculating the prob of none or single
-    std::vector< TDbl > probs_only_p(probs.size());
-    TDbl p_none_or_single = p_none;
-    for (epiworld_fast_uint p = 0u; p < probs.size(); ++p)
+    // If there are one or more probs equal to 1, sample uniformly
+    if (ncertain > 0u)
     {
-        probs_only_p[p] = probs[p] * (p_none / (1.0 - probs[p]));
-        p_none_or_single += probs_only_p[p];
+
+        size_t which = static_cast< size_t >(
+            std::floor(r * static_cast< double >(ncertain))
+            );
+
+        for (size_t p = 0u; p < n; ++p)
+            if ((probs[p] >= 1.0) && (which-- == 0u))
+                return static_cast< int >(p);
+
+        return static_cast< int >(n - 1u);
+
     }
 
-    // Step 3: Roulette
-    TDbl cumsum = p_none/p_none_or_single;
-    if (r < cumsum)
-    {
+    // Step 2: Roulette (none has odds 1)
+    double target = r * (1.0 + odds);
+    double cumsum = 1.0;
+    if (target < cumsum)
         return -1;
-    }
 
-    for (epiworld_fast_uint p = 0u; p < probs.size(); ++p)
+    for (size_t p = 0u; p < n; ++p)
     {
         // If it yield here, then bingo, the individual will acquire the disease
-        cumsum += probs_only_p[p]/(p_none_or_single);
-        if (r < cumsum)
-            return static_cast<int>(p);
-        
+        double p_i = static_cast< double >(probs[p]);
+        cumsum += p_i / (1.0 - p_i);
+        if (target < cumsum)
+            return static_cast< int >(p);
     }
 
-
     #ifdef EPI_DEBUG
-    printf_epiworld("[epi-debug] roulette::cumsum = %.4f\n", cumsum);
+    printf_epiworld("[epi-debug] roulette::cumsum = %.4f\n", cumsum/(1.0 + odds));
     #endif
 
-    return static_cast<int>(probs.size() - 1u);
+    return static_cast< int >(n - 1u);
+
+}
+
+template<typename TSeq, typename TDbl>
+inline int roulette(
+    const std::vector< TDbl > & probs,
+    Model<TSeq> * m
+    )
+{
+
+    return roulette(probs.data(), probs.size(), m->runif());
 
 }
 
@@ -649,7 +718,6 @@ inline int roulette(std::vector< float > & probs, Model<TSeq> * m)
     return roulette<TSeq, float>(probs, m);
 }
 
-
 template<typename TSeq>
 inline int roulette(
     epiworld_fast_uint nelements,
@@ -657,7 +725,7 @@ inline int roulette(
     )
 {
 
-    if ((nelements * 2) > m->array_double_tmp.size())
+    if (nelements > m->array_double_tmp.size())
     {
         throw std::logic_error(
             "Trying to sample from more data than there is in roulette!" +
@@ -666,53 +734,14 @@ inline int roulette(
             );
     }
 
-    // Step 1: Computing the prob on none 
-    epiworld_double p_none = 1.0;
-    epiworld_fast_uint ncertain = 0u;
-    // std::vector< int > certain_infection;
-    for (epiworld_fast_uint p = 0u; p < nelements; ++p)
-    {
-        p_none *= (1.0 - m->array_double_tmp[p]);
-
-        if (m->array_double_tmp[p] > (1 - 1e-100))
-            m->array_double_tmp[nelements + ncertain++] = p;
-            // certain_infection.push_back(p);
-        
-    }
-
-    epiworld_double r = m->runif();
-    // If there are one or more probs that go close to 1, sample
-    // uniformly
-    if (ncertain > 0u)
-        return m->array_double_tmp[nelements + std::floor(ncertain * r)]; //    certain_infection[std::floor(r * certain_infection.size())];
-
-    // Step 2: Calculating the prob of none or single
-    // std::vector< epiworld_double > probs_only_p;
-    epiworld_double p_none_or_single = p_none;
-    for (epiworld_fast_uint p = 0u; p < nelements; ++p)
-    {
-        m->array_double_tmp[nelements + p] = 
-            m->array_double_tmp[p] * (p_none / (1.0 - m->array_double_tmp[p]));
-        p_none_or_single += m->array_double_tmp[nelements + p];
-    }
-
-    // Step 3: Roulette
-    epiworld_double cumsum = p_none/p_none_or_single;
-    if (r < cumsum)
-        return -1;
-
-    for (epiworld_fast_uint p = 0u; p < nelements; ++p)
-    {
-        // If it yield here, then bingo, the individual will acquire the disease
-        cumsum += m->array_double_tmp[nelements + p]/(p_none_or_single);
-        if (r < cumsum)
-            return static_cast<int>(p);
-        
-    }
-
-    return static_cast<int>(nelements - 1u);
+    return roulette(
+        m->array_double_tmp.data(),
+        static_cast< size_t >(nelements),
+        m->runif()
+        );
 
 }
+///@}
 
 #endif
 /*//////////////////////////////////////////////////////////////////////////////
@@ -2609,337 +2638,428 @@ inline std::string default_seq_writer<int>(
 
 }
 
+/**
+ * @name 64-bit fingerprints of sequences
+ * 
+ * @details The fingerprint is the sum (mod 2^64) of a hash of each (position,
+ * value) pair plus a hash of the length. Because of this, changing the value
+ * of a single position can be reflected in O(1) with
+ * `seq_fingerprint_update()`. For example, a mutation function that changes
+ * position `pos` of the sequence of `v` can do
+ * `v.set_fingerprint(seq_fingerprint_update(v.get_fingerprint(), pos, old, new))`
+ * so that `DataBase::record_virus()` does not hash the full sequence again.
+ * This only holds for the default fingerprint (see
+ * `DataBase::set_seq_fingerprint()`).
+ * 
+ * @tparam TSeq 
+ * @param x Sequence.
+ * @return std::uint64_t The fingerprint.
+ */
+///@{
+inline std::uint64_t seq_fingerprint_element(size_t pos, int value) noexcept
+{
+    return hash_combine64(
+        static_cast< std::uint64_t >(pos),
+        static_cast< std::uint32_t >(value)
+        );
+}
 
+inline std::uint64_t seq_fingerprint_length(size_t n) noexcept
+{
+    return hash_combine64(~static_cast< std::uint64_t >(0u), n);
+}
 
-#endif
-/*//////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-
- End of -include/epiworld/seq_processing.hpp-
-
-////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////*/
-
-
-
-/*//////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
+inline std::uint64_t seq_fingerprint_update(
+    std::uint64_t fingerprint,
+    size_t pos,
+    int old_value,
+    int new_value
+) noexcept
+{
+    return fingerprint - seq_fingerprint_element(pos, old_value) +
+        seq_fingerprint_element(pos, new_value);
+}
 
- Start of -include/epiworld/database-bones.hpp-
+template<typename TSeq>
+inline std::uint64_t default_seq_fingerprint(const TSeq & x);
 
-////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////*/
+template<>
+inline std::uint64_t default_seq_fingerprint<std::vector<int>>(
+    const std::vector<int> & x
+) {
 
+    std::uint64_t ans = seq_fingerprint_length(x.size());
+    for (size_t i = 0u; i < x.size(); ++i)
+        ans += seq_fingerprint_element(i, x[i]);
 
-#ifndef EPIWORLD_DATABASE_BONES_HPP
-#define EPIWORLD_DATABASE_BONES_HPP
+    return ans;
 
-template<typename TSeq>
-class Model;
+}
 
-template<typename TSeq>
-class Virus;
+template<>
+inline std::uint64_t default_seq_fingerprint<std::vector<bool>>(
+    const std::vector<bool> & x
+) {
 
-template<typename TSeq>
-class UserData;
+    std::uint64_t ans = seq_fingerprint_length(x.size());
+    for (size_t i = 0u; i < x.size(); ++i)
+        ans += seq_fingerprint_element(i, x[i] ? 1 : 0);
 
-template<typename TSeq>
-inline void default_add_virus(Action<TSeq> & a, Model<TSeq> * m);
+    return ans;
 
-template<typename TSeq>
-inline void default_add_tool(Action<TSeq> & a, Model<TSeq> * m);
+}
 
-template<typename TSeq>
-inline void default_rm_virus(Action<TSeq> & a, Model<TSeq> * m);
+template<>
+inline std::uint64_t default_seq_fingerprint<int>(const int & x) {
+    return seq_fingerprint_length(1u) + seq_fingerprint_element(0u, x);
+}
 
-template<typename TSeq>
-inline void default_rm_tool(Action<TSeq> & a, Model<TSeq> * m);
+template<>
+inline std::uint64_t default_seq_fingerprint<bool>(const bool & x) {
+    return seq_fingerprint_length(1u) + seq_fingerprint_element(0u, x ? 1 : 0);
+}
+///@}
 
 /**
- * @brief Statistical data about the process
+ * @brief Registry of sequences by fingerprint
  * 
- * @tparam TSeq 
+ * @details Maps the fingerprint of a sequence (see
+ * `default_seq_fingerprint()`) to its id using a flat open-addressing table
+ * (linear probing). Lookups don't allocate. Iterating the registry gives the
+ * (fingerprint, id) pairs in the order they were inserted.
  */
-template<typename TSeq>
-class DataBase {
-    friend class Model<TSeq>;
-    friend void default_add_virus<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
-    friend void default_add_tool<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
-    friend void default_rm_virus<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
-    friend void default_rm_tool<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
+class SeqRegistry {
 private:
-    Model<TSeq> * model;
 
-    // Variants information 
-    MapVec_type<int,int> virus_id; ///< The squence is the key
-    std::vector< std::string > virus_name;
-    std::vector< TSeq> virus_sequence;
-    std::vector< int > virus_origin_date;
-    std::vector< int > virus_parent_id;
+    /// (fingerprint, id) pairs in insertion order
+    std::vector< std::pair< std::uint64_t, int > > entries;
 
-    MapVec_type<int,int> tool_id; ///< The squence is the key
-    std::vector< std::string > tool_name;
-    std::vector< TSeq> tool_sequence;
-    std::vector< int > tool_origin_date;
+    /// Location of each entry in `entries` (-1 if empty). Size is a power of 2
+    std::vector< int > table;
 
-    std::function<std::vector<int>(const TSeq&)> seq_hasher = default_seq_hasher<TSeq>;
-    std::function<std::string(const TSeq &)> seq_writer = default_seq_writer<TSeq>;
+    size_t probe(std::uint64_t fingerprint) const noexcept;
+    void grow();
 
-    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
-    std::vector< std::vector<int> > today_virus;
+public:
 
-    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
-    std::vector< std::vector<int> > today_tool;
+    typedef std::vector< std::pair< std::uint64_t, int > >::const_iterator const_iterator;
 
-    // {Susceptible, Infected, etc.}
-    std::vector< int > today_total;
+    SeqRegistry() {};
 
-    // Totals
-    int today_total_nviruses_active = 0;
-    
-    int sampling_freq = 1;
+    /**
+     * @brief Finds the id of a fingerprint
+     * @return The id, or -1 if it is not in the registry.
+     */
+    int find(std::uint64_t fingerprint) const noexcept;
 
-    // Variants history
-    std::vector< int > hist_virus_date;
-    std::vector< int > hist_virus_id;
-    std::vector< epiworld_fast_uint > hist_virus_state;
-    std::vector< int > hist_virus_counts;
+    /**
+     * @brief Sets the id of a fingerprint (overwriting it if already there)
+     */
+    void insert(std::uint64_t fingerprint, int id);
 
-    // Tools history
-    std::vector< int > hist_tool_date;
-    std::vector< int > hist_tool_id;
-    std::vector< epiworld_fast_uint > hist_tool_state;
-    std::vector< int > hist_tool_counts;
+    size_t size() const noexcept;
+    void clear();
 
-    // Overall hist
-    std::vector< int > hist_total_date;
-    std::vector< int > hist_total_nviruses_active;
-    std::vector< epiworld_fast_uint > hist_total_state;
-    std::vector< int > hist_total_counts;
-    std::vector< int > hist_transition_matrix;
+    const_iterator begin() const noexcept;
+    const_iterator end() const noexcept;
 
-    // Transmission network
-    std::vector< int > transmission_date;                 ///< Date of the transmission event
-    std::vector< int > transmission_source;               ///< Id of the source
-    std::vector< int > transmission_target;               ///< Id of the target
-    std::vector< int > transmission_virus;              ///< Id of the variant
-    std::vector< int > transmission_source_exposure_date; ///< Date when the source acquired the variant
+    bool operator==(const SeqRegistry & other) const;
+    bool operator!=(const SeqRegistry & other) const {return !operator==(other);};
 
-    std::vector< int > transition_matrix;
+};
 
-    UserData<TSeq> user_data;
+inline size_t SeqRegistry::probe(std::uint64_t fingerprint) const noexcept
+{
 
-    void update_state(
-        epiworld_fast_uint prev_state,
-        epiworld_fast_uint new_state,
-        bool undo = false
-    );
+    size_t mask = table.size() - 1u;
+    size_t i    = static_cast< size_t >(fingerprint) & mask;
 
-    void update_virus(
-        epiworld_fast_uint virus_id,
-        epiworld_fast_uint prev_state,
-        epiworld_fast_uint new_state
-    );
+    // There is always an empty slot (load factor is at most 1/2)
+    while (
+        (table[i] != -1) &&
+        (entries[static_cast< size_t >(table[i])].first != fingerprint)
+    )
+        i = (i + 1u) & mask;
 
-    void update_tool(
-        epiworld_fast_uint tool_id,
-        epiworld_fast_uint prev_state,
-        epiworld_fast_uint new_state
-    );
+    return i;
 
-    void record_transition(epiworld_fast_uint from, epiworld_fast_uint to, bool undo);
+}
 
+inline void SeqRegistry::grow()
+{
 
-public:
+    table.assign(table.size() == 0u ? 16u : table.size() * 2u, -1);
 
-    #ifdef EPI_DEBUG
-    int n_transmissions_potential = 0;
-    int n_transmissions_today     = 0;
-    #endif
+    for (size_t e = 0u; e < entries.size(); ++e)
+        table[probe(entries[e].first)] = static_cast< int >(e);
 
-    DataBase() = delete;
-    DataBase(Model<TSeq> & m) : model(&m), user_data(m) {};
-    DataBase(const DataBase<TSeq> & db);
-    // DataBase<TSeq> & operator=(const DataBase<TSeq> & m);
+}
 
-    /**
-     * @brief Registering a new variant
-     * 
-     * @param v Pointer to the new virus.
-     * Since viruses are originated in the agent, the numbers simply move around.
-     * From the parent virus to the new virus. And the total number of infected
-     * does not change.
-     */
-    void record_virus(Virus<TSeq> & v); 
-    void record_tool(Tool<TSeq> & t); 
-    void set_seq_hasher(std::function<std::vector<int>(TSeq)> fun);
-    void reset();
-    Model<TSeq> * get_model();
-    void record();
+inline int SeqRegistry::find(std::uint64_t fingerprint) const noexcept
+{
 
-    const std::vector< TSeq > & get_sequence() const;
-    const std::vector< int > & get_nexposed() const;
-    size_t size() const;
+    if (table.size() == 0u)
+        return -1;
 
-    /**
-     * @name Get recorded information from the model
-     * 
-     * @param what std::string, The state, e.g., 0, 1, 2, ...
-     * @return In `get_today_total`, the current counts of `what`.
-     * @return In `get_today_virus`, the current counts of `what` for
-     * each virus.
-     * @return In `get_hist_total`, the time series of `what`
-     * @return In `get_hist_virus`, the time series of what for each virus.
-     * @return In `get_hist_total_date` and `get_hist_virus_date` the
-     * corresponding date
-     */
-    ///@{
-    int get_today_total(std::string what) const;
-    int get_today_total(epiworld_fast_uint what) const;
-    void get_today_total(
-        std::vector< std::string > * state = nullptr,
-        std::vector< int > * counts = nullptr
-    ) const;
+    int e = table[probe(fingerprint)];
 
-    void get_today_virus(
-        std::vector< std::string > & state,
-        std::vector< int > & id,
-        std::vector< int > & counts
-    ) const;
+    return e == -1 ? -1 : entries[static_cast< size_t >(e)].second;
 
-    void get_hist_total(
-        std::vector< int > * date,
-        std::vector< std::string > * state,
-        std::vector< int > * counts
-    ) const;
+}
 
-    void get_hist_virus(
-        std::vector< int > & date,
-        std::vector< int > & id,
-        std::vector< std::string > & state,
-        std::vector< int > & counts
-    ) const;
+inline void SeqRegistry::insert(std::uint64_t fingerprint, int id)
+{
 
-    void get_hist_tool(
-        std::vector< int > & date,
-        std::vector< int > & id,
-        std::vector< std::string > & state,
-        std::vector< int > & counts
-    ) const;
+    if ((entries.size() + 1u) * 2u > table.size())
+        grow();
 
-    void get_hist_transition_matrix(
-        std::vector< std::string > & state_from,
-        std::vector< std::string > & state_to,
-        std::vector< int > & date,
-        std::vector< int > & counts,
-        bool skip_zeros
-    ) const;
-    ///@}
+    size_t i = probe(fingerprint);
+
+    if (table[i] != -1)
+    {
+        entries[static_cast< size_t >(table[i])].second = id;
+        return;
+    }
+
+    table[i] = static_cast< int >(entries.size());
+    entries.push_back({fingerprint, id});
+
+}
+
+inline size_t SeqRegistry::size() const noexcept
+{
+    return entries.size();
+}
+
+inline void SeqRegistry::clear()
+{
+    entries.clear();
+    table.clear();
+}
+
+inline SeqRegistry::const_iterator SeqRegistry::begin() const noexcept
+{
+    return entries.begin();
+}
+
+inline SeqRegistry::const_iterator SeqRegistry::end() const noexcept
+{
+    return entries.end();
+}
+
+inline bool SeqRegistry::operator==(const SeqRegistry & other) const
+{
+    return entries == other.entries;
+}
+
+
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/seq_processing.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/transmissionlog-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_TRANSMISSIONLOG_BONES_HPP
+#define EPIWORLD_TRANSMISSIONLOG_BONES_HPP
+
+/**
+ * @brief A single transmission event (as returned by `TransmissionLog`)
+ */
+struct TransmissionEvent {
+    int date;                 ///< Date of the transmission event
+    int source;               ///< Id of the source
+    int target;               ///< Id of the target
+    int virus;                ///< Id of the variant
+    int source_exposure_date; ///< Date when the source acquired the variant
+};
+
+/**
+ * @brief Append-only log of transmission events
+ * 
+ * @details Events are stored in fixed-size blocks, so growing the log never
+ * reallocates (nor copies) the events already recorded. Within a block,
+ * agent ids are stored as 32-bit integers, whereas the virus id and the
+ * source exposure date (relative to the date of the event) are stored in 8
+ * bits. Values that do not fit in 8 bits are kept in a small per-block
+ * overflow list, so any `int` can be recorded. Dates are run-length encoded
+ * (events are mostly recorded in date order), so a block stores one entry per
+ * day instead of one per event. Overall, an event takes 10 bytes, half of the
+ * 20 used by five `int` columns.
+ * 
+ * Events can be accessed by position (`operator[]` or the per-column
+ * accessors) or through iterators.
+ */
+class TransmissionLog {
+public:
+
+    static const size_t block_size = 4096u; ///< Number of events per block
+
+private:
+
+    typedef std::uint8_t narrow_type;
+    static const narrow_type narrow_na = 0xFFu; ///< Value stored in the overflow list
 
     /**
-     * @brief Get the transmissions object
-     * 
-     * @param date 
-     * @param source 
-     * @param target 
-     * @param virus 
-     * @param source_exposure_date 
+     * @brief Run of events recorded on the same date
      */
-    ///@{
-    void get_transmissions(
-        std::vector<int> & date,
-        std::vector<int> & source,
-        std::vector<int> & target,
-        std::vector<int> & virus,
-        std::vector<int> & source_exposure_date
-    ) const;
+    struct DateRun {
+        std::uint32_t pos; ///< Position (within the block) of the first event
+        int date;
+    };
 
-    void get_transmissions(
-        int * date,
-        int * source,
-        int * target,
-        int * virus,
-        int * source_exposure_date
-    ) const;
-    ///@}
+    struct Block {
 
-    void write_data(
-        std::string fn_virus_info,
-        std::string fn_virus_hist,
-        std::string fn_tool_info,
-        std::string fn_tool_hist,
-        std::string fn_total_hist,
-        std::string fn_transmission,
-        std::string fn_transition,
-        std::string fn_reproductive_number,
-        std::string fn_generation_time
-        ) const;
-    
-    void record_transmission(int i, int j, int virus, int i_expo_date);
+        std::vector< DateRun > date_runs; ///< Sorted by `pos`
 
-    size_t get_n_viruses() const;
-    size_t get_n_tools() const;
-    
-    void set_user_data(std::vector< std::string > names);
-    void add_user_data(std::vector< epiworld_double > x);
-    void add_user_data(epiworld_fast_uint j, epiworld_double x);
-    UserData<TSeq> & get_user_data();
+        std::vector< std::int32_t > source;
+        std::vector< std::int32_t > target;
+        std::vector< narrow_type > virus;
+        std::vector< narrow_type > source_exposure_date;
 
+        /**
+         * @name Overflow lists
+         * @details Pairs of (position within the block, value) for entries
+         * that could not be narrowed. Positions are sorted as the log is
+         * append-only.
+         */
+        ///@{
+        std::vector< std::pair< size_t, int > > virus_wide;
+        std::vector< std::pair< size_t, int > > source_exposure_date_wide;
+        ///@}
+
+        void allocate(); ///< Reserves room for `block_size` events
+        int get_date(size_t pos) const; ///< Date of the event at `pos`
+
+    };
+
+    std::vector< Block > blocks;
+    size_t n = 0u;
+
+    static narrow_type narrow(
+        int x,
+        size_t pos,
+        std::vector< std::pair< size_t, int > > & wide
+        );
+
+    static int widen(
+        narrow_type x,
+        size_t pos,
+        const std::vector< std::pair< size_t, int > > & wide
+        );
+
+public:
+
+    class const_iterator;
+
+    TransmissionLog() {};
+
+    void push_back(
+        int date,
+        int source,
+        int target,
+        int virus,
+        int source_exposure_date
+        );
+
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+    void clear();
+    void reserve(size_t n_events);
 
     /**
-     * @brief Computes the reproductive number of each case
+     * @name Access the i-th event
      * 
-     * @details By definition, whereas it computes R0 (basic reproductive number)
-     * or Rt/R (the effective reproductive number) will depend on whether the
-     * virus is allowed to circulate naïvely or not, respectively.
+     * @details `operator[]` does no boundary check, whereas `at()` does.
+     * The per-column accessors avoid decoding the full event.
      * 
-     * @param fn File where to write out the reproductive number.
+     * @param i Position of the event in the log.
      */
     ///@{
-    MapVec_type<int,int> reproductive_number() const;
-
-    void reproductive_number(
-        std::string fn
-        ) const;
+    TransmissionEvent operator[](size_t i) const;
+    TransmissionEvent at(size_t i) const;
+
+    int date(size_t i) const;
+    int source(size_t i) const;
+    int target(size_t i) const;
+    int virus(size_t i) const;
+    int source_exposure_date(size_t i) const;
     ///@}
 
-    /**
-     * @brief Calculates the transition probabilities
-     * 
-     * @return std::vector< epiworld_double > 
-     */
-    std::vector< epiworld_double > transition_probability(
-        bool print = true
-    ) const;
+    const_iterator begin() const;
+    const_iterator end() const;
 
-    bool operator==(const DataBase<TSeq> & other) const;
-    bool operator!=(const DataBase<TSeq> & other) const {return !operator==(other);};
+    bool operator==(const TransmissionLog & other) const;
+    bool operator!=(const TransmissionLog & other) const {return !operator==(other);};
 
-    /**
-     * Calculates the generating time
-     * @param agent_id,virus_id,time,gentime vectors where to save the values agent_id
-    */
-   ///@{
-    void generation_time(
-        std::vector< int > & agent_id,
-        std::vector< int > & virus_id,
-        std::vector< int > & time,
-        std::vector< int > & gentime
-    ) const;
+};
 
-    void generation_time(
-        std::string fn
-    ) const;
-    ///@}
+/**
+ * @brief Random-access iterator over a `TransmissionLog`
+ */
+class TransmissionLog::const_iterator {
+    friend class TransmissionLog;
+private:
 
-};
+    const TransmissionLog * log = nullptr;
+    size_t i = 0u;
+
+    const_iterator(const TransmissionLog * log_, size_t i_) : log(log_), i(i_) {};
+
+public:
+
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef TransmissionEvent value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const TransmissionEvent * pointer;
+    typedef TransmissionEvent reference;
+
+    const_iterator() {};
+
+    TransmissionEvent operator*() const {return (*log)[i];};
+    TransmissionEvent operator[](difference_type k) const {return (*log)[i + k];};
+
+    const_iterator & operator++() {++i; return *this;};
+    const_iterator operator++(int) {const_iterator tmp(*this); ++i; return tmp;};
+    const_iterator & operator--() {--i; return *this;};
+    const_iterator operator--(int) {const_iterator tmp(*this); --i; return tmp;};
 
+    const_iterator & operator+=(difference_type k) {i += k; return *this;};
+    const_iterator & operator-=(difference_type k) {i -= k; return *this;};
+    const_iterator operator+(difference_type k) const {return const_iterator(log, i + k);};
+    const_iterator operator-(difference_type k) const {return const_iterator(log, i - k);};
+    difference_type operator-(const const_iterator & other) const {
+        return static_cast<difference_type>(i) - static_cast<difference_type>(other.i);
+    };
+
+    bool operator==(const const_iterator & other) const {return i == other.i;};
+    bool operator!=(const const_iterator & other) const {return i != other.i;};
+    bool operator<(const const_iterator & other) const {return i < other.i;};
+    bool operator>(const const_iterator & other) const {return i > other.i;};
+    bool operator<=(const const_iterator & other) const {return i <= other.i;};
+    bool operator>=(const const_iterator & other) const {return i >= other.i;};
+
+};
 
 #endif
 /*//////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
- End of -include/epiworld/database-bones.hpp-
+ End of -include/epiworld/transmissionlog-bones.hpp-
 
 ////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////*/
@@ -2948,1899 +3068,7514 @@ public:
 /*//////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
- Start of -include/epiworld/database-meat.hpp-
+ Start of -include/epiworld/transmissionlog-meat.hpp-
 
 ////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////*/
 
 
-#ifndef EPIWORLD_DATABASE_MEAT_HPP
-#define EPIWORLD_DATABASE_MEAT_HPP
+#ifndef EPIWORLD_TRANSMISSIONLOG_MEAT_HPP
+#define EPIWORLD_TRANSMISSIONLOG_MEAT_HPP
 
-template<typename TSeq>
-inline void DataBase<TSeq>::reset()
+inline void TransmissionLog::Block::allocate()
 {
 
-    // Initializing the counts
-    today_total.resize(model->nstates);
-    std::fill(today_total.begin(), today_total.end(), 0);
-    for (auto & p : model->get_agents())
-        ++today_total[p.get_state()];
+    // Blocks are allocated once and never grow beyond block_size (copies of
+    // the log only allocate what is used, so this is called again on reuse)
+    source.reserve(block_size);
+    target.reserve(block_size);
+    virus.reserve(block_size);
+    source_exposure_date.reserve(block_size);
 
-    #ifdef EPI_DEBUG
-    // Only the first should be different from zero
-    {
-        int n = static_cast<int>(model->size());
-        if (today_total[0] != n)
-            throw std::runtime_error("The number of susceptible agents is not equal to the total number of agents.");
+}
 
-        if (std::accumulate(today_total.begin(), today_total.end(), 0) != n)
-            throw std::runtime_error("The total number of agents is not equal to the sum of the number of agents in each state.");
-            
-    }
-    #endif
+inline int TransmissionLog::Block::get_date(size_t pos) const
+{
 
-    
-    transition_matrix.resize(model->nstates * model->nstates);
-    std::fill(transition_matrix.begin(), transition_matrix.end(), 0);
-    for (size_t s = 0u; s < model->nstates; ++s)
-        transition_matrix[s + s * model->nstates] = today_total[s];
+    // Last run starting at or before pos
+    auto r = std::upper_bound(
+        date_runs.begin(), date_runs.end(), pos,
+        [](size_t a, const DateRun & b) {return a < b.pos;}
+        );
 
-    hist_virus_date.clear();
-    hist_virus_id.clear();
-    hist_virus_state.clear();
-    hist_virus_counts.clear();
+    return (r - 1)->date;
 
-    hist_tool_date.clear();
-    hist_tool_id.clear();
-    hist_tool_state.clear();
-    hist_tool_counts.clear();    
+}
 
-    today_virus.resize(get_n_viruses());
-    std::fill(today_virus.begin(), today_virus.begin(), std::vector<int>(model->nstates, 0));
+inline TransmissionLog::narrow_type TransmissionLog::narrow(
+    int x,
+    size_t pos,
+    std::vector< std::pair< size_t, int > > & wide
+)
+{
 
-    today_tool.resize(get_n_tools());
-    std::fill(today_tool.begin(), today_tool.begin(), std::vector<int>(model->nstates, 0));
+    if ((x >= 0) && (x < static_cast<int>(narrow_na)))
+        return static_cast<narrow_type>(x);
 
-    hist_total_date.clear();
-    hist_total_state.clear();
-    hist_total_nviruses_active.clear();
-    hist_total_counts.clear();
-    hist_transition_matrix.clear();
+    wide.push_back({pos, x});
 
-    transmission_date.clear();
-    transmission_virus.clear();
-    transmission_source.clear();
-    transmission_target.clear();
-    transmission_source_exposure_date.clear();
+    return narrow_na;
 
-    return;
+}
+
+inline int TransmissionLog::widen(
+    narrow_type x,
+    size_t pos,
+    const std::vector< std::pair< size_t, int > > & wide
+)
+{
+
+    if (x != narrow_na)
+        return static_cast<int>(x);
+
+    auto w = std::lower_bound(
+        wide.begin(), wide.end(), pos,
+        [](const std::pair< size_t, int > & a, size_t b) {return a.first < b;}
+        );
+
+    #ifdef EPI_DEBUG
+    if ((w == wide.end()) || (w->first != pos))
+        throw std::logic_error(
+            "[epi-debug] TransmissionLog::widen entry missing in the overflow list."
+            );
+    #endif
+
+    return w->second;
 
 }
 
-template<typename TSeq>
-inline DataBase<TSeq>::DataBase(const DataBase<TSeq> & db) :
-    virus_id(db.virus_id),
-    virus_name(db.virus_name),
-    virus_sequence(db.virus_sequence),
-    virus_origin_date(db.virus_origin_date),
-    virus_parent_id(db.virus_parent_id),
-    tool_id(db.tool_id),
-    tool_name(db.tool_name),
-    tool_sequence(db.tool_sequence),
-    tool_origin_date(db.tool_origin_date),
-    seq_hasher(db.seq_hasher),
-    seq_writer(db.seq_writer),
-    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
-    today_virus(db.today_virus),
-    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
-    today_tool(db.today_tool),
-    // {Susceptible, Infected, etc.}
-    today_total(db.today_total),
-    // Totals
-    today_total_nviruses_active(db.today_total_nviruses_active),
-    sampling_freq(db.sampling_freq),
-    // Variants history
-    hist_virus_date(db.hist_virus_date),
-    hist_virus_id(db.hist_virus_id),
-    hist_virus_state(db.hist_virus_state),
-    hist_virus_counts(db.hist_virus_counts),
-    // Tools history
-    hist_tool_date(db.hist_tool_date),
-    hist_tool_id(db.hist_tool_id),
-    hist_tool_state(db.hist_tool_state),
-    hist_tool_counts(db.hist_tool_counts),
-    // Overall hist
-    hist_total_date(db.hist_total_date),
-    hist_total_nviruses_active(db.hist_total_nviruses_active),
-    hist_total_state(db.hist_total_state),
-    hist_total_counts(db.hist_total_counts),
-    hist_transition_matrix(db.hist_transition_matrix),
-    // Transmission network
-    transmission_date(db.transmission_date),
-    transmission_source(db.transmission_source),
-    transmission_target(db.transmission_target),
-    transmission_virus(db.transmission_virus),
-    transmission_source_exposure_date(db.transmission_source_exposure_date),
-    transition_matrix(db.transition_matrix),
-    user_data(nullptr)
-{}
+inline void TransmissionLog::push_back(
+    int date,
+    int source,
+    int target,
+    int virus,
+    int source_exposure_date
+)
+{
 
-// DataBase<TSeq> & DataBase<TSeq>::operator=(const DataBase<TSeq> & m)
-// {
+    size_t pos = n % block_size;
 
-// }
+    if (pos == 0u)
+    {
 
-template<typename TSeq>
-inline Model<TSeq> * DataBase<TSeq>::get_model() {
-    return model;
-}
+        if ((n / block_size) >= blocks.size())
+            blocks.emplace_back();
+        
+        blocks[n / block_size].allocate();
+
+    }
+
+    Block & b = blocks[n / block_size];
+
+    if (b.date_runs.empty() || (b.date_runs.back().date != date))
+        b.date_runs.push_back({static_cast< std::uint32_t >(pos), date});
+
+    b.source.push_back(static_cast< std::int32_t >(source));
+    b.target.push_back(static_cast< std::int32_t >(target));
+    b.virus.push_back(narrow(virus, pos, b.virus_wide));
+    b.source_exposure_date.push_back(
+        narrow(date - source_exposure_date, pos, b.source_exposure_date_wide)
+        );
+
+    ++n;
+
+    return;
 
-template<typename TSeq>
-inline const std::vector< TSeq > & DataBase<TSeq>::get_sequence() const {
-    return virus_sequence;
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::record() 
+inline size_t TransmissionLog::size() const noexcept
 {
+    return n;
+}
 
-    ////////////////////////////////////////////////////////////////////////////
-    // DEBUGGING BLOCK
-    ////////////////////////////////////////////////////////////////////////////
-    EPI_DEBUG_SUM_INT(today_total, model->size())
-    EPI_DEBUG_ALL_NON_NEGATIVE(today_total)
+inline bool TransmissionLog::empty() const noexcept
+{
+    return n == 0u;
+}
 
-    #ifdef EPI_DEBUG
-    // Checking whether the sums correspond
-    std::vector< int > _today_total_cp(today_total.size(), 0);
-    for (auto & p : model->population)
-        _today_total_cp[p.get_state()]++;
-    
-    EPI_DEBUG_VECTOR_MATCH_INT(
-        _today_total_cp, today_total,
-        "Sums of __today_total_cp in database-meat.hpp"
-        )
+inline void TransmissionLog::clear()
+{
 
-    if (model->today() == 0)
+    // Blocks are kept (and reused) so the memory is not released
+    for (auto & b : blocks)
     {
-        if (hist_total_date.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_total_date should be of length 0.")
-        if (hist_total_nviruses_active.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_total_nviruses_active should be of length 0.")
-        if (hist_total_state.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_total_state should be of length 0.")
-        if (hist_total_counts.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_total_counts should be of length 0.")
-        if (hist_virus_date.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_virus_date should be of length 0.")
-        if (hist_virus_id.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_virus_id should be of length 0.")
-        if (hist_virus_state.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_virus_state should be of length 0.")
-        if (hist_virus_counts.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_virus_counts should be of length 0.")
-        if (hist_tool_date.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_tool_date should be of length 0.")
-        if (hist_tool_id.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_tool_id should be of length 0.")
-        if (hist_tool_state.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_tool_state should be of length 0.")
-        if (hist_tool_counts.size() != 0)
-            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_tool_counts should be of length 0.")
+        b.date_runs.clear();
+        b.source.clear();
+        b.target.clear();
+        b.virus.clear();
+        b.source_exposure_date.clear();
+        b.virus_wide.clear();
+        b.source_exposure_date_wide.clear();
     }
-    #endif
-    ////////////////////////////////////////////////////////////////////////////
-
-    // Only store every now and then
-    if ((model->today() % sampling_freq) == 0)
-    {
 
-        // Recording virus's history
-        for (auto & p : virus_id)
-        {
+    n = 0u;
 
-            for (epiworld_fast_uint s = 0u; s < model->nstates; ++s)
-            {
+}
 
-                hist_virus_date.push_back(model->today());
-                hist_virus_id.push_back(p.second);
-                hist_virus_state.push_back(s);
-                hist_virus_counts.push_back(today_virus[p.second][s]);
+inline void TransmissionLog::reserve(size_t n_events)
+{
 
-            }
+    size_t n_blocks = n_events / block_size + ((n_events % block_size) > 0u);
 
+    if (n_blocks > blocks.size())
+    {
+        blocks.reserve(n_blocks);
+        while (blocks.size() < n_blocks)
+        {
+            blocks.emplace_back();
+            blocks.back().allocate();
         }
+    }
 
-        // Recording tool's history
-        for (auto & p : tool_id)
-        {
+}
 
-            for (epiworld_fast_uint s = 0u; s < model->nstates; ++s)
-            {
+inline TransmissionEvent TransmissionLog::operator[](size_t i) const
+{
 
-                hist_tool_date.push_back(model->today());
-                hist_tool_id.push_back(p.second);
-                hist_tool_state.push_back(s);
-                hist_tool_counts.push_back(today_tool[p.second][s]);
+    const Block & b = blocks[i / block_size];
+    size_t pos = i % block_size;
 
-            }
+    int date = b.get_date(pos);
 
-        }
+    return TransmissionEvent{
+        date,
+        static_cast< int >(b.source[pos]),
+        static_cast< int >(b.target[pos]),
+        widen(b.virus[pos], pos, b.virus_wide),
+        date - widen(b.source_exposure_date[pos], pos, b.source_exposure_date_wide)
+    };
 
-        // Recording the overall history
-        for (epiworld_fast_uint s = 0u; s < model->nstates; ++s)
-        {
-            hist_total_date.push_back(model->today());
-            hist_total_nviruses_active.push_back(today_total_nviruses_active);
-            hist_total_state.push_back(s);
-            hist_total_counts.push_back(today_total[s]);
-        }
+}
 
-        for (auto cell : transition_matrix)
-            hist_transition_matrix.push_back(cell);
+inline TransmissionEvent TransmissionLog::at(size_t i) const
+{
 
-        // Now the diagonal must reflect the state
-        for (size_t s_i = 0u; s_i < model->nstates; ++s_i)
-        {
+    if (i >= n)
+        throw std::range_error(
+            "The transmission event " + std::to_string(i) +
+            " is out of range. The log only has " + std::to_string(n) +
+            " events."
+            );
 
-            for (size_t s_j = 0u; s_j < model->nstates; ++s_j)
-            {
-                
-                if ((s_i != s_j) && (transition_matrix[s_i + s_j * model->nstates] > 0))
-                {
-                    transition_matrix[s_j + s_j * model->nstates] +=
-                        transition_matrix[s_i + s_j * model->nstates];
+    return operator[](i);
 
-                    transition_matrix[s_i + s_j * model->nstates] = 0;
-                }
-         
-            }
+}
 
-        }
+inline int TransmissionLog::date(size_t i) const
+{
+    return blocks[i / block_size].get_date(i % block_size);
+}
 
-        #ifdef EPI_DEBUG
-        for (size_t s_i = 0u; s_i < model->nstates; ++s_i)
-        {
-            if (transition_matrix[s_i + s_i * model->nstates] != 
-                today_total[s_i])
-                throw std::logic_error(
-                    "The diagonal of the updated transition Matrix should match the daily totals"
-                    );
-        }
-        #endif
+inline int TransmissionLog::source(size_t i) const
+{
+    return static_cast< int >(blocks[i / block_size].source[i % block_size]);
+}
 
-    }
+inline int TransmissionLog::target(size_t i) const
+{
+    return static_cast< int >(blocks[i / block_size].target[i % block_size]);
+}
 
+inline int TransmissionLog::virus(size_t i) const
+{
+    const Block & b = blocks[i / block_size];
+    size_t pos = i % block_size;
+    return widen(b.virus[pos], pos, b.virus_wide);
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::record_virus(Virus<TSeq> & v)
+inline int TransmissionLog::source_exposure_date(size_t i) const
 {
+    const Block & b = blocks[i / block_size];
+    size_t pos = i % block_size;
+    return date(i) -
+        widen(b.source_exposure_date[pos], pos, b.source_exposure_date_wide);
+}
 
-    // If no sequence, then need to add one. This is regardless of the case
-    if (v.get_sequence() == nullptr)
-        v.set_sequence(default_sequence<TSeq>(
-            static_cast<int>(virus_name.size())
-            ));
+inline TransmissionLog::const_iterator TransmissionLog::begin() const
+{
+    return const_iterator(this, 0u);
+}
 
-    // Negative id -> virus hasn't been recorded
-    if (v.get_id() < 0)
-    {
+inline TransmissionLog::const_iterator TransmissionLog::end() const
+{
+    return const_iterator(this, n);
+}
 
+inline bool TransmissionLog::operator==(const TransmissionLog & other) const
+{
 
-        // Generating the hash
-        std::vector< int > hash = seq_hasher(*v.get_sequence());
+    if (n != other.n)
+        return false;
 
-        epiworld_fast_uint new_id = virus_id.size();
-        virus_id[hash] = new_id;
-        virus_name.push_back(v.get_name());
-        virus_sequence.push_back(*v.get_sequence());
-        virus_origin_date.push_back(model->today());
-        
-        virus_parent_id.push_back(v.get_id()); // Must be -99
-        
-        today_virus.push_back({});
-        today_virus[new_id].resize(model->nstates, 0);
-       
-        // Updating the variant
-        v.set_id(new_id);
-        v.set_date(model->today());
+    for (size_t i = 0u; i < n; ++i)
+    {
 
-        today_total_nviruses_active++;
+        TransmissionEvent a = operator[](i);
+        TransmissionEvent b = other[i];
 
-    } else { // In this case, the virus is already on record, need to make sure
-             // The new sequence is new.
+        if (
+            (a.date != b.date) || (a.source != b.source) ||
+            (a.target != b.target) || (a.virus != b.virus) ||
+            (a.source_exposure_date != b.source_exposure_date)
+            )
+            return false;
 
-        // Updating registry
-        std::vector< int > hash = seq_hasher(*v.get_sequence());
-        epiworld_fast_uint old_id = v.get_id();
-        epiworld_fast_uint new_id;
+    }
 
-        // If the sequence is new, then it means that the
-        if (virus_id.find(hash) == virus_id.end())
-        {
+    return true;
 
-            new_id = virus_id.size();
-            virus_id[hash] = new_id;
-            virus_name.push_back(v.get_name());
-            virus_sequence.push_back(*v.get_sequence());
-            virus_origin_date.push_back(model->today());
-            
-            virus_parent_id.push_back(old_id);
-            
-            today_virus.push_back({});
-            today_virus[new_id].resize(model->nstates, 0);
-        
-            // Updating the variant
-            v.set_id(new_id);
-            v.set_date(model->today());
+}
 
-            today_total_nviruses_active++;
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 
-        } else {
+ End of -include/epiworld/transmissionlog-meat.hpp-
 
-            // Finding the id
-            new_id = virus_id[hash];
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
 
-            // Reflecting the change
-            v.set_id(new_id);
-            v.set_date(virus_origin_date[new_id]);
 
-        }
 
-        // Moving statistics (only if we are affecting an individual)
-        if (v.get_agent() != nullptr)
-        {
-            // Correcting math
-            epiworld_fast_uint tmp_state = v.get_agent()->get_state();
-            today_virus[old_id][tmp_state]--;
-            today_virus[new_id][tmp_state]++;
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 
-        }
+ Start of -include/epiworld/database-spill-bones.hpp-
 
-    }
-    
-    return;
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
 
-} 
 
-template<typename TSeq>
-inline void DataBase<TSeq>::record_tool(Tool<TSeq> & t)
-{
+#ifndef EPIWORLD_DATABASE_SPILL_BONES_HPP
+#define EPIWORLD_DATABASE_SPILL_BONES_HPP
 
-    if (t.get_sequence() == nullptr)
-        t.set_sequence(default_sequence<TSeq>(
-            static_cast<int>(tool_name.size())
-        ));
+/**
+ * @brief On-disk storage for (date, id, state, counts) history rows
+ * 
+ * @details Used by `DataBase` to move the virus and tool histories out of
+ * memory once they go past the memory budget (see
+ * `DataBase::set_hist_memory_budget()`.) Rows are written to a temporary
+ * binary file (created with `std::tmpfile()`, so it is removed automatically
+ * when closed) and read back by streaming, one chunk of rows at a time.
+ * 
+ * Reads (`for_each()`, `read()`, `read_rows()`) hold a lock while seeking
+ * and reading the file, so several threads can read the same spill at once.
+ * As with the rest of `DataBase`, appending while others read is not safe.
+ */
+class HistSpill {
+public:
 
-    if (t.get_id() < 0) 
-    {
+    static constexpr size_t row_size   = 4u;    ///< Number of int32 per row
+    static constexpr size_t chunk_size = 4096u; ///< Rows per read
 
-        std::vector< int > hash = seq_hasher(*t.get_sequence());
-        epiworld_fast_uint new_id = tool_id.size();
-        tool_id[hash] = new_id;
-        tool_name.push_back(t.get_name());
-        tool_sequence.push_back(*t.get_sequence());
-        tool_origin_date.push_back(model->today());
-                
-        today_tool.push_back({});
-        today_tool[new_id].resize(model->nstates, 0);
+private:
 
-        // Updating the tool
-        t.set_id(new_id);
-        t.set_date(model->today());
+    std::FILE * file = nullptr;
+    size_t n         = 0u;  ///< Number of rows in the file
+    int last_date    = -1;  ///< Date of the last row in the file
 
-    } else {
+    /**
+     * @name Index of the days in the file
+     * @details Rows are appended in date order, so the rows of `day_date[k]`
+     * start at row `day_start[k]`.
+     */
+    ///@{
+    std::vector< int > day_date;
+    std::vector< size_t > day_start;
+    ///@}
 
-        // Updating registry
-        std::vector< int > hash = seq_hasher(*t.get_sequence());
-        epiworld_fast_uint old_id = t.get_id();
-        epiworld_fast_uint new_id;
-        
-        if (tool_id.find(hash) == tool_id.end())
-        {
+    mutable std::mutex file_mutex; ///< Guards the position of `file`
 
-            new_id = tool_id.size();
-            tool_id[hash] = new_id;
-            tool_name.push_back(t.get_name());
-            tool_sequence.push_back(*t.get_sequence());
-            tool_origin_date.push_back(model->today());
-                    
-            today_tool.push_back({});
-            today_tool[new_id].resize(model->nstates, 0);
+    void open();
 
-            // Updating the tool
-            t.set_id(new_id);
-            t.set_date(model->today());
+    /**
+     * @brief Moves the position of `file` (64-bit offsets)
+     * @details `std::fseek()` takes a `long`, which is 32 bits on some
+     * platforms (e.g., Windows), so spills past 2 GiB use `_fseeki64()` or
+     * `fseeko()` instead.
+     * @return `true` on success.
+     */
+    bool seek(std::uint64_t offset, int origin) const;
 
-        } else {
+public:
 
-            // Finding the id
-            new_id = tool_id[hash];
+    HistSpill() {};
+    HistSpill(const HistSpill & other);
+    HistSpill & operator=(const HistSpill & other);
+    ~HistSpill();
 
-            // Reflecting the change
-            t.set_id(new_id);
-            t.set_date(tool_origin_date[new_id]);
+    /**
+     * @brief Appends rows to the file
+     */
+    void append(
+        const std::vector< int > & date,
+        const std::vector< int > & id,
+        const std::vector< epiworld_fast_uint > & state,
+        const std::vector< int > & counts
+    );
 
-        }
+    /**
+     * @brief Streams the rows in the file (in the order they were written)
+     * 
+     * @param fun Function called for each row as `fun(date, id, state, counts)`.
+     */
+    template<typename TFun>
+    void for_each(TFun fun) const;
 
-        // Moving statistics (only if we are affecting an individual)
-        if (t.get_agent() != nullptr)
-        {
-            // Correcting math
-            epiworld_fast_uint tmp_state = t.get_agent()->get_state();
-            today_tool[old_id][tmp_state]--;
-            today_tool[new_id][tmp_state]++;
+    /**
+     * @brief Reads `nrows` rows starting at row `from`
+     * 
+     * @param buffer Where to write the rows, `row_size` int32 per row
+     * (date, id, state, counts).
+     */
+    void read_rows(size_t from, size_t nrows, std::int32_t * buffer) const;
 
-        }
+    /**
+     * @brief Finds the rows that fall within `[day_from, day_to]`
+     * 
+     * @param day_from,day_to Range of days (inclusive). If `day_to` is
+     * negative, the range has no upper bound.
+     * @param from,to Where to store the resulting range of rows `[from, to)`.
+     */
+    void get_range(int day_from, int day_to, size_t * from, size_t * to) const;
 
-    }
+    /**
+     * @brief Appends the rows in the file to the vectors
+     */
+    void read(
+        std::vector< int > & date,
+        std::vector< int > & id,
+        std::vector< epiworld_fast_uint > & state,
+        std::vector< int > & counts
+    ) const;
 
-    
-    
-    return;
-} 
+    size_t size() const noexcept;
+    int get_last_date() const noexcept;
+    void clear();
 
-template<typename TSeq>
-inline size_t DataBase<TSeq>::size() const
-{
-    return virus_id.size();
-}
+    bool operator==(const HistSpill & other) const;
+    bool operator!=(const HistSpill & other) const {return !operator==(other);};
 
-template<typename TSeq>
-inline void DataBase<TSeq>::update_state(
-        epiworld_fast_uint prev_state,
-        epiworld_fast_uint new_state,
-        bool undo
-) {
+};
 
-    if (undo)
-    {
+inline HistSpill::HistSpill(const HistSpill & other)
+{
+    operator=(other);
+}
 
-        today_total[prev_state]++;
-        today_total[new_state]--;
-        
-    } else {
+inline HistSpill & HistSpill::operator=(const HistSpill & other)
+{
 
-        today_total[prev_state]--;
-        today_total[new_state]++;
+    if (this == &other)
+        return *this;
 
-    }
+    clear();
 
-    record_transition(prev_state, new_state, undo);
-    
-    return;
-}
+    if (other.n == 0u)
+        return *this;
 
-template<typename TSeq>
-inline void DataBase<TSeq>::update_virus(
-        epiworld_fast_uint virus_id,
-        epiworld_fast_uint prev_state,
-        epiworld_fast_uint new_state
-) {
+    std::vector< int > date, id, counts;
+    std::vector< epiworld_fast_uint > state;
+    other.read(date, id, state, counts);
+    append(date, id, state, counts);
 
-    today_virus[virus_id][prev_state]--;
-    today_virus[virus_id][new_state]++;
+    return *this;
 
-    return;
-    
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::update_tool(
-        epiworld_fast_uint tool_id,
-        epiworld_fast_uint prev_state,
-        epiworld_fast_uint new_state
-) {
+inline HistSpill::~HistSpill()
+{
+    if (file != nullptr)
+        std::fclose(file);
+}
 
+inline void HistSpill::open()
+{
 
-    today_tool[tool_id][prev_state]--;    
-    today_tool[tool_id][new_state]++;
+    file = std::tmpfile();
 
-    return;
+    if (file == nullptr)
+        throw std::runtime_error(
+            "Could not create a temporary file for spilling the history."
+            );
 
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::record_transition(
-    epiworld_fast_uint from,
-    epiworld_fast_uint to,
-    bool undo
-) {
-
-    if (undo)
-    {   
-
-        transition_matrix[to * model->nstates + from]--;
-        transition_matrix[from * model->nstates + from]++;
+inline bool HistSpill::seek(std::uint64_t offset, int origin) const
+{
 
-    } else {
+    #if defined(_WIN32)
+    if (offset > static_cast< std::uint64_t >(LLONG_MAX))
+        return false;
 
-        transition_matrix[to * model->nstates + from]++;
-        transition_matrix[from * model->nstates + from]--;
+    return _fseeki64(file, static_cast< __int64 >(offset), origin) == 0;
+    #elif defined(EPIWORLD_HAS_MMAP)
+    if (offset > static_cast< std::uint64_t >(std::numeric_limits< off_t >::max()))
+        return false;
 
-    }
+    return fseeko(file, static_cast< off_t >(offset), origin) == 0;
+    #else
+    if (offset > static_cast< std::uint64_t >(LONG_MAX))
+        return false;
 
-    #ifdef EPI_DEBUG
-    if (transition_matrix[from * model->nstates + from] < 0)
-        throw std::logic_error("An entry in transition matrix is negative.");
+    return std::fseek(file, static_cast< long >(offset), origin) == 0;
     #endif
 
 }
 
-template<typename TSeq>
-inline int DataBase<TSeq>::get_today_total(
-    std::string what
-) const
+inline void HistSpill::append(
+    const std::vector< int > & date,
+    const std::vector< int > & id,
+    const std::vector< epiworld_fast_uint > & state,
+    const std::vector< int > & counts
+)
 {
 
-    for (auto i = 0u; i < model->states_labels.size(); ++i)
-    {
-        if (model->states_labels[i] == what)
-            return today_total[i];
-    }
+    size_t nrows = date.size();
+    if (nrows == 0u)
+        return;
 
-    throw std::range_error("The value '" + what + "' is not in the model.");
+    if (file == nullptr)
+        open();
 
-}
+    for (size_t i = 0u; i < nrows; ++i)
+        if (day_date.empty() || (day_date.back() != date[i]))
+        {
+            day_date.push_back(date[i]);
+            day_start.push_back(n + i);
+        }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::get_today_total(
-    std::vector< std::string > * state,
-    std::vector< int > * counts
-) const
-{
-    if (state != nullptr)
-        (*state) = model->states_labels;
+    std::lock_guard< std::mutex > lock(file_mutex);
 
-    if (counts != nullptr)
-        *counts = today_total;
+    // Reads may have moved the position
+    if (!seek(0u, SEEK_END))
+        throw std::runtime_error(
+            "Could not seek the end of the temporary history file."
+            );
 
-}
+    std::vector< std::int32_t > buffer;
+    buffer.reserve(std::min(nrows, chunk_size) * row_size);
 
-template<typename TSeq>
-inline void DataBase<TSeq>::get_today_virus(
-    std::vector< std::string > & state,
-    std::vector< int > & id,
-    std::vector< int > & counts
-    ) const
-{
-      
-    state.resize(today_virus.size(), "");
-    id.resize(today_virus.size(), 0);
-    counts.resize(today_virus.size(),0);
+    for (size_t i = 0u; i < nrows; ++i)
+    {
 
-    int n = 0u;
-    for (epiworld_fast_uint v = 0u; v < today_virus.size(); ++v)
-        for (epiworld_fast_uint s = 0u; s < model->states_labels.size(); ++s)
-        {
-            state[n]   = model->states_labels[s];
-            id[n]       = static_cast<int>(v);
-            counts[n++] = today_virus[v][s];
+        buffer.push_back(static_cast< std::int32_t >(date[i]));
+        buffer.push_back(static_cast< std::int32_t >(id[i]));
+        buffer.push_back(static_cast< std::int32_t >(state[i]));
+        buffer.push_back(static_cast< std::int32_t >(counts[i]));
 
-        }
+        if ((buffer.size() == (chunk_size * row_size)) || ((i + 1u) == nrows))
+        {
 
-}
+            if (
+                std::fwrite(
+                    buffer.data(), sizeof(std::int32_t), buffer.size(), file
+                    ) != buffer.size()
+                )
+                throw std::runtime_error(
+                    "Could not write the history to the temporary file."
+                    );
 
-template<typename TSeq>
-inline void DataBase<TSeq>::get_hist_total(
-    std::vector< int > * date,
-    std::vector< std::string > * state,
-    std::vector< int > * counts
-) const
-{
+            buffer.clear();
 
-    if (date != nullptr)
-        *date = hist_total_date;
+        }
 
-    if (state != nullptr)
-    {
-        state->resize(hist_total_state.size(), "");
-        for (epiworld_fast_uint i = 0u; i < hist_total_state.size(); ++i)
-            state->operator[](i) = model->states_labels[hist_total_state[i]];
     }
 
-    if (counts != nullptr)
-        *counts = hist_total_counts;
+    n += nrows;
+    last_date = date[nrows - 1u];
 
     return;
 
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::get_hist_virus(
-    std::vector< int > & date,
-    std::vector< int > & id,
-    std::vector< std::string > & state,
-    std::vector< int > & counts
-) const {
+template<typename TFun>
+inline void HistSpill::for_each(TFun fun) const
+{
 
-    date = hist_virus_date;
-    std::vector< std::string > labels;
-    labels = model->states_labels;
-    
-    id = hist_virus_id;
-    state.resize(hist_virus_state.size(), "");
-    for (epiworld_fast_uint i = 0u; i < hist_virus_state.size(); ++i)
-        state[i] = labels[hist_virus_state[i]];
+    if (n == 0u)
+        return;
+
+    std::vector< std::int32_t > buffer(chunk_size * row_size);
+
+    size_t nleft = n;
+    while (nleft > 0u)
+    {
+
+        size_t nrows = std::min(nleft, chunk_size);
+        read_rows(n - nleft, nrows, buffer.data());
 
-    counts = hist_virus_counts;
+        for (size_t i = 0u; i < nrows; ++i)
+            fun(
+                static_cast< int >(buffer[i * row_size]),
+                static_cast< int >(buffer[i * row_size + 1u]),
+                static_cast< epiworld_fast_uint >(buffer[i * row_size + 2u]),
+                static_cast< int >(buffer[i * row_size + 3u])
+            );
+
+        nleft -= nrows;
+
+    }
 
     return;
 
 }
 
+inline void HistSpill::read_rows(
+    size_t from,
+    size_t nrows,
+    std::int32_t * buffer
+) const
+{
 
-template<typename TSeq>
-inline void DataBase<TSeq>::get_hist_tool(
-    std::vector< int > & date,
-    std::vector< int > & id,
-    std::vector< std::string > & state,
-    std::vector< int > & counts
-) const {
+    if ((from + nrows) > n)
+        throw std::range_error(
+            "The rows [" + std::to_string(from) + ", " +
+            std::to_string(from + nrows) + ") are out of range. There are " +
+            "only " + std::to_string(n) + " rows in the file."
+            );
 
-    date = hist_tool_date;
-    std::vector< std::string > labels;
-    labels = model->states_labels;
-    
-    id = hist_tool_id;
-    state.resize(hist_tool_state.size(), "");
-    for (size_t i = 0u; i < hist_tool_state.size(); ++i)
-        state[i] = labels[hist_tool_state[i]];
+    if (nrows == 0u)
+        return;
+
+    std::lock_guard< std::mutex > lock(file_mutex);
+
+    std::fflush(file);
+    std::uint64_t offset =
+        static_cast< std::uint64_t >(from) * row_size * sizeof(std::int32_t);
+
+    if (!seek(offset, SEEK_SET))
+        throw std::runtime_error(
+            "Could not seek row " + std::to_string(from) +
+            " of the temporary history file."
+            );
 
-    counts = hist_tool_counts;
+    if (
+        std::fread(buffer, sizeof(std::int32_t), nrows * row_size, file) !=
+        (nrows * row_size)
+        )
+        throw std::runtime_error(
+            "Could not read the history from the temporary file."
+            );
 
     return;
 
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::get_hist_transition_matrix(
-    std::vector< std::string > & state_from,
-    std::vector< std::string > & state_to,
-    std::vector< int > & date,
-    std::vector< int > & counts,
-    bool skip_zeros
+inline void HistSpill::get_range(
+    int day_from,
+    int day_to,
+    size_t * from,
+    size_t * to
 ) const
 {
 
-    size_t n = this->hist_transition_matrix.size();
-    
-    // Clearing the previous vectors
-    state_from.clear();
-    state_to.clear();
-    date.clear();
-    counts.clear();
+    size_t k_from = static_cast< size_t >(
+        std::lower_bound(day_date.begin(), day_date.end(), day_from) -
+        day_date.begin()
+        );
 
-    // Reserving space
-    state_from.reserve(n);
-    state_to.reserve(n);
-    date.reserve(n);
-    counts.reserve(n);
+    size_t k_to = day_date.size();
+    if (day_to >= 0)
+        k_to = static_cast< size_t >(
+            std::upper_bound(day_date.begin(), day_date.end(), day_to) -
+            day_date.begin()
+            );
 
-    size_t n_states = model->nstates;
-    size_t n_steps  = model->get_ndays();
+    if (k_to < k_from)
+        k_to = k_from;
 
-    // If n is zero, then we are done
-    if (n == 0u)
-        return;
+    *from = (k_from < day_date.size()) ? day_start[k_from] : n;
+    *to   = (k_to < day_date.size()) ? day_start[k_to] : n;
 
-    for (size_t step = 0u; step <= n_steps; ++step) // The final step counts
-    {
-        for (size_t j = 0u; j < n_states; ++j) // Column major storage
-        {
-            for (size_t i = 0u; i < n_states; ++i)
-            {
-                // Retrieving the value of the day
-                int v = hist_transition_matrix[
-                    step * n_states * n_states + // Day of the data
-                    j * n_states +               // Column (to)
-                    i                            // Row (from)
-                    ];
+    return;
 
-                // If we are skipping the zeros and it is zero, then don't save
-                if (skip_zeros && v == 0)
-                    continue;
-                                
-                state_from.push_back(model->states_labels[i]);
-                state_to.push_back(model->states_labels[j]);
-                date.push_back(hist_total_date[step * n_states]);
-                counts.push_back(v);
+}
 
-            }
+inline void HistSpill::read(
+    std::vector< int > & date,
+    std::vector< int > & id,
+    std::vector< epiworld_fast_uint > & state,
+    std::vector< int > & counts
+) const
+{
 
-        }
-    }
+    date.reserve(date.size() + n);
+    id.reserve(id.size() + n);
+    state.reserve(state.size() + n);
+    counts.reserve(counts.size() + n);
+
+    for_each([&](int d, int i, epiworld_fast_uint s, int c) -> void {
+        date.push_back(d);
+        id.push_back(i);
+        state.push_back(s);
+        counts.push_back(c);
+    });
 
     return;
 
+}
 
+inline size_t HistSpill::size() const noexcept
+{
+    return n;
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::get_transmissions(
-    std::vector<int> & date,
-    std::vector<int> & source,
-    std::vector<int> & target,
-    std::vector<int> & virus,
-    std::vector<int> & source_exposure_date
-) const 
+inline int HistSpill::get_last_date() const noexcept
 {
+    return last_date;
+}
 
-    size_t nevents = transmission_date.size();
+inline void HistSpill::clear()
+{
 
-    date.resize(nevents);
-    source.resize(nevents);
-    target.resize(nevents);
-    virus.resize(nevents);
-    source_exposure_date.resize(nevents);
+    // Closing the file removes it
+    if (file != nullptr)
+    {
+        std::fclose(file);
+        file = nullptr;
+    }
 
-    get_transmissions(
-        &date[0u],
-        &source[0u],
-        &target[0u],
-        &virus[0u],
-        &source_exposure_date[0u]
-    );
+    n         = 0u;
+    last_date = -1;
+    day_date.clear();
+    day_start.clear();
 
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::get_transmissions(
-    int * date,
-    int * source,
-    int * target,
-    int * virus,
-    int * source_exposure_date
-) const 
+inline bool HistSpill::operator==(const HistSpill & other) const
 {
 
-    size_t nevents = transmission_date.size();
+    if (n != other.n)
+        return false;
 
-    for (size_t i = 0u; i < nevents; ++i)
-    {
+    if (n == 0u)
+        return true;
 
-        *(date + i) = transmission_date.at(i);
-        *(source + i) = transmission_source.at(i);
-        *(target + i) = transmission_target.at(i);
-        *(virus + i) = transmission_virus.at(i);
-        *(source_exposure_date + i) = transmission_source_exposure_date.at(i);
+    std::vector< int > date_a, id_a, counts_a, date_b, id_b, counts_b;
+    std::vector< epiworld_fast_uint > state_a, state_b;
+    read(date_a, id_a, state_a, counts_a);
+    other.read(date_b, id_b, state_b, counts_b);
 
-    }
+    return (date_a == date_b) && (id_a == id_b) &&
+        (state_a == state_b) && (counts_a == counts_b);
 
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::write_data(
-    std::string fn_virus_info,
-    std::string fn_virus_hist,
-    std::string fn_tool_info,
-    std::string fn_tool_hist,
-    std::string fn_total_hist,
-    std::string fn_transmission,
-    std::string fn_transition,
-    std::string fn_reproductive_number,
-    std::string fn_generation_time
-) const
-{
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 
-    if (fn_virus_info != "")
-    {
-        std::ofstream file_virus_info(fn_virus_info, std::ios_base::out);
+ End of -include/epiworld/database-spill-bones.hpp-
 
-        // Check if the file exists and throw an error if it doesn't
-        if (!file_virus_info)
-        {
-            throw std::runtime_error(
-                "Could not open file \"" + fn_virus_info +
-                "\" for writing.")
-                ;
-        }
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
 
 
-        file_virus_info <<
-        #ifdef EPI_DEBUG
-            "thread" << "virus_id " << "virus " << "virus_sequence " << "date_recorded " << "parent\n";
-        #else
-            "virus_id " << "virus " << "virus_sequence " << "date_recorded " << "parent\n";
-        #endif
 
-        for (const auto & v : virus_id)
-        {
-            int id = v.second;
-            file_virus_info <<
-                #ifdef EPI_DEBUG
-                EPI_GET_THREAD_ID() << " " <<
-                #endif
-                id << " \"" <<
-                virus_name[id] << "\" " <<
-                seq_writer(virus_sequence[id]) << " " <<
-                virus_origin_date[id] << " " <<
-                virus_parent_id[id] << "\n";
-        }
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 
-    }
+ Start of -include/epiworld/database-views-bones.hpp-
 
-    if (fn_virus_hist != "")
-    {
-        std::ofstream file_virus(fn_virus_hist, std::ios_base::out);
-        
-        // Repeat the same error if the file doesn't exists
-        if (!file_virus)
-        {
-            throw std::runtime_error(
-                "Could not open file \"" + fn_virus_hist +
-                "\" for writing.")
-                ;
-        }
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
 
-        file_virus <<
-            #ifdef EPI_DEBUG
-            "thread "<< "date " << "id " << "state " << "n\n";
-            #else
-            "date " << "virus_id virus" << "state " << "n\n";
-            #endif
 
-        for (epiworld_fast_uint i = 0; i < hist_virus_id.size(); ++i)
-            file_virus <<
-                #ifdef EPI_DEBUG
-                EPI_GET_THREAD_ID() << " " <<
-                #endif
-                hist_virus_date[i] << " " <<
-                hist_virus_id[i] << " \"" <<
-                virus_name[hist_virus_id[i]] << "\" " <<
-                model->states_labels[hist_virus_state[i]] << " " <<
-                hist_virus_counts[i] << "\n";
-    }
+#ifndef EPIWORLD_DATABASE_VIEWS_BONES_HPP
+#define EPIWORLD_DATABASE_VIEWS_BONES_HPP
 
-    if (fn_tool_info != "")
-    {
-        std::ofstream file_tool_info(fn_tool_info, std::ios_base::out);
+/**
+ * @brief Read-only view of (possibly strided) data owned by someone else
+ * 
+ * @details A `DataView` does not copy the data, so it is only valid as long
+ * as the underlying buffer is not modified (e.g., until the model is run or
+ * reset again). The i-th element is `data()[i * get_stride()]`.
+ * 
+ * @tparam T Type of the elements.
+ */
+template<typename T>
+class DataView {
+private:
 
-        // Repeat the same error if the file doesn't exists
-        if (!file_tool_info)
-        {
-            throw std::runtime_error(
-                "Could not open file \"" + fn_tool_info +
-                "\" for writing.")
-                ;
-        }
+    const T * dat = nullptr;
+    size_t n      = 0u;
+    size_t stride = 1u;
 
-        file_tool_info <<
-            #ifdef EPI_DEBUG
-            "thread " << 
-            #endif
-            "id " << "tool_name " << "tool_sequence " << "date_recorded\n";
+public:
 
-        for (const auto & t : tool_id)
-        {
-            int id = t.second;
-            file_tool_info <<
-                #ifdef EPI_DEBUG
-                EPI_GET_THREAD_ID() << " " <<
-                #endif
-                id << " \"" <<
-                tool_name[id] << "\" " <<
-                seq_writer(tool_sequence[id]) << " " <<
-                tool_origin_date[id] << "\n";
-        }
+    class const_iterator {
+        friend class DataView<T>;
+    private:
+        const T * dat = nullptr;
+        size_t i      = 0u;
+        size_t stride = 1u;
+        const_iterator(const T * dat_, size_t i_, size_t stride_) :
+            dat(dat_), i(i_), stride(stride_) {};
+    public:
+
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T * pointer;
+        typedef const T & reference;
+
+        const_iterator() {};
+
+        const T & operator*() const {return dat[i * stride];};
+        const T & operator[](difference_type k) const {return dat[(i + k) * stride];};
+
+        const_iterator & operator++() {++i; return *this;};
+        const_iterator operator++(int) {const_iterator tmp(*this); ++i; return tmp;};
+        const_iterator & operator--() {--i; return *this;};
+        const_iterator operator--(int) {const_iterator tmp(*this); --i; return tmp;};
+
+        const_iterator & operator+=(difference_type k) {i += k; return *this;};
+        const_iterator & operator-=(difference_type k) {i -= k; return *this;};
+        const_iterator operator+(difference_type k) const {return const_iterator(dat, i + k, stride);};
+        const_iterator operator-(difference_type k) const {return const_iterator(dat, i - k, stride);};
+        difference_type operator-(const const_iterator & other) const {
+            return static_cast<difference_type>(i) - static_cast<difference_type>(other.i);
+        };
 
-    }
+        bool operator==(const const_iterator & other) const {return i == other.i;};
+        bool operator!=(const const_iterator & other) const {return i != other.i;};
+        bool operator<(const const_iterator & other) const {return i < other.i;};
+        bool operator>(const const_iterator & other) const {return i > other.i;};
+        bool operator<=(const const_iterator & other) const {return i <= other.i;};
+        bool operator>=(const const_iterator & other) const {return i >= other.i;};
 
-    if (fn_tool_hist != "")
-    {
-        std::ofstream file_tool_hist(fn_tool_hist, std::ios_base::out);
+    };
 
-        // Repeat the same error if the file doesn't exists
-        if (!file_tool_hist)
-        {
-            throw std::runtime_error(
-                "Could not open file \"" + fn_tool_hist +
-                "\" for writing.")
-                ;
-        }
-        
-        file_tool_hist <<
-            #ifdef EPI_DEBUG
-            "thread " << 
-            #endif
-            "date " << "id " << "state " << "n\n";
+    DataView() {};
+    DataView(const T * dat_, size_t n_, size_t stride_ = 1u) :
+        dat(dat_), n(n_), stride(stride_) {};
+    DataView(const std::vector< T > & v) : dat(v.data()), n(v.size()) {};
 
-        for (epiworld_fast_uint i = 0; i < hist_tool_id.size(); ++i)
-            file_tool_hist <<
-                #ifdef EPI_DEBUG
-                EPI_GET_THREAD_ID() << " " <<
-                #endif
-                hist_tool_date[i] << " " <<
-                hist_tool_id[i] << " " <<
-                model->states_labels[hist_tool_state[i]] << " " <<
-                hist_tool_counts[i] << "\n";
-    }
+    size_t size() const noexcept {return n;};
+    bool empty() const noexcept {return n == 0u;};
+    size_t get_stride() const noexcept {return stride;};
+    const T * data() const noexcept {return dat;};
 
-    if (fn_total_hist != "")
-    {
-        std::ofstream file_total(fn_total_hist, std::ios_base::out);
+    /**
+     * @brief Access the i-th element
+     * @details `operator[]` does no boundary check, whereas `at()` does.
+     */
+    ///@{
+    const T & operator[](size_t i) const {return dat[i * stride];};
+    const T & at(size_t i) const;
+    ///@}
 
-        // Repeat the same error if the file doesn't exists
-        if (!file_total)
-        {
-            throw std::runtime_error(
-                "Could not open file \"" + fn_total_hist +
-                "\" for writing.")
-                ;
-        }
+    const_iterator begin() const {return const_iterator(dat, 0u, stride);};
+    const_iterator end() const {return const_iterator(dat, n, stride);};
 
-        file_total <<
-            #ifdef EPI_DEBUG
-            "thread " << 
-            #endif
-            "date " << "nviruses " << "state " << "counts\n";
+    /**
+     * @brief View of the elements in `[from, to)`
+     */
+    DataView<T> subview(size_t from, size_t to) const;
 
-        for (epiworld_fast_uint i = 0; i < hist_total_date.size(); ++i)
-            file_total <<
-                #ifdef EPI_DEBUG
-                EPI_GET_THREAD_ID() << " " <<
-                #endif
-                hist_total_date[i] << " " <<
-                hist_total_nviruses_active[i] << " \"" <<
-                model->states_labels[hist_total_state[i]] << "\" " << 
-                hist_total_counts[i] << "\n";
-    }
+    /**
+     * @brief Copies the data into a vector
+     */
+    std::vector< T > to_vector() const;
 
-    if (fn_transmission != "")
-    {
-        std::ofstream file_transmission(fn_transmission, std::ios_base::out);
+};
 
-        // Repeat the same error if the file doesn't exists
-        if (!file_transmission)
-        {
-            throw std::runtime_error(
-                "Could not open file \"" + fn_transmission +
-                "\" for writing.")
-                ;
-        }
+template<typename T>
+inline const T & DataView<T>::at(size_t i) const
+{
 
-        file_transmission <<
-            #ifdef EPI_DEBUG
-            "thread " << 
-            #endif
-            "date " << "virus_id virus " << "source_exposure_date " << "source " << "target\n";
+    if (i >= n)
+        throw std::range_error(
+            "The element " + std::to_string(i) + " is out of range. The view " +
+            "only has " + std::to_string(n) + " elements."
+            );
 
-        for (epiworld_fast_uint i = 0; i < transmission_target.size(); ++i)
-            file_transmission <<
-                #ifdef EPI_DEBUG
-                EPI_GET_THREAD_ID() << " " <<
-                #endif
-                transmission_date[i] << " " <<
-                transmission_virus[i] << " \"" <<
-                virus_name[transmission_virus[i]] << "\" " <<
-                transmission_source_exposure_date[i] << " " <<
-                transmission_source[i] << " " <<
-                transmission_target[i] << "\n";
-                
-    }
+    return dat[i * stride];
 
-    if (fn_transition != "")
-    {
-        std::ofstream file_transition(fn_transition, std::ios_base::out);
+}
 
-        // Repeat the same error if the file doesn't exists
-        if (!file_transition)
-        {
-            throw std::runtime_error(
-                "Could not open file \"" + fn_transition +
-                "\" for writing.")
-                ;
-        }
+template<typename T>
+inline DataView<T> DataView<T>::subview(size_t from, size_t to) const
+{
 
-        file_transition <<
-            #ifdef EPI_DEBUG
-            "thread " << 
-            #endif
-            "date " << "from " << "to " << "counts\n";
+    if ((from > to) || (to > n))
+        throw std::range_error(
+            "The range [" + std::to_string(from) + ", " + std::to_string(to) +
+            ") is out of range. The view only has " + std::to_string(n) +
+            " elements."
+            );
 
-        int ns = model->nstates;
+    return DataView<T>(dat + from * stride, to - from, stride);
 
-        for (int i = 0; i <= model->today(); ++i)
-        {
+}
 
-            for (int from = 0u; from < ns; ++from)
-                for (int to = 0u; to < ns; ++to)
-                    file_transition <<
-                        #ifdef EPI_DEBUG
-                        EPI_GET_THREAD_ID() << " " <<
-                        #endif
-                        i << " " <<
-                        model->states_labels[from] << " " <<
-                        model->states_labels[to] << " " <<
-                        hist_transition_matrix[i * (ns * ns) + to * ns + from] << "\n";
-                
-        }
-                
-    }
+template<typename T>
+inline std::vector< T > DataView<T>::to_vector() const
+{
+    return std::vector< T >(begin(), end());
+}
 
-    if (fn_reproductive_number != "")
-        reproductive_number(fn_reproductive_number);
+/**
+ * @brief Finds the elements of a sorted (non-decreasing) view of dates
+ * that fall within `[day_from, day_to]`
+ * 
+ * @param date View of dates.
+ * @param day_from,day_to Range of days (inclusive). If `day_to` is negative,
+ * the range has no upper bound.
+ * @param from,to Where to store the resulting range `[from, to)`.
+ */
+inline void view_date_range(
+    const DataView< int > & date,
+    int day_from,
+    int day_to,
+    size_t * from,
+    size_t * to
+)
+{
 
-    if (fn_generation_time != "")
-        generation_time(fn_generation_time);
+    *from = static_cast< size_t >(
+        std::lower_bound(date.begin(), date.end(), day_from) - date.begin()
+        );
 
-}
+    if (day_to < 0)
+        *to = date.size();
+    else
+        *to = static_cast< size_t >(
+            std::upper_bound(date.begin(), date.end(), day_to) - date.begin()
+            );
 
-template<typename TSeq>
-inline void DataBase<TSeq>::record_transmission(
-    int i,
-    int j,
-    int virus,
-    int i_expo_date
-) {
+    if (*to < *from)
+        *to = *from;
 
-    transmission_date.push_back(model->today());
-    transmission_source.push_back(i);
-    transmission_target.push_back(j);
-    transmission_virus.push_back(virus);
-    transmission_source_exposure_date.push_back(i_expo_date);
+    return;
 
 }
 
-template<typename TSeq>
-inline size_t DataBase<TSeq>::get_n_viruses() const
-{
-    return virus_id.size();
-}
+/**
+ * @brief A row of a history view
+ */
+struct HistRow {
+    int date;                 ///< Date
+    int id;                   ///< Id of the virus/tool (-1 in totals)
+    epiworld_fast_uint state; ///< State
+    int counts;               ///< Counts
+};
 
-template<typename TSeq>
-inline size_t DataBase<TSeq>::get_n_tools() const
-{
-    return tool_id.size();
-}
+/**
+ * @brief View of the history of totals, viruses, or tools
+ * 
+ * @details The columns are accessible as `DataView`s through `get_date()`,
+ * `get_id()`, `get_state()`, and `get_counts()`. If the view was built with
+ * an id and/or state filter that cannot be expressed as a strided view
+ * (viruses and tools), the columns cover the full day range and the
+ * iterators skip the rows that do not match the filter.
+ * 
+ * Rows of the virus and tool histories that were moved to disk (see
+ * `DataBase::set_hist_memory_budget()`) are not in the columns. The iterators
+ * stream them from the file (one chunk at a time) before the rows in memory;
+ * `get_n_spilled()` gives how many rows of the range are on disk.
+ */
+class HistView {
+private:
 
+    DataView< int > date;
+    DataView< int > id;
+    DataView< epiworld_fast_uint > state;
+    DataView< int > counts;
 
-template<typename TSeq>
-inline void DataBase<TSeq>::set_user_data(
-    std::vector< std::string > names
-)
-{
-    user_data = UserData<TSeq>(names);
-    user_data.model = model;
-}
+    int id_filter    = -1;
+    int state_filter = -1;
 
-template<typename TSeq>
-inline void DataBase<TSeq>::add_user_data(
-    std::vector< epiworld_double > x
-)
-{
+    const HistSpill * spill = nullptr; ///< Rows on disk (if any)
+    size_t spill_from = 0u;
+    size_t spill_to   = 0u;
 
-    user_data.add(x);
+public:
+
+    /**
+     * @brief Iterator over the (matching) rows
+     * 
+     * @details Holds the columns (and filters) themselves rather than a
+     * pointer to the view, so it stays valid after the view is copied or
+     * goes out of scope (as long as the underlying data does.)
+     */
+    class const_iterator {
+        friend class HistView;
+    private:
+        DataView< int > date;
+        DataView< int > id;
+        DataView< epiworld_fast_uint > state;
+        DataView< int > counts;
+        int id_filter    = -1;
+        int state_filter = -1;
+
+        const HistSpill * spill = nullptr;
+        size_t spill_from = 0u;
+        size_t n_spilled  = 0u;
+
+        /**
+         * @brief Chunk of rows read from the spill
+         * @details Never modified once read (a new one is read when moving
+         * past it), so copies of the iterator can share it.
+         */
+        std::shared_ptr< const std::vector< std::int32_t > > chunk;
+        size_t chunk_first = 0u; ///< Row (relative to spill_from) of chunk[0]
+
+        size_t i = 0u; ///< Spilled rows first, then the ones in memory
+        const_iterator(const HistView & view_, size_t i_);
+        HistRow row() const;
+        bool match() const;
+        void skip();
+    public:
+
+        typedef std::forward_iterator_tag iterator_category;
+        typedef HistRow value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const HistRow * pointer;
+        typedef HistRow reference;
+
+        const_iterator() {};
+
+        HistRow operator*() const;
+        const_iterator & operator++();
+        const_iterator operator++(int) {const_iterator tmp(*this); ++(*this); return tmp;};
+
+        bool operator==(const const_iterator & other) const {return i == other.i;};
+        bool operator!=(const const_iterator & other) const {return i != other.i;};
 
+    };
+
+    HistView() {};
+    HistView(
+        DataView< int > date_,
+        DataView< int > id_,
+        DataView< epiworld_fast_uint > state_,
+        DataView< int > counts_,
+        int id_filter_ = -1,
+        int state_filter_ = -1,
+        const HistSpill * spill_ = nullptr,
+        size_t spill_from_ = 0u,
+        size_t spill_to_ = 0u
+    ) : date(date_), id(id_), state(state_), counts(counts_),
+        id_filter(id_filter_), state_filter(state_filter_),
+        spill(spill_), spill_from(spill_from_), spill_to(spill_to_) {};
+
+    const DataView< int > & get_date() const {return date;};
+    const DataView< int > & get_id() const {return id;};
+    const DataView< epiworld_fast_uint > & get_state() const {return state;};
+    const DataView< int > & get_counts() const {return counts;};
+
+    bool is_filtered() const; ///< `true` if iterators skip rows.
+    size_t size() const;      ///< Number of rows (linear time if filtered).
+    size_t get_n_spilled() const noexcept {return spill_to - spill_from;};
+
+    const_iterator begin() const {return const_iterator(*this, 0u);};
+    const_iterator end() const {
+        return const_iterator(*this, get_n_spilled() + counts.size());
+    };
+
+};
+
+inline bool HistView::is_filtered() const
+{
+    return (id_filter >= 0) || (state_filter >= 0);
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::add_user_data(
-    epiworld_fast_uint k,
-    epiworld_double x
-)
+inline size_t HistView::size() const
 {
 
-    user_data.add(k, x);
+    if (!is_filtered())
+        return get_n_spilled() + counts.size();
+
+    size_t res = 0u;
+    for (auto it = begin(); it != end(); ++it)
+        ++res;
+
+    return res;
 
 }
 
-template<typename TSeq>
-inline UserData<TSeq> & DataBase<TSeq>::get_user_data()
+inline HistView::const_iterator::const_iterator(
+    const HistView & view_,
+    size_t i_
+) : date(view_.date), id(view_.id), state(view_.state), counts(view_.counts),
+    id_filter(view_.id_filter), state_filter(view_.state_filter),
+    spill(view_.spill), spill_from(view_.spill_from),
+    n_spilled(view_.get_n_spilled()), i(i_)
 {
-    return user_data;
+    skip();
 }
 
-template<typename TSeq>
-inline MapVec_type<int,int> DataBase<TSeq>::reproductive_number()
-const {
-
-    // Checking size
-    MapVec_type<int,int> map;
+inline HistRow HistView::const_iterator::row() const
+{
 
-    // Number of digits of maxid
-    for (size_t i = 0u; i < transmission_date.size(); ++i)
+    if (i < n_spilled)
     {
-        // Fabricating id
-        std::vector< int > h = {
-            transmission_virus[i],
-            transmission_source[i],
-            transmission_source_exposure_date[i]
-        };
 
-        // Adding to counter
-        if (map.find(h) == map.end())
-            map[h] = 1;
-        else
-            map[h]++;
+        const std::int32_t * r =
+            chunk->data() + (i - chunk_first) * HistSpill::row_size;
 
-        // The target is added
-        std::vector< int > h_target = {
-            transmission_virus[i],
-            transmission_target[i],
-            transmission_date[i]
+        return HistRow{
+            static_cast< int >(r[0u]),
+            static_cast< int >(r[1u]),
+            static_cast< epiworld_fast_uint >(r[2u]),
+            static_cast< int >(r[3u])
         };
 
-        map[h_target] = 0;
-        
     }
 
-    return map;
+    size_t j = i - n_spilled;
+    return HistRow{
+        date[j],
+        id.empty() ? -1 : id[j],
+        state[j],
+        counts[j]
+    };
 
 }
 
-template<typename TSeq>
-inline void DataBase<TSeq>::reproductive_number(
-    std::string fn
-) const {
+inline bool HistView::const_iterator::match() const
+{
 
+    if ((id_filter < 0) && (state_filter < 0))
+        return true;
 
-    auto map = reproductive_number();
+    HistRow r = row();
 
-    std::ofstream fn_file(fn, std::ios_base::out);
+    if ((id_filter >= 0) && (r.id != id_filter))
+        return false;
 
-    // Repeat the same error if the file doesn't exists
-    if (!fn_file)
-    {
-        throw std::runtime_error(
-            "Could not open file \"" + fn +
-            "\" for writing.")
-            ;
-    }
+    if ((state_filter >= 0) && (r.state != static_cast<epiworld_fast_uint>(state_filter)))
+        return false;
 
-    fn_file << 
-        #ifdef EPI_DEBUG
-        "thread " <<
-        #endif
-        "virus_id virus source source_exposure_date rt\n";
+    return true;
 
+}
 
-    for (auto & m : map)
-        fn_file <<
-            #ifdef EPI_DEBUG
-            EPI_GET_THREAD_ID() << " " <<
-            #endif
-            m.first[0u] << " \"" <<
-            virus_name[m.first[0u]] << "\" " <<
-            m.first[1u] << " " <<
-            m.first[2u] << " " <<
-            m.second << "\n";
+inline void HistView::const_iterator::skip()
+{
 
-    return;
+    size_t n = n_spilled + counts.size();
+    while (i < n)
+    {
 
-}
+        // Reading the chunk holding the i-th spilled row
+        if (
+            (i < n_spilled) &&
+            (!chunk || (i < chunk_first) ||
+            (i >= (chunk_first + chunk->size() / HistSpill::row_size)))
+            )
+        {
 
-template<typename TSeq>
-inline std::vector< epiworld_double > DataBase<TSeq>::transition_probability(
-    bool print
-) const {
+            chunk_first  = i - (i % HistSpill::chunk_size);
+            size_t nrows = std::min(HistSpill::chunk_size, n_spilled - chunk_first);
 
-    auto states_labels = model->get_states();
-    size_t n_state = states_labels.size();
-    size_t n_days   = model->get_ndays();
-    std::vector< epiworld_double > res(n_state * n_state, 0.0);
-    std::vector< epiworld_double > days_to_include(n_state, 0.0);
+            auto buffer = std::make_shared< std::vector< std::int32_t > >(
+                nrows * HistSpill::row_size
+                );
 
-    for (size_t t = 1; t < n_days; ++t)
-    {
+            spill->read_rows(spill_from + chunk_first, nrows, buffer->data());
+            chunk = buffer;
 
-        for (size_t s_i = 0; s_i < n_state; ++s_i)
-        {
-            epiworld_double daily_total = hist_total_counts[(t - 1) * n_state + s_i];
+        }
 
-            if (daily_total == 0)
-                continue;
+        if (match())
+            break;
 
-            days_to_include[s_i] += 1.0; 
+        ++i;
 
-            for (size_t s_j = 0u; s_j < n_state; ++s_j)
-            {
-                #ifdef EPI_DEBUG
-                epiworld_double entry = hist_transition_matrix[
-                    s_i + s_j * n_state +
-                    t * (n_state * n_state)
-                    ];
+    }
 
-                if (entry > daily_total)
-                    throw std::logic_error(
-                        "The entry in hist_transition_matrix cannot have more elememnts than the total"
-                        );
+}
 
-                res[s_i + s_j * n_state] += (entry / daily_total);
-                #else
-                    res[s_i + s_j * n_state] += (
-                        hist_transition_matrix[
-                            s_i + s_j * n_state +
-                            t * (n_state * n_state)
-                        ] / daily_total
-                    );
-                #endif
-            }
+inline HistRow HistView::const_iterator::operator*() const
+{
+    return row();
+}
 
-        }
+inline HistView::const_iterator & HistView::const_iterator::operator++()
+{
 
-    }
+    ++i;
+    skip();
 
-    for (size_t s_i = 0; s_i < n_state; ++s_i)
-    {
-        for (size_t s_j = 0; s_j < n_state; ++s_j)
-            res[s_i + s_j * n_state] /= days_to_include[s_i];
-    }
+    return *this;
 
-    if (print)
-    {   
+}
 
-        size_t nchar = 0u;
-        for (auto & l : states_labels)
-            if (l.length() > nchar)
-                nchar = l.length();
+/**
+ * @brief A row of the transition matrix view
+ */
+struct TransitionRow {
+    int date;   ///< Date
+    int from;   ///< State from
+    int to;     ///< State to
+    int counts; ///< Counts
+};
 
-        std::string fmt = " - %-" + std::to_string(nchar) + "s";
-        
-        printf_epiworld("\nTransition Probabilities:\n");
-        for (size_t s_i = 0u; s_i < n_state; ++s_i)
-        {
-            printf_epiworld(fmt.c_str(), states_labels[s_i].c_str());
-            for (size_t s_j = 0u; s_j < n_state; ++s_j)
-            {
-                if (std::isnan(res[s_i + s_j * n_state]))
-                {
-                    printf_epiworld("     -");
-                } else {
-                    printf_epiworld(" % 4.2f", res[s_i + s_j * n_state]);
-                }
-            }
-            printf_epiworld("\n");
-        }
+/**
+ * @brief View of the (sparse) history of the transition matrix
+ * 
+ * @details Only non-zero cells are included. `get_start()` has one more
+ * element than `get_date()`, so the entries of the `k`-th day are
+ * `[get_start()[k], get_start()[k + 1])` (positions are absolute in the
+ * database, use `get_start()[0]` as offset.)
+ */
+class TransitionView {
+private:
 
-        printf_epiworld("\n");
+    DataView< int > date;
+    DataView< size_t > start;
+    DataView< int > from;
+    DataView< int > to;
+    DataView< int > counts;
 
-    }
+public:
 
-    return res;
+    /**
+     * @brief Iterator over the entries
+     * 
+     * @details Like `HistView::const_iterator`, holds the columns, not a
+     * pointer to the view.
+     */
+    class const_iterator {
+        friend class TransitionView;
+    private:
+        DataView< int > date;
+        DataView< size_t > start;
+        DataView< int > from;
+        DataView< int > to;
+        DataView< int > counts;
+        size_t k    = 0u; ///< Entry
+        size_t step = 0u; ///< Day
+        const_iterator(const TransitionView & view_, size_t k_);
+        void find_step();
+    public:
+
+        typedef std::forward_iterator_tag iterator_category;
+        typedef TransitionRow value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const TransitionRow * pointer;
+        typedef TransitionRow reference;
+
+        const_iterator() {};
+
+        TransitionRow operator*() const;
+        const_iterator & operator++();
+        const_iterator operator++(int) {const_iterator tmp(*this); ++(*this); return tmp;};
+
+        bool operator==(const const_iterator & other) const {return k == other.k;};
+        bool operator!=(const const_iterator & other) const {return k != other.k;};
 
+    };
 
-} 
+    TransitionView() {};
+    TransitionView(
+        DataView< int > date_,
+        DataView< size_t > start_,
+        DataView< int > from_,
+        DataView< int > to_,
+        DataView< int > counts_
+    ) : date(date_), start(start_), from(from_), to(to_), counts(counts_) {};
 
-#define VECT_MATCH(a, b, c) \
-    EPI_DEBUG_FAIL_AT_TRUE(a.size() != b.size(), c) \
-    for (size_t __i = 0u; __i < a.size(); ++__i) \
-    {\
-        EPI_DEBUG_FAIL_AT_TRUE(a[__i] != b[__i], c) \
-    }
+    const DataView< int > & get_date() const {return date;};
+    const DataView< size_t > & get_start() const {return start;};
+    const DataView< int > & get_from() const {return from;};
+    const DataView< int > & get_to() const {return to;};
+    const DataView< int > & get_counts() const {return counts;};
 
-template<>
-inline bool DataBase<std::vector<int>>::operator==(const DataBase<std::vector<int>> & other) const
-{
-    VECT_MATCH(
-        virus_name, other.virus_name,
-        "DataBase:: virus_name don't match"
-        )
+    size_t size() const noexcept {return counts.size();};
 
-    EPI_DEBUG_FAIL_AT_TRUE(
-        virus_sequence.size() != other.virus_sequence.size(),
-        "DataBase:: virus_sequence don't match."
-        )
+    const_iterator begin() const {return const_iterator(*this, 0u);};
+    const_iterator end() const {return const_iterator(*this, counts.size());};
 
-    for (size_t i = 0u; i < virus_sequence.size(); ++i)
-    {
-        VECT_MATCH(
-            virus_sequence[i], other.virus_sequence[i],
-            "DataBase:: virus_sequence[i] don't match"
-            )
-    }
+};
 
-    VECT_MATCH(
-        virus_origin_date,
-        other.virus_origin_date,
-        "DataBase:: virus_origin_date[i] don't match"
-    )
+inline TransitionView::const_iterator::const_iterator(
+    const TransitionView & view_,
+    size_t k_
+) : date(view_.date), start(view_.start), from(view_.from), to(view_.to),
+    counts(view_.counts), k(k_)
+{
+    find_step();
+}
 
-    VECT_MATCH(
-        virus_parent_id,
-        other.virus_parent_id,
-        "DataBase:: virus_parent_id[i] don't match"
-    )
+inline void TransitionView::const_iterator::find_step()
+{
 
-    VECT_MATCH(
-        tool_name,
-        other.tool_name,
-        "DataBase:: tool_name[i] don't match"
-    )
+    // Finding the day of the entry (skipping days with no entries)
+    if (start.empty())
+        return;
 
-    VECT_MATCH(
-        tool_sequence,
-        other.tool_sequence,
-        "DataBase:: tool_sequence[i] don't match"
-    )
+    size_t offset = start[0u];
+    while (((step + 1u) < date.size()) && (k >= (start[step + 1u] - offset)))
+        ++step;
 
-    VECT_MATCH(
-        tool_origin_date,
-        other.tool_origin_date,
-        "DataBase:: tool_origin_date[i] don't match"
-    )
+}
 
+inline TransitionRow TransitionView::const_iterator::operator*() const
+{
 
-    EPI_DEBUG_FAIL_AT_TRUE(
-        sampling_freq != other.sampling_freq,
-        "DataBase:: sampling_freq don't match."
-        )
+    return TransitionRow{
+        date[step],
+        from[k],
+        to[k],
+        counts[k]
+    };
 
-    // Variants history
-    VECT_MATCH(
-        hist_virus_date,
-        other.hist_virus_date,
-        "DataBase:: hist_virus_date[i] don't match"
-        )
+}
 
-    VECT_MATCH(
-        hist_virus_id,
-        other.hist_virus_id,
-        "DataBase:: hist_virus_id[i] don't match"
-        )
+inline TransitionView::const_iterator & TransitionView::const_iterator::operator++()
+{
 
-    VECT_MATCH(
-        hist_virus_state,
-        other.hist_virus_state,
-        "DataBase:: hist_virus_state[i] don't match"
-        )
+    ++k;
+    find_step();
 
-    VECT_MATCH(
-        hist_virus_counts,
-        other.hist_virus_counts,
-        "DataBase:: hist_virus_counts[i] don't match"
-        )
+    return *this;
 
-    // Tools history
-    VECT_MATCH(
-        hist_tool_date,
-        other.hist_tool_date,
-        "DataBase:: hist_tool_date[i] don't match"
-        )
+}
 
-    VECT_MATCH(
-        hist_tool_id,
-        other.hist_tool_id,
-        "DataBase:: hist_tool_id[i] don't match"
-        )
+/**
+ * @brief View of the transmission log
+ * 
+ * @details Covers a range of events of a `TransmissionLog`. If built with a
+ * virus filter, iterators skip events of other viruses.
+ */
+class TransmissionView {
+private:
 
-    VECT_MATCH(
-        hist_tool_state,
-        other.hist_tool_state,
-        "DataBase:: hist_tool_state[i] don't match"
-        )
+    const TransmissionLog * log = nullptr;
+    size_t from = 0u;
+    size_t to   = 0u;
+    int virus_filter = -1;
 
-    VECT_MATCH(
-        hist_tool_counts,
-        other.hist_tool_counts,
-        "DataBase:: hist_tool_counts[i] don't match"
-        )
+public:
 
-    // Overall hist
-    VECT_MATCH(
-        hist_total_date,
-        other.hist_total_date,
-        "DataBase:: hist_total_date[i] don't match"
-        )
+    /**
+     * @brief Iterator over the (matching) events
+     * 
+     * @details Like `HistView::const_iterator`, holds the log pointer and
+     * range, not a pointer to the view.
+     */
+    class const_iterator {
+        friend class TransmissionView;
+    private:
+        const TransmissionLog * log = nullptr;
+        size_t to = 0u;
+        int virus_filter = -1;
+        size_t i = 0u;
+        const_iterator(const TransmissionView & view_, size_t i_);
+        void skip();
+    public:
+
+        typedef std::forward_iterator_tag iterator_category;
+        typedef TransmissionEvent value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const TransmissionEvent * pointer;
+        typedef TransmissionEvent reference;
+
+        const_iterator() {};
+
+        TransmissionEvent operator*() const {return (*log)[i];};
+        const_iterator & operator++();
+        const_iterator operator++(int) {const_iterator tmp(*this); ++(*this); return tmp;};
+
+        bool operator==(const const_iterator & other) const {return i == other.i;};
+        bool operator!=(const const_iterator & other) const {return i != other.i;};
 
-    VECT_MATCH(
-        hist_total_nviruses_active,
-        other.hist_total_nviruses_active,
-        "DataBase:: hist_total_nviruses_active[i] don't match"
-        )
+    };
 
-    VECT_MATCH(
-        hist_total_state,
-        other.hist_total_state,
-        "DataBase:: hist_total_state[i] don't match"
-        )
+    TransmissionView() {};
+    TransmissionView(
+        const TransmissionLog * log_,
+        size_t from_,
+        size_t to_,
+        int virus_filter_ = -1
+    ) : log(log_), from(from_), to(to_), virus_filter(virus_filter_) {};
 
-    VECT_MATCH(
-        hist_total_counts,
-        other.hist_total_counts,
-        "DataBase:: hist_total_counts[i] don't match"
-        )
+    /**
+     * @brief Access the i-th event of the range (ignores the virus filter)
+     */
+    TransmissionEvent operator[](size_t i) const {return (*log)[from + i];};
 
-    VECT_MATCH(
-        hist_transition_matrix,
-        other.hist_transition_matrix,
-        "DataBase:: hist_transition_matrix[i] don't match"
-        )
+    bool is_filtered() const {return virus_filter >= 0;};
+    size_t size() const; ///< Number of events (linear time if filtered).
 
-    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
-    EPI_DEBUG_FAIL_AT_TRUE(
-        today_virus.size() != other.today_virus.size(),
-        "DataBase:: today_virus don't match."
-        )
-    
-    for (size_t i = 0u; i < today_virus.size(); ++i)
-    {
-        VECT_MATCH(
-            today_virus[i], other.today_virus[i],
-            "DataBase:: today_virus[i] don't match"
-            )
-    }
+    const_iterator begin() const {return const_iterator(*this, from);};
+    const_iterator end() const {return const_iterator(*this, to);};
 
-    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
-    if (today_tool.size() != other.today_tool.size())
-        return false;
-    
-    for (size_t i = 0u; i < today_tool.size(); ++i)
-    {
-        VECT_MATCH(
-            today_tool[i], other.today_tool[i],
-            "DataBase:: today_tool[i] don't match"
-            )
-    }
+};
 
-    // {Susceptible, Infected, etc.}
-    VECT_MATCH(
-        today_total, other.today_total,
-        "DataBase:: today_total don't match"
-        )
+inline TransmissionView::const_iterator::const_iterator(
+    const TransmissionView & view_,
+    size_t i_
+) : log(view_.log), to(view_.to), virus_filter(view_.virus_filter), i(i_)
+{
+    skip();
+}
 
-    // Totals
-    EPI_DEBUG_FAIL_AT_TRUE(
-        today_total_nviruses_active != other.today_total_nviruses_active,
-        "DataBase:: today_total_nviruses_active don't match."
-        )
+inline void TransmissionView::const_iterator::skip()
+{
 
-    // Transmission network
-    VECT_MATCH(
-        transmission_date,
-        other.transmission_date,                 ///< Date of the transmission eve,
-        "DataBase:: transmission_date[i] don't match"
-        )
+    if (virus_filter < 0)
+        return;
 
-    VECT_MATCH(
-        transmission_source,
-        other.transmission_source,               ///< Id of the sour,
-        "DataBase:: transmission_source[i] don't match"
+    while ((i < to) && (log->virus(i) != virus_filter))
+        ++i;
+
+}
+
+inline TransmissionView::const_iterator & TransmissionView::const_iterator::operator++()
+{
+
+    ++i;
+    skip();
+
+    return *this;
+
+}
+
+inline size_t TransmissionView::size() const
+{
+
+    if (virus_filter < 0)
+        return to - from;
+
+    size_t res = 0u;
+    for (size_t i = from; i < to; ++i)
+        if (log->virus(i) == virus_filter)
+            ++res;
+
+    return res;
+
+}
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/database-views-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/database-eventlog-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_DATABASE_EVENTLOG_BONES_HPP
+#define EPIWORLD_DATABASE_EVENTLOG_BONES_HPP
+
+/**
+ * @brief A single change of state of an agent
+ */
+struct StateEvent {
+    int date;
+    int agent;
+    int from;
+    int to;
+    int virus; ///< Virus involved in the change (-1 if none)
+};
+
+/**
+ * @brief Log of the changes of state of the agents
+ * 
+ * @details Events are stored in the order in which they happen (so sorted by
+ * date). Together with a snapshot of the agents' states before the first
+ * event, the log is enough to rebuild the state of every agent at any date.
+ * To avoid replaying the full log, a snapshot (checkpoint) is also stored
+ * every `checkpoint_freq` days, so rebuilding a date only replays the events
+ * after the closest checkpoint.
+ */
+class EventLog {
+private:
+
+    std::vector< int > date;
+    std::vector< int > agent;
+    std::vector< std::uint16_t > from;
+    std::vector< std::uint16_t > to;
+    std::vector< int > virus;
+
+    int checkpoint_freq = 0; ///< Days between checkpoints (0 means none)
+
+    // Checkpoints: date, number of events before it, and the states
+    std::vector< int > checkpoint_date;
+    std::vector< size_t > checkpoint_event;
+    std::vector< std::vector< std::uint16_t > > checkpoint_states;
+
+public:
+
+    EventLog() {};
+
+    /**
+     * @param checkpoint_freq_ Days between checkpoints (0 means none).
+     */
+    EventLog(int checkpoint_freq_);
+
+    void push_back(int date_, int agent_, size_t from_, size_t to_, int virus_);
+
+    /**
+     * @brief Stores a snapshot of the states after all the events of `date_`
+     * 
+     * @details The first checkpoint is the base of the log, and should be
+     * added before any event (its date should not be after the date of the
+     * first event.)
+     */
+    void checkpoint(int date_, std::vector< std::uint16_t > && states);
+
+    /**
+     * @brief Whether a checkpoint should be taken at the end of `date_`
+     */
+    bool is_checkpoint(int date_) const noexcept;
+
+    /**
+     * @brief Rebuilds the states of all agents at the end of `date_`
+     * 
+     * @param date_ Date to rebuild.
+     * @param states Vector where to write the states (resized as needed).
+     */
+    void reconstruct(int date_, std::vector< epiworld_fast_uint > & states) const;
+
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+    size_t n_checkpoints() const noexcept;
+    int get_checkpoint_freq() const noexcept;
+
+    StateEvent operator[](size_t i) const;
+    StateEvent at(size_t i) const;
+
+    void get_events(
+        std::vector< int > & date_,
+        std::vector< int > & agent_,
+        std::vector< int > & from_,
+        std::vector< int > & to_,
+        std::vector< int > & virus_
+    ) const;
+
+    void clear();
+
+    bool operator==(const EventLog & other) const;
+    bool operator!=(const EventLog & other) const {return !operator==(other);};
+
+};
+
+inline EventLog::EventLog(int checkpoint_freq_)
+{
+
+    if (checkpoint_freq_ < 0)
+        throw std::range_error(
+            "The checkpoint frequency must be non-negative."
+            );
+
+    checkpoint_freq = checkpoint_freq_;
+
+}
+
+inline void EventLog::push_back(
+    int date_,
+    int agent_,
+    size_t from_,
+    size_t to_,
+    int virus_
+)
+{
+
+    #ifdef EPI_DEBUG
+    if ((date.size() > 0u) && (date_ < date.back()))
+        throw std::logic_error(
+            "[epi-debug] EventLog::push_back events must be sorted by date."
+            );
+    #endif
+
+    date.push_back(date_);
+    agent.push_back(agent_);
+    from.push_back(static_cast< std::uint16_t >(from_));
+    to.push_back(static_cast< std::uint16_t >(to_));
+    virus.push_back(virus_);
+
+}
+
+inline void EventLog::checkpoint(
+    int date_,
+    std::vector< std::uint16_t > && states
+)
+{
+
+    checkpoint_date.push_back(date_);
+    checkpoint_event.push_back(date.size());
+    checkpoint_states.push_back(std::move(states));
+
+}
+
+inline bool EventLog::is_checkpoint(int date_) const noexcept
+{
+    return (checkpoint_freq > 0) && ((date_ % checkpoint_freq) == 0);
+}
+
+inline void EventLog::reconstruct(
+    int date_,
+    std::vector< epiworld_fast_uint > & states
+) const
+{
+
+    if (checkpoint_date.size() == 0u)
+        throw std::logic_error(
+            "The event log has no base state. Was the model reset with the log on?"
+            );
+
+    if (date_ < checkpoint_date[0u])
+        throw std::range_error(
+            "The date " + std::to_string(date_) +
+            " is before the start of the event log."
+            );
+
+    // Closest checkpoint at or before the date
+    size_t k = static_cast< size_t >(std::distance(
+        checkpoint_date.begin(),
+        std::upper_bound(checkpoint_date.begin(), checkpoint_date.end(), date_)
+    )) - 1u;
+
+    const auto & base = checkpoint_states[k];
+    states.assign(base.begin(), base.end());
+
+    // Replaying the events after it
+    for (size_t i = checkpoint_event[k]; i < date.size(); ++i)
+    {
+
+        if (date[i] > date_)
+            break;
+
+        states[agent[i]] = to[i];
+
+    }
+
+    return;
+
+}
+
+inline size_t EventLog::size() const noexcept
+{
+    return date.size();
+}
+
+inline bool EventLog::empty() const noexcept
+{
+    return date.size() == 0u;
+}
+
+inline size_t EventLog::n_checkpoints() const noexcept
+{
+    return checkpoint_date.size();
+}
+
+inline int EventLog::get_checkpoint_freq() const noexcept
+{
+    return checkpoint_freq;
+}
+
+inline StateEvent EventLog::operator[](size_t i) const
+{
+    return StateEvent{
+        date[i], agent[i], static_cast< int >(from[i]),
+        static_cast< int >(to[i]), virus[i]
+    };
+}
+
+inline StateEvent EventLog::at(size_t i) const
+{
+
+    if (i >= date.size())
+        throw std::range_error(
+            "The event " + std::to_string(i) + " is out of range. " +
+            "The log has " + std::to_string(date.size()) + " events."
+            );
+
+    return operator[](i);
+
+}
+
+inline void EventLog::get_events(
+    std::vector< int > & date_,
+    std::vector< int > & agent_,
+    std::vector< int > & from_,
+    std::vector< int > & to_,
+    std::vector< int > & virus_
+) const
+{
+
+    date_.assign(date.begin(), date.end());
+    agent_.assign(agent.begin(), agent.end());
+    from_.assign(from.begin(), from.end());
+    to_.assign(to.begin(), to.end());
+    virus_.assign(virus.begin(), virus.end());
+
+    return;
+
+}
+
+inline void EventLog::clear()
+{
+
+    date.clear();
+    agent.clear();
+    from.clear();
+    to.clear();
+    virus.clear();
+
+    checkpoint_date.clear();
+    checkpoint_event.clear();
+    checkpoint_states.clear();
+
+}
+
+inline bool EventLog::operator==(const EventLog & other) const
+{
+
+    return (checkpoint_freq == other.checkpoint_freq) &&
+        (date == other.date) && (agent == other.agent) &&
+        (from == other.from) && (to == other.to) && (virus == other.virus) &&
+        (checkpoint_date == other.checkpoint_date) &&
+        (checkpoint_event == other.checkpoint_event) &&
+        (checkpoint_states == other.checkpoint_states);
+
+}
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/database-eventlog-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/database-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_DATABASE_BONES_HPP
+#define EPIWORLD_DATABASE_BONES_HPP
+
+template<typename TSeq>
+class Model;
+
+template<typename TSeq>
+class Virus;
+
+template<typename TSeq>
+class UserData;
+
+template<typename TSeq>
+inline void default_add_virus(Action<TSeq> & a, Model<TSeq> * m);
+
+template<typename TSeq>
+inline void default_add_tool(Action<TSeq> & a, Model<TSeq> * m);
+
+template<typename TSeq>
+inline void default_rm_virus(Action<TSeq> & a, Model<TSeq> * m);
+
+template<typename TSeq>
+inline void default_rm_tool(Action<TSeq> & a, Model<TSeq> * m);
+
+/**
+ * @brief Statistical data about the process
+ * 
+ * @tparam TSeq 
+ */
+template<typename TSeq>
+class DataBase {
+    friend class Model<TSeq>;
+    friend class DistributedModel<TSeq>;
+    friend void default_add_virus<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
+    friend void default_add_tool<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
+    friend void default_rm_virus<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
+    friend void default_rm_tool<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
+private:
+    Model<TSeq> * model;
+
+    // Variants information 
+    SeqRegistry virus_id; ///< The fingerprint of the sequence is the key
+    std::vector< std::string > virus_name;
+    std::vector< TSeq> virus_sequence;
+    std::vector< int > virus_origin_date;
+    std::vector< int > virus_parent_id;
+
+    SeqRegistry tool_id; ///< The fingerprint of the sequence is the key
+    std::vector< std::string > tool_name;
+    std::vector< TSeq> tool_sequence;
+    std::vector< int > tool_origin_date;
+
+    std::function<std::uint64_t(const TSeq&)> seq_fingerprint = default_seq_fingerprint<TSeq>;
+    std::function<std::string(const TSeq &)> seq_writer = default_seq_writer<TSeq>;
+
+    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
+    std::vector< std::vector<int> > today_virus;
+
+    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
+    std::vector< std::vector<int> > today_tool;
+
+    // {Susceptible, Infected, etc.}
+    std::vector< int > today_total;
+
+    // Totals
+    int today_total_nviruses_active = 0;
+    
+    int sampling_freq = 1;
+
+    // Variants history
+    std::vector< int > hist_virus_date;
+    std::vector< int > hist_virus_id;
+    std::vector< epiworld_fast_uint > hist_virus_state;
+    std::vector< int > hist_virus_counts;
+
+    // Tools history
+    std::vector< int > hist_tool_date;
+    std::vector< int > hist_tool_id;
+    std::vector< epiworld_fast_uint > hist_tool_state;
+    std::vector< int > hist_tool_counts;
+
+    // Variants and tools history moved to disk (see set_hist_memory_budget)
+    size_t hist_memory_budget = 0u; ///< In bytes (0 means no limit)
+    HistSpill hist_virus_spill;
+    HistSpill hist_tool_spill;
+
+    // Counts summed across processes before recording (see set_reduce)
+    std::function<void(std::vector< int > &)> reduce_fun = nullptr;
+    std::vector< int > reduce_buffer;
+
+    // Overall hist
+    std::vector< int > hist_total_date;
+    std::vector< int > hist_total_nviruses_active;
+    std::vector< epiworld_fast_uint > hist_total_state;
+    std::vector< int > hist_total_counts;
+
+    /**
+     * @name Sparse history of the transition matrix
+     *
+     * @details Only the non-zero cells of `transition_matrix` are stored
+     * every sampled day as (from, to, counts) triplets, in column-major
+     * order. `hist_transition_start[k]` marks where the `k`-th recorded day
+     * starts, with an extra element at the end (so it has one more element
+     * than recorded days).
+     */
+    ///@{
+    std::vector< int > hist_transition_from;
+    std::vector< int > hist_transition_to;
+    std::vector< int > hist_transition_counts;
+    std::vector< size_t > hist_transition_start = {0u};
+    ///@}
+
+    // Transmission network
+    TransmissionLog transmissions; ///< (date, source, target, virus, source exposure date)
+
+    // Changes of state of the agents (see event_log_on)
+    bool use_event_log = false;
+    EventLog event_log;
+
+    // Rolling hash of the recorded days (see get_hash)
+    std::vector< std::uint64_t > hist_hash;
+    size_t hash_ntransmissions = 0u; ///< Transmissions already in the hash
+
+    std::vector< int > transition_matrix;
+
+    UserData<TSeq> user_data;
+
+    void update_state(
+        epiworld_fast_uint prev_state,
+        epiworld_fast_uint new_state,
+        bool undo = false
+    );
+
+    void update_virus(
+        epiworld_fast_uint virus_id,
+        epiworld_fast_uint prev_state,
+        epiworld_fast_uint new_state
+    );
+
+    void update_tool(
+        epiworld_fast_uint tool_id,
+        epiworld_fast_uint prev_state,
+        epiworld_fast_uint new_state
+    );
+
+    void record_transition(epiworld_fast_uint from, epiworld_fast_uint to, bool undo);
+
+    void record_state_event(
+        int agent,
+        epiworld_fast_uint from,
+        epiworld_fast_uint to,
+        int virus
+    );
+
+    void record_checkpoint(); ///< Snapshot of the agents' states for the event log
+
+    void record_hash(); ///< Adds the current day to the rolling hash
+
+    void spill_hist(); ///< Moves the virus and tool histories to disk if over budget
+
+    /**
+     * @brief Key of a sequence in a registry
+     * 
+     * @details Starts at `fingerprint` and, if the key is taken by a
+     * different sequence (a collision), moves to the next key in a fixed
+     * chain, until finding `seq` or a free key.
+     * 
+     * @param found Set to the id of `seq` if registered, -1 otherwise.
+     */
+    std::uint64_t registry_key(
+        const SeqRegistry & registry,
+        const std::vector< TSeq > & sequences,
+        std::uint64_t fingerprint,
+        const TSeq & seq,
+        int * found
+    ) const;
+
+    /**
+     * @brief Rebuilds the dense transition matrix of a recorded day
+     *
+     * @param step Index of the recorded day (not the date).
+     * @param res Vector of size `nstates * nstates` (column-major) where to
+     * write the counts. Cells not in the sparse history are set to zero.
+     */
+    void get_hist_transition_matrix_day(
+        size_t step,
+        std::vector< int > & res
+    ) const;
+
+
+public:
+
+    #ifdef EPI_DEBUG
+    int n_transmissions_potential = 0;
+    int n_transmissions_today     = 0;
+    #endif
+
+    DataBase() = delete;
+    DataBase(Model<TSeq> & m) : model(&m), user_data(m) {};
+    DataBase(const DataBase<TSeq> & db);
+    // DataBase<TSeq> & operator=(const DataBase<TSeq> & m);
+
+    /**
+     * @brief Registering a new variant
+     * 
+     * @param v Pointer to the new virus.
+     * Since viruses are originated in the agent, the numbers simply move around.
+     * From the parent virus to the new virus. And the total number of infected
+     * does not change.
+     */
+    void record_virus(Virus<TSeq> & v); 
+    void record_tool(Tool<TSeq> & t); 
+
+    /**
+     * @brief Sets how sequences are identified
+     * 
+     * @details Two sequences with the same fingerprint are considered the
+     * same variant. `set_seq_hasher()` takes a function turning the sequence
+     * into an integer vector, which is then fingerprinted.
+     */
+    ///@{
+    void set_seq_hasher(std::function<std::vector<int>(TSeq)> fun);
+    void set_seq_fingerprint(std::function<std::uint64_t(const TSeq&)> fun);
+    ///@}
+
+    /**
+     * @brief Sets a memory budget for the virus and tool histories
+     * 
+     * @details Once the in-memory virus and tool histories take more than
+     * `bytes`, they are moved to a temporary file on disk. The data is read
+     * back (streaming) by `get_hist_virus()`, `get_hist_tool()`, and
+     * `write_data()`. The iterators of the views `get_hist_virus_view()` and
+     * `get_hist_tool_view()` stream the rows on disk too, whereas the columns
+     * of the views only cover the rows still in memory.
+     * 
+     * @param bytes Maximum number of bytes. Zero (default) means no limit.
+     */
+    ///@{
+    void set_hist_memory_budget(size_t bytes);
+    size_t get_hist_memory_budget() const;
+    ///@}
+
+    /**
+     * @brief Sums the counts across processes before recording them
+     * 
+     * @details Used by distributed runs (see `DistributedModel`.) Every
+     * recorded day, the counts by state and the transitions of the day are
+     * put in a vector that is passed to `fun`, which should replace each
+     * element by its sum across processes, and the sums are what goes into
+     * the total and transition histories (`get_hist_total()`,
+     * `get_hist_transition_matrix()`.) The counts of the current day
+     * (`get_today_total()`), the virus and tool histories, and the
+     * transmissions stay local to the process.
+     * 
+     * @param fun Function (`nullptr` records the local counts.)
+     */
+    void set_reduce(std::function<void(std::vector< int > &)> fun);
+
+    /**
+     * @brief Logging every change of state of the agents
+     * 
+     * @details When on, the database keeps a log of (date, agent, from, to,
+     * virus) events, which can be used to rebuild the state of all agents at
+     * any date with `get_states_at()`. The log starts when the model is reset
+     * (so it should be turned on before running the model.)
+     * 
+     * @param checkpoint_freq Days between snapshots of the agents' states.
+     * Larger values use less memory but rebuilding a date replays more events.
+     * Zero means only the initial snapshot is kept.
+     */
+    ///@{
+    void event_log_on(int checkpoint_freq = 30);
+    void event_log_off();
+    bool is_event_log_on() const noexcept;
+    const EventLog & get_event_log() const;
+    ///@}
+
+    /**
+     * @brief Rebuilds the states of all agents at the end of a given day
+     * 
+     * @param day Day to rebuild (0 is the initial state.)
+     * @param states Vector where to write the state of each agent.
+     */
+    void get_states_at(int day, std::vector< epiworld_fast_uint > & states) const;
+
+    /**
+     * @brief Rolling hash of the simulation
+     * 
+     * @details Every time the day is recorded, the previous hash is mixed
+     * with the date, the daily totals, the transition matrix, and the
+     * transmissions of that day. Two runs with the same hash can be
+     * considered identical, which makes it a cheap check for reproducibility
+     * (see `make_check_hash()`.)
+     * 
+     * @return In `get_hash()`, the hash of the last recorded day (0 if
+     * nothing has been recorded.) In `get_hist_hash()`, the hash of each
+     * recorded day.
+     */
+    ///@{
+    std::uint64_t get_hash() const noexcept;
+    const std::vector< std::uint64_t > & get_hist_hash() const noexcept;
+    ///@}
+
+    void reset();
+    Model<TSeq> * get_model();
+    void record();
+
+    const std::vector< TSeq > & get_sequence() const;
+    const std::vector< int > & get_nexposed() const;
+    size_t size() const;
+
+    /**
+     * @name Get recorded information from the model
+     * 
+     * @param what std::string, The state, e.g., 0, 1, 2, ...
+     * @return In `get_today_total`, the current counts of `what`.
+     * @return In `get_today_virus`, the current counts of `what` for
+     * each virus.
+     * @return In `get_hist_total`, the time series of `what`
+     * @return In `get_hist_virus`, the time series of what for each virus.
+     * @return In `get_hist_total_date` and `get_hist_virus_date` the
+     * corresponding date
+     */
+    ///@{
+    int get_today_total(std::string what) const;
+    int get_today_total(epiworld_fast_uint what) const;
+    void get_today_total(
+        std::vector< std::string > * state = nullptr,
+        std::vector< int > * counts = nullptr
+    ) const;
+
+    void get_today_virus(
+        std::vector< std::string > & state,
+        std::vector< int > & id,
+        std::vector< int > & counts
+    ) const;
+
+    void get_hist_total(
+        std::vector< int > * date,
+        std::vector< std::string > * state,
+        std::vector< int > * counts
+    ) const;
+
+    void get_hist_virus(
+        std::vector< int > & date,
+        std::vector< int > & id,
+        std::vector< std::string > & state,
+        std::vector< int > & counts
+    ) const;
+
+    void get_hist_tool(
+        std::vector< int > & date,
+        std::vector< int > & id,
+        std::vector< std::string > & state,
+        std::vector< int > & counts
+    ) const;
+
+    void get_hist_transition_matrix(
+        std::vector< std::string > & state_from,
+        std::vector< std::string > & state_to,
+        std::vector< int > & date,
+        std::vector< int > & counts,
+        bool skip_zeros
+    ) const;
+    ///@}
+
+    /**
+     * @name Views of the recorded information (no copies)
+     *
+     * @details These return views of the internal buffers, which remain valid
+     * until the database is modified (e.g., the model is run or reset again).
+     *
+     * @param day_from,day_to Range of days to include (inclusive). A negative
+     * `day_to` includes all days from `day_from` onwards.
+     * @param state If non-negative, only rows of that state are included.
+     * @param id,virus If non-negative, only rows of that virus/tool are
+     * included.
+     */
+    ///@{
+    HistView get_hist_total_view(
+        int day_from = 0,
+        int day_to = -1,
+        int state = -1
+    ) const;
+
+    HistView get_hist_virus_view(
+        int day_from = 0,
+        int day_to = -1,
+        int id = -1,
+        int state = -1
+    ) const;
+
+    HistView get_hist_tool_view(
+        int day_from = 0,
+        int day_to = -1,
+        int id = -1,
+        int state = -1
+    ) const;
+
+    TransitionView get_hist_transition_matrix_view(
+        int day_from = 0,
+        int day_to = -1
+    ) const;
+
+    TransmissionView get_transmissions_view(
+        int day_from = 0,
+        int day_to = -1,
+        int virus = -1
+    ) const;
+    ///@}
+
+    /**
+     * @brief Get the transmissions object
+     * 
+     * @param date 
+     * @param source 
+     * @param target 
+     * @param virus 
+     * @param source_exposure_date 
+     */
+    ///@{
+    void get_transmissions(
+        std::vector<int> & date,
+        std::vector<int> & source,
+        std::vector<int> & target,
+        std::vector<int> & virus,
+        std::vector<int> & source_exposure_date
+    ) const;
+
+    void get_transmissions(
+        int * date,
+        int * source,
+        int * target,
+        int * virus,
+        int * source_exposure_date
+    ) const;
+    ///@}
+
+    void write_data(
+        std::string fn_virus_info,
+        std::string fn_virus_hist,
+        std::string fn_tool_info,
+        std::string fn_tool_hist,
+        std::string fn_total_hist,
+        std::string fn_transmission,
+        std::string fn_transition,
+        std::string fn_reproductive_number,
+        std::string fn_generation_time
+        ) const;
+    
+    void record_transmission(int i, int j, int virus, int i_expo_date);
+
+    size_t get_n_viruses() const;
+    size_t get_n_tools() const;
+    
+    void set_user_data(std::vector< std::string > names);
+    void add_user_data(std::vector< epiworld_double > x);
+    void add_user_data(epiworld_fast_uint j, epiworld_double x);
+    UserData<TSeq> & get_user_data();
+
+
+    /**
+     * @brief Computes the reproductive number of each case
+     * 
+     * @details By definition, whereas it computes R0 (basic reproductive number)
+     * or Rt/R (the effective reproductive number) will depend on whether the
+     * virus is allowed to circulate naïvely or not, respectively.
+     * 
+     * @param fn File where to write out the reproductive number.
+     */
+    ///@{
+    MapVec_type<int,int> reproductive_number() const;
+
+    void reproductive_number(
+        std::string fn
+        ) const;
+    ///@}
+
+    /**
+     * @brief Calculates the transition probabilities
+     * 
+     * @return std::vector< epiworld_double > 
+     */
+    std::vector< epiworld_double > transition_probability(
+        bool print = true
+    ) const;
+
+    bool operator==(const DataBase<TSeq> & other) const;
+    bool operator!=(const DataBase<TSeq> & other) const {return !operator==(other);};
+
+    /**
+     * Calculates the generating time
+     * @param agent_id,virus_id,time,gentime vectors where to save the values agent_id
+    */
+   ///@{
+    void generation_time(
+        std::vector< int > & agent_id,
+        std::vector< int > & virus_id,
+        std::vector< int > & time,
+        std::vector< int > & gentime
+    ) const;
+
+    void generation_time(
+        std::string fn
+    ) const;
+    ///@}
+
+};
+
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/database-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/database-meat.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_DATABASE_MEAT_HPP
+#define EPIWORLD_DATABASE_MEAT_HPP
+
+template<typename TSeq>
+inline void DataBase<TSeq>::reset()
+{
+
+    // Initializing the counts (ghosts are counted by their owners, see
+    // Model::set_halo_exchange())
+    today_total.resize(model->nstates);
+    std::fill(today_total.begin(), today_total.end(), 0);
+    for (size_t i = 0u; i < model->get_n_owned(); ++i)
+        ++today_total[model->population[i].get_state()];
+
+    #ifdef EPI_DEBUG
+    // Only the first should be different from zero
+    {
+        int n = static_cast<int>(model->get_n_owned());
+        if (today_total[0] != n)
+            throw std::runtime_error("The number of susceptible agents is not equal to the total number of agents.");
+
+        if (std::accumulate(today_total.begin(), today_total.end(), 0) != n)
+            throw std::runtime_error("The total number of agents is not equal to the sum of the number of agents in each state.");
+            
+    }
+    #endif
+
+    
+    transition_matrix.resize(model->nstates * model->nstates);
+    std::fill(transition_matrix.begin(), transition_matrix.end(), 0);
+    for (size_t s = 0u; s < model->nstates; ++s)
+        transition_matrix[s + s * model->nstates] = today_total[s];
+
+    hist_virus_date.clear();
+    hist_virus_id.clear();
+    hist_virus_state.clear();
+    hist_virus_counts.clear();
+
+    hist_tool_date.clear();
+    hist_tool_id.clear();
+    hist_tool_state.clear();
+    hist_tool_counts.clear();    
+
+    hist_virus_spill.clear();
+    hist_tool_spill.clear();
+
+    today_virus.resize(get_n_viruses());
+    std::fill(today_virus.begin(), today_virus.begin(), std::vector<int>(model->nstates, 0));
+
+    today_tool.resize(get_n_tools());
+    std::fill(today_tool.begin(), today_tool.begin(), std::vector<int>(model->nstates, 0));
+
+    hist_total_date.clear();
+    hist_total_state.clear();
+    hist_total_nviruses_active.clear();
+    hist_total_counts.clear();
+    hist_transition_from.clear();
+    hist_transition_to.clear();
+    hist_transition_counts.clear();
+    hist_transition_start.assign(1u, 0u);
+
+    transmissions.clear();
+
+    event_log.clear();
+    if (use_event_log)
+        record_checkpoint();
+
+    hist_hash.clear();
+    hash_ntransmissions = 0u;
+
+    return;
+
+}
+
+template<typename TSeq>
+inline DataBase<TSeq>::DataBase(const DataBase<TSeq> & db) :
+    virus_id(db.virus_id),
+    virus_name(db.virus_name),
+    virus_sequence(db.virus_sequence),
+    virus_origin_date(db.virus_origin_date),
+    virus_parent_id(db.virus_parent_id),
+    tool_id(db.tool_id),
+    tool_name(db.tool_name),
+    tool_sequence(db.tool_sequence),
+    tool_origin_date(db.tool_origin_date),
+    seq_fingerprint(db.seq_fingerprint),
+    seq_writer(db.seq_writer),
+    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
+    today_virus(db.today_virus),
+    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
+    today_tool(db.today_tool),
+    // {Susceptible, Infected, etc.}
+    today_total(db.today_total),
+    // Totals
+    today_total_nviruses_active(db.today_total_nviruses_active),
+    sampling_freq(db.sampling_freq),
+    // Variants history
+    hist_virus_date(db.hist_virus_date),
+    hist_virus_id(db.hist_virus_id),
+    hist_virus_state(db.hist_virus_state),
+    hist_virus_counts(db.hist_virus_counts),
+    // Tools history
+    hist_tool_date(db.hist_tool_date),
+    hist_tool_id(db.hist_tool_id),
+    hist_tool_state(db.hist_tool_state),
+    hist_tool_counts(db.hist_tool_counts),
+    hist_memory_budget(db.hist_memory_budget),
+    hist_virus_spill(db.hist_virus_spill),
+    hist_tool_spill(db.hist_tool_spill),
+    // Overall hist
+    hist_total_date(db.hist_total_date),
+    hist_total_nviruses_active(db.hist_total_nviruses_active),
+    hist_total_state(db.hist_total_state),
+    hist_total_counts(db.hist_total_counts),
+    hist_transition_from(db.hist_transition_from),
+    hist_transition_to(db.hist_transition_to),
+    hist_transition_counts(db.hist_transition_counts),
+    hist_transition_start(db.hist_transition_start),
+    // Transmission network
+    transmissions(db.transmissions),
+    use_event_log(db.use_event_log),
+    event_log(db.event_log),
+    hist_hash(db.hist_hash),
+    hash_ntransmissions(db.hash_ntransmissions),
+    transition_matrix(db.transition_matrix),
+    user_data(nullptr)
+{}
+
+// DataBase<TSeq> & DataBase<TSeq>::operator=(const DataBase<TSeq> & m)
+// {
+
+// }
+
+template<typename TSeq>
+inline Model<TSeq> * DataBase<TSeq>::get_model() {
+    return model;
+}
+
+template<typename TSeq>
+inline const std::vector< TSeq > & DataBase<TSeq>::get_sequence() const {
+    return virus_sequence;
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::record() 
+{
+
+    ////////////////////////////////////////////////////////////////////////////
+    // DEBUGGING BLOCK
+    ////////////////////////////////////////////////////////////////////////////
+    EPI_DEBUG_SUM_INT(today_total, model->get_n_owned())
+    EPI_DEBUG_ALL_NON_NEGATIVE(today_total)
+
+    #ifdef EPI_DEBUG
+    // Checking whether the sums correspond
+    std::vector< int > _today_total_cp(today_total.size(), 0);
+    for (size_t i = 0u; i < model->get_n_owned(); ++i)
+        _today_total_cp[model->population[i].get_state()]++;
+    
+    EPI_DEBUG_VECTOR_MATCH_INT(
+        _today_total_cp, today_total,
+        "Sums of __today_total_cp in database-meat.hpp"
+        )
+
+    if (model->today() == 0)
+    {
+        if (hist_total_date.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_total_date should be of length 0.")
+        if (hist_total_nviruses_active.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_total_nviruses_active should be of length 0.")
+        if (hist_total_state.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_total_state should be of length 0.")
+        if (hist_total_counts.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_total_counts should be of length 0.")
+        if (hist_virus_date.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_virus_date should be of length 0.")
+        if (hist_virus_id.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_virus_id should be of length 0.")
+        if (hist_virus_state.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_virus_state should be of length 0.")
+        if (hist_virus_counts.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_virus_counts should be of length 0.")
+        if (hist_tool_date.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_tool_date should be of length 0.")
+        if (hist_tool_id.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_tool_id should be of length 0.")
+        if (hist_tool_state.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_tool_state should be of length 0.")
+        if (hist_tool_counts.size() != 0)
+            EPI_DEBUG_ERROR(std::logic_error, "DataBase::record hist_tool_counts should be of length 0.")
+    }
+    #endif
+    ////////////////////////////////////////////////////////////////////////////
+
+    // The hash covers every day, not only the sampled ones
+    record_hash();
+
+    // Only store every now and then
+    if ((model->today() % sampling_freq) == 0)
+    {
+
+        // Counts by state and transitions (summed across processes, if
+        // needed)
+        const int * totals      = today_total.data();
+        const int * transitions = transition_matrix.data();
+        if (reduce_fun)
+        {
+
+            reduce_buffer.assign(today_total.begin(), today_total.end());
+            reduce_buffer.insert(
+                reduce_buffer.end(),
+                transition_matrix.begin(), transition_matrix.end()
+                );
+
+            reduce_fun(reduce_buffer);
+
+            totals      = reduce_buffer.data();
+            transitions = reduce_buffer.data() + today_total.size();
+
+        }
+
+        // Recording virus's history
+        for (auto & p : virus_id)
+        {
+
+            for (epiworld_fast_uint s = 0u; s < model->nstates; ++s)
+            {
+
+                hist_virus_date.push_back(model->today());
+                hist_virus_id.push_back(p.second);
+                hist_virus_state.push_back(s);
+                hist_virus_counts.push_back(today_virus[p.second][s]);
+
+            }
+
+        }
+
+        // Recording tool's history
+        for (auto & p : tool_id)
+        {
+
+            for (epiworld_fast_uint s = 0u; s < model->nstates; ++s)
+            {
+
+                hist_tool_date.push_back(model->today());
+                hist_tool_id.push_back(p.second);
+                hist_tool_state.push_back(s);
+                hist_tool_counts.push_back(today_tool[p.second][s]);
+
+            }
+
+        }
+
+        // Recording the overall history
+        for (epiworld_fast_uint s = 0u; s < model->nstates; ++s)
+        {
+            hist_total_date.push_back(model->today());
+            hist_total_nviruses_active.push_back(today_total_nviruses_active);
+            hist_total_state.push_back(s);
+            hist_total_counts.push_back(totals[s]);
+        }
+
+        if (hist_memory_budget > 0u)
+            spill_hist();
+
+        // Only the non-zero cells are stored (column-major, as the matrix)
+        for (size_t s_j = 0u; s_j < model->nstates; ++s_j)
+        {
+            for (size_t s_i = 0u; s_i < model->nstates; ++s_i)
+            {
+
+                int cell = transitions[s_i + s_j * model->nstates];
+                if (cell == 0)
+                    continue;
+
+                hist_transition_from.push_back(static_cast<int>(s_i));
+                hist_transition_to.push_back(static_cast<int>(s_j));
+                hist_transition_counts.push_back(cell);
+
+            }
+        }
+
+        hist_transition_start.push_back(hist_transition_counts.size());
+
+        // Now the diagonal must reflect the state
+        for (size_t s_i = 0u; s_i < model->nstates; ++s_i)
+        {
+
+            for (size_t s_j = 0u; s_j < model->nstates; ++s_j)
+            {
+                
+                if ((s_i != s_j) && (transition_matrix[s_i + s_j * model->nstates] > 0))
+                {
+                    transition_matrix[s_j + s_j * model->nstates] +=
+                        transition_matrix[s_i + s_j * model->nstates];
+
+                    transition_matrix[s_i + s_j * model->nstates] = 0;
+                }
+         
+            }
+
+        }
+
+        #ifdef EPI_DEBUG
+        for (size_t s_i = 0u; s_i < model->nstates; ++s_i)
+        {
+            if (transition_matrix[s_i + s_i * model->nstates] != 
+                today_total[s_i])
+                throw std::logic_error(
+                    "The diagonal of the updated transition Matrix should match the daily totals"
+                    );
+        }
+        #endif
+
+    }
+
+    if (use_event_log && event_log.is_checkpoint(model->today()))
+        record_checkpoint();
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::spill_hist()
+{
+
+    size_t row_bytes = 3u * sizeof(int) + sizeof(epiworld_fast_uint);
+    size_t nbytes    = (hist_virus_date.size() + hist_tool_date.size()) * row_bytes;
+
+    if (nbytes <= hist_memory_budget)
+        return;
+
+    hist_virus_spill.append(
+        hist_virus_date, hist_virus_id, hist_virus_state, hist_virus_counts
+        );
+
+    hist_tool_spill.append(
+        hist_tool_date, hist_tool_id, hist_tool_state, hist_tool_counts
+        );
+
+    // Clearing keeps the capacity, so memory stays around the budget
+    hist_virus_date.clear();
+    hist_virus_id.clear();
+    hist_virus_state.clear();
+    hist_virus_counts.clear();
+
+    hist_tool_date.clear();
+    hist_tool_id.clear();
+    hist_tool_state.clear();
+    hist_tool_counts.clear();
+
+    return;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::set_hist_memory_budget(size_t bytes)
+{
+    hist_memory_budget = bytes;
+}
+
+template<typename TSeq>
+inline size_t DataBase<TSeq>::get_hist_memory_budget() const
+{
+    return hist_memory_budget;
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::set_reduce(
+    std::function<void(std::vector< int > &)> fun
+)
+{
+    reduce_fun = fun;
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::record_state_event(
+    int agent,
+    epiworld_fast_uint from,
+    epiworld_fast_uint to,
+    int virus
+)
+{
+    event_log.push_back(model->today(), agent, from, to, virus);
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::record_checkpoint()
+{
+
+    if (model->nstates > static_cast< size_t >(UINT16_MAX))
+        throw std::range_error(
+            "The event log supports up to " + std::to_string(UINT16_MAX) +
+            " states."
+            );
+
+    std::vector< std::uint16_t > states;
+    states.reserve(model->size());
+    for (auto & p : model->get_agents())
+        states.push_back(static_cast< std::uint16_t >(p.get_state()));
+
+    event_log.checkpoint(model->today(), std::move(states));
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::record_hash()
+{
+
+    std::uint64_t hash = hist_hash.size() > 0u ? hist_hash.back() : 0u;
+
+    hash = hash_combine64(hash, static_cast< std::uint32_t >(model->today()));
+
+    for (auto & c : today_total)
+        hash = hash_combine64(hash, static_cast< std::uint32_t >(c));
+
+    // Only the non-zero cells (including the location)
+    for (size_t i = 0u; i < transition_matrix.size(); ++i)
+    {
+
+        if (transition_matrix[i] == 0)
+            continue;
+
+        hash = hash_combine64(hash, i);
+        hash = hash_combine64(
+            hash, static_cast< std::uint32_t >(transition_matrix[i])
+            );
+
+    }
+
+    // Transmissions since the last record
+    for (size_t i = hash_ntransmissions; i < transmissions.size(); ++i)
+    {
+
+        hash = hash_combine64(hash, static_cast< std::uint32_t >(transmissions.date(i)));
+        hash = hash_combine64(hash, static_cast< std::uint32_t >(transmissions.source(i)));
+        hash = hash_combine64(hash, static_cast< std::uint32_t >(transmissions.target(i)));
+        hash = hash_combine64(hash, static_cast< std::uint32_t >(transmissions.virus(i)));
+
+    }
+
+    hash_ntransmissions = transmissions.size();
+
+    hist_hash.push_back(hash);
+
+}
+
+template<typename TSeq>
+inline std::uint64_t DataBase<TSeq>::get_hash() const noexcept
+{
+    return hist_hash.size() > 0u ? hist_hash.back() : 0u;
+}
+
+template<typename TSeq>
+inline const std::vector< std::uint64_t > & DataBase<TSeq>::get_hist_hash() const noexcept
+{
+    return hist_hash;
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::event_log_on(int checkpoint_freq)
+{
+    use_event_log = true;
+    event_log     = EventLog(checkpoint_freq);
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::event_log_off()
+{
+    use_event_log = false;
+    event_log.clear();
+}
+
+template<typename TSeq>
+inline bool DataBase<TSeq>::is_event_log_on() const noexcept
+{
+    return use_event_log;
+}
+
+template<typename TSeq>
+inline const EventLog & DataBase<TSeq>::get_event_log() const
+{
+    return event_log;
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_states_at(
+    int day,
+    std::vector< epiworld_fast_uint > & states
+) const
+{
+
+    if (!use_event_log)
+        throw std::logic_error(
+            "The event log is off. See DataBase::event_log_on()."
+            );
+
+    if (day > model->today())
+        throw std::range_error(
+            "The day " + std::to_string(day) + " is after the current day (" +
+            std::to_string(model->today()) + ")."
+            );
+
+    event_log.reconstruct(day, states);
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::record_virus(Virus<TSeq> & v)
+{
+
+    // If no sequence, then need to add one. This is regardless of the case
+    if (v.get_sequence() == nullptr)
+        v.set_sequence(default_sequence<TSeq>(
+            static_cast<int>(virus_name.size())
+            ));
+
+    // Negative id -> virus hasn't been recorded
+    if (v.get_id() < 0)
+    {
+
+
+        // Generating the hash
+        if (!v.has_fingerprint())
+            v.set_fingerprint(seq_fingerprint(*v.get_sequence()));
+
+        int found_id;
+        std::uint64_t key = registry_key(
+            virus_id, virus_sequence, v.get_fingerprint(), *v.get_sequence(),
+            &found_id
+            );
+
+        epiworld_fast_uint new_id = virus_id.size();
+        virus_id.insert(key, static_cast< int >(new_id));
+        virus_name.push_back(v.get_name());
+        virus_sequence.push_back(*v.get_sequence());
+        virus_origin_date.push_back(model->today());
+        
+        virus_parent_id.push_back(v.get_id()); // Must be -99
+        
+        today_virus.push_back({});
+        today_virus[new_id].resize(model->nstates, 0);
+       
+        // Updating the variant
+        v.set_id(new_id);
+        v.set_date(model->today());
+
+        today_total_nviruses_active++;
+
+    } else { // In this case, the virus is already on record, need to make sure
+             // The new sequence is new.
+
+        // Updating registry (O(1) if the mutation updated the fingerprint)
+        if (!v.has_fingerprint())
+            v.set_fingerprint(seq_fingerprint(*v.get_sequence()));
+
+        epiworld_fast_uint old_id = v.get_id();
+        epiworld_fast_uint new_id;
+        int found_id;
+        std::uint64_t key = registry_key(
+            virus_id, virus_sequence, v.get_fingerprint(), *v.get_sequence(),
+            &found_id
+            );
+
+        // If the sequence is new, then it means that the
+        if (found_id < 0)
+        {
+
+            new_id = virus_id.size();
+            virus_id.insert(key, static_cast< int >(new_id));
+            virus_name.push_back(v.get_name());
+            virus_sequence.push_back(*v.get_sequence());
+            virus_origin_date.push_back(model->today());
+            
+            virus_parent_id.push_back(old_id);
+            
+            today_virus.push_back({});
+            today_virus[new_id].resize(model->nstates, 0);
+        
+            // Updating the variant
+            v.set_id(new_id);
+            v.set_date(model->today());
+
+            today_total_nviruses_active++;
+
+        } else {
+
+            // Finding the id
+            new_id = static_cast< epiworld_fast_uint >(found_id);
+
+            // Reflecting the change
+            v.set_id(new_id);
+            v.set_date(virus_origin_date[new_id]);
+
+        }
+
+        // Moving statistics (only if we are affecting an individual)
+        if (v.get_agent() != nullptr)
+        {
+            // Correcting math
+            epiworld_fast_uint tmp_state = v.get_agent()->get_state();
+            today_virus[old_id][tmp_state]--;
+            today_virus[new_id][tmp_state]++;
+
+        }
+
+    }
+    
+    return;
+
+} 
+
+template<typename TSeq>
+inline std::uint64_t DataBase<TSeq>::registry_key(
+    const SeqRegistry & registry,
+    const std::vector< TSeq > & sequences,
+    std::uint64_t fingerprint,
+    const TSeq & seq,
+    int * found
+) const
+{
+
+    std::uint64_t key = fingerprint;
+    int id = registry.find(key);
+
+    // Same fingerprint, different sequence
+    while ((id >= 0) && !(sequences[static_cast< size_t >(id)] == seq))
+    {
+        key = hash_combine64(key, 0x9E3779B97F4A7C15ull);
+        id  = registry.find(key);
+    }
+
+    *found = id;
+
+    return key;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::set_seq_hasher(
+    std::function<std::vector<int>(TSeq)> fun
+)
+{
+
+    seq_fingerprint = [fun](const TSeq & x) -> std::uint64_t {
+        return default_seq_fingerprint<std::vector<int>>(fun(x));
+    };
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::set_seq_fingerprint(
+    std::function<std::uint64_t(const TSeq&)> fun
+)
+{
+    seq_fingerprint = fun;
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::record_tool(Tool<TSeq> & t)
+{
+
+    if (t.get_sequence() == nullptr)
+        t.set_sequence(default_sequence<TSeq>(
+            static_cast<int>(tool_name.size())
+        ));
+
+    if (t.get_id() < 0) 
+    {
+
+        if (!t.has_fingerprint())
+            t.set_fingerprint(seq_fingerprint(*t.get_sequence()));
+
+        int found_id;
+        std::uint64_t key = registry_key(
+            tool_id, tool_sequence, t.get_fingerprint(), *t.get_sequence(),
+            &found_id
+            );
+
+        epiworld_fast_uint new_id = tool_id.size();
+        tool_id.insert(key, static_cast< int >(new_id));
+        tool_name.push_back(t.get_name());
+        tool_sequence.push_back(*t.get_sequence());
+        tool_origin_date.push_back(model->today());
+                
+        today_tool.push_back({});
+        today_tool[new_id].resize(model->nstates, 0);
+
+        // Updating the tool
+        t.set_id(new_id);
+        t.set_date(model->today());
+
+    } else {
+
+        // Updating registry
+        if (!t.has_fingerprint())
+            t.set_fingerprint(seq_fingerprint(*t.get_sequence()));
+
+        epiworld_fast_uint old_id = t.get_id();
+        epiworld_fast_uint new_id;
+        int found_id;
+        std::uint64_t key = registry_key(
+            tool_id, tool_sequence, t.get_fingerprint(), *t.get_sequence(),
+            &found_id
+            );
+        
+        if (found_id < 0)
+        {
+
+            new_id = tool_id.size();
+            tool_id.insert(key, static_cast< int >(new_id));
+            tool_name.push_back(t.get_name());
+            tool_sequence.push_back(*t.get_sequence());
+            tool_origin_date.push_back(model->today());
+                    
+            today_tool.push_back({});
+            today_tool[new_id].resize(model->nstates, 0);
+
+            // Updating the tool
+            t.set_id(new_id);
+            t.set_date(model->today());
+
+        } else {
+
+            // Finding the id
+            new_id = static_cast< epiworld_fast_uint >(found_id);
+
+            // Reflecting the change
+            t.set_id(new_id);
+            t.set_date(tool_origin_date[new_id]);
+
+        }
+
+        // Moving statistics (only if we are affecting an individual)
+        if (t.get_agent() != nullptr)
+        {
+            // Correcting math
+            epiworld_fast_uint tmp_state = t.get_agent()->get_state();
+            today_tool[old_id][tmp_state]--;
+            today_tool[new_id][tmp_state]++;
+
+        }
+
+    }
+
+    
+    
+    return;
+} 
+
+template<typename TSeq>
+inline size_t DataBase<TSeq>::size() const
+{
+    return virus_id.size();
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::update_state(
+        epiworld_fast_uint prev_state,
+        epiworld_fast_uint new_state,
+        bool undo
+) {
+
+    if (undo)
+    {
+
+        today_total[prev_state]++;
+        today_total[new_state]--;
+        
+    } else {
+
+        today_total[prev_state]--;
+        today_total[new_state]++;
+
+    }
+
+    record_transition(prev_state, new_state, undo);
+    
+    return;
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::update_virus(
+        epiworld_fast_uint virus_id,
+        epiworld_fast_uint prev_state,
+        epiworld_fast_uint new_state
+) {
+
+    today_virus[virus_id][prev_state]--;
+    today_virus[virus_id][new_state]++;
+
+    return;
+    
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::update_tool(
+        epiworld_fast_uint tool_id,
+        epiworld_fast_uint prev_state,
+        epiworld_fast_uint new_state
+) {
+
+
+    today_tool[tool_id][prev_state]--;    
+    today_tool[tool_id][new_state]++;
+
+    return;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::record_transition(
+    epiworld_fast_uint from,
+    epiworld_fast_uint to,
+    bool undo
+) {
+
+    if (undo)
+    {   
+
+        transition_matrix[to * model->nstates + from]--;
+        transition_matrix[from * model->nstates + from]++;
+
+    } else {
+
+        transition_matrix[to * model->nstates + from]++;
+        transition_matrix[from * model->nstates + from]--;
+
+    }
+
+    #ifdef EPI_DEBUG
+    if (transition_matrix[from * model->nstates + from] < 0)
+        throw std::logic_error("An entry in transition matrix is negative.");
+    #endif
+
+}
+
+template<typename TSeq>
+inline int DataBase<TSeq>::get_today_total(
+    std::string what
+) const
+{
+
+    for (auto i = 0u; i < model->states_labels.size(); ++i)
+    {
+        if (model->states_labels[i] == what)
+            return today_total[i];
+    }
+
+    throw std::range_error("The value '" + what + "' is not in the model.");
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_today_total(
+    std::vector< std::string > * state,
+    std::vector< int > * counts
+) const
+{
+    if (state != nullptr)
+        (*state) = model->states_labels;
+
+    if (counts != nullptr)
+        *counts = today_total;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_today_virus(
+    std::vector< std::string > & state,
+    std::vector< int > & id,
+    std::vector< int > & counts
+    ) const
+{
+      
+    state.resize(today_virus.size(), "");
+    id.resize(today_virus.size(), 0);
+    counts.resize(today_virus.size(),0);
+
+    int n = 0u;
+    for (epiworld_fast_uint v = 0u; v < today_virus.size(); ++v)
+        for (epiworld_fast_uint s = 0u; s < model->states_labels.size(); ++s)
+        {
+            state[n]   = model->states_labels[s];
+            id[n]       = static_cast<int>(v);
+            counts[n++] = today_virus[v][s];
+
+        }
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_hist_total(
+    std::vector< int > * date,
+    std::vector< std::string > * state,
+    std::vector< int > * counts
+) const
+{
+
+    if (date != nullptr)
+        *date = hist_total_date;
+
+    if (state != nullptr)
+    {
+        state->resize(hist_total_state.size(), "");
+        for (epiworld_fast_uint i = 0u; i < hist_total_state.size(); ++i)
+            state->operator[](i) = model->states_labels[hist_total_state[i]];
+    }
+
+    if (counts != nullptr)
+        *counts = hist_total_counts;
+
+    return;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_hist_virus(
+    std::vector< int > & date,
+    std::vector< int > & id,
+    std::vector< std::string > & state,
+    std::vector< int > & counts
+) const {
+
+    std::vector< std::string > labels;
+    labels = model->states_labels;
+
+    if (hist_virus_spill.size() == 0u)
+    {
+
+        date = hist_virus_date;
+        id = hist_virus_id;
+        state.resize(hist_virus_state.size(), "");
+        for (epiworld_fast_uint i = 0u; i < hist_virus_state.size(); ++i)
+            state[i] = labels[hist_virus_state[i]];
+
+        counts = hist_virus_counts;
+
+        return;
+
+    }
+
+    // Spilled rows go first
+    std::vector< epiworld_fast_uint > state_ids;
+    date.clear();
+    id.clear();
+    counts.clear();
+    hist_virus_spill.read(date, id, state_ids, counts);
+
+    date.insert(date.end(), hist_virus_date.begin(), hist_virus_date.end());
+    id.insert(id.end(), hist_virus_id.begin(), hist_virus_id.end());
+    state_ids.insert(state_ids.end(), hist_virus_state.begin(), hist_virus_state.end());
+    counts.insert(counts.end(), hist_virus_counts.begin(), hist_virus_counts.end());
+
+    state.resize(state_ids.size(), "");
+    for (size_t i = 0u; i < state_ids.size(); ++i)
+        state[i] = labels[state_ids[i]];
+
+    return;
+
+}
+
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_hist_tool(
+    std::vector< int > & date,
+    std::vector< int > & id,
+    std::vector< std::string > & state,
+    std::vector< int > & counts
+) const {
+
+    std::vector< std::string > labels;
+    labels = model->states_labels;
+
+    if (hist_tool_spill.size() == 0u)
+    {
+
+        date = hist_tool_date;
+        id = hist_tool_id;
+        state.resize(hist_tool_state.size(), "");
+        for (size_t i = 0u; i < hist_tool_state.size(); ++i)
+            state[i] = labels[hist_tool_state[i]];
+
+        counts = hist_tool_counts;
+
+        return;
+
+    }
+
+    // Spilled rows go first
+    std::vector< epiworld_fast_uint > state_ids;
+    date.clear();
+    id.clear();
+    counts.clear();
+    hist_tool_spill.read(date, id, state_ids, counts);
+
+    date.insert(date.end(), hist_tool_date.begin(), hist_tool_date.end());
+    id.insert(id.end(), hist_tool_id.begin(), hist_tool_id.end());
+    state_ids.insert(state_ids.end(), hist_tool_state.begin(), hist_tool_state.end());
+    counts.insert(counts.end(), hist_tool_counts.begin(), hist_tool_counts.end());
+
+    state.resize(state_ids.size(), "");
+    for (size_t i = 0u; i < state_ids.size(); ++i)
+        state[i] = labels[state_ids[i]];
+
+    return;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_hist_transition_matrix_day(
+    size_t step,
+    std::vector< int > & res
+) const
+{
+
+    size_t n_states = model->nstates;
+
+    if ((step + 1u) >= hist_transition_start.size())
+        throw std::range_error(
+            "The step " + std::to_string(step) +
+            " is out of range. There are only " +
+            std::to_string(hist_transition_start.size() - 1u) +
+            " recorded days."
+            );
+
+    res.resize(n_states * n_states);
+    std::fill(res.begin(), res.end(), 0);
+
+    for (
+        size_t k = hist_transition_start[step];
+        k < hist_transition_start[step + 1u];
+        ++k
+        )
+        res[hist_transition_from[k] + hist_transition_to[k] * n_states] =
+            hist_transition_counts[k];
+
+    return;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_hist_transition_matrix(
+    std::vector< std::string > & state_from,
+    std::vector< std::string > & state_to,
+    std::vector< int > & date,
+    std::vector< int > & counts,
+    bool skip_zeros
+) const
+{
+
+    size_t n_states = model->nstates;
+    size_t n_steps  = hist_transition_start.size() - 1u;
+    size_t n = skip_zeros ?
+        hist_transition_counts.size() : n_steps * n_states * n_states;
+    
+    // Clearing the previous vectors
+    state_from.clear();
+    state_to.clear();
+    date.clear();
+    counts.clear();
+
+    // If n is zero, then we are done
+    if (n == 0u)
+        return;
+
+    // Reserving space
+    state_from.reserve(n);
+    state_to.reserve(n);
+    date.reserve(n);
+    counts.reserve(n);
+
+    for (size_t step = 0u; step < n_steps; ++step)
+    {
+
+        int step_date = hist_total_date[step * n_states];
+
+        // The sparse history is stored in column-major order, so walking
+        // the dense matrix just requires a cursor over the day's entries.
+        size_t k     = hist_transition_start[step];
+        size_t k_end = hist_transition_start[step + 1u];
+
+        for (size_t j = 0u; j < n_states; ++j) // Column major storage
+        {
+            for (size_t i = 0u; i < n_states; ++i)
+            {
+
+                int v = 0;
+                if (
+                    (k < k_end) &&
+                    (hist_transition_from[k] == static_cast<int>(i)) &&
+                    (hist_transition_to[k] == static_cast<int>(j))
+                    )
+                    v = hist_transition_counts[k++];
+
+                // If we are skipping the zeros and it is zero, then don't save
+                if (skip_zeros && v == 0)
+                    continue;
+                                
+                state_from.push_back(model->states_labels[i]);
+                state_to.push_back(model->states_labels[j]);
+                date.push_back(step_date);
+                counts.push_back(v);
+
+            }
+
+        }
+    }
+
+    return;
+
+
+}
+
+template<typename TSeq>
+inline HistView DataBase<TSeq>::get_hist_total_view(
+    int day_from,
+    int day_to,
+    int state
+) const
+{
+
+    size_t ns    = model->nstates;
+    size_t nrows = (ns > 0u) ? hist_total_date.size() / ns : 0u;
+
+    // Totals are stored by day, so the range is found on the first state
+    size_t from, to;
+    view_date_range(
+        DataView< int >(hist_total_date.data(), nrows, ns),
+        day_from, day_to, &from, &to
+        );
+
+    if (state < 0)
+        return HistView(
+            DataView< int >(hist_total_date.data() + from * ns, (to - from) * ns),
+            DataView< int >(),
+            DataView< epiworld_fast_uint >(hist_total_state.data() + from * ns, (to - from) * ns),
+            DataView< int >(hist_total_counts.data() + from * ns, (to - from) * ns)
+        );
+
+    if (static_cast< size_t >(state) >= ns)
+        throw std::range_error(
+            "The state " + std::to_string(state) + " is out of range. " +
+            "There are only " + std::to_string(ns) + " states."
+            );
+
+    // A single state is a strided view
+    size_t offset = from * ns + static_cast< size_t >(state);
+    return HistView(
+        DataView< int >(hist_total_date.data() + offset, to - from, ns),
+        DataView< int >(),
+        DataView< epiworld_fast_uint >(hist_total_state.data() + offset, to - from, ns),
+        DataView< int >(hist_total_counts.data() + offset, to - from, ns)
+    );
+
+}
+
+template<typename TSeq>
+inline HistView DataBase<TSeq>::get_hist_virus_view(
+    int day_from,
+    int day_to,
+    int id,
+    int state
+) const
+{
+
+    // Rows moved to disk are streamed by the view's iterators
+    size_t spill_from, spill_to;
+    hist_virus_spill.get_range(day_from, day_to, &spill_from, &spill_to);
+
+    size_t from, to;
+    view_date_range(
+        DataView< int >(hist_virus_date), day_from, day_to, &from, &to
+        );
+
+    return HistView(
+        DataView< int >(hist_virus_date).subview(from, to),
+        DataView< int >(hist_virus_id).subview(from, to),
+        DataView< epiworld_fast_uint >(hist_virus_state).subview(from, to),
+        DataView< int >(hist_virus_counts).subview(from, to),
+        id,
+        state,
+        &hist_virus_spill,
+        spill_from,
+        spill_to
+    );
+
+}
+
+template<typename TSeq>
+inline HistView DataBase<TSeq>::get_hist_tool_view(
+    int day_from,
+    int day_to,
+    int id,
+    int state
+) const
+{
+
+    // Rows moved to disk are streamed by the view's iterators
+    size_t spill_from, spill_to;
+    hist_tool_spill.get_range(day_from, day_to, &spill_from, &spill_to);
+
+    size_t from, to;
+    view_date_range(
+        DataView< int >(hist_tool_date), day_from, day_to, &from, &to
+        );
+
+    return HistView(
+        DataView< int >(hist_tool_date).subview(from, to),
+        DataView< int >(hist_tool_id).subview(from, to),
+        DataView< epiworld_fast_uint >(hist_tool_state).subview(from, to),
+        DataView< int >(hist_tool_counts).subview(from, to),
+        id,
+        state,
+        &hist_tool_spill,
+        spill_from,
+        spill_to
+    );
+
+}
+
+template<typename TSeq>
+inline TransitionView DataBase<TSeq>::get_hist_transition_matrix_view(
+    int day_from,
+    int day_to
+) const
+{
+
+    size_t ns     = model->nstates;
+    size_t nsteps = hist_transition_start.size() - 1u;
+
+    size_t from, to;
+    view_date_range(
+        DataView< int >(hist_total_date.data(), nsteps, ns),
+        day_from, day_to, &from, &to
+        );
+
+    size_t k_from = hist_transition_start[from];
+    size_t k_to   = hist_transition_start[to];
+
+    return TransitionView(
+        DataView< int >(hist_total_date.data() + from * ns, to - from, ns),
+        DataView< size_t >(hist_transition_start).subview(from, to + 1u),
+        DataView< int >(hist_transition_from).subview(k_from, k_to),
+        DataView< int >(hist_transition_to).subview(k_from, k_to),
+        DataView< int >(hist_transition_counts).subview(k_from, k_to)
+    );
+
+}
+
+template<typename TSeq>
+inline TransmissionView DataBase<TSeq>::get_transmissions_view(
+    int day_from,
+    int day_to,
+    int virus
+) const
+{
+
+    // Transmissions are recorded as they happen, so dates are sorted
+    auto cmp_lower = [](const TransmissionEvent & e, int d) {return e.date < d;};
+    auto cmp_upper = [](int d, const TransmissionEvent & e) {return d < e.date;};
+
+    size_t from = static_cast< size_t >(std::lower_bound(
+        transmissions.begin(), transmissions.end(), day_from, cmp_lower
+        ) - transmissions.begin());
+
+    size_t to = transmissions.size();
+    if (day_to >= 0)
+        to = static_cast< size_t >(std::upper_bound(
+            transmissions.begin(), transmissions.end(), day_to, cmp_upper
+            ) - transmissions.begin());
+
+    if (to < from)
+        to = from;
+
+    return TransmissionView(&transmissions, from, to, virus);
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_transmissions(
+    std::vector<int> & date,
+    std::vector<int> & source,
+    std::vector<int> & target,
+    std::vector<int> & virus,
+    std::vector<int> & source_exposure_date
+) const 
+{
+
+    size_t nevents = transmissions.size();
+
+    date.resize(nevents);
+    source.resize(nevents);
+    target.resize(nevents);
+    virus.resize(nevents);
+    source_exposure_date.resize(nevents);
+
+    get_transmissions(
+        &date[0u],
+        &source[0u],
+        &target[0u],
+        &virus[0u],
+        &source_exposure_date[0u]
+    );
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::get_transmissions(
+    int * date,
+    int * source,
+    int * target,
+    int * virus,
+    int * source_exposure_date
+) const 
+{
+
+    size_t i = 0u;
+    for (const auto & e : transmissions)
+    {
+
+        *(date + i) = e.date;
+        *(source + i) = e.source;
+        *(target + i) = e.target;
+        *(virus + i) = e.virus;
+        *(source_exposure_date + i) = e.source_exposure_date;
+        ++i;
+
+    }
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::write_data(
+    std::string fn_virus_info,
+    std::string fn_virus_hist,
+    std::string fn_tool_info,
+    std::string fn_tool_hist,
+    std::string fn_total_hist,
+    std::string fn_transmission,
+    std::string fn_transition,
+    std::string fn_reproductive_number,
+    std::string fn_generation_time
+) const
+{
+
+    if (fn_virus_info != "")
+    {
+        std::ofstream file_virus_info(fn_virus_info, std::ios_base::out);
+
+        // Check if the file exists and throw an error if it doesn't
+        if (!file_virus_info)
+        {
+            throw std::runtime_error(
+                "Could not open file \"" + fn_virus_info +
+                "\" for writing.")
+                ;
+        }
+
+
+        file_virus_info <<
+        #ifdef EPI_DEBUG
+            "thread" << "virus_id " << "virus " << "virus_sequence " << "date_recorded " << "parent\n";
+        #else
+            "virus_id " << "virus " << "virus_sequence " << "date_recorded " << "parent\n";
+        #endif
+
+        for (const auto & v : virus_id)
+        {
+            int id = v.second;
+            file_virus_info <<
+                #ifdef EPI_DEBUG
+                EPI_GET_THREAD_ID() << " " <<
+                #endif
+                id << " \"" <<
+                virus_name[id] << "\" " <<
+                seq_writer(virus_sequence[id]) << " " <<
+                virus_origin_date[id] << " " <<
+                virus_parent_id[id] << "\n";
+        }
+
+    }
+
+    if (fn_virus_hist != "")
+    {
+        std::ofstream file_virus(fn_virus_hist, std::ios_base::out);
+        
+        // Repeat the same error if the file doesn't exists
+        if (!file_virus)
+        {
+            throw std::runtime_error(
+                "Could not open file \"" + fn_virus_hist +
+                "\" for writing.")
+                ;
+        }
+
+        file_virus <<
+            #ifdef EPI_DEBUG
+            "thread "<< "date " << "id " << "state " << "n\n";
+            #else
+            "date " << "virus_id virus" << "state " << "n\n";
+            #endif
+
+        auto write_row = [&](
+            int date, int id, epiworld_fast_uint state, int counts
+        ) -> void {
+            file_virus <<
+                #ifdef EPI_DEBUG
+                EPI_GET_THREAD_ID() << " " <<
+                #endif
+                date << " " <<
+                id << " \"" <<
+                virus_name[id] << "\" " <<
+                model->states_labels[state] << " " <<
+                counts << "\n";
+        };
+
+        // Spilled rows (if any) are streamed back from disk first
+        hist_virus_spill.for_each(write_row);
+
+        for (epiworld_fast_uint i = 0; i < hist_virus_id.size(); ++i)
+            write_row(
+                hist_virus_date[i], hist_virus_id[i],
+                hist_virus_state[i], hist_virus_counts[i]
+                );
+    }
+
+    if (fn_tool_info != "")
+    {
+        std::ofstream file_tool_info(fn_tool_info, std::ios_base::out);
+
+        // Repeat the same error if the file doesn't exists
+        if (!file_tool_info)
+        {
+            throw std::runtime_error(
+                "Could not open file \"" + fn_tool_info +
+                "\" for writing.")
+                ;
+        }
+
+        file_tool_info <<
+            #ifdef EPI_DEBUG
+            "thread " << 
+            #endif
+            "id " << "tool_name " << "tool_sequence " << "date_recorded\n";
+
+        for (const auto & t : tool_id)
+        {
+            int id = t.second;
+            file_tool_info <<
+                #ifdef EPI_DEBUG
+                EPI_GET_THREAD_ID() << " " <<
+                #endif
+                id << " \"" <<
+                tool_name[id] << "\" " <<
+                seq_writer(tool_sequence[id]) << " " <<
+                tool_origin_date[id] << "\n";
+        }
+
+    }
+
+    if (fn_tool_hist != "")
+    {
+        std::ofstream file_tool_hist(fn_tool_hist, std::ios_base::out);
+
+        // Repeat the same error if the file doesn't exists
+        if (!file_tool_hist)
+        {
+            throw std::runtime_error(
+                "Could not open file \"" + fn_tool_hist +
+                "\" for writing.")
+                ;
+        }
+        
+        file_tool_hist <<
+            #ifdef EPI_DEBUG
+            "thread " << 
+            #endif
+            "date " << "id " << "state " << "n\n";
+
+        auto write_row = [&](
+            int date, int id, epiworld_fast_uint state, int counts
+        ) -> void {
+            file_tool_hist <<
+                #ifdef EPI_DEBUG
+                EPI_GET_THREAD_ID() << " " <<
+                #endif
+                date << " " <<
+                id << " " <<
+                model->states_labels[state] << " " <<
+                counts << "\n";
+        };
+
+        // Spilled rows (if any) are streamed back from disk first
+        hist_tool_spill.for_each(write_row);
+
+        for (epiworld_fast_uint i = 0; i < hist_tool_id.size(); ++i)
+            write_row(
+                hist_tool_date[i], hist_tool_id[i],
+                hist_tool_state[i], hist_tool_counts[i]
+                );
+    }
+
+    if (fn_total_hist != "")
+    {
+        std::ofstream file_total(fn_total_hist, std::ios_base::out);
+
+        // Repeat the same error if the file doesn't exists
+        if (!file_total)
+        {
+            throw std::runtime_error(
+                "Could not open file \"" + fn_total_hist +
+                "\" for writing.")
+                ;
+        }
+
+        file_total <<
+            #ifdef EPI_DEBUG
+            "thread " << 
+            #endif
+            "date " << "nviruses " << "state " << "counts\n";
+
+        for (epiworld_fast_uint i = 0; i < hist_total_date.size(); ++i)
+            file_total <<
+                #ifdef EPI_DEBUG
+                EPI_GET_THREAD_ID() << " " <<
+                #endif
+                hist_total_date[i] << " " <<
+                hist_total_nviruses_active[i] << " \"" <<
+                model->states_labels[hist_total_state[i]] << "\" " << 
+                hist_total_counts[i] << "\n";
+    }
+
+    if (fn_transmission != "")
+    {
+        std::ofstream file_transmission(fn_transmission, std::ios_base::out);
+
+        // Repeat the same error if the file doesn't exists
+        if (!file_transmission)
+        {
+            throw std::runtime_error(
+                "Could not open file \"" + fn_transmission +
+                "\" for writing.")
+                ;
+        }
+
+        file_transmission <<
+            #ifdef EPI_DEBUG
+            "thread " << 
+            #endif
+            "date " << "virus_id virus " << "source_exposure_date " << "source " << "target\n";
+
+        for (const auto & e : transmissions)
+            file_transmission <<
+                #ifdef EPI_DEBUG
+                EPI_GET_THREAD_ID() << " " <<
+                #endif
+                e.date << " " <<
+                e.virus << " \"" <<
+                virus_name[e.virus] << "\" " <<
+                e.source_exposure_date << " " <<
+                model->get_agent_original_id(e.source) << " " <<
+                model->get_agent_original_id(e.target) << "\n";
+                
+    }
+
+    if (fn_transition != "")
+    {
+        std::ofstream file_transition(fn_transition, std::ios_base::out);
+
+        // Repeat the same error if the file doesn't exists
+        if (!file_transition)
+        {
+            throw std::runtime_error(
+                "Could not open file \"" + fn_transition +
+                "\" for writing.")
+                ;
+        }
+
+        file_transition <<
+            #ifdef EPI_DEBUG
+            "thread " << 
+            #endif
+            "date " << "from " << "to " << "counts\n";
+
+        int ns = model->nstates;
+        size_t n_steps = hist_transition_start.size() - 1u;
+        std::vector< int > tmat(ns * ns);
+
+        for (size_t i = 0u; i < n_steps; ++i)
+        {
+
+            get_hist_transition_matrix_day(i, tmat);
+
+            for (int from = 0u; from < ns; ++from)
+                for (int to = 0u; to < ns; ++to)
+                    file_transition <<
+                        #ifdef EPI_DEBUG
+                        EPI_GET_THREAD_ID() << " " <<
+                        #endif
+                        hist_total_date[i * ns] << " " <<
+                        model->states_labels[from] << " " <<
+                        model->states_labels[to] << " " <<
+                        tmat[to * ns + from] << "\n";
+                
+        }
+                
+    }
+
+    if (fn_reproductive_number != "")
+        reproductive_number(fn_reproductive_number);
+
+    if (fn_generation_time != "")
+        generation_time(fn_generation_time);
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::record_transmission(
+    int i,
+    int j,
+    int virus,
+    int i_expo_date
+) {
+
+    transmissions.push_back(model->today(), i, j, virus, i_expo_date);
+
+}
+
+template<typename TSeq>
+inline size_t DataBase<TSeq>::get_n_viruses() const
+{
+    return virus_id.size();
+}
+
+template<typename TSeq>
+inline size_t DataBase<TSeq>::get_n_tools() const
+{
+    return tool_id.size();
+}
+
+
+template<typename TSeq>
+inline void DataBase<TSeq>::set_user_data(
+    std::vector< std::string > names
+)
+{
+    user_data = UserData<TSeq>(names);
+    user_data.model = model;
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::add_user_data(
+    std::vector< epiworld_double > x
+)
+{
+
+    user_data.add(x);
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::add_user_data(
+    epiworld_fast_uint k,
+    epiworld_double x
+)
+{
+
+    user_data.add(k, x);
+
+}
+
+template<typename TSeq>
+inline UserData<TSeq> & DataBase<TSeq>::get_user_data()
+{
+    return user_data;
+}
+
+template<typename TSeq>
+inline MapVec_type<int,int> DataBase<TSeq>::reproductive_number()
+const {
+
+    // Checking size
+    MapVec_type<int,int> map;
+
+    // Number of digits of maxid
+    for (const auto & e : transmissions)
+    {
+        // Fabricating id
+        std::vector< int > h = {
+            e.virus,
+            e.source,
+            e.source_exposure_date
+        };
+
+        // Adding to counter
+        if (map.find(h) == map.end())
+            map[h] = 1;
+        else
+            map[h]++;
+
+        // The target is added
+        std::vector< int > h_target = {
+            e.virus,
+            e.target,
+            e.date
+        };
+
+        map[h_target] = 0;
+        
+    }
+
+    return map;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::reproductive_number(
+    std::string fn
+) const {
+
+
+    auto map = reproductive_number();
+
+    std::ofstream fn_file(fn, std::ios_base::out);
+
+    // Repeat the same error if the file doesn't exists
+    if (!fn_file)
+    {
+        throw std::runtime_error(
+            "Could not open file \"" + fn +
+            "\" for writing.")
+            ;
+    }
+
+    fn_file << 
+        #ifdef EPI_DEBUG
+        "thread " <<
+        #endif
+        "virus_id virus source source_exposure_date rt\n";
+
+
+    for (auto & m : map)
+        fn_file <<
+            #ifdef EPI_DEBUG
+            EPI_GET_THREAD_ID() << " " <<
+            #endif
+            m.first[0u] << " \"" <<
+            virus_name[m.first[0u]] << "\" " <<
+            model->get_agent_original_id(m.first[1u]) << " " <<
+            m.first[2u] << " " <<
+            m.second << "\n";
+
+    return;
+
+}
+
+template<typename TSeq>
+inline std::vector< epiworld_double > DataBase<TSeq>::transition_probability(
+    bool print
+) const {
+
+    auto states_labels = model->get_states();
+    size_t n_state = states_labels.size();
+    size_t n_days   = model->get_ndays();
+    size_t n_steps  = hist_transition_start.size() - 1u;
+    std::vector< epiworld_double > res(n_state * n_state, 0.0);
+    std::vector< epiworld_double > days_to_include(n_state, 0.0);
+
+    if (n_days > n_steps)
+        n_days = n_steps;
+
+    for (size_t t = 1; t < n_days; ++t)
+    {
+
+        const int * daily_total = &hist_total_counts[(t - 1) * n_state];
+
+        for (size_t s_i = 0; s_i < n_state; ++s_i)
+            if (daily_total[s_i] != 0)
+                days_to_include[s_i] += 1.0; 
+
+        // Zero cells add nothing, so only the sparse entries are visited
+        for (
+            size_t k = hist_transition_start[t];
+            k < hist_transition_start[t + 1u];
+            ++k
+            )
+        {
+
+            size_t s_i = static_cast<size_t>(hist_transition_from[k]);
+            size_t s_j = static_cast<size_t>(hist_transition_to[k]);
+
+            if (daily_total[s_i] == 0)
+                continue;
+
+            #ifdef EPI_DEBUG
+            if (hist_transition_counts[k] > daily_total[s_i])
+                throw std::logic_error(
+                    "The entry in hist_transition_counts cannot have more elememnts than the total"
+                    );
+            #endif
+
+            res[s_i + s_j * n_state] += (
+                static_cast<epiworld_double>(hist_transition_counts[k]) /
+                static_cast<epiworld_double>(daily_total[s_i])
+            );
+
+        }
+
+    }
+
+    for (size_t s_i = 0; s_i < n_state; ++s_i)
+    {
+        for (size_t s_j = 0; s_j < n_state; ++s_j)
+            res[s_i + s_j * n_state] /= days_to_include[s_i];
+    }
+
+    if (print)
+    {   
+
+        size_t nchar = 0u;
+        for (auto & l : states_labels)
+            if (l.length() > nchar)
+                nchar = l.length();
+
+        std::string fmt = " - %-" + std::to_string(nchar) + "s";
+        
+        printf_epiworld("\nTransition Probabilities:\n");
+        for (size_t s_i = 0u; s_i < n_state; ++s_i)
+        {
+            printf_epiworld(fmt.c_str(), states_labels[s_i].c_str());
+            for (size_t s_j = 0u; s_j < n_state; ++s_j)
+            {
+                if (std::isnan(res[s_i + s_j * n_state]))
+                {
+                    printf_epiworld("     -");
+                } else {
+                    printf_epiworld(" % 4.2f", res[s_i + s_j * n_state]);
+                }
+            }
+            printf_epiworld("\n");
+        }
+
+        printf_epiworld("\n");
+
+    }
+
+    return res;
+
+
+} 
+
+#define VECT_MATCH(a, b, c) \
+    EPI_DEBUG_FAIL_AT_TRUE(a.size() != b.size(), c) \
+    for (size_t __i = 0u; __i < a.size(); ++__i) \
+    {\
+        EPI_DEBUG_FAIL_AT_TRUE(a[__i] != b[__i], c) \
+    }
+
+template<>
+inline bool DataBase<std::vector<int>>::operator==(const DataBase<std::vector<int>> & other) const
+{
+    VECT_MATCH(
+        virus_name, other.virus_name,
+        "DataBase:: virus_name don't match"
+        )
+
+    EPI_DEBUG_FAIL_AT_TRUE(
+        virus_sequence.size() != other.virus_sequence.size(),
+        "DataBase:: virus_sequence don't match."
+        )
+
+    for (size_t i = 0u; i < virus_sequence.size(); ++i)
+    {
+        VECT_MATCH(
+            virus_sequence[i], other.virus_sequence[i],
+            "DataBase:: virus_sequence[i] don't match"
+            )
+    }
+
+    VECT_MATCH(
+        virus_origin_date,
+        other.virus_origin_date,
+        "DataBase:: virus_origin_date[i] don't match"
+    )
+
+    VECT_MATCH(
+        virus_parent_id,
+        other.virus_parent_id,
+        "DataBase:: virus_parent_id[i] don't match"
+    )
+
+    VECT_MATCH(
+        tool_name,
+        other.tool_name,
+        "DataBase:: tool_name[i] don't match"
+    )
+
+    VECT_MATCH(
+        tool_sequence,
+        other.tool_sequence,
+        "DataBase:: tool_sequence[i] don't match"
+    )
+
+    VECT_MATCH(
+        tool_origin_date,
+        other.tool_origin_date,
+        "DataBase:: tool_origin_date[i] don't match"
+    )
+
+
+    EPI_DEBUG_FAIL_AT_TRUE(
+        sampling_freq != other.sampling_freq,
+        "DataBase:: sampling_freq don't match."
+        )
+
+    EPI_DEBUG_FAIL_AT_TRUE(
+        hist_virus_spill != other.hist_virus_spill,
+        "DataBase:: hist_virus_spill don't match."
+        )
+
+    // Variants history
+    VECT_MATCH(
+        hist_virus_date,
+        other.hist_virus_date,
+        "DataBase:: hist_virus_date[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_virus_id,
+        other.hist_virus_id,
+        "DataBase:: hist_virus_id[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_virus_state,
+        other.hist_virus_state,
+        "DataBase:: hist_virus_state[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_virus_counts,
+        other.hist_virus_counts,
+        "DataBase:: hist_virus_counts[i] don't match"
+        )
+
+    EPI_DEBUG_FAIL_AT_TRUE(
+        hist_tool_spill != other.hist_tool_spill,
+        "DataBase:: hist_tool_spill don't match."
+        )
+
+    // Tools history
+    VECT_MATCH(
+        hist_tool_date,
+        other.hist_tool_date,
+        "DataBase:: hist_tool_date[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_tool_id,
+        other.hist_tool_id,
+        "DataBase:: hist_tool_id[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_tool_state,
+        other.hist_tool_state,
+        "DataBase:: hist_tool_state[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_tool_counts,
+        other.hist_tool_counts,
+        "DataBase:: hist_tool_counts[i] don't match"
+        )
+
+    // Overall hist
+    VECT_MATCH(
+        hist_total_date,
+        other.hist_total_date,
+        "DataBase:: hist_total_date[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_total_nviruses_active,
+        other.hist_total_nviruses_active,
+        "DataBase:: hist_total_nviruses_active[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_total_state,
+        other.hist_total_state,
+        "DataBase:: hist_total_state[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_total_counts,
+        other.hist_total_counts,
+        "DataBase:: hist_total_counts[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_transition_from,
+        other.hist_transition_from,
+        "DataBase:: hist_transition_from[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_transition_to,
+        other.hist_transition_to,
+        "DataBase:: hist_transition_to[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_transition_counts,
+        other.hist_transition_counts,
+        "DataBase:: hist_transition_counts[i] don't match"
+        )
+
+    VECT_MATCH(
+        hist_transition_start,
+        other.hist_transition_start,
+        "DataBase:: hist_transition_start[i] don't match"
+        )
+
+    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
+    EPI_DEBUG_FAIL_AT_TRUE(
+        today_virus.size() != other.today_virus.size(),
+        "DataBase:: today_virus don't match."
+        )
+    
+    for (size_t i = 0u; i < today_virus.size(); ++i)
+    {
+        VECT_MATCH(
+            today_virus[i], other.today_virus[i],
+            "DataBase:: today_virus[i] don't match"
+            )
+    }
+
+    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
+    if (today_tool.size() != other.today_tool.size())
+        return false;
+    
+    for (size_t i = 0u; i < today_tool.size(); ++i)
+    {
+        VECT_MATCH(
+            today_tool[i], other.today_tool[i],
+            "DataBase:: today_tool[i] don't match"
+            )
+    }
+
+    // {Susceptible, Infected, etc.}
+    VECT_MATCH(
+        today_total, other.today_total,
+        "DataBase:: today_total don't match"
+        )
+
+    // Totals
+    EPI_DEBUG_FAIL_AT_TRUE(
+        today_total_nviruses_active != other.today_total_nviruses_active,
+        "DataBase:: today_total_nviruses_active don't match."
+        )
+
+    // Transmission network
+    EPI_DEBUG_FAIL_AT_TRUE(
+        transmissions != other.transmissions,
+        "DataBase:: transmissions don't match."
+        )
+
+    EPI_DEBUG_FAIL_AT_TRUE(
+        event_log != other.event_log,
+        "DataBase:: event logs don't match."
+        )
+
+
+    VECT_MATCH(
+        transition_matrix,
+        other.transition_matrix,
+        "DataBase:: transition_matrix[i] don't match"
+        )
+
+
+    return true;
+
+}
+
+template<typename TSeq>
+inline bool DataBase<TSeq>::operator==(const DataBase<TSeq> & other) const
+{
+    VECT_MATCH(
+        virus_name,
+        other.virus_name,
+        "DataBase:: virus_name[i] don't match"
+    )
+
+    VECT_MATCH(
+        virus_sequence,
+        other.virus_sequence,
+        "DataBase:: virus_sequence[i] don't match"
+    )
+
+    VECT_MATCH(
+        virus_origin_date,
+        other.virus_origin_date,
+        "DataBase:: virus_origin_date[i] don't match"
+    )
+
+    VECT_MATCH(
+        virus_parent_id,
+        other.virus_parent_id,
+        "DataBase:: virus_parent_id[i] don't match"
+    )
+
+    VECT_MATCH(
+        tool_name,
+        other.tool_name,
+        "DataBase:: tool_name[i] don't match"
+    )
+
+    VECT_MATCH(
+        tool_sequence,
+        other.tool_sequence,
+        "DataBase:: tool_sequence[i] don't match"
+    )
+
+    VECT_MATCH(
+        tool_origin_date,
+        other.tool_origin_date,
+        "DataBase:: tool_origin_date[i] don't match"
+    )
+
+    
+    EPI_DEBUG_FAIL_AT_TRUE(
+        sampling_freq != other.sampling_freq,
+        "DataBase:: sampling_freq don't match."
+    )
+
+    EPI_DEBUG_FAIL_AT_TRUE(
+        hist_virus_spill != other.hist_virus_spill,
+        "DataBase:: hist_virus_spill don't match."
+    )
+
+    // Variants history
+    VECT_MATCH(
+        hist_virus_date,
+        other.hist_virus_date,
+        "DataBase:: hist_virus_date[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_virus_id,
+        other.hist_virus_id,
+        "DataBase:: hist_virus_id[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_virus_state,
+        other.hist_virus_state,
+        "DataBase:: hist_virus_state[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_virus_counts,
+        other.hist_virus_counts,
+        "DataBase:: hist_virus_counts[i] don't match"
+    )
+
+    EPI_DEBUG_FAIL_AT_TRUE(
+        hist_tool_spill != other.hist_tool_spill,
+        "DataBase:: hist_tool_spill don't match."
+    )
+
+    // Tools history
+    VECT_MATCH(
+        hist_tool_date,
+        other.hist_tool_date,
+        "DataBase:: hist_tool_date[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_tool_id,
+        other.hist_tool_id,
+        "DataBase:: hist_tool_id[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_tool_state,
+        other.hist_tool_state,
+        "DataBase:: hist_tool_state[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_tool_counts,
+        other.hist_tool_counts,
+        "DataBase:: hist_tool_counts[i] don't match"
+    )
+
+    // Overall hist
+    VECT_MATCH(
+        hist_total_date,
+        other.hist_total_date,
+        "DataBase:: hist_total_date[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_total_nviruses_active,
+        other.hist_total_nviruses_active,
+        "DataBase:: hist_total_nviruses_active[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_total_state,
+        other.hist_total_state,
+        "DataBase:: hist_total_state[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_total_counts,
+        other.hist_total_counts,
+        "DataBase:: hist_total_counts[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_transition_from,
+        other.hist_transition_from,
+        "DataBase:: hist_transition_from[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_transition_to,
+        other.hist_transition_to,
+        "DataBase:: hist_transition_to[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_transition_counts,
+        other.hist_transition_counts,
+        "DataBase:: hist_transition_counts[i] don't match"
+    )
+
+    VECT_MATCH(
+        hist_transition_start,
+        other.hist_transition_start,
+        "DataBase:: hist_transition_start[i] don't match"
+    )
+
+    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
+    EPI_DEBUG_FAIL_AT_TRUE(
+        today_virus.size() != other.today_virus.size(),
+        "DataBase:: today_virus.size() don't match."
+    )
+    
+    for (size_t i = 0u; i < today_virus.size(); ++i)
+    {
+        VECT_MATCH(
+            today_virus[i], other.today_virus[i],
+            "DataBase:: today_virus[i] don't match"
+            )
+    }
+
+    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
+    EPI_DEBUG_FAIL_AT_TRUE(
+        today_tool.size() != other.today_tool.size(),
+        "DataBase:: today_tool.size() don't match."
+    )
+    
+    for (size_t i = 0u; i < today_tool.size(); ++i)
+    {
+        VECT_MATCH(
+            today_tool[i], other.today_tool[i],
+            "DataBase:: today_tool[i] don't match"
+            )
+    }
+
+    // {Susceptible, Infected, etc.}
+    VECT_MATCH(
+        today_total, other.today_total,
+        "DataBase:: today_total[i] don't match"
         )
 
-    VECT_MATCH(
-        transmission_target,
-        other.transmission_target,               ///< Id of the targ,
-        "DataBase:: transmission_target[i] don't match"
-        )
+    // Totals
+    EPI_DEBUG_FAIL_AT_TRUE(
+        today_total_nviruses_active != other.today_total_nviruses_active,
+        "DataBase:: today_total_nviruses_active don't match."
+    )
+
+    // Transmission network
+    EPI_DEBUG_FAIL_AT_TRUE(
+        transmissions != other.transmissions,
+        "DataBase:: transmissions don't match."
+    )
+
+    EPI_DEBUG_FAIL_AT_TRUE(
+        event_log != other.event_log,
+        "DataBase:: event logs don't match."
+    )
+
+    VECT_MATCH(
+        transition_matrix,
+        other.transition_matrix,
+        "DataBase:: transition_matrix[i] don't match"
+    )
+
+    return true;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::generation_time(
+    std::vector< int > & agent_id,
+    std::vector< int > & virus_id,
+    std::vector< int > & time,
+    std::vector< int > & gentime
+) const {
+    
+    size_t nevents = transmissions.size();
+
+    agent_id.reserve(nevents);
+    virus_id.reserve(nevents);
+    time.reserve(nevents);
+    gentime.reserve(nevents);
+
+    // Iterating through the individuals
+    for (size_t i = 0u; i < nevents; ++i)
+    {
+        int agent_id_i = transmissions.target(i);
+        agent_id.push_back(agent_id_i);
+        virus_id.push_back(transmissions.virus(i));
+        time.push_back(transmissions.date(i));
+
+        bool found = false;
+        for (size_t j = i; j < nevents; ++j)
+        {
+
+            if (transmissions.source(j) == agent_id_i)
+            {
+                gentime.push_back(transmissions.date(j) - time[i]);
+                found = true;
+                break;
+            }
+
+        }
+
+        // If there's no transmission, we set the generation time to
+        // minus 1;
+        if (!found)
+            gentime.push_back(-1);
+
+    }
+
+    agent_id.shrink_to_fit();
+    virus_id.shrink_to_fit();
+    time.shrink_to_fit();
+    gentime.shrink_to_fit();
+
+    return;
+
+}
+
+template<typename TSeq>
+inline void DataBase<TSeq>::generation_time(
+    std::string fn
+) const
+{
+
+    std::vector< int > agent_id;
+    std::vector< int > virus_id;
+    std::vector< int > time;
+    std::vector< int > gentime;
+
+    generation_time(agent_id, virus_id, time, gentime);
+
+    std::ofstream fn_file(fn, std::ios_base::out);
+
+    // Throw an error if the file doesn't exists using throw
+    if (!fn_file)
+    {
+        throw std::runtime_error(
+            "DataBase::generation_time: "
+            "Cannot open file " + fn + "."
+        );
+    }
+
+
+
+    fn_file << 
+        #ifdef EPI_DEBUG
+        "thread " <<
+        #endif
+        "virus source source_exposure_date gentime\n";
+
+    size_t n = agent_id.size();
+    for (size_t i = 0u; i < n; ++i)
+        fn_file <<
+            #ifdef EPI_DEBUG
+            EPI_GET_THREAD_ID() << " " <<
+            #endif
+            virus_id[i] << " " <<
+            model->get_agent_original_id(agent_id[i]) << " " <<
+            time[i] << " " <<
+            gentime[i] << "\n";
+
+    return;
+
+}
+
+#undef VECT_MATCH
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/database-meat.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/edgelist-reader.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_EDGELIST_READER_HPP
+#define EPIWORLD_EDGELIST_READER_HPP
+
+/**
+ * @brief Read-only view of the contents of a file
+ * 
+ * @details Where available (POSIX), the file is memory-mapped, so nothing is
+ * copied until the pages are touched. Otherwise, the file is read into memory.
+ */
+class MappedFile {
+private:
+
+    const char * dat = nullptr;
+    size_t n         = 0u;
+
+    #ifdef EPIWORLD_HAS_MMAP
+    void * mapped = nullptr;
+    #else
+    std::vector< char > buffer;
+    #endif
+
+public:
+
+    MappedFile(const std::string & fn);
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    const char * data() const noexcept;
+    size_t size() const noexcept;
+
+};
+
+inline MappedFile::MappedFile(const std::string & fn)
+{
+
+    #ifdef EPIWORLD_HAS_MMAP
+
+    int fd = ::open(fn.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw std::logic_error("The file " + fn + " was not found.");
+
+    struct stat info;
+    if (::fstat(fd, &info) == -1)
+    {
+        ::close(fd);
+        throw std::logic_error("I/O error while reading the file " + fn);
+    }
+
+    n = static_cast< size_t >(info.st_size);
+
+    if (n > 0u)
+    {
+
+        mapped = ::mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapped == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::logic_error("I/O error while reading the file " + fn);
+        }
+
+        // The file is read once, from the beginning to the end
+        ::madvise(mapped, n, MADV_SEQUENTIAL);
+
+        dat = static_cast< const char * >(mapped);
+
+    }
+
+    // The mapping is still valid after closing the file
+    ::close(fd);
+
+    #else
+
+    std::ifstream filei(fn, std::ios::binary | std::ios::ate);
+    if (!filei)
+        throw std::logic_error("The file " + fn + " was not found.");
+
+    n = static_cast< size_t >(filei.tellg());
+    buffer.resize(n);
+    filei.seekg(0);
+
+    if ((n > 0u) && !filei.read(buffer.data(), n))
+        throw std::logic_error("I/O error while reading the file " + fn);
+
+    dat = buffer.data();
+
+    #endif
+
+}
+
+inline MappedFile::~MappedFile()
+{
+
+    #ifdef EPIWORLD_HAS_MMAP
+    if (mapped != nullptr)
+        ::munmap(mapped, n);
+    #endif
+
+}
+
+inline const char * MappedFile::data() const noexcept
+{
+    return dat;
+}
+
+inline size_t MappedFile::size() const noexcept
+{
+    return n;
+}
+
+/**
+ * @brief Reads a file with two integer columns (e.g., an edgelist)
+ * 
+ * @details The file is memory-mapped and split at line boundaries into one
+ * chunk per thread. Each chunk is parsed with `std::from_chars`, and the
+ * results are put together in the order of the file. Columns beyond the
+ * second are ignored, as are empty lines.
+ * 
+ * @param fn Path to the file.
+ * @param first,second Vectors where to store the first and second column.
+ * @param skip Number of lines to skip (e.g., 1 if there's a header).
+ * @param nthreads Number of threads.
+ */
+inline void read_int_pairs(
+    const std::string & fn,
+    std::vector< int > & first,
+    std::vector< int > & second,
+    int skip = 0,
+    int nthreads = 1
+)
+{
+
+    MappedFile file(fn);
+    const char * dat = file.data();
+    const char * end = dat + file.size();
+
+    // Skipping the first lines
+    const char * start = dat;
+    for (int l = 0; (l < skip) && (start < end); ++l)
+    {
+
+        start = static_cast< const char * >(
+            std::memchr(start, '\n', static_cast< size_t >(end - start))
+            );
+
+        start = (start == nullptr) ? end : start + 1;
+
+    }
+
+    // Splitting the file into chunks that end at a line break
+    if (nthreads < 1)
+        nthreads = 1;
+
+    size_t nchunks = static_cast< size_t >(nthreads);
+    size_t len     = static_cast< size_t >(end - start);
+    std::vector< const char * > bounds(nchunks + 1u, end);
+    bounds[0u] = start;
+    for (size_t c = 1u; c < nchunks; ++c)
+    {
+
+        const char * b = std::max(bounds[c - 1u], start + (len / nchunks) * c);
+        if (b < end)
+        {
+            b = static_cast< const char * >(
+                std::memchr(b, '\n', static_cast< size_t >(end - b))
+                );
+            b = (b == nullptr) ? end : b + 1;
+        }
+
+        bounds[c] = b;
+
+    }
+
+    // Parsing each chunk. Errors are recorded (as the location in the
+    // file) and thrown after the parallel region.
+    std::vector< std::vector< int > > first_chunk(nchunks), second_chunk(nchunks);
+    std::vector< const char * > error_at(nchunks, nullptr);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+    #endif
+    for (int cc = 0; cc < static_cast< int >(nchunks); ++cc)
+    {
+
+        size_t c          = static_cast< size_t >(cc);
+        const char * p    = bounds[c];
+        const char * cend = bounds[c + 1u];
+
+        // Upper bound of the number of lines
+        size_t nlines = static_cast< size_t >(std::count(p, cend, '\n')) + 1u;
+        first_chunk[c].reserve(nlines);
+        second_chunk[c].reserve(nlines);
+
+        while (p < cend)
+        {
+
+            // Skipping blank space (including empty lines)
+            while ((p < cend) && std::isspace(static_cast< unsigned char >(*p)))
+                ++p;
+
+            if (p == cend)
+                break;
+
+            int a, b;
+            auto res = std::from_chars(p, cend, a);
+            if (res.ec != std::errc())
+            {
+                error_at[c] = p;
+                break;
+            }
+
+            p = res.ptr;
+            while ((p < cend) && ((*p == ' ') || (*p == '\t')))
+                ++p;
+
+            res = std::from_chars(p, cend, b);
+            if (res.ec != std::errc())
+            {
+                error_at[c] = p;
+                break;
+            }
+
+            first_chunk[c].push_back(a);
+            second_chunk[c].push_back(b);
+
+            // Ignoring the rest of the line
+            p = res.ptr;
+            while ((p < cend) && (*p != '\n'))
+                ++p;
+
+        }
+
+    }
+
+    for (size_t c = 0u; c < nchunks; ++c)
+    {
+
+        if (error_at[c] == nullptr)
+            continue;
+
+        size_t line = static_cast< size_t >(std::count(dat, error_at[c], '\n'));
+        throw std::logic_error(
+            "Could not read two integers from line " + std::to_string(line + 1u) +
+            " of the file " + fn
+            );
+
+    }
+
+    // Putting the chunks together
+    std::vector< size_t > offset(nchunks + 1u, 0u);
+    for (size_t c = 0u; c < nchunks; ++c)
+        offset[c + 1u] = offset[c] + first_chunk[c].size();
+
+    first.resize(offset[nchunks]);
+    second.resize(offset[nchunks]);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+    #endif
+    for (int cc = 0; cc < static_cast< int >(nchunks); ++cc)
+    {
+
+        size_t c = static_cast< size_t >(cc);
+        std::copy(first_chunk[c].begin(), first_chunk[c].end(), first.begin() + offset[c]);
+        std::copy(second_chunk[c].begin(), second_chunk[c].end(), second.begin() + offset[c]);
+
+    }
+
+    return;
+
+}
+
+/**
+ * @brief Checks that all the ids are within `[0, max_id]`
+ * 
+ * @details The check is done in bulk (a parallel min/max). Only if it fails
+ * the vector is scanned again to report the first id out of range.
+ * 
+ * @param x Vector of ids.
+ * @param max_id Largest valid id.
+ * @param what Name of the vector (used in the error message).
+ * @param nthreads Number of threads.
+ */
+inline void check_id_range(
+    const std::vector< int > & x,
+    int max_id,
+    const std::string & what,
+    int nthreads = 1
+)
+{
+
+    int xmin = 0, xmax = 0;
+    if (x.size() > 0u)
+        xmin = xmax = x[0u];
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(std::max(nthreads, 1)) \
+        reduction(min:xmin) reduction(max:xmax)
+    #endif
+    for (long long m = 0; m < static_cast< long long >(x.size()); ++m)
+    {
+        xmin = std::min(xmin, x[m]);
+        xmax = std::max(xmax, x[m]);
+    }
+
+    if ((xmin >= 0) && (xmax <= max_id))
+        return;
+
+    for (size_t m = 0u; m < x.size(); ++m)
+        if ((x[m] < 0) || (x[m] > max_id))
+            throw std::range_error(
+                "The " + what + "["+std::to_string(m)+"] = " +
+                std::to_string(x[m]) + " is out of the range [0, " +
+                std::to_string(max_id) + "]"
+                );
+
+}
+
+/**
+ * @brief Reads an edgelist into source and target arrays
+ * 
+ * @details Ids in the network are assume to range from `0` to `size - 1`.
+ * The arrays can be passed directly to `CSRGraph` or `AdjList`.
+ * 
+ * @param fn Path to the file
+ * @param size Number of vertices in the network.
+ * @param source,target Vectors where to store the edges.
+ * @param skip Number of lines to skip (e.g., 1 if there's a header)
+ * @param nthreads Number of threads used to parse the file.
+ */
+inline void load_edgelist(
+    const std::string & fn,
+    int size,
+    std::vector< int > & source,
+    std::vector< int > & target,
+    int skip = 0,
+    int nthreads = 1
+)
+{
+
+    read_int_pairs(fn, source, target, skip, nthreads);
+
+    check_id_range(source, size - 1, "source", nthreads);
+    check_id_range(target, size - 1, "target", nthreads);
+
+}
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/edgelist-reader.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/adjlist-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_ADJLIST_BONES_HPP
+#define EPIWORLD_ADJLIST_BONES_HPP
+
+class CSRGraph;
+
+class AdjList {
+    friend class CSRGraph;
+private:
+
+    std::vector<std::map<int, int>> dat;
+    bool directed;
+    epiworld_fast_uint N = 0;
+    epiworld_fast_uint E = 0;
+
+public:
+
+    AdjList() {};
+
+    /**
+     * @brief Construct a new Adj List object
+     * 
+     * @details 
+     * Ids in the network are assume to range from `0` to `size - 1`.
+     * 
+     * @param source Unsigned int vector with the source
+     * @param target Unsigned int vector with the target
+     * @param size Number of vertices in the network.
+     * @param directed Bool true if the network is directed
+     */
+    AdjList(
+        const std::vector< int > & source,
+        const std::vector< int > & target,
+        int size,
+        bool directed
+        );
+
+    AdjList(AdjList && a); // Move constructor
+    AdjList(const AdjList & a); // Copy constructor
+    AdjList& operator=(const AdjList& a);
+
+    explicit AdjList(const CSRGraph & g); ///< Converts a CSR graph
+
+
+    /**
+     * @brief Read an edgelist
+     * 
+     * Ids in the network are assume to range from `0` to `size - 1`.
+     * 
+     * @param fn Path to the file
+     * @param skip Number of lines to skip (e.g., 1 if there's a header)
+     * @param directed `true` if the network is directed
+     * @param size Number of vertices in the network.
+     */
+    void read_edgelist(
+        std::string fn,
+        int size,
+        int skip = 0,
+        bool directed = true
+        );
+
+    std::map<int, int> operator()(
+        epiworld_fast_uint i
+        ) const;
+        
+    void print(epiworld_fast_uint limit = 20u) const;
+    size_t vcount() const; ///< Number of vertices/nodes in the network.
+    size_t ecount() const; ///< Number of edges/arcs/ties in the network.
+    
+    std::vector<std::map<int,int>> & get_dat() {
+        return dat;
+    };
+
+    bool is_directed() const; ///< `true` if the network is directed.
+
+};
+
+
+#endif
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/adjlist-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/adjlist-meat.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_ADJLIST_MEAT_HPP
+#define EPIWORLD_ADJLIST_MEAT_HPP
+
+inline AdjList::AdjList(
+    const std::vector< int > & source,
+    const std::vector< int > & target,
+    int size,
+    bool directed
+) : directed(directed) {
+
+
+    dat.resize(size, std::map<int,int>({}));
+    int max_id = size - 1;
+
+    int i,j;
+    for (int m = 0; m < static_cast<int>(source.size()); ++m)
+    {
+
+        i = source[m];
+        j = target[m];
+
+        if (i > max_id)
+            throw std::range_error(
+                "The source["+std::to_string(m)+"] = " + std::to_string(i) +
+                " is above the max_id " + std::to_string(max_id)
+                );
+
+        if (j > max_id)
+            throw std::range_error(
+                "The target["+std::to_string(m)+"] = " + std::to_string(j) +
+                " is above the max_id " + std::to_string(max_id)
+                );
+
+        // Adding nodes
+        if (dat[i].find(j) == dat[i].end())
+            dat[i].insert(std::pair<int, int>(j, 1u));
+        else
+            dat[i][j]++; 
+        
+        if (!directed)
+        {
+
+            if (dat[j].find(i) == dat[j].end())
+                dat[j].insert(std::pair<int, int>(i, 1u));
+            else
+                dat[j][i]++;
+
+        }
+
+        E++;
+
+    }
+
+    N = size;
+
+    return;
+
+}
+
+
+inline AdjList::AdjList(AdjList && a) :
+    dat(std::move(a.dat)),
+    directed(a.directed),
+    N(a.N),
+    E(a.E)
+{
+
+}
+
+inline AdjList::AdjList(const AdjList & a) :
+    dat(a.dat),
+    directed(a.directed),
+    N(a.N),
+    E(a.E)
+{
+
+}
+
+inline AdjList& AdjList::operator=(const AdjList& a)
+{
+    if (this == &a)
+        return *this;
+
+    this->dat = a.dat;
+    this->directed = a.directed;
+    this->N = a.N;
+    this->E = a.E;
+
+    return *this;
+}
+
+inline void AdjList::read_edgelist(
+    std::string fn,
+    int size,
+    int skip,
+    bool directed
+) {
+
+    std::vector< int > source_;
+    std::vector< int > target_;
+
+    load_edgelist(fn, size, source_, target_, skip);
+
+    // Now using the right constructor
+    *this = AdjList(source_, target_, size, directed);
+
+    return;
+
+}
+
+inline std::map<int,int> AdjList::operator()(
+    epiworld_fast_uint i
+    ) const {
+
+    if (i >= N)
+        throw std::range_error(
+            "The vertex id " + std::to_string(i) + " is not in the network."
+            );
+
+    return dat[i];
+
+}
+
+inline void AdjList::print(epiworld_fast_uint limit) const {
+
+
+    epiworld_fast_uint counter = 0;
+    printf_epiworld("Nodeset:\n");
+    int i = -1;
+    for (auto & n : dat)
+    {
+
+        if (counter++ > limit)
+            break;
+
+        printf_epiworld("  % 3i: {", ++i);
+        int niter = 0;
+        for (auto n_n : n)
+            if (++niter < static_cast<int>(n.size()))
+            {    
+                printf_epiworld("%i, ", static_cast<int>(n_n.first));
+            }
+            else {
+                printf_epiworld("%i}\n", static_cast<int>(n_n.first));
+            }
+    }
+
+    if (limit < dat.size())
+    {
+        printf_epiworld(
+            "  (... skipping %i records ...)\n",
+            static_cast<int>(dat.size() - limit)
+            );
+    }
+
+}
+
+inline size_t AdjList::vcount() const 
+{
+    return N;
+}
+
+inline size_t AdjList::ecount() const 
+{
+    return E;
+}
+
+inline bool AdjList::is_directed() const {
+
+    if (dat.size() == 0u)
+        throw std::logic_error("The edgelist is empty.");
+    
+    return directed;
+    
+}
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/adjlist-meat.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/csrgraph-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_CSRGRAPH_BONES_HPP
+#define EPIWORLD_CSRGRAPH_BONES_HPP
+
+struct GraphFileHeader;
+
+/**
+ * @brief Graph in compressed sparse row (CSR) format
+ * 
+ * @details The neighbors of vertex `i` are stored (sorted and without
+ * duplicates) in `neighbors[offsets[i]]` to `neighbors[offsets[i + 1] - 1]`.
+ * Repeated edges are collapsed into one, and the number of times each was
+ * added is stored in the multiplicity column (only if there are repeated
+ * edges.) If the graph is built with weights, the weights of repeated edges
+ * are added up.
+ * 
+ * Compared to `AdjList`, which uses one `std::map` per vertex, this takes
+ * about a tenth of the memory and is faster to build and traverse. Both can
+ * be converted into each other.
+ */
+class CSRGraph {
+private:
+
+    std::vector< size_t > offsets = {0u};
+    std::vector< int > neighbors;
+    std::vector< int > multiplicity;        ///< Empty if no repeated edges
+    std::vector< epiworld_double > weights; ///< Empty if not weighted
+    bool directed = false;
+    epiworld_fast_uint N = 0;
+    epiworld_fast_uint E = 0;
+
+    void build(
+        const std::vector< int > & source,
+        const std::vector< int > & target,
+        const std::vector< epiworld_double > * weight,
+        int size,
+        bool directed,
+        int nthreads
+        );
+
+public:
+
+    CSRGraph() {};
+
+    /**
+     * @brief Construct a new CSRGraph object from an edgelist
+     * 
+     * @details 
+     * Ids in the network are assume to range from `0` to `size - 1`. If the
+     * graph is undirected, each edge is stored in both directions.
+     * 
+     * @param source Int vector with the source
+     * @param target Int vector with the target
+     * @param weight Weight of each edge (optional).
+     * @param size Number of vertices in the network.
+     * @param directed Bool true if the network is directed
+     * @param nthreads Number of threads used to sort the neighbors.
+     */
+    ///@{
+    CSRGraph(
+        const std::vector< int > & source,
+        const std::vector< int > & target,
+        int size,
+        bool directed,
+        int nthreads = 1
+        );
+
+    CSRGraph(
+        const std::vector< int > & source,
+        const std::vector< int > & target,
+        const std::vector< epiworld_double > & weight,
+        int size,
+        bool directed,
+        int nthreads = 1
+        );
+    ///@}
+
+    /**
+     * @brief Construct a new CSRGraph object from an AdjList
+     * 
+     * @param al Adjacency list.
+     * @param values_as_weights If `true`, the values of the ties in `al` are
+     * used as weights. Otherwise, they are the multiplicity.
+     */
+    explicit CSRGraph(const AdjList & al, bool values_as_weights = false);
+
+    /**
+     * @brief Construct a new CSRGraph object from the raw CSR arrays
+     * 
+     * @details Each row of `neighbors` must be sorted and without
+     * duplicates. If the graph is undirected, each edge must be in both
+     * rows. This is used by the generators that write the graph directly
+     * in CSR format (e.g., `rgraph_bernoulli_csr()`.)
+     * 
+     * @param offsets Vector of size `vcount() + 1`.
+     * @param neighbors Vector of size `offsets.back()`.
+     * @param directed Bool true if the network is directed
+     * @param ecount Number of edges used to build the network.
+     */
+    CSRGraph(
+        std::vector< size_t > && offsets,
+        std::vector< int > && neighbors,
+        bool directed,
+        size_t ecount
+        );
+
+    /**
+     * @brief Read an edgelist
+     * 
+     * Ids in the network are assume to range from `0` to `size - 1`. See
+     * `load_edgelist()`.
+     * 
+     * If `use_cache = true`, the graph is also saved in binary format to
+     * `fn + ".csr"`, and later calls read that file instead of parsing the
+     * text. The cache is rebuilt if the size of `fn` changes, or if its
+     * modification time changes and so does the hash of its contents. If
+     * only the modification time changed, the cache is kept and its header
+     * updated with the new time.
+     * 
+     * If `fn` is a graph in binary format (see `write_binary()`), it is read
+     * directly and `skip`, `directed`, and `use_cache` are ignored.
+     * 
+     * @param fn Path to the file
+     * @param size Number of vertices in the network. If negative, it is
+     * taken from the largest id in the file.
+     * @param skip Number of lines to skip (e.g., 1 if there's a header)
+     * @param directed `true` if the network is directed
+     * @param nthreads Number of threads used to parse the file and build
+     * the graph.
+     * @param use_cache `true` to use (and create if needed) the binary cache.
+     */
+    void read_edgelist(
+        std::string fn,
+        int size,
+        int skip = 0,
+        bool directed = true,
+        int nthreads = 1,
+        bool use_cache = false
+        );
+
+    /**
+     * @brief Write and read the graph in binary format
+     * 
+     * @details See `GraphFileHeader` for the format. `read_binary()` can read
+     * both files written by `write_binary()` and caches.
+     * 
+     * @param fn Path to the file.
+     * @param source If not null, information about the text file the graph
+     * was read from.
+     * @param header If not null, where to store the header of the file.
+     */
+    ///@{
+    void write_binary(
+        std::string fn,
+        const GraphFileHeader * source = nullptr
+        ) const;
+
+    void read_binary(
+        std::string fn,
+        GraphFileHeader * header = nullptr
+        );
+    ///@}
+
+    size_t vcount() const; ///< Number of vertices/nodes in the network.
+    size_t ecount() const; ///< Number of edges/arcs/ties used to build the network.
+    bool is_directed() const; ///< `true` if the network is directed.
+
+    size_t degree(size_t i) const; ///< Number of distinct neighbors of `i`.
+
+    /**
+     * @brief Neighbors of a vertex (and the multiplicity and weights)
+     * 
+     * @details The views are empty if the graph has no multiplicity (no
+     * repeated edges) or weights, respectively.
+     */
+    ///@{
+    DataView< int > get_neighbors(size_t i) const;
+    DataView< int > get_multiplicity(size_t i) const;
+    DataView< epiworld_double > get_weights(size_t i) const;
+    ///@}
+
+    bool has_multiplicity() const noexcept;
+    bool has_weights() const noexcept;
+
+    /**
+     * @name Raw CSR arrays
+     */
+    ///@{
+    const std::vector< size_t > & get_offsets() const noexcept;
+    const std::vector< int > & get_neighbors() const noexcept;
+    const std::vector< int > & get_multiplicity() const noexcept;
+    const std::vector< epiworld_double > & get_weights() const noexcept;
+    ///@}
+
+    /**
+     * @brief Relabels the vertices
+     * 
+     * @param order Permutation of the vertices: vertex `order[i]` becomes
+     * vertex `i` (see, e.g., `graph_order_rcm()`.)
+     * @return CSRGraph 
+     */
+    CSRGraph permute(const std::vector< int > & order) const;
+
+    void print(epiworld_fast_uint limit = 20u) const;
+
+    bool operator==(const CSRGraph & other) const;
+    bool operator!=(const CSRGraph & other) const {return !operator==(other);};
+
+};
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/csrgraph-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/csrgraph-meat.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_CSRGRAPH_MEAT_HPP
+#define EPIWORLD_CSRGRAPH_MEAT_HPP
+
+inline CSRGraph::CSRGraph(
+    const std::vector< int > & source,
+    const std::vector< int > & target,
+    int size,
+    bool directed,
+    int nthreads
+) {
+
+    build(source, target, nullptr, size, directed, nthreads);
+
+}
+
+inline CSRGraph::CSRGraph(
+    const std::vector< int > & source,
+    const std::vector< int > & target,
+    const std::vector< epiworld_double > & weight,
+    int size,
+    bool directed,
+    int nthreads
+) {
+
+    if (weight.size() != source.size())
+        throw std::length_error(
+            "The weight vector (" + std::to_string(weight.size()) +
+            ") must be of the same length as source (" +
+            std::to_string(source.size()) + ")."
+            );
+
+    build(source, target, &weight, size, directed, nthreads);
+
+}
+
+inline void CSRGraph::build(
+    const std::vector< int > & source,
+    const std::vector< int > & target,
+    const std::vector< epiworld_double > * weight,
+    int size,
+    bool directed_,
+    int nthreads
+) {
+
+    if (source.size() != target.size())
+        throw std::length_error(
+            "The source (" + std::to_string(source.size()) +
+            ") and target (" + std::to_string(target.size()) +
+            ") vectors must be of the same length."
+            );
+
+    if (size < 0)
+        throw std::range_error("The size of the network cannot be negative.");
+
+    directed = directed_;
+    N        = static_cast< epiworld_fast_uint >(size);
+    E        = static_cast< epiworld_fast_uint >(source.size());
+
+    int max_id = size - 1;
+    size_t n   = static_cast< size_t >(size);
+
+    // Counting the degree of each vertex (including repeated edges)
+    std::vector< size_t > cursor(n + 1u, 0u);
+    for (size_t m = 0u; m < source.size(); ++m)
+    {
+
+        int i = source[m];
+        int j = target[m];
+
+        if ((i < 0) || (i > max_id))
+            throw std::range_error(
+                "The source["+std::to_string(m)+"] = " + std::to_string(i) +
+                " is out of the range [0, " + std::to_string(max_id) + "]"
+                );
+
+        if ((j < 0) || (j > max_id))
+            throw std::range_error(
+                "The target["+std::to_string(m)+"] = " + std::to_string(j) +
+                " is out of the range [0, " + std::to_string(max_id) + "]"
+                );
+
+        ++cursor[i + 1];
+        if (!directed)
+            ++cursor[j + 1];
+
+    }
+
+    for (size_t i = 0u; i < n; ++i)
+        cursor[i + 1u] += cursor[i];
+
+    // Scattering the edges into their rows
+    std::vector< size_t > rows(cursor);
+    std::vector< int > nbrs(cursor[n]);
+    std::vector< epiworld_double > w(weight != nullptr ? cursor[n] : 0u);
+    for (size_t m = 0u; m < source.size(); ++m)
+    {
+
+        size_t i = static_cast< size_t >(source[m]);
+        size_t j = static_cast< size_t >(target[m]);
+
+        if (weight != nullptr)
+            w[cursor[i]] = (*weight)[m];
+
+        nbrs[cursor[i]++] = target[m];
+
+        if (!directed)
+        {
+
+            if (weight != nullptr)
+                w[cursor[j]] = (*weight)[m];
+
+            nbrs[cursor[j]++] = source[m];
+
+        }
+
+    }
+
+    // Sorting each row and collapsing repeated edges (in parallel). The
+    // unique neighbors are moved to the beginning of the row.
+    std::vector< int > mult(nbrs.size(), 1);
+    std::vector< size_t > deg(n + 1u, 0u);
+    bool repeated = false;
+
+    #ifdef _OPENMP
+    #pragma omp parallel num_threads(nthreads) reduction(||:repeated)
+    #endif
+    {
+
+        std::vector< std::pair< int, epiworld_double > > pairs;
+
+        #ifdef _OPENMP
+        #pragma omp for schedule(dynamic, 1024)
+        #endif
+        for (int ii = 0; ii < size; ++ii)
+        {
+
+            size_t i     = static_cast< size_t >(ii);
+            size_t start = rows[i];
+            size_t end   = rows[i + 1u];
+
+            if (start == end)
+                continue;
+
+            if (weight == nullptr)
+                std::sort(nbrs.begin() + start, nbrs.begin() + end);
+            else
+            {
+
+                pairs.clear();
+                for (size_t k = start; k < end; ++k)
+                    pairs.push_back({nbrs[k], w[k]});
+
+                std::sort(pairs.begin(), pairs.end());
+
+                for (size_t k = start; k < end; ++k)
+                {
+                    nbrs[k] = pairs[k - start].first;
+                    w[k]    = pairs[k - start].second;
+                }
+
+            }
+
+            size_t last = start;
+            for (size_t k = start + 1u; k < end; ++k)
+            {
+
+                if (nbrs[k] == nbrs[last])
+                {
+
+                    ++mult[last];
+                    if (weight != nullptr)
+                        w[last] += w[k];
+
+                    repeated = true;
+                    continue;
+
+                }
+
+                ++last;
+                nbrs[last] = nbrs[k];
+                if (weight != nullptr)
+                    w[last] = w[k];
+
+            }
+
+            deg[i + 1u] = last - start + 1u;
+
+        }
+
+    }
+
+    // Compacting the rows
+    offsets.assign(n + 1u, 0u);
+    for (size_t i = 0u; i < n; ++i)
+        offsets[i + 1u] = offsets[i] + deg[i + 1u];
+
+    neighbors.resize(offsets[n]);
+    multiplicity.resize(repeated ? offsets[n] : 0u);
+    weights.resize(weight != nullptr ? offsets[n] : 0u);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads) schedule(static)
+    #endif
+    for (int ii = 0; ii < size; ++ii)
+    {
+
+        size_t i = static_cast< size_t >(ii);
+        for (size_t k = 0u; k < deg[i + 1u]; ++k)
+        {
+
+            neighbors[offsets[i] + k] = nbrs[rows[i] + k];
+
+            if (repeated)
+                multiplicity[offsets[i] + k] = mult[rows[i] + k];
+
+            if (weight != nullptr)
+                weights[offsets[i] + k] = w[rows[i] + k];
+
+        }
+
+    }
+
+    return;
+
+}
+
+inline CSRGraph::CSRGraph(
+    std::vector< size_t > && offsets_,
+    std::vector< int > && neighbors_,
+    bool directed_,
+    size_t ecount
+) :
+    offsets(std::move(offsets_)),
+    neighbors(std::move(neighbors_)),
+    directed(directed_),
+    E(static_cast< epiworld_fast_uint >(ecount))
+{
+
+    if ((offsets.size() == 0u) || (offsets.back() != neighbors.size()))
+        throw std::length_error(
+            "The last offset must be equal to the number of neighbors (" +
+            std::to_string(neighbors.size()) + ")."
+            );
+
+    N = static_cast< epiworld_fast_uint >(offsets.size() - 1u);
+
+}
+
+inline CSRGraph::CSRGraph(const AdjList & al, bool values_as_weights) :
+    directed(al.directed),
+    N(al.N),
+    E(al.E)
+{
+
+    offsets.assign(al.dat.size() + 1u, 0u);
+    for (size_t i = 0u; i < al.dat.size(); ++i)
+        offsets[i + 1u] = offsets[i] + al.dat[i].size();
+
+    neighbors.reserve(offsets.back());
+    multiplicity.reserve(offsets.back());
+
+    bool repeated = false;
+    for (const auto & row : al.dat)
+        for (const auto & link : row)
+        {
+
+            neighbors.push_back(link.first);
+            multiplicity.push_back(link.second);
+
+            if (link.second != 1)
+                repeated = true;
+
+        }
+
+    if (values_as_weights)
+    {
+        weights.assign(multiplicity.begin(), multiplicity.end());
+        repeated = false;
+    }
+
+    if (!repeated)
+    {
+        multiplicity.clear();
+        multiplicity.shrink_to_fit();
+    }
+
+}
+
+inline size_t CSRGraph::vcount() const
+{
+    return N;
+}
+
+inline size_t CSRGraph::ecount() const
+{
+    return E;
+}
+
+inline bool CSRGraph::is_directed() const
+{
+    return directed;
+}
+
+inline size_t CSRGraph::degree(size_t i) const
+{
+
+    if (i >= N)
+        throw std::range_error(
+            "The vertex id " + std::to_string(i) + " is not in the network."
+            );
+
+    return offsets[i + 1u] - offsets[i];
+
+}
+
+inline DataView< int > CSRGraph::get_neighbors(size_t i) const
+{
+    return DataView< int >(neighbors.data() + offsets[i], degree(i));
+}
+
+inline DataView< int > CSRGraph::get_multiplicity(size_t i) const
+{
+
+    if (multiplicity.size() == 0u)
+        return DataView< int >();
+
+    return DataView< int >(multiplicity.data() + offsets[i], degree(i));
+
+}
+
+inline DataView< epiworld_double > CSRGraph::get_weights(size_t i) const
+{
+
+    if (weights.size() == 0u)
+        return DataView< epiworld_double >();
+
+    return DataView< epiworld_double >(weights.data() + offsets[i], degree(i));
+
+}
+
+inline bool CSRGraph::has_multiplicity() const noexcept
+{
+    return multiplicity.size() > 0u;
+}
+
+inline bool CSRGraph::has_weights() const noexcept
+{
+    return weights.size() > 0u;
+}
+
+inline const std::vector< size_t > & CSRGraph::get_offsets() const noexcept
+{
+    return offsets;
+}
+
+inline const std::vector< int > & CSRGraph::get_neighbors() const noexcept
+{
+    return neighbors;
+}
+
+inline const std::vector< int > & CSRGraph::get_multiplicity() const noexcept
+{
+    return multiplicity;
+}
+
+inline const std::vector< epiworld_double > & CSRGraph::get_weights() const noexcept
+{
+    return weights;
+}
+
+inline void CSRGraph::print(epiworld_fast_uint limit) const {
+
+    printf_epiworld("Nodeset:\n");
+    for (size_t i = 0u; i < N; ++i)
+    {
+
+        if (i > limit)
+            break;
+
+        printf_epiworld("  % 3i: {", static_cast<int>(i));
+        for (size_t k = offsets[i]; k < offsets[i + 1u]; ++k)
+        {
+            printf_epiworld(
+                (k + 1u) < offsets[i + 1u] ? "%i, " : "%i",
+                neighbors[k]
+                );
+        }
+
+        printf_epiworld("}\n");
+
+    }
+
+    if (limit < N)
+    {
+        printf_epiworld(
+            "  (... skipping %i records ...)\n",
+            static_cast<int>(N - limit)
+            );
+    }
+
+}
+
+inline bool CSRGraph::operator==(const CSRGraph & other) const
+{
+
+    return (directed == other.directed) && (N == other.N) && (E == other.E) &&
+        (offsets == other.offsets) && (neighbors == other.neighbors) &&
+        (multiplicity == other.multiplicity) && (weights == other.weights);
+
+}
+
+inline AdjList::AdjList(const CSRGraph & g) :
+    directed(g.is_directed()),
+    N(g.vcount()),
+    E(g.ecount())
+{
+
+    dat.resize(N);
+
+    const auto & offsets = g.get_offsets();
+    const auto & nbrs    = g.get_neighbors();
+    const auto & mult    = g.get_multiplicity();
+    for (size_t i = 0u; i < N; ++i)
+        for (size_t k = offsets[i]; k < offsets[i + 1u]; ++k)
+            dat[i].emplace_hint(
+                dat[i].end(), nbrs[k], mult.size() > 0u ? mult[k] : 1
+                );
+
+}
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/csrgraph-meat.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/csrgraph-cache.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_CSRGRAPH_CACHE_HPP
+#define EPIWORLD_CSRGRAPH_CACHE_HPP
+
+/**
+ * @brief Header of the binary graph format
+ * 
+ * @details The file has the header followed by the CSR arrays: `vcount + 1`
+ * offsets (uint64), `nnz` neighbors (int32), and, depending on `flags`,
+ * `nnz` multiplicities (int32) and `nnz` weights (double). When used as a
+ * cache of a text edgelist, the `source_*` fields and `skip` describe the
+ * text file it was built from (otherwise they are zero.) Files of pairs
+ * (flag 8) use the same header (see `write_int_pairs_binary()`.)
+ */
+struct GraphFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;       ///< 1: directed, 2: multiplicity, 4: weights, 8: pairs
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+    std::uint64_t source_hash;
+    std::int32_t skip;
+    std::int32_t size;         ///< Size requested when read (-1 if from the file)
+    std::uint64_t vcount;
+    std::uint64_t ecount;
+    std::uint64_t nnz;
+};
+
+static const char graph_file_magic[8] = {'E', 'P', 'I', 'W', 'C', 'S', 'R', '\0'};
+static const std::uint32_t graph_file_version = 1u;
+static const std::uint32_t graph_file_pairs   = 8u; ///< Flag of files of pairs (see `write_int_pairs_binary()`)
+
+/**
+ * @brief `true` if the file starts with `graph_file_magic`
+ */
+inline bool is_graph_file(const std::string & fn)
+{
+
+    char magic[8] = {0};
+    std::ifstream f(fn, std::ios::binary);
+
+    return f && f.read(magic, 8) &&
+        (std::memcmp(magic, graph_file_magic, 8u) == 0);
+
+}
+
+/**
+ * @brief Size and modification time of a file
+ * 
+ * @details The modification time is zero where it is not available, in
+ * which case caches are validated with the hash of the contents.
+ */
+inline void file_stat(
+    const std::string & fn,
+    std::uint64_t * size,
+    std::int64_t * mtime
+)
+{
+
+    #ifdef EPIWORLD_HAS_MMAP
+    struct stat info;
+    if (::stat(fn.c_str(), &info) == -1)
+        throw std::logic_error("The file " + fn + " was not found.");
+
+    *size  = static_cast< std::uint64_t >(info.st_size);
+    *mtime = static_cast< std::int64_t >(info.st_mtime);
+    #else
+    std::ifstream filei(fn, std::ios::binary | std::ios::ate);
+    if (!filei)
+        throw std::logic_error("The file " + fn + " was not found.");
+
+    *size  = static_cast< std::uint64_t >(filei.tellg());
+    *mtime = 0;
+    #endif
+
+}
+
+/**
+ * @brief 64-bit hash of the contents of a file
+ */
+inline std::uint64_t file_hash(const std::string & fn)
+{
+
+    MappedFile file(fn);
+    const char * dat = file.data();
+    size_t n         = file.size();
+
+    std::uint64_t hash = hash_combine64(0u, n);
+    size_t i = 0u;
+    for (; (i + 8u) <= n; i += 8u)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, dat + i, 8u);
+        hash = hash_combine64(hash, word);
+    }
+
+    if (i < n)
+    {
+        std::uint64_t word = 0u;
+        std::memcpy(&word, dat + i, n - i);
+        hash = hash_combine64(hash, word);
+    }
+
+    return hash;
+
+}
+
+/**
+ * @brief Checks whether a cache is up to date with the file it was built from
+ * 
+ * @details The cache is up to date if the size of `fn` is the same and so is
+ * either its modification time or the hash of its contents. If only the time
+ * changed, the new time is stored in the cache so the file is not hashed
+ * again next time.
+ * 
+ * @param fn,fn_cache Paths to the file and its cache.
+ * @param source Size and time of `fn` (see `file_stat()`). Its hash is set if
+ * the file is hashed.
+ * @param cached Header of the cache.
+ */
+inline bool graph_cache_is_current(
+    const std::string & fn,
+    const std::string & fn_cache,
+    GraphFileHeader & source,
+    GraphFileHeader & cached
+)
+{
+
+    if (cached.source_size != source.source_size)
+        return false;
+
+    if (cached.source_mtime == source.source_mtime)
+        return true;
+
+    source.source_hash = file_hash(fn);
+    if (source.source_hash != cached.source_hash)
+        return false;
+
+    std::FILE * file = std::fopen(fn_cache.c_str(), "r+b");
+    if (file != nullptr)
+    {
+        cached.source_mtime = source.source_mtime;
+        std::fwrite(&cached, sizeof(cached), 1u, file);
+        std::fclose(file);
+    }
+
+    return true;
+
+}
+
+/**
+ * @brief Writes a cache with `write(fn_tmp)`
+ * 
+ * @details The cache is first written to a temporary file, so other
+ * processes never see it half written. If it cannot be written, we move on
+ * without it.
+ */
+template<typename TFun>
+inline void graph_cache_write(const std::string & fn_cache, TFun write)
+{
+
+    try
+    {
+
+        std::string fn_tmp = fn_cache + ".tmp" +
+            std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+
+        write(fn_tmp);
+
+        if (std::rename(fn_tmp.c_str(), fn_cache.c_str()) != 0)
+            std::remove(fn_tmp.c_str());
+
+    }
+    catch (...)
+    {
+    }
+
+}
+
+inline void CSRGraph::write_binary(
+    std::string fn,
+    const GraphFileHeader * source
+) const
+{
+
+    GraphFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+
+    if (source != nullptr)
+        header = *source;
+    else
+        header.size = static_cast< std::int32_t >(N);
+
+    std::memcpy(header.magic, graph_file_magic, 8u);
+    header.version = graph_file_version;
+    header.flags   = (directed ? 1u : 0u) |
+        (multiplicity.size() > 0u ? 2u : 0u) |
+        (weights.size() > 0u ? 4u : 0u);
+    header.vcount  = N;
+    header.ecount  = E;
+    header.nnz     = neighbors.size();
+
+    std::FILE * file = std::fopen(fn.c_str(), "wb");
+    if (file == nullptr)
+        throw std::runtime_error(
+            "Could not open file \"" + fn + "\" for writing."
+            );
+
+    std::vector< std::uint64_t > offsets_(offsets.begin(), offsets.end());
+    std::vector< std::int32_t > neighbors_(neighbors.begin(), neighbors.end());
+    std::vector< std::int32_t > multiplicity_(multiplicity.begin(), multiplicity.end());
+    std::vector< double > weights_(weights.begin(), weights.end());
+
+    bool ok =
+        (std::fwrite(&header, sizeof(header), 1u, file) == 1u) &&
+        (std::fwrite(offsets_.data(), sizeof(std::uint64_t), offsets_.size(), file) == offsets_.size()) &&
+        (std::fwrite(neighbors_.data(), sizeof(std::int32_t), neighbors_.size(), file) == neighbors_.size()) &&
+        (std::fwrite(multiplicity_.data(), sizeof(std::int32_t), multiplicity_.size(), file) == multiplicity_.size()) &&
+        (std::fwrite(weights_.data(), sizeof(double), weights_.size(), file) == weights_.size());
+
+    ok = (std::fclose(file) == 0) && ok;
+
+    if (!ok)
+        throw std::runtime_error(
+            "Could not write the graph to the file \"" + fn + "\"."
+            );
+
+}
+
+/**
+ * @brief Reads `n` values stored as `TFile` in a graph file into `x`
+ * 
+ * @details When `T` and `TFile` are the same type, the values are copied
+ * straight into `x`; otherwise they are converted one by one.
+ * 
+ * @return Pointer past the last value read.
+ */
+template<typename TFile, typename T>
+inline const char * read_binary_array(
+    const char * p,
+    size_t n,
+    std::vector< T > & x
+)
+{
+
+    x.resize(n);
+
+    if (std::is_same< T, TFile >::value)
+        std::memcpy(x.data(), p, n * sizeof(TFile));
+    else
+    {
+        for (size_t i = 0u; i < n; ++i)
+        {
+            TFile value;
+            std::memcpy(&value, p + i * sizeof(TFile), sizeof(TFile));
+            x[i] = static_cast< T >(value);
+        }
+    }
+
+    return p + n * sizeof(TFile);
+
+}
+
+/**
+ * @brief Reads and checks the header of a (mapped) graph file
+ * 
+ * @details Throws if the file is not a graph in binary format, has another
+ * version, or its size does not match the header.
+ */
+inline GraphFileHeader read_graph_file_header(
+    const MappedFile & file,
+    const std::string & fn
+)
+{
+
+    GraphFileHeader header;
+    if (file.size() < sizeof(header))
+        throw std::runtime_error("The file " + fn + " is not a graph file.");
+
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, graph_file_magic, 8u) != 0)
+        throw std::runtime_error("The file " + fn + " is not a graph file.");
+
+    if (header.version != graph_file_version)
+        throw std::runtime_error(
+            "The graph file " + fn + " has version " +
+            std::to_string(header.version) + " but " +
+            std::to_string(graph_file_version) + " was expected."
+            );
+
+    if ((header.flags & graph_file_pairs) != 0u)
+        throw std::runtime_error(
+            "The file " + fn + " has pairs of integers, not a graph."
+            );
+
+    size_t nnz      = static_cast< size_t >(header.nnz);
+    size_t nv       = static_cast< size_t >(header.vcount);
+    bool has_mult   = (header.flags & 2u) != 0u;
+    bool has_weight = (header.flags & 4u) != 0u;
+
+    size_t expected = sizeof(header) + (nv + 1u) * sizeof(std::uint64_t) +
+        nnz * sizeof(std::int32_t) * (has_mult ? 2u : 1u) +
+        (has_weight ? nnz * sizeof(double) : 0u);
+
+    if (file.size() != expected)
+        throw std::runtime_error(
+            "The graph file " + fn + " is truncated or corrupted."
+            );
+
+    return header;
+
+}
+
+inline void CSRGraph::read_binary(
+    std::string fn,
+    GraphFileHeader * header_out
+)
+{
+
+    MappedFile file(fn);
+    GraphFileHeader header = read_graph_file_header(file, fn);
+
+    size_t nnz      = static_cast< size_t >(header.nnz);
+    size_t nv       = static_cast< size_t >(header.vcount);
+    bool has_mult   = (header.flags & 2u) != 0u;
+    bool has_weight = (header.flags & 4u) != 0u;
+
+    // Copying the arrays out of the mapped file
+    const char * p = file.data() + sizeof(header);
+
+    p = read_binary_array< std::uint64_t >(p, nv + 1u, offsets);
+    p = read_binary_array< std::int32_t >(p, nnz, neighbors);
+
+    multiplicity.clear();
+    if (has_mult)
+        p = read_binary_array< std::int32_t >(p, nnz, multiplicity);
+
+    weights.clear();
+    if (has_weight)
+        p = read_binary_array< double >(p, nnz, weights);
+
+    directed = (header.flags & 1u) != 0u;
+    N        = static_cast< epiworld_fast_uint >(header.vcount);
+    E        = static_cast< epiworld_fast_uint >(header.ecount);
+
+    if (header_out != nullptr)
+        *header_out = header;
+
+}
+
+inline void CSRGraph::read_edgelist(
+    std::string fn,
+    int size,
+    int skip,
+    bool directed,
+    int nthreads,
+    bool use_cache
+) {
+
+    // Is it already in binary format?
+    if (is_graph_file(fn))
+    {
+
+        read_binary(fn);
+
+        if ((size >= 0) && (static_cast< size_t >(size) != N))
+            throw std::range_error(
+                "The graph in \"" + fn + "\" has " + std::to_string(N) +
+                " vertices, but size = " + std::to_string(size) + "."
+                );
+
+        return;
+
+    }
+
+    GraphFileHeader source;
+    std::memset(&source, 0, sizeof(source));
+
+    std::string fn_cache = fn + ".csr";
+    if (use_cache)
+    {
+
+        file_stat(fn, &source.source_size, &source.source_mtime);
+        source.skip = static_cast< std::int32_t >(skip);
+        source.size = static_cast< std::int32_t >(size);
+
+        // Checking the cache. Any problem reading it means rebuilding it.
+        GraphFileHeader cached;
+        bool valid = false;
+        try
+        {
+
+            CSRGraph g;
+            g.read_binary(fn_cache, &cached);
+
+            valid = (cached.skip == source.skip) &&
+                (cached.size == source.size) &&
+                (((cached.flags & 1u) != 0u) == directed) &&
+                graph_cache_is_current(fn, fn_cache, source, cached);
+
+            if (valid)
+            {
+                *this = std::move(g);
+                return;
+            }
+
+        }
+        catch (...)
+        {
+            valid = false;
+        }
+
+    }
+
+    std::vector< int > source_;
+    std::vector< int > target_;
+
+    // Taking the size from the data
+    if (size < 0)
+    {
+
+        read_int_pairs(fn, source_, target_, skip, nthreads);
+
+        int max_id = -1;
+        for (size_t m = 0u; m < source_.size(); ++m)
+            max_id = std::max(max_id, std::max(source_[m], target_[m]));
+
+        check_id_range(source_, max_id, "source", nthreads);
+        check_id_range(target_, max_id, "target", nthreads);
+
+        build(source_, target_, nullptr, max_id + 1, directed, nthreads);
+
+    }
+    else
+    {
+
+        load_edgelist(fn, size, source_, target_, skip, nthreads);
+        build(source_, target_, nullptr, size, directed, nthreads);
+
+    }
+
+    if (!use_cache)
+        return;
+
+    if (source.source_hash == 0u)
+        source.source_hash = file_hash(fn);
+
+    graph_cache_write(
+        fn_cache,
+        [&](const std::string & fn_tmp) {write_binary(fn_tmp, &source);}
+        );
+
+    return;
+
+}
+
+/**
+ * @brief Write and read pairs of integers in binary format
+ * 
+ * @details Used for lists of pairs whose order matters (e.g., the
+ * agent-entity ties, see `Model::load_agents_entities_ties()`.) The file has
+ * a `GraphFileHeader` with the `graph_file_pairs` flag, `nnz` (and `ecount`)
+ * equal to the number of pairs, and `vcount` zero, followed by the pairs as
+ * int32 in the order given: `first[0], second[0], first[1], second[1], ...`
+ * 
+ * @param fn Path to the file.
+ * @param first,second Vectors (of the same length) with the pairs.
+ * @param source If not null, information about the text file the pairs
+ * were read from.
+ * @param header If not null, where to store the header of the file.
+ */
+///@{
+inline void write_int_pairs_binary(
+    const std::string & fn,
+    const std::vector< int > & first,
+    const std::vector< int > & second,
+    const GraphFileHeader * source = nullptr
+)
+{
+
+    if (first.size() != second.size())
+        throw std::length_error(
+            "The vectors first (" + std::to_string(first.size()) +
+            ") and second (" + std::to_string(second.size()) +
+            ") must be of the same length."
+            );
+
+    GraphFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+
+    if (source != nullptr)
+        header = *source;
+
+    std::memcpy(header.magic, graph_file_magic, 8u);
+    header.version = graph_file_version;
+    header.flags   = graph_file_pairs;
+    header.size    = -1;
+    header.vcount  = 0u;
+    header.ecount  = first.size();
+    header.nnz     = first.size();
+
+    std::vector< std::int32_t > pairs(first.size() * 2u);
+    for (size_t i = 0u; i < first.size(); ++i)
+    {
+        pairs[2u * i]      = static_cast< std::int32_t >(first[i]);
+        pairs[2u * i + 1u] = static_cast< std::int32_t >(second[i]);
+    }
+
+    std::FILE * file = std::fopen(fn.c_str(), "wb");
+    if (file == nullptr)
+        throw std::runtime_error(
+            "Could not open file \"" + fn + "\" for writing."
+            );
+
+    bool ok =
+        (std::fwrite(&header, sizeof(header), 1u, file) == 1u) &&
+        (std::fwrite(pairs.data(), sizeof(std::int32_t), pairs.size(), file) == pairs.size());
+
+    ok = (std::fclose(file) == 0) && ok;
+
+    if (!ok)
+        throw std::runtime_error(
+            "Could not write the pairs to the file \"" + fn + "\"."
+            );
+
+}
+
+inline void read_int_pairs_binary(
+    const std::string & fn,
+    std::vector< int > & first,
+    std::vector< int > & second,
+    GraphFileHeader * header_out = nullptr
+)
+{
+
+    MappedFile file(fn);
+    const char * dat = file.data();
+
+    GraphFileHeader header;
+    if (file.size() < sizeof(header))
+        throw std::runtime_error("The file " + fn + " is not a file of pairs.");
+
+    std::memcpy(&header, dat, sizeof(header));
+
+    if ((std::memcmp(header.magic, graph_file_magic, 8u) != 0) ||
+        ((header.flags & graph_file_pairs) == 0u))
+        throw std::runtime_error("The file " + fn + " is not a file of pairs.");
+
+    if (header.version != graph_file_version)
+        throw std::runtime_error(
+            "The file of pairs " + fn + " has version " +
+            std::to_string(header.version) + " but " +
+            std::to_string(graph_file_version) + " was expected."
+            );
+
+    size_t n = static_cast< size_t >(header.nnz);
+    if (file.size() != (sizeof(header) + 2u * n * sizeof(std::int32_t)))
+        throw std::runtime_error(
+            "The file of pairs " + fn + " is truncated or corrupted."
+            );
+
+    const char * p = dat + sizeof(header);
+
+    first.resize(n);
+    second.resize(n);
+    for (size_t i = 0u; i < n; ++i)
+    {
+
+        std::int32_t pair[2u];
+        std::memcpy(pair, p + 2u * i * sizeof(std::int32_t), sizeof(pair));
+
+        first[i]  = static_cast< int >(pair[0u]);
+        second[i] = static_cast< int >(pair[1u]);
+
+    }
+
+    if (header_out != nullptr)
+        *header_out = header;
+
+}
+///@}
+
+/**
+ * @brief Reads a file with two integer columns, keeping a binary cache
+ * 
+ * @details Same as `read_int_pairs()`, but if `use_cache = true`, the pairs
+ * are also saved (in the order of the file) to `fn + ".pairs"` with
+ * `write_int_pairs_binary()`, and later calls read that file instead of
+ * parsing the text. The cache is validated as the one of
+ * `CSRGraph::read_edgelist()`. If `fn` is itself a binary file of pairs, it
+ * is read directly and `skip` and `use_cache` are ignored.
+ * 
+ * @param fn Path to the file.
+ * @param first,second Vectors where to store the first and second column.
+ * @param skip Number of lines to skip (e.g., 1 if there's a header).
+ * @param nthreads Number of threads used to parse the file.
+ * @param use_cache `true` to use (and create if needed) the binary cache.
+ */
+inline void read_int_pairs_cached(
+    const std::string & fn,
+    std::vector< int > & first,
+    std::vector< int > & second,
+    int skip = 0,
+    int nthreads = 1,
+    bool use_cache = true
+)
+{
+
+    // Is it already in binary format?
+    if (is_graph_file(fn))
+    {
+        read_int_pairs_binary(fn, first, second);
+        return;
+    }
+
+    GraphFileHeader source;
+    std::memset(&source, 0, sizeof(source));
+
+    std::string fn_cache = fn + ".pairs";
+    if (use_cache)
+    {
+
+        file_stat(fn, &source.source_size, &source.source_mtime);
+        source.skip = static_cast< std::int32_t >(skip);
+
+        // Any problem reading the cache means rebuilding it
+        try
+        {
+
+            GraphFileHeader cached;
+            std::vector< int > first_, second_;
+            read_int_pairs_binary(fn_cache, first_, second_, &cached);
+
+            if ((cached.skip == source.skip) &&
+                graph_cache_is_current(fn, fn_cache, source, cached))
+            {
+                first  = std::move(first_);
+                second = std::move(second_);
+                return;
+            }
+
+        }
+        catch (...)
+        {
+        }
+
+    }
+
+    read_int_pairs(fn, first, second, skip, nthreads);
+
+    if (!use_cache)
+        return;
+
+    if (source.source_hash == 0u)
+        source.source_hash = file_hash(fn);
+
+    graph_cache_write(
+        fn_cache,
+        [&](const std::string & fn_tmp) {
+            write_int_pairs_binary(fn_tmp, first, second, &source);
+        });
+
+    return;
+
+}
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/csrgraph-cache.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/csrgraph-order.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_CSRGRAPH_ORDER_HPP
+#define EPIWORLD_CSRGRAPH_ORDER_HPP
+
+inline CSRGraph CSRGraph::permute(const std::vector< int > & order) const
+{
+
+    size_t n = N;
+    if (order.size() != n)
+        throw std::length_error(
+            "The order (" + std::to_string(order.size()) +
+            ") must be of the same length as the number of vertices (" +
+            std::to_string(n) + ")."
+            );
+
+    // New id of each vertex
+    std::vector< int > new_id(n, -1);
+    for (size_t i = 0u; i < n; ++i)
+    {
+
+        if ((order[i] < 0) || (static_cast< size_t >(order[i]) >= n) ||
+            (new_id[order[i]] != -1))
+            throw std::logic_error("The order is not a permutation of the vertices.");
+
+        new_id[order[i]] = static_cast< int >(i);
+
+    }
+
+    CSRGraph res;
+    res.directed = directed;
+    res.N        = N;
+    res.E        = E;
+
+    res.offsets.assign(n + 1u, 0u);
+    for (size_t i = 0u; i < n; ++i)
+        res.offsets[i + 1u] = res.offsets[i] + degree(order[i]);
+
+    res.neighbors.resize(neighbors.size());
+    res.multiplicity.resize(multiplicity.size());
+    res.weights.resize(weights.size());
+
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1024)
+    #endif
+    for (int ii = 0; ii < static_cast< int >(n); ++ii)
+    {
+
+        size_t i   = static_cast< size_t >(ii);
+        size_t old = static_cast< size_t >(order[i]);
+        size_t deg = offsets[old + 1u] - offsets[old];
+
+        // Sorting the row by the new ids
+        std::vector< std::pair< int, size_t > > row(deg);
+        for (size_t k = 0u; k < deg; ++k)
+            row[k] = {new_id[neighbors[offsets[old] + k]], offsets[old] + k};
+
+        std::sort(row.begin(), row.end());
+
+        for (size_t k = 0u; k < deg; ++k)
+        {
+
+            size_t to = res.offsets[i] + k;
+            res.neighbors[to] = row[k].first;
+
+            if (multiplicity.size() > 0u)
+                res.multiplicity[to] = multiplicity[row[k].second];
+
+            if (weights.size() > 0u)
+                res.weights[to] = weights[row[k].second];
+
+        }
+
+    }
+
+    return res;
+
+}
+
+/**
+ * @name Orderings of the vertices of a graph
+ * 
+ * @details Each function returns `order`, with `order[i]` the vertex that
+ * should go in position `i` (see `CSRGraph::permute()`.) Placing vertices
+ * that share neighbors close to each other improves cache locality in
+ * loops over the neighbors of the agents.
+ * 
+ * - `graph_order_degree()` sorts the vertices by decreasing degree.
+ * - `graph_order_rcm()` is the Reverse Cuthill-McKee ordering, which
+ * reduces the bandwidth of the adjacency matrix.
+ * - `graph_order_community()` groups the vertices by the communities found
+ * by label propagation (in order of appearance.)
+ * 
+ * In directed graphs, only the outgoing ties are considered.
+ * 
+ * @param g Graph.
+ * @param max_iter Maximum number of label propagation sweeps.
+ * @param method Either `"degree"`, `"rcm"`, or `"community"`.
+ */
+///@{
+inline std::vector< int > graph_order_degree(const CSRGraph & g)
+{
+
+    std::vector< int > order(g.vcount());
+    for (size_t i = 0u; i < order.size(); ++i)
+        order[i] = static_cast< int >(i);
+
+    std::stable_sort(order.begin(), order.end(), [&g](int a, int b) {
+        return g.degree(a) > g.degree(b);
+    });
+
+    return order;
+
+}
+
+inline std::vector< int > graph_order_rcm(const CSRGraph & g)
+{
+
+    size_t n = g.vcount();
+    const auto & offsets = g.get_offsets();
+    const auto & nbrs    = g.get_neighbors();
+
+    // Each component starts from an unvisited vertex of minimum degree
+    std::vector< int > by_degree(n);
+    for (size_t i = 0u; i < n; ++i)
+        by_degree[i] = static_cast< int >(i);
+
+    std::stable_sort(by_degree.begin(), by_degree.end(), [&g](int a, int b) {
+        return g.degree(a) < g.degree(b);
+    });
+
+    std::vector< int > order;
+    order.reserve(n);
+
+    std::vector< bool > visited(n, false);
+    std::vector< int > next;
+    for (auto root : by_degree)
+    {
+
+        if (visited[root])
+            continue;
+
+        // Breadth-first search, adding the neighbors by increasing degree
+        size_t head = order.size();
+        visited[root] = true;
+        order.push_back(root);
+        while (head < order.size())
+        {
+
+            int v = order[head++];
+
+            next.clear();
+            for (size_t k = offsets[v]; k < offsets[v + 1]; ++k)
+                if (!visited[nbrs[k]])
+                {
+                    visited[nbrs[k]] = true;
+                    next.push_back(nbrs[k]);
+                }
+
+            std::stable_sort(next.begin(), next.end(), [&g](int a, int b) {
+                return g.degree(a) < g.degree(b);
+            });
+
+            order.insert(order.end(), next.begin(), next.end());
+
+        }
+
+    }
+
+    std::reverse(order.begin(), order.end());
+
+    return order;
+
+}
+
+inline std::vector< int > graph_order_community(
+    const CSRGraph & g,
+    int max_iter = 20
+)
+{
+
+    size_t n = g.vcount();
+    const auto & offsets = g.get_offsets();
+    const auto & nbrs    = g.get_neighbors();
+
+    std::vector< int > label(n);
+    for (size_t i = 0u; i < n; ++i)
+        label[i] = static_cast< int >(i);
+
+    // Label propagation: each vertex takes the most common label among its
+    // neighbors (the current label or the smallest one on ties.) Sweeps are
+    // in vertex order, so the result is deterministic.
+    std::unordered_map< int, int > counts;
+    for (int iter = 0; iter < max_iter; ++iter)
+    {
+
+        bool changed = false;
+        for (size_t i = 0u; i < n; ++i)
+        {
+
+            if (offsets[i] == offsets[i + 1u])
+                continue;
+
+            counts.clear();
+            for (size_t k = offsets[i]; k < offsets[i + 1u]; ++k)
+                ++counts[label[nbrs[k]]];
+
+            int best   = -1;
+            int best_n = 0;
+            for (const auto & c : counts)
+                if ((c.second > best_n) ||
+                    ((c.second == best_n) && (c.first < best)))
+                {
+                    best   = c.first;
+                    best_n = c.second;
+                }
+
+            auto current = counts.find(label[i]);
+            if ((current != counts.end()) && (current->second == best_n))
+                best = label[i];
+
+            if (best != label[i])
+            {
+                label[i] = best;
+                changed  = true;
+            }
+
+        }
+
+        if (!changed)
+            break;
+
+    }
+
+    // Communities in order of appearance
+    std::vector< int > rank(n, -1);
+    int nranks = 0;
+    for (size_t i = 0u; i < n; ++i)
+        if (rank[label[i]] == -1)
+            rank[label[i]] = nranks++;
+
+    std::vector< int > order(n);
+    for (size_t i = 0u; i < n; ++i)
+        order[i] = static_cast< int >(i);
+
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return rank[label[a]] < rank[label[b]];
+    });
+
+    return order;
+
+}
+
+inline std::vector< int > graph_order(
+    const CSRGraph & g,
+    std::string method
+)
+{
+
+    if (method == "degree")
+        return graph_order_degree(g);
+    else if (method == "rcm")
+        return graph_order_rcm(g);
+    else if (method == "community")
+        return graph_order_community(g);
+
+    throw std::logic_error(
+        "The ordering method \"" + method + "\" is not supported. " +
+        "Use either \"degree\", \"rcm\", or \"community\"."
+        );
+
+}
+///@}
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 
-    VECT_MATCH(
-        transmission_virus,
-        other.transmission_virus,              ///< Id of the varia,
-        "DataBase:: transmission_virus[i] don't match"
-        )
+ End of -include/epiworld/csrgraph-order.hpp-
 
-    VECT_MATCH(
-        transmission_source_exposure_date,
-        other.transmission_source_exposure_date, ///< Date when the source acquired the varia,
-        "DataBase:: transmission_source_exposure_date[i] don't match"
-        )
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
 
 
-    VECT_MATCH(
-        transition_matrix,
-        other.transition_matrix,
-        "DataBase:: transition_matrix[i] don't match"
-        )
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 
+ Start of -include/epiworld/csrgraph-partition.hpp-
 
-    return true;
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_CSRGRAPH_PARTITION_HPP
+#define EPIWORLD_CSRGRAPH_PARTITION_HPP
+
+/**
+ * @name Partitions of the vertices of a graph
+ * 
+ * @details Each function returns `part`, with `part[i]` in `[0, nparts)` the
+ * part vertex `i` is assigned to. Parts have (almost) the same number of
+ * vertices. Used to split a population across processes (see
+ * `GraphPartition`), so few ties should cross parts.
+ * 
+ * - `graph_partition_block()` assigns contiguous ranges of ids (useful after
+ * relabeling the vertices, see `graph_order()`.)
+ * - `graph_partition_bfs()` grows each part by breadth-first search from the
+ * smallest unassigned id, so parts are connected regions of the graph.
+ * - `graph_partition_coords()` is a recursive coordinate bisection: the
+ * vertices are split along the axis with the widest range, proportionally
+ * to the number of parts on each side (e.g., for geographic partitions.)
+ * 
+ * @param g Graph.
+ * @param nparts Number of parts.
+ * @param x,y Coordinates of the vertices (e.g., longitude and latitude.)
+ * @param method Either `"block"` or `"bfs"`.
+ */
+///@{
+inline std::vector< int > graph_partition_block(size_t n, int nparts)
+{
+
+    if (nparts < 1)
+        throw std::range_error("The number of parts must be positive.");
+
+    std::vector< int > part(n);
+    for (size_t i = 0u; i < n; ++i)
+        part[i] = static_cast< int >(
+            (i * static_cast< size_t >(nparts)) / n
+            );
+
+    return part;
 
 }
 
-template<typename TSeq>
-inline bool DataBase<TSeq>::operator==(const DataBase<TSeq> & other) const
+inline std::vector< int > graph_partition_bfs(const CSRGraph & g, int nparts)
 {
-    VECT_MATCH(
-        virus_name,
-        other.virus_name,
-        "DataBase:: virus_name[i] don't match"
-    )
 
-    VECT_MATCH(
-        virus_sequence,
-        other.virus_sequence,
-        "DataBase:: virus_sequence[i] don't match"
-    )
+    if (nparts < 1)
+        throw std::range_error("The number of parts must be positive.");
 
-    VECT_MATCH(
-        virus_origin_date,
-        other.virus_origin_date,
-        "DataBase:: virus_origin_date[i] don't match"
-    )
+    size_t n = g.vcount();
+    const auto & offsets = g.get_offsets();
+    const auto & nbrs    = g.get_neighbors();
 
-    VECT_MATCH(
-        virus_parent_id,
-        other.virus_parent_id,
-        "DataBase:: virus_parent_id[i] don't match"
-    )
+    std::vector< int > part(n, -1);
+    std::vector< int > queue;
+    queue.reserve(n);
 
-    VECT_MATCH(
-        tool_name,
-        other.tool_name,
-        "DataBase:: tool_name[i] don't match"
-    )
+    size_t next_seed = 0u;
+    size_t assigned  = 0u;
+    for (int k = 0; k < nparts; ++k)
+    {
 
-    VECT_MATCH(
-        tool_sequence,
-        other.tool_sequence,
-        "DataBase:: tool_sequence[i] don't match"
-    )
+        // Sizes differ at most by one
+        size_t target = ((static_cast< size_t >(k) + 1u) * n) /
+            static_cast< size_t >(nparts);
 
-    VECT_MATCH(
-        tool_origin_date,
-        other.tool_origin_date,
-        "DataBase:: tool_origin_date[i] don't match"
-    )
+        queue.clear();
+        size_t head = 0u;
+        while (assigned < target)
+        {
 
-    
-    EPI_DEBUG_FAIL_AT_TRUE(
-        sampling_freq != other.sampling_freq,
-        "DataBase:: sampling_freq don't match."
-    )
+            // Starting a new region (or continuing in another component)
+            if (head == queue.size())
+            {
 
-    // Variants history
-    VECT_MATCH(
-        hist_virus_date,
-        other.hist_virus_date,
-        "DataBase:: hist_virus_date[i] don't match"
-    )
+                while (part[next_seed] != -1)
+                    ++next_seed;
 
-    VECT_MATCH(
-        hist_virus_id,
-        other.hist_virus_id,
-        "DataBase:: hist_virus_id[i] don't match"
-    )
+                part[next_seed] = k;
+                queue.push_back(static_cast< int >(next_seed));
+                ++assigned;
+                continue;
 
-    VECT_MATCH(
-        hist_virus_state,
-        other.hist_virus_state,
-        "DataBase:: hist_virus_state[i] don't match"
-    )
+            }
 
-    VECT_MATCH(
-        hist_virus_counts,
-        other.hist_virus_counts,
-        "DataBase:: hist_virus_counts[i] don't match"
-    )
+            int v = queue[head++];
+            for (size_t j = offsets[v]; (j < offsets[v + 1]) &&
+                (assigned < target); ++j)
+                if (part[nbrs[j]] == -1)
+                {
+                    part[nbrs[j]] = k;
+                    queue.push_back(nbrs[j]);
+                    ++assigned;
+                }
 
-    // Tools history
-    VECT_MATCH(
-        hist_tool_date,
-        other.hist_tool_date,
-        "DataBase:: hist_tool_date[i] don't match"
-    )
+        }
 
-    VECT_MATCH(
-        hist_tool_id,
-        other.hist_tool_id,
-        "DataBase:: hist_tool_id[i] don't match"
-    )
+    }
 
-    VECT_MATCH(
-        hist_tool_state,
-        other.hist_tool_state,
-        "DataBase:: hist_tool_state[i] don't match"
-    )
+    return part;
 
-    VECT_MATCH(
-        hist_tool_counts,
-        other.hist_tool_counts,
-        "DataBase:: hist_tool_counts[i] don't match"
-    )
+}
 
-    // Overall hist
-    VECT_MATCH(
-        hist_total_date,
-        other.hist_total_date,
-        "DataBase:: hist_total_date[i] don't match"
-    )
+inline std::vector< int > graph_partition_coords(
+    const std::vector< double > & x,
+    const std::vector< double > & y,
+    int nparts
+)
+{
 
-    VECT_MATCH(
-        hist_total_nviruses_active,
-        other.hist_total_nviruses_active,
-        "DataBase:: hist_total_nviruses_active[i] don't match"
-    )
+    if (nparts < 1)
+        throw std::range_error("The number of parts must be positive.");
 
-    VECT_MATCH(
-        hist_total_state,
-        other.hist_total_state,
-        "DataBase:: hist_total_state[i] don't match"
-    )
+    if (x.size() != y.size())
+        throw std::length_error(
+            "The coordinates -x- (" + std::to_string(x.size()) +
+            ") and -y- (" + std::to_string(y.size()) +
+            ") must be of the same length."
+            );
 
-    VECT_MATCH(
-        hist_total_counts,
-        other.hist_total_counts,
-        "DataBase:: hist_total_counts[i] don't match"
-    )
+    size_t n = x.size();
+    std::vector< int > idx(n);
+    for (size_t i = 0u; i < n; ++i)
+        idx[i] = static_cast< int >(i);
 
-    VECT_MATCH(
-        hist_transition_matrix,
-        other.hist_transition_matrix,
-        "DataBase:: hist_transition_matrix[i] don't match"
-    )
+    std::vector< int > part(n, 0);
 
-    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
-    EPI_DEBUG_FAIL_AT_TRUE(
-        today_virus.size() != other.today_virus.size(),
-        "DataBase:: today_virus.size() don't match."
-    )
-    
-    for (size_t i = 0u; i < today_virus.size(); ++i)
+    // Each task is a range of idx to split into parts [p0, p0 + np)
+    struct Task {size_t begin; size_t end; int p0; int np;};
+    std::vector< Task > tasks = {{0u, n, 0, nparts}};
+    while (tasks.size() > 0u)
     {
-        VECT_MATCH(
-            today_virus[i], other.today_virus[i],
-            "DataBase:: today_virus[i] don't match"
-            )
-    }
 
-    // {Variant 1: {state 1, state 2, etc.}, Variant 2: {...}, ...}
-    EPI_DEBUG_FAIL_AT_TRUE(
-        today_tool.size() != other.today_tool.size(),
-        "DataBase:: today_tool.size() don't match."
-    )
-    
-    for (size_t i = 0u; i < today_tool.size(); ++i)
-    {
-        VECT_MATCH(
-            today_tool[i], other.today_tool[i],
-            "DataBase:: today_tool[i] don't match"
-            )
+        Task t = tasks.back();
+        tasks.pop_back();
+
+        if (t.np == 1)
+        {
+            for (size_t i = t.begin; i < t.end; ++i)
+                part[idx[i]] = t.p0;
+            continue;
+        }
+
+        if (t.begin == t.end)
+            continue;
+
+        double xmin = x[idx[t.begin]], xmax = xmin;
+        double ymin = y[idx[t.begin]], ymax = ymin;
+        for (size_t i = t.begin; i < t.end; ++i)
+        {
+            xmin = std::min(xmin, x[idx[i]]);
+            xmax = std::max(xmax, x[idx[i]]);
+            ymin = std::min(ymin, y[idx[i]]);
+            ymax = std::max(ymax, y[idx[i]]);
+        }
+
+        const auto & coord = ((xmax - xmin) >= (ymax - ymin)) ? x : y;
+
+        int left  = t.np / 2;
+        size_t mid = t.begin + ((t.end - t.begin) * static_cast< size_t >(left)) /
+            static_cast< size_t >(t.np);
+
+        std::nth_element(
+            idx.begin() + t.begin, idx.begin() + mid, idx.begin() + t.end,
+            [&coord](int a, int b) {
+                return (coord[a] < coord[b]) ||
+                    ((coord[a] == coord[b]) && (a < b));
+            });
+
+        tasks.push_back({t.begin, mid, t.p0, left});
+        tasks.push_back({mid, t.end, t.p0 + left, t.np - left});
+
     }
 
-    // {Susceptible, Infected, etc.}
-    VECT_MATCH(
-        today_total, other.today_total,
-        "DataBase:: today_total[i] don't match"
-        )
+    return part;
 
-    // Totals
-    EPI_DEBUG_FAIL_AT_TRUE(
-        today_total_nviruses_active != other.today_total_nviruses_active,
-        "DataBase:: today_total_nviruses_active don't match."
-    )
+}
+
+inline std::vector< int > graph_partition(
+    const CSRGraph & g,
+    int nparts,
+    std::string method = "bfs"
+)
+{
+
+    if (method == "block")
+        return graph_partition_block(g.vcount(), nparts);
+    else if (method == "bfs")
+        return graph_partition_bfs(g, nparts);
+
+    throw std::logic_error(
+        "The partition method \"" + method + "\" is not supported. " +
+        "Use either \"block\" or \"bfs\"."
+        );
+
+}
+///@}
+
+/**
+ * @brief Part of a graph owned by one process
+ * 
+ * @details Given a partition of the vertices (see `graph_partition()`), the
+ * local graph of part `rank` has the vertices it owns, with local ids
+ * `0, ..., n_owned() - 1`, followed by its ghosts: the vertices owned by
+ * other parts that are neighbors of an owned vertex. Both are sorted by
+ * global id. The local graph has all the ties of the owned vertices, but
+ * no ties between ghosts.
+ * 
+ * `get_send_ids(r)` are the (local ids of the) owned vertices that are
+ * ghosts in part `r`, and `get_recv_ids(r)` the ghosts owned by part `r`.
+ * Since both are sorted by global id, `get_send_ids(r)` in this part
+ * matches `get_recv_ids(rank)` in part `r`.
+ */
+class GraphPartition {
+private:
+
+    int rank   = 0;
+    int nparts = 1;
+    size_t n_owned_ = 0u;
+
+    std::vector< int > global_ids; ///< Global id of each local vertex.
+    CSRGraph graph;
+
+    std::vector< std::vector< int > > send_ids;
+    std::vector< std::vector< int > > recv_ids;
+
+    /**
+     * @brief Builds the local graph
+     * 
+     * @param n Number of vertices of the global graph.
+     * @param row Function called as `row(i, fun)` that calls
+     * `fun(j, multiplicity, weight)` for each tie `i -> j`. For undirected
+     * graphs, only the rows of the owned vertices are visited.
+     */
+    template<typename TRow>
+    void build(
+        size_t n,
+        const std::vector< int > & part,
+        int nparts,
+        bool directed,
+        bool weighted,
+        TRow row
+        );
+
+public:
+
+    GraphPartition() {};
+
+    /**
+     * @brief Part of a global graph in memory
+     * 
+     * @details Mostly for testing: every process needs the whole graph (see
+     * the constructor reading a file.)
+     * 
+     * @param g Global graph.
+     * @param part Part of each vertex of `g`.
+     * @param rank Part to extract.
+     * @param nparts Number of parts (if negative, the largest in `part`
+     * plus one.)
+     */
+    GraphPartition(
+        const CSRGraph & g,
+        const std::vector< int > & part,
+        int rank,
+        int nparts = -1
+        );
+
+    /**
+     * @brief Part of a graph in binary format
+     * 
+     * @details `fn` is a graph written by `CSRGraph::write_binary()` (or the
+     * cache `fn + ".csr"` of `CSRGraph::read_edgelist()`.) The file is
+     * memory-mapped, and the global graph is never loaded: for undirected
+     * graphs, only the rows of the owned vertices are read, which, with a
+     * block partition (see `graph_partition_block()`), is a single range of
+     * the file. Directed graphs also need the ties from other vertices to
+     * the owned ones, so all the rows are scanned, keeping only those ties.
+     * 
+     * @param fn Path to the file.
+     * @param part,rank,nparts As in the other constructor.
+     */
+    GraphPartition(
+        std::string fn,
+        const std::vector< int > & part,
+        int rank,
+        int nparts = -1
+        );
+
+    int get_rank() const noexcept {return rank;};
+    int get_nparts() const noexcept {return nparts;};
+    size_t n_owned() const noexcept {return n_owned_;};
+    size_t n_ghosts() const noexcept {return global_ids.size() - n_owned_;};
+
+    const CSRGraph & get_graph() const noexcept {return graph;};
+    const std::vector< int > & get_global_ids() const noexcept {return global_ids;};
+    int get_global_id(size_t i) const {return global_ids[i];};
+
+    const std::vector< int > & get_send_ids(int r) const {return send_ids[r];};
+    const std::vector< int > & get_recv_ids(int r) const {return recv_ids[r];};
+
+};
+
+template<typename TRow>
+inline void GraphPartition::build(
+    size_t n,
+    const std::vector< int > & part,
+    int nparts,
+    bool directed,
+    bool weighted,
+    TRow row
+)
+{
 
-    // Transmission network
-    VECT_MATCH( ///< Date of the transmission eve
-        transmission_date,
-        other.transmission_date,
-        "DataBase:: transmission_date[i] don't match"
-    )
+    if (part.size() != n)
+        throw std::length_error(
+            "The partition (" + std::to_string(part.size()) +
+            ") must be of the same length as the number of vertices (" +
+            std::to_string(n) + ")."
+            );
 
-    VECT_MATCH( ///< Id of the sour
-        transmission_source,
-        other.transmission_source,
-        "DataBase:: transmission_source[i] don't match"
-    )
+    int max_part = -1;
+    for (auto p : part)
+    {
+        if (p < 0)
+            throw std::range_error("Parts cannot be negative.");
+        max_part = std::max(max_part, p);
+    }
 
-    VECT_MATCH( ///< Id of the targ
-        transmission_target,
-        other.transmission_target,
-        "DataBase:: transmission_target[i] don't match"
-    )
+    if (nparts < 0)
+        nparts = max_part + 1;
+    else if (max_part >= nparts)
+        throw std::range_error(
+            "Parts must be between 0 and " + std::to_string(nparts - 1) + "."
+            );
 
-    VECT_MATCH( ///< Id of the varia
-        transmission_virus,
-        other.transmission_virus,
-        "DataBase:: transmission_virus[i] don't match"
-    )
+    if ((rank < 0) || (rank >= nparts))
+        throw std::range_error(
+            "The rank must be between 0 and " + std::to_string(nparts - 1) + "."
+            );
 
-    VECT_MATCH( ///< Date when the source acquired the varia
-        transmission_source_exposure_date,
-        other.transmission_source_exposure_date,
-        "DataBase:: transmission_source_exposure_date[i] don't match"
-    )
+    this->nparts = nparts;
 
-    VECT_MATCH(
-        transition_matrix,
-        other.transition_matrix,
-        "DataBase:: transition_matrix[i] don't match"
-    )
+    // Owned vertices and, per part, the vertices exchanged with it
+    std::vector< std::vector< int > > send_global(nparts);
+    std::vector< std::vector< int > > recv_global(nparts);
+    for (size_t i = 0u; i < n; ++i)
+        if (part[i] == rank)
+            global_ids.push_back(static_cast< int >(i));
 
-    return true;
+    n_owned_ = global_ids.size();
 
-}
+    std::vector< int > source, target;
+    std::vector< epiworld_double > weight;
+    for (size_t i = 0u; i < n; ++i)
+    {
 
-template<typename TSeq>
-inline void DataBase<TSeq>::generation_time(
-    std::vector< int > & agent_id,
-    std::vector< int > & virus_id,
-    std::vector< int > & time,
-    std::vector< int > & gentime
-) const {
-    
-    size_t nevents = transmission_date.size();
+        // Undirected ties are in both rows, so the rows of the owned
+        // vertices have all the ties we need
+        bool own_i = part[i] == rank;
+        if (!directed && !own_i)
+            continue;
 
-    agent_id.reserve(nevents);
-    virus_id.reserve(nevents);
-    time.reserve(nevents);
-    gentime.reserve(nevents);
+        row(i, [&](int j, int m, epiworld_double w) -> void {
 
-    // Iterating through the individuals
-    for (size_t i = 0u; i < nevents; ++i)
-    {
-        int agent_id_i = transmission_target[i];
-        agent_id.push_back(agent_id_i);
-        virus_id.push_back(transmission_virus[i]);
-        time.push_back(transmission_date[i]);
+            if ((j < 0) || (static_cast< size_t >(j) >= n))
+                throw std::range_error(
+                    "The vertex " + std::to_string(i) + " has a tie to " +
+                    std::to_string(j) + ", which is out of range."
+                    );
 
-        bool found = false;
-        for (size_t j = i; j < nevents; ++j)
-        {
+            if (static_cast< size_t >(j) == i)
+                return;
 
-            if (transmission_source[j] == agent_id_i)
+            // Undirected ties between owned vertices are added once
+            bool own_j = part[j] == rank;
+            if ((!directed && own_j && (static_cast< size_t >(j) < i)) ||
+                (!own_i && !own_j))
+                return;
+
+            if (own_i && !own_j)
             {
-                gentime.push_back(transmission_date[j] - time[i]);
-                found = true;
-                break;
+                send_global[part[j]].push_back(static_cast< int >(i));
+                recv_global[part[j]].push_back(j);
+            }
+            else if (!own_i && own_j)
+            {
+                send_global[part[i]].push_back(j);
+                recv_global[part[i]].push_back(static_cast< int >(i));
             }
 
-        }
+            for (int r = 0; r < m; ++r)
+            {
+                source.push_back(static_cast< int >(i));
+                target.push_back(j);
+                if (weighted)
+                    weight.push_back(w);
+            }
 
-        // If there's no transmission, we set the generation time to
-        // minus 1;
-        if (!found)
-            gentime.push_back(-1);
+        });
 
     }
 
-    agent_id.shrink_to_fit();
-    virus_id.shrink_to_fit();
-    time.shrink_to_fit();
-    gentime.shrink_to_fit();
-
-    return;
-
-}
-
-template<typename TSeq>
-inline void DataBase<TSeq>::generation_time(
-    std::string fn
-) const
-{
+    for (auto & ids : send_global)
+    {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
 
-    std::vector< int > agent_id;
-    std::vector< int > virus_id;
-    std::vector< int > time;
-    std::vector< int > gentime;
+    // Ghosts, sorted by global id
+    std::vector< int > ghosts;
+    for (auto & ids : recv_global)
+    {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        ghosts.insert(ghosts.end(), ids.begin(), ids.end());
+    }
 
-    generation_time(agent_id, virus_id, time, gentime);
+    std::sort(ghosts.begin(), ghosts.end());
+    global_ids.insert(global_ids.end(), ghosts.begin(), ghosts.end());
 
-    std::ofstream fn_file(fn, std::ios_base::out);
+    std::unordered_map< int, int > local_id;
+    local_id.reserve(global_ids.size());
+    for (size_t i = 0u; i < global_ids.size(); ++i)
+        local_id[global_ids[i]] = static_cast< int >(i);
 
-    // Throw an error if the file doesn't exists using throw
-    if (!fn_file)
+    for (size_t i = 0u; i < source.size(); ++i)
     {
-        throw std::runtime_error(
-            "DataBase::generation_time: "
-            "Cannot open file " + fn + "."
-        );
+        source[i] = local_id[source[i]];
+        target[i] = local_id[target[i]];
     }
 
+    send_ids.resize(nparts);
+    recv_ids.resize(nparts);
+    for (int r = 0; r < nparts; ++r)
+    {
 
+        for (auto id : send_global[r])
+            send_ids[r].push_back(local_id[id]);
 
-    fn_file << 
-        #ifdef EPI_DEBUG
-        "thread " <<
-        #endif
-        "virus source source_exposure_date gentime\n";
+        for (auto id : recv_global[r])
+            recv_ids[r].push_back(local_id[id]);
 
-    size_t n = agent_id.size();
-    for (size_t i = 0u; i < n; ++i)
-        fn_file <<
-            #ifdef EPI_DEBUG
-            EPI_GET_THREAD_ID() << " " <<
-            #endif
-            virus_id[i] << " " <<
-            agent_id[i] << " " <<
-            time[i] << " " <<
-            gentime[i] << "\n";
+    }
 
-    return;
+    int nlocal = static_cast< int >(global_ids.size());
+    if (weighted)
+        graph = CSRGraph(source, target, weight, nlocal, directed);
+    else
+        graph = CSRGraph(source, target, nlocal, directed);
 
 }
 
-#undef VECT_MATCH
-
-#endif
-/*//////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-
- End of -include/epiworld/database-meat.hpp-
-
-////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////*/
+inline GraphPartition::GraphPartition(
+    const CSRGraph & g,
+    const std::vector< int > & part,
+    int rank,
+    int nparts
+) : rank(rank)
+{
 
+    const auto & offsets = g.get_offsets();
+    const auto & nbrs    = g.get_neighbors();
+    const auto & mult    = g.get_multiplicity();
+    const auto & w       = g.get_weights();
 
-/*//////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
+    build(
+        g.vcount(), part, nparts, g.is_directed(), w.size() > 0u,
+        [&](size_t i, auto && fun) {
+            for (size_t k = offsets[i]; k < offsets[i + 1u]; ++k)
+                fun(
+                    nbrs[k],
+                    (mult.size() > 0u) ? mult[k] : 1,
+                    (w.size() > 0u) ? w[k] : 1.0
+                    );
+        });
 
- Start of -include/epiworld/adjlist-bones.hpp-
+}
 
-////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////*/
+inline GraphPartition::GraphPartition(
+    std::string fn,
+    const std::vector< int > & part,
+    int rank,
+    int nparts
+) : rank(rank)
+{
 
+    MappedFile file(fn);
+    GraphFileHeader header = read_graph_file_header(file, fn);
 
-#ifndef EPIWORLD_ADJLIST_BONES_HPP
-#define EPIWORLD_ADJLIST_BONES_HPP
+    size_t nv       = static_cast< size_t >(header.vcount);
+    size_t nnz      = static_cast< size_t >(header.nnz);
+    bool has_mult   = (header.flags & 2u) != 0u;
+    bool has_weight = (header.flags & 4u) != 0u;
 
-class AdjList {
-private:
+    // Where each array starts (see GraphFileHeader). Values are copied one
+    // at a time since the mapping has no alignment guarantees.
+    const char * offsets = file.data() + sizeof(header);
+    const char * nbrs    = offsets + (nv + 1u) * sizeof(std::uint64_t);
+    const char * mult    = nbrs + nnz * sizeof(std::int32_t);
+    const char * w       = mult + (has_mult ? nnz * sizeof(std::int32_t) : 0u);
 
-    std::vector<std::map<int, int>> dat;
-    bool directed;
-    epiworld_fast_uint N = 0;
-    epiworld_fast_uint E = 0;
+    build(
+        nv, part, nparts, (header.flags & 1u) != 0u, has_weight,
+        [&](size_t i, auto && fun) {
 
-public:
+            std::uint64_t range[2u];
+            std::memcpy(range, offsets + i * sizeof(std::uint64_t), sizeof(range));
 
-    AdjList() {};
+            if ((range[0u] > range[1u]) || (range[1u] > nnz))
+                throw std::runtime_error(
+                    "The graph file " + fn + " is truncated or corrupted."
+                    );
 
-    /**
-     * @brief Construct a new Adj List object
-     * 
-     * @details 
-     * Ids in the network are assume to range from `0` to `size - 1`.
-     * 
-     * @param source Unsigned int vector with the source
-     * @param target Unsigned int vector with the target
-     * @param size Number of vertices in the network.
-     * @param directed Bool true if the network is directed
-     */
-    AdjList(
-        const std::vector< int > & source,
-        const std::vector< int > & target,
-        int size,
-        bool directed
-        );
+            for (size_t k = range[0u]; k < range[1u]; ++k)
+            {
 
-    AdjList(AdjList && a); // Move constructor
-    AdjList(const AdjList & a); // Copy constructor
-    AdjList& operator=(const AdjList& a);
+                std::int32_t j, m = 1;
+                double wk = 1.0;
+                std::memcpy(&j, nbrs + k * sizeof(std::int32_t), sizeof(j));
 
+                if (has_mult)
+                    std::memcpy(&m, mult + k * sizeof(std::int32_t), sizeof(m));
 
-    /**
-     * @brief Read an edgelist
-     * 
-     * Ids in the network are assume to range from `0` to `size - 1`.
-     * 
-     * @param fn Path to the file
-     * @param skip Number of lines to skip (e.g., 1 if there's a header)
-     * @param directed `true` if the network is directed
-     * @param size Number of vertices in the network.
-     */
-    void read_edgelist(
-        std::string fn,
-        int size,
-        int skip = 0,
-        bool directed = true
-        );
+                if (has_weight)
+                    std::memcpy(&wk, w + k * sizeof(double), sizeof(wk));
 
-    std::map<int, int> operator()(
-        epiworld_fast_uint i
-        ) const;
-        
-    void print(epiworld_fast_uint limit = 20u) const;
-    size_t vcount() const; ///< Number of vertices/nodes in the network.
-    size_t ecount() const; ///< Number of edges/arcs/ties in the network.
-    
-    std::vector<std::map<int,int>> & get_dat() {
-        return dat;
-    };
+                fun(
+                    static_cast< int >(j), static_cast< int >(m),
+                    static_cast< epiworld_double >(wk)
+                    );
 
-    bool is_directed() const; ///< `true` if the network is directed.
+            }
 
-};
+        });
 
+}
 
 #endif
-
 /*//////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
- End of -include/epiworld/adjlist-bones.hpp-
+ End of -include/epiworld/csrgraph-partition.hpp-
 
 ////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////*/
@@ -4849,244 +10584,285 @@ public:
 /*//////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
- Start of -include/epiworld/adjlist-meat.hpp-
+ Start of -include/epiworld/network-deltas.hpp-
 
 ////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////*/
 
 
-#ifndef EPIWORLD_ADJLIST_MEAT_HPP
-#define EPIWORLD_ADJLIST_MEAT_HPP
+#ifndef EPIWORLD_NETWORK_DELTAS_HPP
+#define EPIWORLD_NETWORK_DELTAS_HPP
 
-inline AdjList::AdjList(
+/**
+ * @brief Daily changes of a network in binary format
+ * 
+ * @details The file starts with a `NetworkDeltasHeader`, followed by one
+ * record per day (in increasing order of `day`). Each record is a
+ * `NetworkDeltasRecord` followed by the ties to add (`n_add` sources and
+ * then `n_add` targets, as `int32_t`) and the ties to remove (`n_rm`
+ * sources and `n_rm` targets.) Files are written in the byte order of the
+ * machine. See `write_network_deltas()`.
+ */
+///@{
+struct NetworkDeltasHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t vcount;
+};
+
+struct NetworkDeltasRecord {
+    std::int32_t day;
+    std::uint32_t reserved;
+    std::uint64_t n_add;
+    std::uint64_t n_rm;
+};
+
+static const char network_deltas_magic[8] = {'E', 'P', 'I', 'W', 'D', 'L', 'T', '\0'};
+static const std::uint32_t network_deltas_version = 1u;
+///@}
+
+/**
+ * @brief Writes the daily changes of a network
+ * 
+ * @param fn Path to the file.
+ * @param vcount Number of vertices of the network.
+ * @param day Day of each change.
+ * @param source,target Tie.
+ * @param add `true` if the tie is added, `false` if it is removed.
+ */
+inline void write_network_deltas(
+    std::string fn,
+    size_t vcount,
+    const std::vector< int > & day,
     const std::vector< int > & source,
     const std::vector< int > & target,
-    int size,
-    bool directed
-) : directed(directed) {
+    const std::vector< bool > & add
+)
+{
 
+    size_t n = day.size();
+    if ((source.size() != n) || (target.size() != n) || (add.size() != n))
+        throw std::length_error(
+            "The day, source, target, and add vectors must be of the same length."
+            );
 
-    dat.resize(size, std::map<int,int>({}));
-    int max_id = size - 1;
+    check_id_range(source, static_cast< int >(vcount) - 1, "source");
+    check_id_range(target, static_cast< int >(vcount) - 1, "target");
 
-    int i,j;
-    for (int m = 0; m < static_cast<int>(source.size()); ++m)
-    {
+    std::ofstream f(fn, std::ios::binary);
+    if (!f)
+        throw std::runtime_error(
+            "Could not open file \"" + fn + "\" for writing."
+            );
 
-        i = source[m];
-        j = target[m];
+    NetworkDeltasHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, network_deltas_magic, 8u);
+    header.version = network_deltas_version;
+    header.vcount  = static_cast< std::uint64_t >(vcount);
+    f.write(reinterpret_cast< const char * >(&header), sizeof(header));
 
-        if (i > max_id)
-            throw std::range_error(
-                "The source["+std::to_string(m)+"] = " + std::to_string(i) +
-                " is above the max_id " + std::to_string(max_id)
-                );
+    // Grouping the changes by day (keeping their order)
+    std::vector< size_t > idx(n);
+    for (size_t i = 0u; i < n; ++i)
+        idx[i] = i;
 
-        if (j > max_id)
-            throw std::range_error(
-                "The target["+std::to_string(m)+"] = " + std::to_string(j) +
-                " is above the max_id " + std::to_string(max_id)
-                );
+    std::stable_sort(idx.begin(), idx.end(), [&day](size_t a, size_t b) {
+        return day[a] < day[b];
+    });
 
-        // Adding nodes
-        if (dat[i].find(j) == dat[i].end())
-            dat[i].insert(std::pair<int, int>(j, 1u));
-        else
-            dat[i][j]++; 
-        
-        if (!directed)
+    std::vector< std::int32_t > add_s, add_t, rm_s, rm_t;
+    for (size_t start = 0u; start < n;)
+    {
+
+        size_t end = start;
+        while ((end < n) && (day[idx[end]] == day[idx[start]]))
+            ++end;
+
+        add_s.clear(); add_t.clear(); rm_s.clear(); rm_t.clear();
+        for (size_t k = start; k < end; ++k)
         {
 
-            if (dat[j].find(i) == dat[j].end())
-                dat[j].insert(std::pair<int, int>(i, 1u));
+            size_t i = idx[k];
+            if (add[i])
+            {
+                add_s.push_back(source[i]);
+                add_t.push_back(target[i]);
+            }
             else
-                dat[j][i]++;
+            {
+                rm_s.push_back(source[i]);
+                rm_t.push_back(target[i]);
+            }
 
         }
 
-        E++;
-
-    }
-
-    N = size;
+        NetworkDeltasRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.day   = static_cast< std::int32_t >(day[idx[start]]);
+        record.n_add = add_s.size();
+        record.n_rm  = rm_s.size();
 
-    return;
+        f.write(reinterpret_cast< const char * >(&record), sizeof(record));
+        f.write(reinterpret_cast< const char * >(add_s.data()), add_s.size() * sizeof(std::int32_t));
+        f.write(reinterpret_cast< const char * >(add_t.data()), add_t.size() * sizeof(std::int32_t));
+        f.write(reinterpret_cast< const char * >(rm_s.data()), rm_s.size() * sizeof(std::int32_t));
+        f.write(reinterpret_cast< const char * >(rm_t.data()), rm_t.size() * sizeof(std::int32_t));
 
-}
+        start = end;
 
+    }
 
-inline AdjList::AdjList(AdjList && a) :
-    dat(std::move(a.dat)),
-    directed(a.directed),
-    N(a.N),
-    E(a.E)
-{
+    if (!f)
+        throw std::runtime_error(
+            "Could not write the network changes to \"" + fn + "\"."
+            );
 
 }
 
-inline AdjList::AdjList(const AdjList & a) :
-    dat(a.dat),
-    directed(a.directed),
-    N(a.N),
-    E(a.E)
-{
-
-}
+/**
+ * @brief Streams the daily changes of a network
+ * 
+ * @details Only the record of the current day is kept in memory. Records
+ * hold ties only (no weights; see `Model::set_network_deltas()`.) Records
+ * are read in order: `read(day)` skips the records before `day`, and
+ * `rewind()` goes back to the first record (e.g., to replay a week.)
+ */
+class NetworkDeltas {
+private:
 
-inline AdjList& AdjList::operator=(const AdjList& a)
-{
-    if (this == &a)
-        return *this;
+    std::string fn;
+    std::ifstream file;
+    std::streampos first_record;
+    std::uint64_t vcount = 0u;
 
-    this->dat = a.dat;
-    this->directed = a.directed;
-    this->N = a.N;
-    this->E = a.E;
+    NetworkDeltasRecord next;
+    bool has_next = false;
 
-    return *this;
-}
+    void read_record_header();
+    void read_ints(std::vector< int > & x, std::uint64_t n);
 
-inline void AdjList::read_edgelist(
-    std::string fn,
-    int size,
-    int skip,
-    bool directed
-) {
+public:
 
-    int i,j;
-    std::ifstream filei(fn);
+    std::vector< int > add_source; ///< Ties added (current record.)
+    std::vector< int > add_target;
+    std::vector< int > rm_source;  ///< Ties removed (current record.)
+    std::vector< int > rm_target;
 
-    if (!filei)
-        throw std::logic_error("The file " + fn + " was not found.");
+    NetworkDeltas(std::string fn);
 
-    int linenum = 0;
-    std::vector< int > source_;
-    std::vector< int > target_;
+    /**
+     * @brief Reads the record of `day` (if any)
+     * @return `true` if there is a record for `day`.
+     */
+    bool read(int day);
 
-    source_.reserve(1e5);
-    target_.reserve(1e5);
+    void rewind();
 
-    int max_id = size - 1;
+    size_t get_vcount() const noexcept {return static_cast< size_t >(vcount);};
 
-    while (!filei.eof())
-    {
+};
 
-        if (linenum++ < skip)
-            continue;
+inline NetworkDeltas::NetworkDeltas(std::string fn_) : fn(fn_)
+{
 
-        filei >> i >> j;
+    file.open(fn, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Could not open file \"" + fn + "\".");
 
-        // Looking for exceptions
-        if (filei.bad())
-            throw std::logic_error(
-                "I/O error while reading the file " +
-                fn
+    NetworkDeltasHeader header;
+    if (!file.read(reinterpret_cast< char * >(&header), sizeof(header)) ||
+        (std::memcmp(header.magic, network_deltas_magic, 8u) != 0))
+        throw std::logic_error(
+            "The file \"" + fn + "\" is not a file of network changes."
             );
 
-        if (filei.fail())
-            break;
-
-        if (i > max_id)
-            throw std::range_error(
-                "The source["+std::to_string(linenum)+"] = " + std::to_string(i) +
-                " is above the max_id " + std::to_string(max_id)
-                );
-
-        if (j > max_id)
-            throw std::range_error(
-                "The target["+std::to_string(linenum)+"] = " + std::to_string(j) +
-                " is above the max_id " + std::to_string(max_id)
-                );
+    if (header.version != network_deltas_version)
+        throw std::logic_error(
+            "The file \"" + fn + "\" has version " +
+            std::to_string(header.version) + " (expected " +
+            std::to_string(network_deltas_version) + ")."
+            );
 
-        source_.push_back(i);
-        target_.push_back(j);
+    vcount       = header.vcount;
+    first_record = file.tellg();
+    read_record_header();
 
-    }
+}
 
-    // Now using the right constructor
-    *this = AdjList(source_, target_, size, directed);
+inline void NetworkDeltas::read_record_header()
+{
 
-    return;
+    has_next = static_cast< bool >(
+        file.read(reinterpret_cast< char * >(&next), sizeof(next))
+        );
 
 }
 
-inline std::map<int,int> AdjList::operator()(
-    epiworld_fast_uint i
-    ) const {
+inline void NetworkDeltas::read_ints(std::vector< int > & x, std::uint64_t n)
+{
 
-    if (i >= N)
-        throw std::range_error(
-            "The vertex id " + std::to_string(i) + " is not in the network."
+    x.resize(n);
+    if ((n > 0u) && !file.read(reinterpret_cast< char * >(x.data()), n * sizeof(std::int32_t)))
+        throw std::runtime_error(
+            "The file \"" + fn + "\" ended in the middle of a record."
             );
 
-    return dat[i];
-
 }
 
-inline void AdjList::print(epiworld_fast_uint limit) const {
+inline bool NetworkDeltas::read(int day)
+{
 
+    add_source.clear(); add_target.clear();
+    rm_source.clear(); rm_target.clear();
 
-    epiworld_fast_uint counter = 0;
-    printf_epiworld("Nodeset:\n");
-    int i = -1;
-    for (auto & n : dat)
+    // Skipping the records of previous days
+    while (has_next && (next.day < day))
     {
 
-        if (counter++ > limit)
-            break;
+        file.seekg(
+            static_cast< std::streamoff >(2u * (next.n_add + next.n_rm) * sizeof(std::int32_t)),
+            std::ios::cur
+            );
 
-        printf_epiworld("  % 3i: {", ++i);
-        int niter = 0;
-        for (auto n_n : n)
-            if (++niter < static_cast<int>(n.size()))
-            {    
-                printf_epiworld("%i, ", static_cast<int>(n_n.first));
-            }
-            else {
-                printf_epiworld("%i}\n", static_cast<int>(n_n.first));
-            }
-    }
+        read_record_header();
 
-    if (limit < dat.size())
-    {
-        printf_epiworld(
-            "  (... skipping %i records ...)\n",
-            static_cast<int>(dat.size() - limit)
-            );
     }
 
-}
+    if (!has_next || (next.day != day))
+        return false;
+
+    read_ints(add_source, next.n_add);
+    read_ints(add_target, next.n_add);
+    read_ints(rm_source, next.n_rm);
+    read_ints(rm_target, next.n_rm);
+
+    read_record_header();
+
+    return true;
 
-inline size_t AdjList::vcount() const 
-{
-    return N;
 }
 
-inline size_t AdjList::ecount() const 
+inline void NetworkDeltas::rewind()
 {
-    return E;
-}
 
-inline bool AdjList::is_directed() const {
+    file.clear();
+    file.seekg(first_record);
+    read_record_header();
 
-    if (dat.size() == 0u)
-        throw std::logic_error("The edgelist is empty.");
-    
-    return directed;
-    
 }
 
 #endif
 /*//////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
- End of -include/epiworld/adjlist-meat.hpp-
+ End of -include/epiworld/network-deltas.hpp-
 
 ////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////*/
 
 
-
 /*//////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -5115,6 +10891,77 @@ inline void rewire_degseq(
     epiworld_double proportion
     );
 
+/**
+ * @brief Neighbor slots (half-edges) of the agents
+ * 
+ * @details `owner[k]` is the agent of the k-th slot, and the slot is
+ * `k - starts[owner[k]]` in its list of neighbors. Drawing a slot uniformly
+ * picks an agent with probability proportional to its degree, and one of
+ * its neighbors uniformly, in O(1).
+ */
+template<typename TSeq>
+inline void rewire_stubs(
+    const std::vector< Agent<TSeq> > & agents,
+    std::vector< size_t > & starts,
+    std::vector< epiworld_fast_uint > & owner
+)
+{
+
+    starts.assign(agents.size() + 1u, 0u);
+    for (size_t i = 0u; i < agents.size(); ++i)
+        starts[i + 1u] = starts[i] + agents[i].get_n_neighbors();
+
+    owner.resize(starts.back());
+    for (size_t i = 0u; i < agents.size(); ++i)
+        for (size_t k = starts[i]; k < starts[i + 1u]; ++k)
+            owner[k] = static_cast< epiworld_fast_uint >(i);
+
+    if (owner.size() == 0u)
+        throw std::logic_error("The graph is completely disconnected.");
+
+    return;
+
+}
+
+/**
+ * @brief Draws a candidate double-edge swap
+ * 
+ * @details Picks two neighbor slots uniformly. The swap `ego0 - alter0`,
+ * `ego1 - alter1` -> `ego0 - alter1`, `ego1 - alter0` preserves the degrees.
+ * Swaps that would create a self-loop or do nothing are rejected (returns
+ * `false`.)
+ */
+template<typename TSeq>
+inline bool rewire_draw_swap(
+    const std::vector< Agent<TSeq> > & agents,
+    const std::vector< size_t > & starts,
+    const std::vector< epiworld_fast_uint > & owner,
+    Model<TSeq> * model,
+    size_t * ego,
+    size_t * slot,
+    size_t * alter
+)
+{
+
+    size_t nslots = owner.size();
+    for (size_t j = 0u; j < 2u; ++j)
+    {
+
+        size_t k = static_cast< size_t >(std::floor(model->runif() * nslots));
+        if (k >= nslots)
+            k = nslots - 1u;
+
+        ego[j]   = owner[k];
+        slot[j]  = k - starts[ego[j]];
+        alter[j] = agents[ego[j]].neighbors[slot[j]];
+
+    }
+
+    return (ego[0u] != ego[1u]) && (alter[0u] != alter[1u]) &&
+        (alter[0u] != ego[1u]) && (alter[1u] != ego[0u]);
+
+}
+
 template<typename TSeq = int>
 inline void rewire_degseq(
     std::vector< Agent<TSeq> > * agents,
@@ -5126,89 +10973,29 @@ inline void rewire_degseq(
     #ifdef EPI_DEBUG
     std::vector< int > _degree0(agents->size(), 0);
     for (size_t i = 0u; i < _degree0.size(); ++i)
-        _degree0[i] = model->get_agents()[i].get_neighbors().size();
+        _degree0[i] = model->get_agents()[i].get_n_neighbors();
     #endif
 
-    // Identifying individuals with degree > 0
-    std::vector< epiworld_fast_uint > non_isolates;
-    std::vector< epiworld_double > weights;
-    epiworld_double nedges = 0.0;
-    
-    for (epiworld_fast_uint i = 0u; i < agents->size(); ++i)
-    {
-        if (agents->operator[](i).get_neighbors().size() > 0u)
-        {
-            non_isolates.push_back(i);
-            epiworld_double wtemp = static_cast<epiworld_double>(
-                agents->operator[](i).get_neighbors().size()
-                );
-            weights.push_back(wtemp);
-            nedges += wtemp;
-        }
-    }
-
-    if (non_isolates.size() == 0u)
-        throw std::logic_error("The graph is completely disconnected.");
-
-    // Cumulative probs
-    weights[0u] /= nedges;
-    for (epiworld_fast_uint i = 1u; i < non_isolates.size(); ++i)
-    {
-         weights[i] /= nedges;
-         weights[i] += weights[i - 1u];
-    }
+    std::vector< size_t > starts;
+    std::vector< epiworld_fast_uint > owner;
+    rewire_stubs(*agents, starts, owner);
 
-    // Only swap if needed
-    epiworld_fast_uint N = non_isolates.size();
-    epiworld_double prob;
-    int nrewires = floor(proportion * nedges);
+    // Each attempt is O(1)
+    size_t ego[2u], slot[2u], alter[2u];
+    int nrewires = floor(proportion * owner.size());
     while (nrewires-- > 0)
     {
 
-        // Picking egos
-        prob = model->runif();
-        int id0 = N - 1;
-        for (epiworld_fast_uint i = 0u; i < N; ++i)
-            if (prob <= weights[i])
-            {
-                id0 = i;
-                break;
-            }
-
-        prob = model->runif();
-        int id1 = N - 1;
-        for (epiworld_fast_uint i = 0u; i < N; ++i)
-            if (prob <= weights[i])
-            {
-                id1 = i;
-                break;
-            }
-
-        // Correcting for under or overflow.
-        if (id1 == id0)
-            id1++;
-
-        if (id1 >= static_cast<int>(N))
-            id1 = 0;
-
-        Agent<TSeq> & p0 = agents->operator[](non_isolates[id0]);
-        Agent<TSeq> & p1 = agents->operator[](non_isolates[id1]);
-
-        // Picking alters (relative location in their lists)
-        // In this case, these are uniformly distributed within the list
-        int id01 = std::floor(p0.get_n_neighbors() * model->runif());
-        int id11 = std::floor(p1.get_n_neighbors() * model->runif());
+        if (!rewire_draw_swap(*agents, starts, owner, model, ego, slot, alter))
+            continue;
 
         // When rewiring, we need to flip the individuals from the other
         // end as well, since we are dealing withi an undirected graph
-        
-        // Finding what neighbour is id0
-        model->get_agents()[id0].swap_neighbors(
-            model->get_agents()[id1],
-            id01,
-            id11
+        agents->operator[](ego[0u]).swap_neighbors(
+            agents->operator[](ego[1u]),
+            slot[0u],
+            slot[1u]
             );
-        
 
     }
 
@@ -5218,7 +11005,96 @@ inline void rewire_degseq(
         if (_degree0[_i] != static_cast<int>(model->get_agents()[_i].get_n_neighbors()))
             throw std::logic_error("[epi-debug] Degree does not match afted rewire_degseq.");
     }
-    #endif
+    #endif
+
+    return;
+
+}
+
+/**
+ * @brief Degree-preserving rewiring in parallel batches
+ * 
+ * @details Same as `rewire_degseq()`, but the swaps are drawn in batches of
+ * `batch_size`. Within a batch, a swap that involves an agent already used
+ * by an earlier swap of the batch is dropped, so the remaining swaps are
+ * independent and are applied in parallel. Since the swaps are drawn
+ * sequentially, the result does not depend on `nthreads`.
+ * 
+ * To use it in a model, e.g.,
+ * `model.set_rewire_fun([](auto * a, auto * m, epiworld_double p) {rewire_degseq_batch(a, m, p, 4);})`.
+ * 
+ * @param agents Population
+ * @param model Model (used for the random numbers)
+ * @param proportion Number of swaps to attempt, as a proportion of the
+ * number of neighbor slots.
+ * @param nthreads Number of threads.
+ * @param batch_size Number of swaps drawn per batch.
+ */
+template<typename TSeq = int>
+inline void rewire_degseq_batch(
+    std::vector< Agent<TSeq> > * agents,
+    Model<TSeq> * model,
+    epiworld_double proportion,
+    int nthreads = 1,
+    size_t batch_size = 4096u
+    )
+{
+
+    if (batch_size == 0u)
+        throw std::logic_error("batch_size must be positive.");
+
+    std::vector< size_t > starts;
+    std::vector< epiworld_fast_uint > owner;
+    rewire_stubs(*agents, starts, owner);
+
+    // Batch in which each agent was last used
+    std::vector< size_t > used(agents->size(), 0u);
+
+    std::vector< std::array< size_t, 4u > > batch;
+    batch.reserve(batch_size);
+
+    size_t ego[2u], slot[2u], alter[2u];
+    size_t nrewires = static_cast< size_t >(floor(proportion * owner.size()));
+    for (size_t b = 1u; nrewires > 0u; ++b)
+    {
+
+        batch.clear();
+        size_t ndraws = std::min(nrewires, batch_size);
+        nrewires -= ndraws;
+        
+        while (ndraws-- > 0u)
+        {
+
+            if (!rewire_draw_swap(*agents, starts, owner, model, ego, slot, alter))
+                continue;
+
+            if ((used[ego[0u]] == b) || (used[ego[1u]] == b) ||
+                (used[alter[0u]] == b) || (used[alter[1u]] == b))
+                continue;
+
+            used[ego[0u]]   = b;
+            used[ego[1u]]   = b;
+            used[alter[0u]] = b;
+            used[alter[1u]] = b;
+
+            batch.push_back({ego[0u], ego[1u], slot[0u], slot[1u]});
+
+        }
+
+        #ifdef _OPENMP
+        #pragma omp parallel for num_threads(nthreads) schedule(static)
+        #endif
+        for (int k = 0; k < static_cast< int >(batch.size()); ++k)
+        {
+
+            const auto & s = batch[k];
+            agents->operator[](s[0u]).swap_neighbors(
+                agents->operator[](s[1u]), s[2u], s[3u]
+                );
+
+        }
+
+    }
 
     return;
 
@@ -5296,24 +11172,22 @@ inline void rewire_degseq(
     while (nrewires-- > 0)
     {
 
-        // Picking egos
+        // Picking egos (binary search on the cumulative probs)
         prob = model->runif();
-        int id0 = N - 1;
-        for (epiworld_fast_uint i = 0u; i < N; ++i)
-            if (prob <= weights[i])
-            {
-                id0 = i;
-                break;
-            }
+        int id0 = std::min(
+            static_cast< int >(N - 1),
+            static_cast< int >(
+                std::lower_bound(weights.begin(), weights.end(), prob) -
+                weights.begin()
+            ));
 
         prob = model->runif();
-        int id1 = N - 1;
-        for (epiworld_fast_uint i = 0u; i < N; ++i)
-            if (prob <= weights[i])
-            {
-                id1 = i;
-                break;
-            }
+        int id1 = std::min(
+            static_cast< int >(N - 1),
+            static_cast< int >(
+                std::lower_bound(weights.begin(), weights.end(), prob) -
+                weights.begin()
+            ));
 
         // Correcting for under or overflow.
         if (id1 == id0)
@@ -5604,25 +11478,500 @@ inline AdjList rgraph_blocked(
         if (i != 0)
         {
 
-            size_t max_cons = std::min(ncons, n - cum_node_count);
+            size_t max_cons = std::min(ncons, n - cum_node_count);
+
+            // Generating the connections
+            for (size_t j = 0u; j < max_cons; ++j)
+            {
+
+                source_.push_back(static_cast<int>(i + j - blocksize));
+                target_.push_back(static_cast<int>(i + j));
+
+            }
+        }
+
+        i += blocksize;
+        
+    }
+        
+    return AdjList(source_, target_, n, false);
+
+}
+
+/**
+ * @name Random graphs in CSR format
+ * 
+ * @details These generators write the graph directly in CSR format (see
+ * `CSRGraph`) without going through `AdjList`, using O(n + m) time and
+ * memory. Vertices are processed in blocks of `rgraph_block_size`, each with
+ * its own random number stream seeded from a single draw of the model's
+ * engine. Hence, the resulting graph depends on the model's seed but not on
+ * the number of threads.
+ */
+///@{
+static const size_t rgraph_block_size = 4096u;
+
+/**
+ * @brief Random number engine of a block
+ * @param seed Seed drawn from the model's engine.
+ * @param block Block id.
+ */
+inline std::mt19937 rgraph_block_engine(std::uint64_t seed, size_t block)
+{
+
+    std::uint64_t h = hash_combine64(seed, static_cast< std::uint64_t >(block));
+    std::seed_seq seq{
+        static_cast< std::uint32_t >(h),
+        static_cast< std::uint32_t >(h >> 32)
+    };
+
+    return std::mt19937(seq);
+
+}
+
+template<typename TSeq>
+inline std::uint64_t rgraph_seed(Model<TSeq> & model)
+{
+
+    auto & engine = model.get_rand_endgine();
+    std::uint64_t hi = static_cast< std::uint64_t >(engine());
+    return (hi << 32) | static_cast< std::uint64_t >(engine());
+
+}
+
+/**
+ * @brief Erdos-Renyi G(n, p) random graph
+ * 
+ * @details Uses the geometric skipping of Batagelj and Brandes (2005): instead
+ * of flipping a coin for each of the n(n - 1) (or n(n - 1)/2) pairs, the
+ * number of pairs to skip until the next edge is drawn from a geometric
+ * distribution. Unlike `rgraph_bernoulli()`, there are no repeated edges.
+ * 
+ * @param n Number of vertices.
+ * @param p Probability of each edge.
+ * @param directed `true` if the network is directed.
+ * @param model Model (used for the seed).
+ * @param nthreads Number of threads.
+ * @return CSRGraph 
+ */
+template<typename TSeq>
+inline CSRGraph rgraph_bernoulli_csr(
+    epiworld_fast_uint n,
+    epiworld_double p,
+    bool directed,
+    Model<TSeq> & model,
+    int nthreads = 1
+) {
+
+    if ((p < 0.0) || (p > 1.0))
+        throw std::range_error("p must be within [0, 1].");
+
+    std::uint64_t seed = rgraph_seed(model);
+
+    size_t nblocks = (n + rgraph_block_size - 1u) / rgraph_block_size;
+
+    // Row of each edge is v (the block's own rows) and the column is w. In
+    // the undirected case, only w < v is drawn.
+    std::vector< std::vector< int > > rows(nblocks);
+    std::vector< std::vector< int > > cols(nblocks);
+
+    double log_q = std::log(1.0 - static_cast< double >(p));
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
+    #endif
+    for (int bb = 0; bb < static_cast< int >(nblocks); ++bb)
+    {
+
+        if (p <= 0.0)
+            continue;
+
+        size_t b     = static_cast< size_t >(bb);
+        size_t start = b * rgraph_block_size;
+        size_t end   = std::min(start + rgraph_block_size, static_cast< size_t >(n));
+
+        std::mt19937 engine = rgraph_block_engine(seed, b);
+        std::uniform_real_distribution< double > runif(0.0, 1.0);
+
+        auto & row = rows[b];
+        auto & col = cols[b];
+
+        // Number of pairs in the row
+        auto slots = [directed, n](size_t v) -> long long {
+            return static_cast< long long >(directed ? n - 1u : v);
+        };
+
+        size_t v    = start;
+        long long w = -1;
+        while (v < end)
+        {
+
+            // Pairs to skip (capped so it doesn't overflow)
+            double skip = (p >= 1.0) ?
+                0.0 : std::floor(std::log(1.0 - runif(engine)) / log_q);
+
+            w += 1 + static_cast< long long >(std::min(skip, 1e15));
+
+            while ((v < end) && (w >= slots(v)))
+            {
+                w -= slots(v);
+                ++v;
+            }
+
+            if (v >= end)
+                break;
+
+            row.push_back(static_cast< int >(v));
+
+            // Directed graphs skip the diagonal
+            if (directed && (w >= static_cast< long long >(v)))
+                col.push_back(static_cast< int >(w + 1));
+            else
+                col.push_back(static_cast< int >(w));
+
+        }
+
+    }
+
+    // Degrees
+    std::vector< size_t > offsets(n + 1u, 0u);
+    std::vector< size_t > n_lower(n, 0u);
+    size_t m = 0u;
+    for (size_t b = 0u; b < nblocks; ++b)
+    {
+
+        m += rows[b].size();
+        for (size_t k = 0u; k < rows[b].size(); ++k)
+        {
+
+            ++offsets[rows[b][k] + 1];
+            ++n_lower[rows[b][k]];
+
+            if (!directed)
+                ++offsets[cols[b][k] + 1];
+
+        }
+
+    }
+
+    for (size_t i = 0u; i < n; ++i)
+        offsets[i + 1u] += offsets[i];
+
+    std::vector< int > neighbors(offsets[n]);
+
+    // Each block's rows are already sorted (and, if undirected, come before
+    // the neighbors with a larger id.)
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads) schedule(static)
+    #endif
+    for (int bb = 0; bb < static_cast< int >(nblocks); ++bb)
+    {
+
+        size_t b = static_cast< size_t >(bb);
+        size_t v_prev = static_cast< size_t >(n);
+        size_t pos    = 0u;
+        for (size_t k = 0u; k < rows[b].size(); ++k)
+        {
+
+            size_t v = static_cast< size_t >(rows[b][k]);
+            if (v != v_prev)
+            {
+                pos    = offsets[v];
+                v_prev = v;
+            }
+
+            neighbors[pos++] = cols[b][k];
+
+        }
+
+    }
+
+    // The other direction, visiting the rows in increasing order
+    if (!directed)
+    {
+
+        std::vector< size_t > cursor(n);
+        for (size_t i = 0u; i < n; ++i)
+            cursor[i] = offsets[i] + n_lower[i];
+
+        for (size_t b = 0u; b < nblocks; ++b)
+            for (size_t k = 0u; k < rows[b].size(); ++k)
+                neighbors[cursor[cols[b][k]]++] = rows[b][k];
+
+    }
+
+    return CSRGraph(std::move(offsets), std::move(neighbors), directed, m);
+
+}
+
+/**
+ * @brief Ring lattice
+ * 
+ * @details Same graph as `rgraph_ring_lattice()`: each vertex is connected
+ * to the next `k` (or, if undirected, the next and previous `k/2`) vertices.
+ * 
+ * @param n Number of vertices.
+ * @param k Number of neighbors.
+ * @param directed `true` if the network is directed.
+ * @param nthreads Number of threads.
+ * @return CSRGraph 
+ */
+inline CSRGraph rgraph_ring_lattice_csr(
+    epiworld_fast_uint n,
+    epiworld_fast_uint k,
+    bool directed = false,
+    int nthreads = 1
+) {
+
+    if ((n - 1u) < k)
+        throw std::logic_error("k can be at most n - 1.");
+
+    if (!directed)
+        if (k > 1u) k = static_cast< size_t >(floor(k / 2.0));
+
+    // With two vertices and k = 1, the undirected edge is added twice
+    if (!directed && (2u * k >= n))
+        return CSRGraph(AdjList(
+            std::vector< int >({0, 1}), std::vector< int >({1, 0}),
+            static_cast< int >(n), false
+            ));
+
+    size_t deg = directed ? k : 2u * k;
+
+    std::vector< size_t > offsets(n + 1u);
+    for (size_t i = 0u; i <= n; ++i)
+        offsets[i] = i * deg;
+
+    std::vector< int > neighbors(n * deg);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads) schedule(static)
+    #endif
+    for (int ii = 0; ii < static_cast< int >(n); ++ii)
+    {
+
+        size_t i = static_cast< size_t >(ii);
+        auto row = neighbors.begin() + offsets[i];
+        size_t pos = 0u;
+        for (size_t j = 1u; j <= k; ++j)
+        {
+
+            *(row + pos++) = static_cast< int >((i + j) % n);
+            if (!directed)
+                *(row + pos++) = static_cast< int >((i + n - j) % n);
+
+        }
+
+        std::sort(row, row + deg);
+
+    }
+
+    return CSRGraph(std::move(offsets), std::move(neighbors), directed, n * k);
+
+}
+
+/**
+ * @brief Smallworld network (Watts-Strogatz) in CSR format
+ * 
+ * @details Starts from the ring lattice of `rgraph_ring_lattice_csr()`, and
+ * each edge `i -> i + j` is rewired with probability `p` to a uniformly
+ * drawn vertex that is neither `i` nor already a neighbor drawn by `i`.
+ * Rewired edges that coincide with one drawn by another vertex are merged.
+ * Unlike `rgraph_smallworld()`, which rewires preserving the degree
+ * sequence, this is the original Watts-Strogatz model.
+ * 
+ * @param n Number of vertices.
+ * @param k Number of neighbors.
+ * @param p Probability of rewiring each edge.
+ * @param directed `true` if the network is directed.
+ * @param model Model (used for the seed).
+ * @param nthreads Number of threads.
+ * @return CSRGraph 
+ */
+template<typename TSeq>
+inline CSRGraph rgraph_smallworld_csr(
+    epiworld_fast_uint n,
+    epiworld_fast_uint k,
+    epiworld_double p,
+    bool directed,
+    Model<TSeq> & model,
+    int nthreads = 1
+) {
+
+    if ((n - 1u) < k)
+        throw std::logic_error("k can be at most n - 1.");
+
+    if ((p <= 0.0) || (k == 0u))
+        return rgraph_ring_lattice_csr(n, k, directed, nthreads);
+
+    std::uint64_t seed = rgraph_seed(model);
+
+    if (!directed)
+        if (k > 1u) k = static_cast< size_t >(floor(k / 2.0));
+
+    // Each vertex draws its k edges
+    std::vector< int > source(n * k);
+    std::vector< int > target(n * k);
+
+    size_t nblocks = (n + rgraph_block_size - 1u) / rgraph_block_size;
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads) schedule(static)
+    #endif
+    for (int bb = 0; bb < static_cast< int >(nblocks); ++bb)
+    {
+
+        size_t b     = static_cast< size_t >(bb);
+        size_t start = b * rgraph_block_size;
+        size_t end   = std::min(start + rgraph_block_size, static_cast< size_t >(n));
+
+        std::mt19937 engine = rgraph_block_engine(seed, b);
+        std::uniform_real_distribution< double > runif(0.0, 1.0);
+
+        for (size_t i = start; i < end; ++i)
+        {
+
+            int * row = &target[i * k];
+            for (size_t j = 0u; j < k; ++j)
+            {
+
+                source[i * k + j] = static_cast< int >(i);
+                row[j] = static_cast< int >((i + j + 1u) % n);
+
+            }
+
+            // Rewiring (only if there is somewhere else to go)
+            if (k >= (n - 1u))
+                continue;
+
+            for (size_t j = 0u; j < k; ++j)
+            {
+
+                if (runif(engine) >= p)
+                    continue;
+
+                int new_target;
+                bool taken;
+                do
+                {
+
+                    new_target = static_cast< int >(
+                        std::floor(runif(engine) * (n - 1u))
+                        );
+
+                    if (new_target >= static_cast< int >(i))
+                        ++new_target;
+
+                    taken = false;
+                    for (size_t l = 0u; (l < k) && !taken; ++l)
+                        taken = (l != j) && (row[l] == new_target);
+
+                } while (taken);
+
+                row[j] = new_target;
+
+            }
+
+        }
+
+    }
+
+    CSRGraph g(source, target, static_cast< int >(n), directed, nthreads);
+    return g;
+
+}
+
+/**
+ * @brief Blocked network in CSR format
+ * 
+ * @details Same graph as `rgraph_blocked()`. Requires `ncons <= blocksize`.
+ * 
+ * @param n Size of the network
+ * @param blocksize Size of the block.
+ * @param ncons Number of connections between blocks
+ * @param nthreads Number of threads.
+ * @return CSRGraph 
+ */
+inline CSRGraph rgraph_blocked_csr(
+    epiworld_fast_uint n,
+    epiworld_fast_uint blocksize,
+    epiworld_fast_uint ncons,
+    int nthreads = 1
+) {
+
+    if (blocksize == 0u)
+        throw std::logic_error("blocksize must be positive.");
+
+    if (ncons > blocksize)
+        throw std::logic_error("ncons cannot be larger than blocksize.");
+
+    size_t bsize   = static_cast< size_t >(blocksize);
+    size_t nblocks = (n + bsize - 1u) / bsize;
+
+    // Connections between block b - 1 and b
+    auto cons = [n, bsize, ncons](size_t b) -> size_t {
+        size_t end = std::min((b + 1u) * bsize, static_cast< size_t >(n));
+        return (b == 0u) ? 0u : std::min(static_cast< size_t >(ncons), static_cast< size_t >(n) - end);
+    };
+
+    std::vector< size_t > offsets(n + 1u, 0u);
+    size_t m = 0u;
+    for (size_t b = 0u; b < nblocks; ++b)
+    {
+
+        size_t start = b * bsize;
+        size_t end   = std::min(start + bsize, static_cast< size_t >(n));
+        size_t size  = end - start;
+
+        m += size * (size - 1u) / 2u + cons(b);
+
+        for (size_t i = start; i < end; ++i)
+        {
+
+            size_t t = i - start;
+            offsets[i + 1u] = size - 1u +
+                ((t < cons(b)) ? 1u : 0u) +
+                (((b + 1u) < nblocks) && (t < cons(b + 1u)) ? 1u : 0u);
+
+        }
+
+    }
+
+    for (size_t i = 0u; i < n; ++i)
+        offsets[i + 1u] += offsets[i];
+
+    std::vector< int > neighbors(offsets[n]);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads) schedule(static)
+    #endif
+    for (int ii = 0; ii < static_cast< int >(n); ++ii)
+    {
 
-            // Generating the connections
-            for (size_t j = 0u; j < max_cons; ++j)
-            {
+        size_t i     = static_cast< size_t >(ii);
+        size_t b     = i / bsize;
+        size_t start = b * bsize;
+        size_t end   = std::min(start + bsize, static_cast< size_t >(n));
+        size_t t     = i - start;
+        size_t pos   = offsets[i];
 
-                source_.push_back(static_cast<int>(i + j - blocksize));
-                target_.push_back(static_cast<int>(i + j));
+        // Previous block, this block, and next block (sorted)
+        if (t < cons(b))
+            neighbors[pos++] = static_cast< int >(i - bsize);
 
-            }
-        }
+        for (size_t j = start; j < end; ++j)
+            if (j != i)
+                neighbors[pos++] = static_cast< int >(j);
+
+        if (((b + 1u) < nblocks) && (t < cons(b + 1u)))
+            neighbors[pos++] = static_cast< int >(i + bsize);
 
-        i += blocksize;
-        
     }
-        
-    return AdjList(source_, target_, n, false);
+
+    return CSRGraph(std::move(offsets), std::move(neighbors), false, m);
 
 }
+///@}
 
 #endif
 /*//////////////////////////////////////////////////////////////////////////////
@@ -6027,12 +12376,30 @@ inline std::function<void(size_t,Model<TSeq>*)> make_save_run(
     bool generation = false
     );
 
+template<typename TSeq>
+inline std::function<void(size_t,Model<TSeq>*)> make_check_hash(
+    std::string fn,
+    std::vector< size_t > * mismatches = nullptr
+    );
+
 // template<typename TSeq>
 // class VirusPtr;
 
 // template<typename TSeq>
 // class ToolPtr;
 
+/**
+ * @brief Exposure of an agent to a virus through a tie
+ * 
+ * @details Used in push propagation (see `Model::set_propagation()`.)
+ */
+template<typename TSeq>
+struct Exposure {
+    Agent<TSeq> * source;   ///< Agent carrying the virus.
+    VirusPtr<TSeq> * virus; ///< Virus (owned by `source`.)
+    epiworld_double weight; ///< Weight of the tie.
+};
+
 /**
  * @brief Core class of epiworld.
  * 
@@ -6048,6 +12415,9 @@ class Model {
     friend class AgentsSample<TSeq>;
     friend class DataBase<TSeq>;
     friend class Queue<TSeq>;
+    friend class DistributedModel<TSeq>;
+    friend void default_add_virus<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
+    friend void default_rm_virus<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
 protected:
 
     std::string name = ""; ///< Name of the model
@@ -6089,6 +12459,10 @@ protected:
     ///@}
 
     bool directed = false;
+    bool weighted = false; ///< `true` if the ties have weights.
+
+    std::string agents_order = "none";     ///< See `set_agents_order()`.
+    std::vector< int > agents_original_id; ///< Empty if not relabeled.
     
     std::vector< VirusPtr<TSeq> > viruses = {};
     std::vector< epiworld_double > prevalence_virus = {}; ///< Initial prevalence_virus of each virus
@@ -6120,6 +12494,37 @@ protected:
 
     std::function<void(std::vector<Agent<TSeq>>*,Model<TSeq>*,epiworld_double)> rewire_fun;
     epiworld_double rewire_prop = 0.0;
+
+    std::string network_deltas_fn = ""; ///< See `set_network_deltas()`.
+    int network_deltas_period = 0;
+    std::shared_ptr< NetworkDeltas > network_deltas = nullptr;
+
+    std::function<void(Model<TSeq>*)> halo_exchange_fun = nullptr; ///< See `set_halo_exchange()`.
+    size_t halo_n_owned = 0u;
+
+    bool propagation_push = false; ///< See `set_propagation()`.
+    bool exposures_valid  = false;
+    std::vector< Exposure<TSeq> > exposures;
+    std::vector< size_t > exposures_start;
+    std::vector< size_t > exposures_n;
+    std::vector< size_t > exposures_targets; ///< Agents with exposures.
+    void build_exposures();
+
+    /**
+     * @name Agents with viruses (push mode)
+     * 
+     * @details Kept up to date by `default_add_virus()` and
+     * `default_rm_virus()` so `build_exposures()` only visits the agents with
+     * viruses. Changes that bypass them (e.g., a reset) set
+     * `virus_holders_valid = false`, and the next build finds the agents by
+     * scanning the population.
+     */
+    ///@{
+    bool virus_holders_valid = false;
+    std::vector< size_t > virus_holders;
+    std::vector< size_t > virus_holders_loc; ///< Location in `virus_holders` (by agent.)
+    void virus_holders_update(Agent<TSeq> & p);
+    ///@}
         
     std::map<std::string, epiworld_double > parameters;
     epiworld_fast_uint ndays = 0;
@@ -6190,6 +12595,12 @@ protected:
      */
     void actions_run();
 
+    /**
+     * @brief Builds the population from `g` without relabeling it (see
+     * `agents_from_adjlist()` and `set_agents_order()`.)
+     */
+    void build_population(const CSRGraph & g);
+
     /**
      * @name Tool Mixers
      * 
@@ -6201,6 +12612,8 @@ protected:
      */
     MixerFun<TSeq> susceptibility_reduction_mixer = susceptibility_reduction_mixer_default<TSeq>;
     MixerFun<TSeq> transmission_reduction_mixer = transmission_reduction_mixer_default<TSeq>;
+    bool susceptibility_reduction_cached = true; ///< Only the default mixers are cached by the agents.
+    bool transmission_reduction_cached   = true;
     MixerFun<TSeq> recovery_enhancer_mixer = recovery_enhancer_mixer_default<TSeq>;
     MixerFun<TSeq> death_reduction_mixer = death_reduction_mixer_default<TSeq>;
 
@@ -6313,10 +12726,43 @@ public:
      * space. The first column indexing between 0 and nagents-1, and the
      * second column between 0 and nentities - 1.
      * 
+     * The agents of each entity are added in the order in which they
+     * appear in the file (see the overload below.)
+     * 
+     * The file can also be a binary file of pairs (see
+     * `write_int_pairs_binary()`), in which case `skip` and `use_cache` are
+     * ignored. With `use_cache = true`, the ties are saved in that format to
+     * `fn + ".pairs"` and read from there in later calls (see
+     * `read_int_pairs_cached()`.)
+     * 
      * @param fn Path to the file.
      * @param skip How many rows to skip.
+     * @param use_cache `true` to use (and create if needed) the binary cache.
+     * @param nthreads Number of threads used to parse the file.
+     */
+    void load_agents_entities_ties(
+        std::string fn,
+        int skip,
+        bool use_cache = true,
+        int nthreads = 1
+        );
+
+    /**
+     * @brief Associate agents-entities in bulk
+     * 
+     * @details The ties are sorted by entity (keeping their order otherwise)
+     * and added in a single pass, reserving the exact space needed in each
+     * agent and entity. Unlike `Agent::add_entity()`, this doesn't go through
+     * the actions.
+     * 
+     * @param agents_ids,entities_ids Vectors of the same length with the
+     * agent and the entity of each tie. The agent ids are those in the model
+     * (see `set_agents_order()`.)
      */
-    void load_agents_entities_ties(std::string fn, int skip);
+    void load_agents_entities_ties(
+        const std::vector< int > & agents_ids,
+        const std::vector< int > & entities_ids
+        );
 
     /**
      * @name Accessing population of the model
@@ -6326,13 +12772,26 @@ public:
      * @param directed bool Whether the graph is directed or not.
      * @param size Size of the network.
      * @param al AdjList to read into the model.
+     * @param values_as_weights If `true`, the values of the ties in `al` are
+     * used as their weights.
+     * @param g CSRGraph to read into the model. If it has weights, so do the
+     * ties between the agents (see `is_weighted()`.)
+     * @param weight Weight of each tie (e.g., duration of the contact.) The
+     * probability of transmission through a tie is multiplied by its weight
+     * (capped at 1.)
+     * @param use_cache If `true`, a binary copy of the graph is kept in
+     * `fn + ".csr"` and used in later calls (see `CSRGraph::read_edgelist()`.)
+     * @param nthreads Number of threads used to parse `fn` and build the
+     * graph.
      */
     ///@{
     void agents_from_adjlist(
         std::string fn,
         int size,
         int skip = 0,
-        bool directed = false
+        bool directed = false,
+        bool use_cache = true,
+        int nthreads = 1
         );
 
     void agents_from_edgelist(
@@ -6342,9 +12801,20 @@ public:
         bool directed
     );
 
-    void agents_from_adjlist(AdjList al);
+    void agents_from_edgelist(
+        const std::vector< int > & source,
+        const std::vector< int > & target,
+        const std::vector< epiworld_double > & weight,
+        int size,
+        bool directed
+    );
+
+    void agents_from_adjlist(AdjList al, bool values_as_weights = false);
+
+    void agents_from_adjlist(const CSRGraph & g);
 
     bool is_directed() const;
+    bool is_weighted() const; ///< `true` if the ties have weights (see `Agent::get_neighbor_weight()`.)
 
     std::vector< Agent<TSeq> > & get_agents(); ///< Returns a reference to the vector of agents.
 
@@ -6365,6 +12835,36 @@ public:
     void agents_empty_graph(epiworld_fast_uint n = 1000);
     ///@}
 
+    /**
+     * @name Relabeling the agents by the structure of the network
+     * 
+     * @details If set, the agents are relabeled when the network is read
+     * (`agents_from_adjlist()` and friends) so that agents that share
+     * neighbors get nearby ids, which improves cache locality in loops over
+     * neighbors (see `graph_order()` for the methods.)
+     * 
+     * Only the model's files use the original ids: those written by
+     * `write_edgelist()` and `write_data()` (transmissions, reproductive
+     * number, and generation time), and the ties read by
+     * `load_agents_entities_ties(fn, ...)`. Everything in memory uses the new
+     * ids, that is, `Agent::get_id()` (also within actions, global actions,
+     * and other callbacks), `get_agents()`, `DataBase::get_transmissions()`,
+     * the `DataBase::reproductive_number()` and `DataBase::generation_time()`
+     * overloads that return data, `TransmissionView`, `TransitionView`, the
+     * event log, and `load_agents_entities_ties(agents_ids, ...)`. Use
+     * `get_agent_original_id()` to map a new id to the original one.
+     * 
+     * @param method Either `"none"` (default), `"degree"`, `"rcm"`, or
+     * `"community"`.
+     * @param id Id of the agent in the model.
+     */
+    ///@{
+    void set_agents_order(std::string method);
+    const std::string & get_agents_order() const;
+    int get_agent_original_id(int id) const;
+    const std::vector< int > & get_agents_original_ids() const; ///< Empty if not relabeled.
+    ///@}
+
     /**
      * @name Functions to run the model
      * 
@@ -6421,6 +12921,57 @@ public:
     void rewire();
     ///@}
 
+    /**
+     * @brief Time-varying network
+     * 
+     * @details The ties are added and removed in place each day following
+     * the records in `fn` (see `write_network_deltas()`), which is read one
+     * day at a time. The record of day `d` is applied at the end of day `d`
+     * (after updating the states and the global actions, before `next()`),
+     * so it shapes the contacts from day `d + 1` on. The record of day 0 is
+     * applied at `reset()`. Adding an existing tie, self-ties, and removing
+     * a missing tie do nothing. The records carry no weights: if the ties
+     * are weighted, added ties get weight 1.0 (the default of
+     * `Agent::add_neighbor()`), and re-adding a removed tie does not restore
+     * its original weight.
+     * 
+     * The network is restored at the beginning of each run (see
+     * `set_backup()`). Since the queue counts ties to infected agents,
+     * queuing is turned off.
+     * 
+     * @param fn Path to the file (an empty string disables the changes.)
+     * @param period If positive, the records are replayed every `period`
+     * days (e.g., 7 for a week), using the record of day `today() % period`.
+     */
+    ///@{
+    void set_network_deltas(std::string fn, int period = 0);
+    void apply_network_deltas();
+    ///@}
+
+    /**
+     * @brief Synchronization of agents owned by other processes
+     * 
+     * @details Used by distributed runs (see `DistributedModel`), where
+     * the first `n_owned` agents belong to this process and the rest are
+     * copies (ghosts) of neighbors owned by other processes. Only the owned
+     * agents update their state, get the initial viruses and tools, mutate
+     * their viruses, and are counted in the database. Actions over ghosts
+     * are dropped, so they only change when `fun` is called: once per day,
+     * after all the changes of the day are applied and before `next()` (and
+     * at `reset()`.)
+     * 
+     * @param fun Function (`nullptr` disables the synchronization.)
+     * @param n_owned Number of agents owned by this process.
+     */
+    ///@{
+    void set_halo_exchange(
+        std::function<void(Model<TSeq>*)> fun,
+        size_t n_owned
+        );
+    void halo_exchange();
+    size_t get_n_owned() const noexcept; ///< Agents owned by this process (all of them without a halo exchange.)
+    ///@}
+
     /**
      * @brief Wrapper of `DataBase::write_data`
      * 
@@ -6615,9 +13166,41 @@ public:
     Queue<TSeq> & get_queue(); ///< Retrieve the `Queue` object.
     ///@}
 
+    /**
+     * @name Infection propagation
+     * @details With `"pull"` (default), each susceptible agent scans all its
+     * neighbors looking for viruses. With `"push"`, the agents with viruses
+     * push an `Exposure` to each of their neighbors, so the cost is
+     * proportional to the number of ties of the agents with viruses, and
+     * susceptible agents without exposures skip the roulette. The agents
+     * with viruses are tracked as viruses are added and removed, so only
+     * the first build after a reset scans the whole population. The
+     * exposures are built the first time they are requested after the
+     * states, viruses, or the network change.
+     * 
+     * Both give the same distribution of outcomes (the exposures of an
+     * agent are ordered by the id of the source, so the draws differ.)
+     * Used by `default_update_susceptible()`, `sampler::sample_virus_single()`,
+     * `sampler::make_update_susceptible()`, and
+     * `sampler::make_sample_virus_neighbors()`.
+     * 
+     * @param mode Either `"pull"` or `"push"`.
+     * @param agent_id Id of the exposed agent.
+     */
+    ///@{
+    void set_propagation(std::string mode);
+    std::string get_propagation() const;
+    bool is_propagation_push() const noexcept;
+    DataView< Exposure<TSeq> > get_exposures(size_t agent_id);
+    ///@}
+
     /**
      * @name Get the susceptibility reduction object
      * 
+     * @details The agents cache the susceptibility and transmission
+     * reductions of the default mixers (see `Tool::set_time_dependent()`.)
+     * Custom mixers are called every time.
+     * 
      * @param v 
      * @return epiworld_double 
      */
@@ -6832,6 +13415,144 @@ inline std::function<void(size_t,Model<TSeq>*)> make_save_run(
     return saver;
 }
 
+/**
+ * @brief Function to check the hash of each run against a golden file
+ * 
+ * @details To be used with `Model::run_multiple()` for regression checks. If
+ * `fn` does not exist, it is created and the rolling hash of each day of
+ * each replicate (see `DataBase::get_hash()`) is written to it as
+ * `replicate date hash`. Otherwise, the hashes of each replicate are compared
+ * to the ones in the file, and the first day that does not match is reported.
+ * 
+ * @param fn Path to the golden file.
+ * @param mismatches If not null, the ids of the replicates that don't match
+ * are appended to it.
+ * @return std::function<void(size_t,Model<TSeq>*)> 
+ */
+template<typename TSeq = int>
+inline std::function<void(size_t,Model<TSeq>*)> make_check_hash(
+    std::string fn,
+    std::vector< size_t > * mismatches
+    )
+{
+
+    // Replicate -> hash of each day
+    auto golden = std::make_shared<
+        std::map< size_t, std::vector< std::uint64_t > >
+        >();
+
+    std::ifstream file_in(fn);
+    bool write = !file_in.is_open();
+
+    if (!write)
+    {
+
+        std::string header, hash;
+        std::getline(file_in, header);
+
+        size_t replicate;
+        int date;
+        while (file_in >> replicate >> date >> hash)
+            (*golden)[replicate].push_back(std::stoull(hash, nullptr, 16));
+
+    }
+    else
+    {
+
+        std::ofstream file_out(fn, std::ios_base::out);
+
+        if (!file_out)
+            throw std::runtime_error(
+                "Could not open file \"" + fn + "\" for writing.");
+
+        file_out << "replicate date hash\n";
+
+    }
+
+    std::function<void(size_t,Model<TSeq>*)> checker = [fn,golden,write,mismatches](
+        size_t niter, Model<TSeq> * m
+    ) -> void {
+
+        const auto & hashes = m->get_db().get_hist_hash();
+
+        if (write)
+        {
+
+            std::string lines;
+            char buff[64u];
+            for (size_t d = 0u; d < hashes.size(); ++d)
+            {
+                snprintf(
+                    buff, sizeof(buff), "%lu %lu %016llx\n",
+                    static_cast< unsigned long >(niter),
+                    static_cast< unsigned long >(d),
+                    static_cast< unsigned long long >(hashes[d])
+                    );
+                lines += buff;
+            }
+
+            #ifdef _OPENMP
+            #pragma omp critical (epiworld_check_hash)
+            #endif
+            {
+                std::ofstream file_out(fn, std::ios_base::app);
+                file_out << lines;
+            }
+
+            return;
+
+        }
+
+        // Finding the first day that doesn't match
+        int day = -1;
+        auto iter = golden->find(niter);
+        if (iter == golden->end())
+            day = 0;
+        else
+        {
+
+            const auto & expected = iter->second;
+            size_t n = std::max(expected.size(), hashes.size());
+            for (size_t d = 0u; d < n; ++d)
+            {
+
+                if (
+                    (d >= expected.size()) || (d >= hashes.size()) ||
+                    (expected[d] != hashes[d])
+                    )
+                {
+                    day = static_cast< int >(d);
+                    break;
+                }
+
+            }
+
+        }
+
+        if (day < 0)
+            return;
+
+        #ifdef _OPENMP
+        #pragma omp critical (epiworld_check_hash)
+        #endif
+        {
+
+            printf_epiworld(
+                "Replicate %lu doesn't match the golden file \"%s\" (first day: %i).\n",
+                static_cast< unsigned long >(niter), fn.c_str(), day
+                );
+
+            if (mismatches != nullptr)
+                mismatches->push_back(niter);
+
+        }
+
+    };
+
+    return checker;
+
+}
+
 template<typename TSeq>
 inline void Model<TSeq>::actions_add(
     Agent<TSeq> * agent_,
@@ -6894,6 +13615,12 @@ inline void Model<TSeq>::actions_add(
 template<typename TSeq>
 inline void Model<TSeq>::actions_run()
 {
+
+    // States and viruses may change (the agents with viruses are tracked by
+    // the actions themselves)
+    if (nactions != 0u)
+        exposures_valid = false;
+
     // Making the call
     while (nactions != 0u)
     {
@@ -6901,6 +13628,10 @@ inline void Model<TSeq>::actions_run()
         Action<TSeq>   a = actions[--nactions];
         Agent<TSeq> * p  = a.agent;
 
+        // Ghosts only change through the halo exchange
+        if (static_cast< size_t >(p->id) >= get_n_owned())
+            continue;
+
         // Applying function
         if (a.call)
         {
@@ -6916,6 +13647,14 @@ inline void Model<TSeq>::actions_run()
                     "The proposed state " + std::to_string(a.new_state) + " is out of range. " +
                     "The model currently has " + std::to_string(nstates - 1) + " states.");
 
+            if (db.use_event_log)
+                db.record_state_event(
+                    static_cast< int >(p->id), p->state, a.new_state,
+                    a.virus != nullptr ? a.virus->get_id() : (
+                        p->n_viruses > 0u ? p->viruses[0u]->get_id() : -1
+                        )
+                );
+
             // Figuring out if we need to undo a change
             // If the agent has made a change in the state recently, then we
             // need to undo the accounting, e.g., if A->B was made, we need to
@@ -7068,6 +13807,32 @@ inline epiworld_double death_reduction_mixer_default(
 }
 ///@}
 
+template<typename TSeq>
+inline void Model<TSeq>::set_susceptibility_reduction_mixer(MixerFun<TSeq> fun)
+{
+    susceptibility_reduction_mixer  = fun;
+    susceptibility_reduction_cached = false;
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::set_transmission_reduction_mixer(MixerFun<TSeq> fun)
+{
+    transmission_reduction_mixer  = fun;
+    transmission_reduction_cached = false;
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::set_recovery_enhancer_mixer(MixerFun<TSeq> fun)
+{
+    recovery_enhancer_mixer = fun;
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::set_death_reduction_mixer(MixerFun<TSeq> fun)
+{
+    death_reduction_mixer = fun;
+}
+
 template<typename TSeq>
 inline Model<TSeq> * Model<TSeq>::clone_ptr()
 {
@@ -7097,6 +13862,9 @@ inline Model<TSeq>::Model(const Model<TSeq> & model) :
     population(model.population),
     population_backup(model.population_backup),
     directed(model.directed),
+    weighted(model.weighted),
+    agents_order(model.agents_order),
+    agents_original_id(model.agents_original_id),
     viruses(model.viruses),
     prevalence_virus(model.prevalence_virus),
     prevalence_virus_as_proportion(model.prevalence_virus_as_proportion),
@@ -7112,6 +13880,9 @@ inline Model<TSeq>::Model(const Model<TSeq> & model) :
     // entities_dist_funs(model.entities_dist_funs),
     rewire_fun(model.rewire_fun),
     rewire_prop(model.rewire_prop),
+    network_deltas_fn(model.network_deltas_fn),
+    network_deltas_period(model.network_deltas_period),
+    propagation_push(model.propagation_push),
     parameters(model.parameters),
     ndays(model.ndays),
     pb(model.pb),
@@ -7165,6 +13936,9 @@ inline Model<TSeq>::Model(Model<TSeq> && model) :
     agents_data(std::move(model.agents_data)),
     agents_data_ncols(std::move(model.agents_data_ncols)),
     directed(std::move(model.directed)),
+    weighted(model.weighted),
+    agents_order(std::move(model.agents_order)),
+    agents_original_id(std::move(model.agents_original_id)),
     // Virus
     viruses(std::move(model.viruses)),
     prevalence_virus(std::move(model.prevalence_virus)),
@@ -7191,6 +13965,12 @@ inline Model<TSeq>::Model(Model<TSeq> && model) :
     // Rewiring
     rewire_fun(std::move(model.rewire_fun)),
     rewire_prop(std::move(model.rewire_prop)),
+    network_deltas_fn(std::move(model.network_deltas_fn)),
+    network_deltas_period(model.network_deltas_period),
+    network_deltas(std::move(model.network_deltas)),
+    halo_exchange_fun(std::move(model.halo_exchange_fun)),
+    halo_n_owned(model.halo_n_owned),
+    propagation_push(model.propagation_push),
     parameters(std::move(model.parameters)),
     // Others
     ndays(model.ndays),
@@ -7242,6 +14022,10 @@ inline Model<TSeq> & Model<TSeq>::operator=(const Model<TSeq> & m)
     db.user_data.model = this;
 
     directed = m.directed;
+    weighted = m.weighted;
+
+    agents_order       = m.agents_order;
+    agents_original_id = m.agents_original_id;
     
     viruses                        = m.viruses;
     prevalence_virus               = m.prevalence_virus;
@@ -7262,6 +14046,17 @@ inline Model<TSeq> & Model<TSeq>::operator=(const Model<TSeq> & m)
     rewire_fun  = m.rewire_fun;
     rewire_prop = m.rewire_prop;
 
+    network_deltas_fn     = m.network_deltas_fn;
+    network_deltas_period = m.network_deltas_period;
+    network_deltas        = nullptr;
+
+    halo_exchange_fun = nullptr;
+    halo_n_owned      = 0u;
+
+    propagation_push    = m.propagation_push;
+    exposures_valid     = false;
+    virus_holders_valid = false;
+
     parameters = m.parameters;
     ndays      = m.ndays;
     pb         = m.pb;
@@ -7377,6 +14172,9 @@ inline void Model<TSeq>::agents_empty_graph(
     // Resizing the people
     population.clear();
     population.resize(n, Agent<TSeq>());
+    agents_original_id.clear();
+    virus_holders_valid = false;
+    weighted = false;
 
     // Filling the model and ids
     size_t i = 0u;
@@ -7389,6 +14187,44 @@ inline void Model<TSeq>::agents_empty_graph(
 
 }
 
+template<typename TSeq>
+inline void Model<TSeq>::set_agents_order(std::string method)
+{
+
+    if ((method != "none") && (method != "degree") && (method != "rcm") &&
+        (method != "community"))
+        throw std::logic_error(
+            "The ordering method \"" + method + "\" is not supported. " +
+            "Use either \"none\", \"degree\", \"rcm\", or \"community\"."
+            );
+
+    agents_order = method;
+
+}
+
+template<typename TSeq>
+inline const std::string & Model<TSeq>::get_agents_order() const
+{
+    return agents_order;
+}
+
+template<typename TSeq>
+inline int Model<TSeq>::get_agent_original_id(int id) const
+{
+
+    if ((id < 0) || (agents_original_id.size() == 0u))
+        return id;
+
+    return agents_original_id[id];
+
+}
+
+template<typename TSeq>
+inline const std::vector< int > & Model<TSeq>::get_agents_original_ids() const
+{
+    return agents_original_id;
+}
+
 // template<typename TSeq>
 // inline void Model<TSeq>::set_rand_engine(std::mt19937 & eng)
 // {
@@ -7450,8 +14286,8 @@ template<typename TSeq>
 inline void Model<TSeq>::dist_virus()
 {
 
-    // Starting first infection
-    int n = size();
+    // Starting first infection (ghosts get their viruses from their owners)
+    int n = static_cast< int >(get_n_owned());
     std::vector< size_t > idx(n);
 
     int n_left = n;
@@ -7471,15 +14307,15 @@ inline void Model<TSeq>::dist_virus()
             int nsampled;
             if (prevalence_virus_as_proportion[v])
             {
-                nsampled = static_cast<int>(std::floor(prevalence_virus[v] * size()));
+                nsampled = static_cast<int>(std::floor(prevalence_virus[v] * n));
             }
             else
             {
                 nsampled = static_cast<int>(prevalence_virus[v]);
             }
 
-            if (nsampled > static_cast<int>(size()))
-                throw std::range_error("There are only " + std::to_string(size()) + 
+            if (nsampled > n)
+                throw std::range_error("There are only " + std::to_string(n) + 
                 " individuals in the population. Cannot add the virus to " + std::to_string(nsampled));
 
 
@@ -7518,8 +14354,8 @@ template<typename TSeq>
 inline void Model<TSeq>::dist_tools()
 {
 
-    // Starting first infection
-    int n = size();
+    // Starting first infection (ghosts get their tools from their owners)
+    int n = static_cast< int >(get_n_owned());
     std::vector< size_t > idx(n);
     for (epiworld_fast_uint t = 0; t < tools.size(); ++t)
     {
@@ -7535,15 +14371,15 @@ inline void Model<TSeq>::dist_tools()
             int nsampled;
             if (prevalence_tool_as_proportion[t])
             {
-                nsampled = static_cast<int>(std::floor(prevalence_tool[t] * size()));
+                nsampled = static_cast<int>(std::floor(prevalence_tool[t] * n));
             }
             else
             {
                 nsampled = static_cast<int>(prevalence_tool[t]);
             }
 
-            if (nsampled > static_cast<int>(size()))
-                throw std::range_error("There are only " + std::to_string(size()) + 
+            if (nsampled > n)
+                throw std::range_error("There are only " + std::to_string(n) + 
                 " individuals in the population. Cannot add the tool to " + std::to_string(nsampled));
             
             ToolPtr<TSeq> tool = tools[t];
@@ -7990,55 +14826,130 @@ inline void Model<TSeq>::rm_tool(size_t tool_pos)
 template<typename TSeq>
 inline void Model<TSeq>::load_agents_entities_ties(
     std::string fn,
-    int skip
+    int skip,
+    bool use_cache,
+    int nthreads
     )
 {
 
-    int i,j;
-    std::ifstream filei(fn);
+    // Reading the ties in the order of the file
+    std::vector< int > agents_ids;
+    std::vector< int > entities_ids;
+    read_int_pairs_cached(
+        fn, agents_ids, entities_ids, skip, nthreads, use_cache
+        );
 
-    if (!filei)
-        throw std::logic_error("The file " + fn + " was not found.");
+    // If the agents were relabeled, the file has the original ids
+    if (agents_original_id.size() > 0u)
+    {
+
+        std::vector< int > new_id(agents_original_id.size());
+        for (size_t i = 0u; i < agents_original_id.size(); ++i)
+            new_id[agents_original_id[i]] = static_cast< int >(i);
+
+        for (auto & i : agents_ids)
+            if ((i >= 0) && (static_cast< size_t >(i) < new_id.size()))
+                i = new_id[i];
+
+    }
+
+    load_agents_entities_ties(agents_ids, entities_ids);
+
+    return;
+
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::load_agents_entities_ties(
+    const std::vector< int > & agents_ids,
+    const std::vector< int > & entities_ids
+)
+{
+
+    if (agents_ids.size() != entities_ids.size())
+        throw std::length_error(
+            "The agents_ids (" + std::to_string(agents_ids.size()) +
+            ") and entities_ids (" + std::to_string(entities_ids.size()) +
+            ") vectors must be of the same length."
+            );
+
+    check_id_range(agents_ids, static_cast<int>(this->size()) - 1, "agent");
+    check_id_range(entities_ids, static_cast<int>(this->entities.size()) - 1, "entity");
+
+    size_t nagents   = this->size();
+    size_t nentities = this->entities.size();
+
+    // Counting (and sorting by entity)
+    std::vector< size_t > n_per_agent(nagents, 0u);
+    std::vector< size_t > start(nentities + 1u, 0u);
+    for (size_t k = 0u; k < agents_ids.size(); ++k)
+    {
+        ++n_per_agent[agents_ids[k]];
+        ++start[entities_ids[k] + 1];
+    }
+
+    for (size_t e = 0u; e < nentities; ++e)
+        start[e + 1u] += start[e];
+
+    std::vector< int > sorted_agents(agents_ids.size());
+    {
+        std::vector< size_t > cursor(start.begin(), start.end() - 1);
+        for (size_t k = 0u; k < agents_ids.size(); ++k)
+            sorted_agents[cursor[entities_ids[k]]++] = agents_ids[k];
+    }
+
+    // Reserving the exact space (entries past n_agents/n_entities are
+    // leftovers from removals)
+    for (size_t i = 0u; i < nagents; ++i)
+    {
+
+        if (n_per_agent[i] == 0u)
+            continue;
 
-    int linenum = 0;
-    std::vector< epiworld_fast_uint > source_;
-    std::vector< std::vector< epiworld_fast_uint > > target_(entities.size());
+        auto & p = population[i];
+        p.entities.resize(p.n_entities);
+        p.entities_locations.resize(p.n_entities);
+        p.entities.reserve(p.n_entities + n_per_agent[i]);
+        p.entities_locations.reserve(p.n_entities + n_per_agent[i]);
 
-    target_.reserve(1e5);
+    }
 
-    while (!filei.eof())
+    // Adding the ties, one entity at a time
+    std::vector< int > last_entity(nagents, -1);
+    for (size_t e = 0u; e < nentities; ++e)
     {
 
-        if (linenum++ < skip)
+        auto & entity = entities[e];
+        size_t n_new  = start[e + 1u] - start[e];
+        if (n_new == 0u)
             continue;
 
-        filei >> i >> j;
+        entity.agents.resize(entity.n_agents);
+        entity.agents_location.resize(entity.n_agents);
+        entity.agents.reserve(entity.n_agents + n_new);
+        entity.agents_location.reserve(entity.n_agents + n_new);
 
-        // Looking for exceptions
-        if (filei.bad())
-            throw std::logic_error(
-                "I/O error while reading the file " +
-                fn
-            );
+        for (size_t k = start[e]; k < start[e + 1u]; ++k)
+        {
 
-        if (filei.fail())
-            break;
+            auto & p = population[sorted_agents[k]];
 
-        if (i >= static_cast<int>(this->size()))
-            throw std::range_error(
-                "The agent["+std::to_string(linenum)+"] = " + std::to_string(i) +
-                " is above the max id " + std::to_string(this->size() - 1)
-                );
+            // Checking the agent and the entity are not linked
+            bool linked = last_entity[p.id] == static_cast< int >(e);
+            for (size_t j = 0u; !linked && (j < p.n_entities); ++j)
+                linked = p.entities[j] == e;
 
-        if (j >= static_cast<int>(this->entities.size()))
-            throw std::range_error(
-                "The entity["+std::to_string(linenum)+"] = " + std::to_string(j) +
-                " is above the max id " + std::to_string(this->entities.size() - 1)
-                );
+            if (linked)
+                throw std::logic_error("An entity cannot be reassigned to an agent.");
+
+            last_entity[p.id] = static_cast< int >(e);
 
-        target_[j].push_back(i);
+            p.entities.push_back(e);
+            p.entities_locations.push_back(entity.n_agents++);
+            entity.agents.push_back(p.id);
+            entity.agents_location.push_back(p.n_entities++);
 
-        population[i].add_entity(entities[j], nullptr);
+        }
 
     }
 
@@ -8079,12 +14990,14 @@ inline void Model<TSeq>::agents_from_adjlist(
     std::string fn,
     int size,
     int skip,
-    bool directed
+    bool directed,
+    bool use_cache,
+    int nthreads
     ) {
 
-    AdjList al;
-    al.read_edgelist(fn, size, skip, directed);
-    this->agents_from_adjlist(al);
+    CSRGraph g;
+    g.read_edgelist(fn, size, skip, directed, nthreads, use_cache);
+    this->agents_from_adjlist(g);
 
 }
 
@@ -8102,26 +15015,225 @@ inline void Model<TSeq>::agents_from_edgelist(
 }
 
 template<typename TSeq>
-inline void Model<TSeq>::agents_from_adjlist(AdjList al) {
+inline void Model<TSeq>::agents_from_edgelist(
+    const std::vector< int > & source,
+    const std::vector< int > & target,
+    const std::vector< epiworld_double > & weight,
+    int size,
+    bool directed
+) {
+
+    agents_from_adjlist(CSRGraph(source, target, weight, size, directed));
+
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::agents_from_adjlist(AdjList al, bool values_as_weights) {
+
+    agents_from_adjlist(CSRGraph(al, values_as_weights));
+
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::agents_from_adjlist(const CSRGraph & g) {
+
+    if (agents_order == "none")
+    {
+        build_population(g);
+        return;
+    }
+
+    // Relabeling the agents first
+    std::vector< int > order = graph_order(g, agents_order);
+
+    build_population(g.permute(order));
+    agents_original_id = std::move(order);
+
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::build_population(const CSRGraph & g) {
 
     // Resizing the people
-    agents_empty_graph(al.vcount());
-    
-    const auto & tmpdat = al.get_dat();
-    
-    for (size_t i = 0u; i < tmpdat.size(); ++i)
+    agents_empty_graph(g.vcount());
+
+    const auto & offsets = g.get_offsets();
+    const auto & nbrs    = g.get_neighbors();
+    const auto & wgts    = g.get_weights();
+    int n = static_cast< int >(g.vcount());
+
+    weighted = g.has_weights();
+
+    // Ties are symmetric in the population (if i is a neighbor of j, then j
+    // is a neighbor of i.) Each agent's neighbors are ordered by where the
+    // tie first appears in the graph, row by row.
+    if (!g.is_directed())
+    {
+
+        // The rows of an undirected graph are already symmetric and sorted,
+        // so the neighbors are the rows. The location of i in the row of j
+        // is found by binary search.
+        #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 1024)
+        #endif
+        for (int ii = 0; ii < n; ++ii)
+        {
+
+            size_t i  = static_cast< size_t >(ii);
+            auto & p  = population[i];
+            size_t nn = offsets[i + 1u] - offsets[i];
+
+            p.neighbors.resize(nn);
+            p.neighbors_locations.resize(nn);
+            p.n_neighbors = nn;
+
+            if (weighted)
+                p.neighbors_weights.assign(
+                    wgts.begin() + offsets[i], wgts.begin() + offsets[i + 1u]
+                    );
+
+            for (size_t k = 0u; k < nn; ++k)
+            {
+
+                size_t j = static_cast< size_t >(nbrs[offsets[i] + k]);
+                p.neighbors[k] = j;
+                p.neighbors_locations[k] = static_cast< size_t >(std::distance(
+                    nbrs.begin() + offsets[j],
+                    std::lower_bound(
+                        nbrs.begin() + offsets[j],
+                        nbrs.begin() + offsets[j + 1u],
+                        static_cast< int >(i)
+                    )
+                ));
+
+            }
+
+        }
+
+    }
+    else
     {
 
-        // population[i].id    = i;
-        population[i].model = this;
+        // Each tie i -> j is listed for both i and j with the key
+        // i * n + j. Repeated ties (i -> j and j -> i) keep the smallest key.
+        size_t nv = static_cast< size_t >(n);
+        std::vector< size_t > start(nv + 1u, 0u);
+        for (size_t i = 0u; i < nv; ++i)
+            for (size_t k = offsets[i]; k < offsets[i + 1u]; ++k)
+            {
+
+                size_t j = static_cast< size_t >(nbrs[k]);
+                ++start[i + 1u];
+                if (j != i)
+                    ++start[j + 1u];
+
+            }
+
+        for (size_t i = 0u; i < nv; ++i)
+            start[i + 1u] += start[i];
+
+        std::vector< std::pair< std::uint64_t, int > > ties(start[nv]);
+        std::vector< size_t > cursor(start.begin(), start.end() - 1);
+        for (size_t i = 0u; i < nv; ++i)
+            for (size_t k = offsets[i]; k < offsets[i + 1u]; ++k)
+            {
+
+                size_t j = static_cast< size_t >(nbrs[k]);
+                std::uint64_t key = static_cast< std::uint64_t >(i) * nv + j;
+
+                ties[cursor[i]++] = {key, static_cast< int >(j)};
+                if (j != i)
+                    ties[cursor[j]++] = {key, static_cast< int >(i)};
 
-        for (const auto & link: tmpdat[i])
+            }
+
+        // Sorting by neighbor to drop the repeated ones, and then by key
+        std::vector< size_t > deg(nv, 0u);
+
+        #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 1024)
+        #endif
+        for (int ii = 0; ii < n; ++ii)
         {
 
-            population[i].add_neighbor(
-                population[link.first],
-                true, true
-                );
+            size_t i     = static_cast< size_t >(ii);
+            auto row_beg = ties.begin() + start[i];
+            auto row_end = ties.begin() + start[i + 1u];
+
+            std::sort(
+                row_beg, row_end,
+                [](const std::pair< std::uint64_t, int > & a,
+                   const std::pair< std::uint64_t, int > & b) {
+                    return (a.second < b.second) ||
+                        ((a.second == b.second) && (a.first < b.first));
+                });
+
+            row_end = std::unique(
+                row_beg, row_end,
+                [](const std::pair< std::uint64_t, int > & a,
+                   const std::pair< std::uint64_t, int > & b) {
+                    return a.second == b.second;
+                });
+
+            std::sort(row_beg, row_end);
+
+            deg[i] = static_cast< size_t >(std::distance(row_beg, row_end));
+
+        }
+
+        #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 1024)
+        #endif
+        for (int ii = 0; ii < n; ++ii)
+        {
+
+            size_t i = static_cast< size_t >(ii);
+            auto & p = population[i];
+
+            p.neighbors.resize(deg[i]);
+            p.neighbors_locations.resize(deg[i]);
+            p.n_neighbors = deg[i];
+
+            if (weighted)
+                p.neighbors_weights.resize(deg[i]);
+
+            for (size_t k = 0u; k < deg[i]; ++k)
+            {
+
+                const auto & tie = ties[start[i] + k];
+                size_t j = static_cast< size_t >(tie.second);
+
+                // The tie has the same key in the row of j
+                p.neighbors[k] = j;
+                p.neighbors_locations[k] = static_cast< size_t >(std::distance(
+                    ties.begin() + start[j],
+                    std::lower_bound(
+                        ties.begin() + start[j],
+                        ties.begin() + start[j] + deg[j],
+                        std::pair< std::uint64_t, int >(tie.first, INT_MIN)
+                    )
+                ));
+
+                // The weight is that of the tie in the graph
+                if (weighted)
+                {
+
+                    size_t from = static_cast< size_t >(tie.first / nv);
+                    int to      = static_cast< int >(tie.first % nv);
+                    size_t pos  = static_cast< size_t >(std::distance(
+                        nbrs.begin(),
+                        std::lower_bound(
+                            nbrs.begin() + offsets[from],
+                            nbrs.begin() + offsets[from + 1u],
+                            to
+                        )
+                    ));
+
+                    p.neighbors_weights[k] = wgts[pos];
+
+                }
+
+            }
 
         }
 
@@ -8130,7 +15242,7 @@ inline void Model<TSeq>::agents_from_adjlist(AdjList al) {
     #ifdef EPI_DEBUG
     for (auto & p: population)
     {
-        if (p.id >= static_cast<int>(al.vcount()))
+        if (p.id >= static_cast<int>(g.vcount()))
             throw std::logic_error(
                 "Agent's id cannot be negative above or equal to the number of agents!");
     }
@@ -8138,6 +15250,12 @@ inline void Model<TSeq>::agents_from_adjlist(AdjList al) {
 
 }
 
+template<typename TSeq>
+inline bool Model<TSeq>::is_weighted() const
+{
+    return weighted;
+}
+
 template<typename TSeq>
 inline bool Model<TSeq>::is_directed() const
 {
@@ -8263,6 +15381,12 @@ inline void Model<TSeq>::run(
         // to change the network just a bit.
         this->rewire();
 
+        // Daily changes in the network (if any)
+        this->apply_network_deltas();
+
+        // Refreshing agents owned by other processes (if any)
+        this->halo_exchange();
+
         // This locks all the changes
         this->next();
 
@@ -8476,13 +15600,14 @@ inline void Model<TSeq>::run_multiple(
 template<typename TSeq>
 inline void Model<TSeq>::update_state() {
 
-    // Next state
+    // Next state. Ghosts (if any) are updated by their owners.
     if (use_queuing)
     {
-        int i = -1;
-        for (auto & p: population)
-            if (queue[++i] > 0)
+
+        for (size_t i = 0u; i < get_n_owned(); ++i)
+            if (queue[i] > 0)
             {
+                auto & p = population[i];
                 if (state_fun[p.state])
                     state_fun[p.state](&p, this);
             }
@@ -8491,9 +15616,12 @@ inline void Model<TSeq>::update_state() {
     else
     {
 
-        for (auto & p: population)
+        for (size_t i = 0u; i < get_n_owned(); ++i)
+        {
+            auto & p = population[i];
             if (state_fun[p.state])
-                    state_fun[p.state](&p, this);
+                state_fun[p.state](&p, this);
+        }
 
     }
 
@@ -8506,16 +15634,17 @@ inline void Model<TSeq>::update_state() {
 template<typename TSeq>
 inline void Model<TSeq>::mutate_virus() {
 
+    // Ghosts (if any) get their viruses from their owners
     if (use_queuing)
     {
 
-        int i = -1;
-        for (auto & p: population)
+        for (size_t i = 0u; i < get_n_owned(); ++i)
         {
 
-            if (queue[++i] == 0)
+            if (queue[i] == 0)
                 continue;
 
+            auto & p = population[i];
             if (p.n_viruses > 0u)
                 for (auto & v : p.get_viruses())
                     v->mutate(this);
@@ -8526,9 +15655,10 @@ inline void Model<TSeq>::mutate_virus() {
     else 
     {
 
-        for (auto & p: population)
+        for (size_t i = 0u; i < get_n_owned(); ++i)
         {
 
+            auto & p = population[i];
             if (p.n_viruses > 0u)
                 for (auto & v : p.get_viruses())
                     v->mutate(this);
@@ -8610,7 +15740,123 @@ template<typename TSeq>
 inline void Model<TSeq>::rewire() {
 
     if (rewire_fun)
+    {
         rewire_fun(&population, this, rewire_prop);
+        exposures_valid = false;
+    }
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::set_network_deltas(std::string fn, int period)
+{
+
+    if (period < 0)
+        throw std::range_error("The period cannot be negative.");
+
+    // Checking the file (it is opened again at each reset)
+    if (fn != "")
+    {
+
+        NetworkDeltas deltas(fn);
+        if ((size() > 0u) && (deltas.get_vcount() != size()))
+            throw std::range_error(
+                "The network changes in \"" + fn + "\" are for " +
+                std::to_string(deltas.get_vcount()) + " agents, but the " +
+                "model has " + std::to_string(size()) + "."
+                );
+
+        queuing_off();
+
+    }
+
+    network_deltas_fn     = fn;
+    network_deltas_period = period;
+    network_deltas        = nullptr;
+
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::set_halo_exchange(
+    std::function<void(Model<TSeq>*)> fun,
+    size_t n_owned
+)
+{
+
+    if (fun && (size() > 0u) && (n_owned > size()))
+        throw std::range_error(
+            "The number of owned agents (" + std::to_string(n_owned) +
+            ") cannot exceed the number of agents (" +
+            std::to_string(size()) + ")."
+            );
+
+    // The queue would count ties to ghosts
+    if (fun)
+        queuing_off();
+
+    halo_exchange_fun = fun;
+    halo_n_owned      = n_owned;
+
+}
+
+template<typename TSeq>
+inline size_t Model<TSeq>::get_n_owned() const noexcept
+{
+    return halo_exchange_fun ? halo_n_owned : population.size();
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::halo_exchange()
+{
+
+    if (halo_exchange_fun)
+    {
+        halo_exchange_fun(this);
+        exposures_valid = false;
+    }
+
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::apply_network_deltas()
+{
+
+    if (!network_deltas)
+        return;
+
+    int day = today();
+    if (network_deltas_period > 0)
+    {
+
+        day %= network_deltas_period;
+        if ((day == 0) && (today() > 0))
+            network_deltas->rewind();
+
+    }
+
+    if (!network_deltas->read(day))
+        return;
+
+    exposures_valid = false;
+
+    auto & d = *network_deltas;
+    int max_id = static_cast< int >(size()) - 1;
+    check_id_range(d.add_source, max_id, "source");
+    check_id_range(d.add_target, max_id, "target");
+    check_id_range(d.rm_source, max_id, "source");
+    check_id_range(d.rm_target, max_id, "target");
+
+    // Self-ties can only come from the initial network (they are not added
+    // below), and rm_neighbor() takes care of them
+    for (size_t k = 0u; k < d.rm_source.size(); ++k)
+        population[d.rm_source[k]].rm_neighbor(population[d.rm_target[k]]);
+
+    // Added ties get the default weight (1.0) if the ties are weighted
+    for (size_t k = 0u; k < d.add_source.size(); ++k)
+        if (d.add_source[k] != d.add_target[k])
+            population[d.add_source[k]].add_neighbor(
+                population[d.add_target[k]], true, true
+                );
+
 }
 
 
@@ -8656,7 +15902,8 @@ inline void Model<TSeq>::write_edgelist(
         for (const auto & p : wseq)
         {
             for (auto & n : p->neighbors)
-                efile << p->id << " " << n << "\n";
+                efile << get_agent_original_id(p->id) << " " <<
+                    get_agent_original_id(n) << "\n";
         }
 
     } else {
@@ -8664,8 +15911,9 @@ inline void Model<TSeq>::write_edgelist(
         for (const auto & p : wseq)
         {
             for (auto & n : p->neighbors)
-                if (static_cast<int>(p->id) <= static_cast<int>(n))
-                    efile << p->id << " " << n << "\n";
+                if (get_agent_original_id(p->id) <= get_agent_original_id(n))
+                    efile << get_agent_original_id(p->id) << " " <<
+                        get_agent_original_id(n) << "\n";
         }
 
     }
@@ -8690,8 +15938,8 @@ std::vector< int > & target
         {
             for (auto & n : p->neighbors)
             {
-                source.push_back(static_cast<int>(p->id));
-                target.push_back(static_cast<int>(n));
+                source.push_back(get_agent_original_id(p->id));
+                target.push_back(get_agent_original_id(n));
             }
         }
 
@@ -8700,9 +15948,9 @@ std::vector< int > & target
         for (const auto & p : wseq)
         {
             for (auto & n : p->neighbors) {
-                if (static_cast<int>(p->id) <= static_cast<int>(n)) {
-                    source.push_back(static_cast<int>(p->id));
-                    target.push_back(static_cast<int>(n));
+                if (get_agent_original_id(p->id) <= get_agent_original_id(n)) {
+                    source.push_back(get_agent_original_id(p->id));
+                    target.push_back(get_agent_original_id(n));
                 }
             }
         }
@@ -8724,6 +15972,15 @@ inline void Model<TSeq>::reset() {
     // Restablishing people
     pb = Progress(ndays, 80);
 
+    // The network changes during the run, so the original is kept
+    if (network_deltas_fn != "")
+    {
+        set_backup();
+        network_deltas = std::make_shared< NetworkDeltas >(network_deltas_fn);
+    }
+    else
+        network_deltas = nullptr;
+
     if (population_backup.size() != 0u)
     {
         population = population_backup;
@@ -8777,6 +16034,9 @@ inline void Model<TSeq>::reset() {
     
     current_date = 0;
 
+    exposures_valid     = false;
+    virus_holders_valid = false;
+
     db.reset();
 
     // This also clears the queue
@@ -8787,6 +16047,10 @@ inline void Model<TSeq>::reset() {
     dist_virus();
     dist_tools();
 
+    apply_network_deltas();
+
+    halo_exchange();
+
     // Recording the original state (at time 0) and advancing
     // to time 1
     next();
@@ -9542,6 +16806,172 @@ inline void Model<TSeq>::rm_global_action(
 
 }
 
+template<typename TSeq>
+inline void Model<TSeq>::set_propagation(std::string mode)
+{
+
+    if (mode == "push")
+        propagation_push = true;
+    else if (mode == "pull")
+        propagation_push = false;
+    else
+        throw std::logic_error(
+            "The propagation mode \"" + mode + "\" is not supported. " +
+            "Use either \"pull\" or \"push\"."
+            );
+
+    exposures_valid     = false;
+    virus_holders_valid = false;
+
+}
+
+template<typename TSeq>
+inline std::string Model<TSeq>::get_propagation() const
+{
+    return propagation_push ? "push" : "pull";
+}
+
+template<typename TSeq>
+inline bool Model<TSeq>::is_propagation_push() const noexcept
+{
+    return propagation_push;
+}
+
+template<typename TSeq>
+inline DataView< Exposure<TSeq> > Model<TSeq>::get_exposures(size_t agent_id)
+{
+
+    if (!exposures_valid)
+        build_exposures();
+
+    if (exposures_n[agent_id] == 0u)
+        return DataView< Exposure<TSeq> >();
+
+    return DataView< Exposure<TSeq> >(
+        exposures.data() + exposures_start[agent_id],
+        exposures_n[agent_id]
+        );
+
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::build_exposures()
+{
+
+    size_t n = population.size();
+    if (exposures_n.size() != n)
+    {
+        exposures_n.assign(n, 0u);
+        exposures_start.assign(n, 0u);
+        exposures_targets.clear();
+    }
+
+    // Only the agents exposed in the last build need to be cleared
+    for (auto t : exposures_targets)
+        exposures_n[t] = 0u;
+
+    exposures_targets.clear();
+
+    // The sources, sorted by id so the exposures are too
+    if (!virus_holders_valid)
+    {
+
+        virus_holders.clear();
+        virus_holders_loc.assign(n, n);
+        for (auto & p : population)
+            if (p.n_viruses > 0u)
+                virus_holders.push_back(p.id);
+
+        virus_holders_valid = true;
+
+    }
+    else
+        std::sort(virus_holders.begin(), virus_holders.end());
+
+    for (size_t k = 0u; k < virus_holders.size(); ++k)
+        virus_holders_loc[virus_holders[k]] = k;
+
+    // Step 1: Counting the exposures of each agent
+    size_t total = 0u;
+    for (auto i : virus_holders)
+    {
+
+        auto & p = population[i];
+
+        for (size_t k = 0u; k < p.n_neighbors; ++k)
+        {
+
+            size_t t = p.neighbors[k];
+            if (exposures_n[t] == 0u)
+                exposures_targets.push_back(t);
+
+            exposures_n[t] += p.n_viruses;
+
+        }
+
+        total += p.n_neighbors * p.n_viruses;
+
+    }
+
+    // Step 2: Each exposed agent gets a contiguous block
+    size_t offset = 0u;
+    for (auto t : exposures_targets)
+    {
+        exposures_start[t] = offset;
+        offset += exposures_n[t];
+        exposures_n[t] = 0u;
+    }
+
+    exposures.resize(total);
+
+    // Step 3: Filling the blocks (by id of the source)
+    for (auto i : virus_holders)
+    {
+
+        auto & p = population[i];
+        bool weighted = p.neighbors_weights.size() > 0u;
+        for (size_t k = 0u; k < p.n_neighbors; ++k)
+        {
+
+            size_t t = p.neighbors[k];
+            epiworld_double w = weighted ? p.neighbors_weights[k] : 1.0;
+            for (size_t v = 0u; v < p.n_viruses; ++v)
+                exposures[exposures_start[t] + exposures_n[t]++] =
+                    {&p, &p.viruses[v], w};
+
+        }
+
+    }
+
+    exposures_valid = true;
+
+}
+
+template<typename TSeq>
+inline void Model<TSeq>::virus_holders_update(Agent<TSeq> & p)
+{
+
+    if (!propagation_push || !virus_holders_valid)
+        return;
+
+    size_t & loc = virus_holders_loc[p.id];
+    size_t none  = virus_holders_loc.size();
+
+    if ((p.n_viruses > 0u) && (loc == none))
+    {
+        loc = virus_holders.size();
+        virus_holders.push_back(p.id);
+    }
+    else if ((p.n_viruses == 0u) && (loc != none))
+    {
+        virus_holders_loc[virus_holders.back()] = loc;
+        virus_holders[loc] = virus_holders.back();
+        virus_holders.pop_back();
+        loc = none;
+    }
+
+}
+
 template<typename TSeq>
 inline void Model<TSeq>::run_global_actions()
 {
@@ -10134,6 +17564,8 @@ private:
     int agent_exposure_number = -99;
 
     std::shared_ptr<TSeq> baseline_sequence = nullptr;
+    std::uint64_t fingerprint = 0u;  ///< Fingerprint of the sequence
+    bool fingerprint_valid = false;  ///< `false` if it needs recomputing
     std::shared_ptr<std::string> virus_name = nullptr;
     int date = -99;
     int id   = -99;
@@ -10145,6 +17577,29 @@ private:
     VirusFun<TSeq>        probability_of_death_fun     = nullptr;
     VirusFun<TSeq>        incubation_fun               = nullptr;
 
+    /**
+     * @name Constant and parameter probabilities
+     * 
+     * @details Probabilities set with a number or a pointer to a model
+     * parameter are stored here instead of being wrapped in a `VirusFun`, so
+     * the getters read them inline (no indirect call). Precedence is pointer,
+     * then function, then value; the value holds the default otherwise.
+     * Setting a null function (e.g., `set_prob_infecting_fun(nullptr)`)
+     * resets the value to the default (`EPI_DEFAULT_*`), not to a constant
+     * set earlier.
+     */
+    ///@{
+    const epiworld_double * probability_of_infecting_ptr = nullptr;
+    const epiworld_double * probability_of_recovery_ptr  = nullptr;
+    const epiworld_double * probability_of_death_ptr     = nullptr;
+    const epiworld_double * incubation_ptr               = nullptr;
+
+    epiworld_double probability_of_infecting_value = EPI_DEFAULT_VIRUS_PROB_INFECTION;
+    epiworld_double probability_of_recovery_value  = EPI_DEFAULT_VIRUS_PROB_RECOVERY;
+    epiworld_double probability_of_death_value     = EPI_DEFAULT_VIRUS_PROB_DEATH;
+    epiworld_double incubation_value               = EPI_DEFAULT_INCUBATION_DAYS;
+    ///@}
+
     // Setup parameters
     std::vector< epiworld_double * > params = {};
     std::vector< epiworld_double > data = {};
@@ -10165,6 +17620,21 @@ public:
     
     std::shared_ptr<TSeq> get_sequence();
     void set_sequence(TSeq sequence);
+
+    /**
+     * @name Fingerprint of the sequence
+     * 
+     * @details Set when the virus is recorded in the database. Setting the
+     * sequence, or mutating the virus, marks it as outdated, so it is
+     * recomputed when recording unless the mutation function updates it
+     * with `set_fingerprint()` (see `seq_fingerprint_update()`).
+     * `get_fingerprint()` returns the last value set, even if outdated.
+     */
+    ///@{
+    std::uint64_t get_fingerprint() const noexcept;
+    bool has_fingerprint() const noexcept;
+    void set_fingerprint(std::uint64_t fp) noexcept;
+    ///@}
     
     Agent<TSeq> * get_agent();
     void set_agent(Agent<TSeq> * p, epiworld_fast_uint idx);
@@ -10370,8 +17840,18 @@ inline void Virus<TSeq>::mutate(
 ) {
 
     if (mutation_fun)
+    {
+
+        // The mutation may change the sequence in place
+        bool fingerprint_valid_prev = fingerprint_valid;
+        fingerprint_valid = false;
+
         if (mutation_fun(agent, *this, model))
             model->get_db().record_virus(*this);
+        else
+            fingerprint_valid = fingerprint_valid_prev;
+
+    }
 
     return;
     
@@ -10397,10 +17877,30 @@ inline void Virus<TSeq>::set_sequence(TSeq sequence)
 {
 
     baseline_sequence = std::make_shared<TSeq>(sequence);
+    fingerprint_valid = false;
     return;
 
 }
 
+template<typename TSeq>
+inline std::uint64_t Virus<TSeq>::get_fingerprint() const noexcept
+{
+    return fingerprint;
+}
+
+template<typename TSeq>
+inline bool Virus<TSeq>::has_fingerprint() const noexcept
+{
+    return fingerprint_valid;
+}
+
+template<typename TSeq>
+inline void Virus<TSeq>::set_fingerprint(std::uint64_t fp) noexcept
+{
+    fingerprint       = fp;
+    fingerprint_valid = true;
+}
+
 template<typename TSeq>
 inline Agent<TSeq> * Virus<TSeq>::get_agent()
 {
@@ -10467,10 +17967,13 @@ inline epiworld_double Virus<TSeq>::get_prob_infecting(
 )
 {
 
+    if (probability_of_infecting_ptr)
+        return *probability_of_infecting_ptr;
+
     if (probability_of_infecting_fun)
         return probability_of_infecting_fun(agent, *this, model);
         
-    return EPI_DEFAULT_VIRUS_PROB_INFECTION;
+    return probability_of_infecting_value;
 
 }
 
@@ -10482,10 +17985,13 @@ inline epiworld_double Virus<TSeq>::get_prob_recovery(
 )
 {
 
+    if (probability_of_recovery_ptr)
+        return *probability_of_recovery_ptr;
+
     if (probability_of_recovery_fun)
         return probability_of_recovery_fun(agent, *this, model);
         
-    return EPI_DEFAULT_VIRUS_PROB_RECOVERY;
+    return probability_of_recovery_value;
 
 }
 
@@ -10497,10 +18003,13 @@ inline epiworld_double Virus<TSeq>::get_prob_death(
 )
 {
 
+    if (probability_of_death_ptr)
+        return *probability_of_death_ptr;
+
     if (probability_of_death_fun)
         return probability_of_death_fun(agent, *this, model);
         
-    return EPI_DEFAULT_VIRUS_PROB_DEATH;
+    return probability_of_death_value;
 
 }
 
@@ -10510,10 +18019,13 @@ inline epiworld_double Virus<TSeq>::get_incubation(
 )
 {
 
+    if (incubation_ptr)
+        return *incubation_ptr;
+
     if (incubation_fun)
         return incubation_fun(agent, *this, model);
         
-    return EPI_DEFAULT_INCUBATION_DAYS;
+    return incubation_value;
 
 }
 
@@ -10521,120 +18033,100 @@ template<typename TSeq>
 inline void Virus<TSeq>::set_prob_infecting_fun(VirusFun<TSeq> fun)
 {
     probability_of_infecting_fun = fun;
+    probability_of_infecting_ptr = nullptr;
+
+    if (!fun)
+        probability_of_infecting_value = EPI_DEFAULT_VIRUS_PROB_INFECTION;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_prob_recovery_fun(VirusFun<TSeq> fun)
 {
     probability_of_recovery_fun = fun;
+    probability_of_recovery_ptr = nullptr;
+
+    if (!fun)
+        probability_of_recovery_value = EPI_DEFAULT_VIRUS_PROB_RECOVERY;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_prob_death_fun(VirusFun<TSeq> fun)
 {
     probability_of_death_fun = fun;
+    probability_of_death_ptr = nullptr;
+
+    if (!fun)
+        probability_of_death_value = EPI_DEFAULT_VIRUS_PROB_DEATH;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_incubation_fun(VirusFun<TSeq> fun)
 {
     incubation_fun = fun;
+    incubation_ptr = nullptr;
+
+    if (!fun)
+        incubation_value = EPI_DEFAULT_INCUBATION_DAYS;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_prob_infecting(const epiworld_double * prob)
 {
-    VirusFun<TSeq> tmpfun = 
-        [prob](Agent<TSeq> *, Virus<TSeq> &, Model<TSeq> *)
-        {
-            return *prob;
-        };
-    
-    probability_of_infecting_fun = tmpfun;
+    probability_of_infecting_ptr = prob;
+    probability_of_infecting_fun = nullptr;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_prob_recovery(const epiworld_double * prob)
 {
-    VirusFun<TSeq> tmpfun = 
-        [prob](Agent<TSeq> *, Virus<TSeq> &, Model<TSeq> *)
-        {
-            return *prob;
-        };
-    
-    probability_of_recovery_fun = tmpfun;
+    probability_of_recovery_ptr = prob;
+    probability_of_recovery_fun = nullptr;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_prob_death(const epiworld_double * prob)
 {
-    VirusFun<TSeq> tmpfun = 
-        [prob](Agent<TSeq> *, Virus<TSeq> &, Model<TSeq> *)
-        {
-            return *prob;
-        };
-    
-    probability_of_death_fun = tmpfun;
+    probability_of_death_ptr = prob;
+    probability_of_death_fun = nullptr;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_incubation(const epiworld_double * prob)
 {
-    VirusFun<TSeq> tmpfun = 
-        [prob](Agent<TSeq> *, Virus<TSeq> &, Model<TSeq> *)
-        {
-            return *prob;
-        };
-    
-    incubation_fun = tmpfun;
+    incubation_ptr = prob;
+    incubation_fun = nullptr;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_prob_infecting(epiworld_double prob)
 {
-    VirusFun<TSeq> tmpfun = 
-        [prob](Agent<TSeq> *, Virus<TSeq> &, Model<TSeq> *)
-        {
-            return prob;
-        };
-    
-    probability_of_infecting_fun = tmpfun;
+    probability_of_infecting_value = prob;
+    probability_of_infecting_ptr   = nullptr;
+    probability_of_infecting_fun   = nullptr;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_prob_recovery(epiworld_double prob)
 {
-    VirusFun<TSeq> tmpfun = 
-        [prob](Agent<TSeq> *, Virus<TSeq> &, Model<TSeq> *)
-        {
-            return prob;
-        };
-    
-    probability_of_recovery_fun = tmpfun;
+    probability_of_recovery_value = prob;
+    probability_of_recovery_ptr   = nullptr;
+    probability_of_recovery_fun   = nullptr;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_prob_death(epiworld_double prob)
 {
-    VirusFun<TSeq> tmpfun = 
-        [prob](Agent<TSeq> *, Virus<TSeq> &, Model<TSeq> *)
-        {
-            return prob;
-        };
-    
-    probability_of_death_fun = tmpfun;
+    probability_of_death_value = prob;
+    probability_of_death_ptr   = nullptr;
+    probability_of_death_fun   = nullptr;
 }
 
 template<typename TSeq>
 inline void Virus<TSeq>::set_incubation(epiworld_double prob)
 {
-    VirusFun<TSeq> tmpfun = 
-        [prob](Agent<TSeq> *, Virus<TSeq> &, Model<TSeq> *)
-        {
-            return prob;
-        };
-    
-    incubation_fun = tmpfun;
+    incubation_value = prob;
+    incubation_ptr   = nullptr;
+    incubation_fun   = nullptr;
 }
 
 template<typename TSeq>
@@ -11252,6 +18744,7 @@ template<typename TSeq>
 class Tool {
     friend class Agent<TSeq>;
     friend class Model<TSeq>;
+    friend class DistributedModel<TSeq>;
     friend void default_add_tool<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
     friend void default_rm_tool<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
 private:
@@ -11263,11 +18756,32 @@ private:
     int id   = -99;
     std::shared_ptr<std::string> tool_name     = nullptr;
     std::shared_ptr<TSeq> sequence             = nullptr;
+    std::uint64_t fingerprint = 0u;  ///< Fingerprint of the sequence
+    bool fingerprint_valid = false;  ///< `false` if it needs recomputing
     ToolFun<TSeq> susceptibility_reduction_fun = nullptr;
     ToolFun<TSeq> transmission_reduction_fun   = nullptr;
     ToolFun<TSeq> recovery_enhancer_fun        = nullptr;
     ToolFun<TSeq> death_reduction_fun          = nullptr;
 
+    /**
+     * @name Constant and parameter effects
+     * 
+     * @details Same as in `Virus`: pointers and constants are read inline,
+     * without calling a `ToolFun`. A null function resets the value to the
+     * default (`DEFAULT_TOOL_*`).
+     */
+    ///@{
+    const epiworld_double * susceptibility_reduction_ptr = nullptr;
+    const epiworld_double * transmission_reduction_ptr   = nullptr;
+    const epiworld_double * recovery_enhancer_ptr        = nullptr;
+    const epiworld_double * death_reduction_ptr          = nullptr;
+
+    epiworld_double susceptibility_reduction_value = DEFAULT_TOOL_CONTAGION_REDUCTION;
+    epiworld_double transmission_reduction_value   = DEFAULT_TOOL_TRANSMISSION_REDUCTION;
+    epiworld_double recovery_enhancer_value        = DEFAULT_TOOL_RECOVERY_ENHANCER;
+    epiworld_double death_reduction_value          = DEFAULT_TOOL_DEATH_REDUCTION;
+    ///@}
+
     // Setup parameters
     std::vector< epiworld_double * > params;  
 
@@ -11277,6 +18791,8 @@ private:
     epiworld_fast_int queue_init = Queue<TSeq>::NoOne; ///< Change of state when added to agent.
     epiworld_fast_int queue_post = Queue<TSeq>::NoOne; ///< Change of state when removed from agent.
 
+    bool time_dependent = false; ///< See `set_time_dependent()`.
+
     void set_agent(Agent<TSeq> * p, size_t idx);
 
 public:
@@ -11287,6 +18803,16 @@ public:
     void set_sequence(std::shared_ptr<TSeq> d);
     std::shared_ptr<TSeq> get_sequence();
 
+    /**
+     * @name Fingerprint of the sequence
+     * @details Same as in `Virus`.
+     */
+    ///@{
+    std::uint64_t get_fingerprint() const noexcept;
+    bool has_fingerprint() const noexcept;
+    void set_fingerprint(std::uint64_t fp) noexcept;
+    ///@}
+
     /**
      * @name Get and set the tool functions
      * 
@@ -11331,6 +18857,21 @@ public:
     void get_state(epiworld_fast_int * init, epiworld_fast_int * post);
     void get_queue(epiworld_fast_int * init, epiworld_fast_int * post);
 
+    /**
+     * @brief Whether the effect of the tool changes over time
+     * 
+     * @details Agents cache the susceptibility and transmission reductions
+     * of their tools for each virus, and recompute them only when their
+     * tools change. If the reductions of a tool can change from one day to
+     * the next (e.g., because they depend on the date the tool was given, or
+     * on parameters modified during the run), it should be declared
+     * time-dependent, so the agents that have it recompute them once a day.
+     */
+    ///@{
+    void set_time_dependent(bool value = true);
+    bool is_time_dependent() const noexcept;
+    ///@}
+
     bool operator==(const Tool<TSeq> & other) const;
     bool operator!=(const Tool<TSeq> & other) const {return !operator==(other);};
 
@@ -11452,11 +18993,29 @@ inline Tool<TSeq>::Tool(std::string name)
 template<typename TSeq>
 inline void Tool<TSeq>::set_sequence(TSeq d) {
     sequence = std::make_shared<TSeq>(d);
+    fingerprint_valid = false;
 }
 
 template<typename TSeq>
 inline void Tool<TSeq>::set_sequence(std::shared_ptr<TSeq> d) {
     sequence = d;
+    fingerprint_valid = false;
+}
+
+template<typename TSeq>
+inline std::uint64_t Tool<TSeq>::get_fingerprint() const noexcept {
+    return fingerprint;
+}
+
+template<typename TSeq>
+inline bool Tool<TSeq>::has_fingerprint() const noexcept {
+    return fingerprint_valid;
+}
+
+template<typename TSeq>
+inline void Tool<TSeq>::set_fingerprint(std::uint64_t fp) noexcept {
+    fingerprint       = fp;
+    fingerprint_valid = true;
 }
 
 template<typename TSeq>
@@ -11471,10 +19030,13 @@ inline epiworld_double Tool<TSeq>::get_susceptibility_reduction(
 )
 {
 
+    if (susceptibility_reduction_ptr)
+        return *susceptibility_reduction_ptr;
+
     if (susceptibility_reduction_fun)
         return susceptibility_reduction_fun(*this, this->agent, v, model);
 
-    return DEFAULT_TOOL_CONTAGION_REDUCTION;
+    return susceptibility_reduction_value;
 
 }
 
@@ -11485,10 +19047,13 @@ inline epiworld_double Tool<TSeq>::get_transmission_reduction(
 )
 {
 
+    if (transmission_reduction_ptr)
+        return *transmission_reduction_ptr;
+
     if (transmission_reduction_fun)
         return transmission_reduction_fun(*this, this->agent, v, model);
 
-    return DEFAULT_TOOL_TRANSMISSION_REDUCTION;
+    return transmission_reduction_value;
 
 }
 
@@ -11499,10 +19064,13 @@ inline epiworld_double Tool<TSeq>::get_recovery_enhancer(
 )
 {
 
+    if (recovery_enhancer_ptr)
+        return *recovery_enhancer_ptr;
+
     if (recovery_enhancer_fun)
         return recovery_enhancer_fun(*this, this->agent, v, model);
 
-    return DEFAULT_TOOL_RECOVERY_ENHANCER;
+    return recovery_enhancer_value;
 
 }
 
@@ -11513,10 +19081,13 @@ inline epiworld_double Tool<TSeq>::get_death_reduction(
 )
 {
 
+    if (death_reduction_ptr)
+        return *death_reduction_ptr;
+
     if (death_reduction_fun)
         return death_reduction_fun(*this, this->agent, v, model);
 
-    return DEFAULT_TOOL_DEATH_REDUCTION;
+    return death_reduction_value;
 
 }
 
@@ -11526,6 +19097,10 @@ inline void Tool<TSeq>::set_susceptibility_reduction_fun(
 )
 {
     susceptibility_reduction_fun = fun;
+    susceptibility_reduction_ptr = nullptr;
+
+    if (!fun)
+        susceptibility_reduction_value = DEFAULT_TOOL_CONTAGION_REDUCTION;
 }
 
 template<typename TSeq>
@@ -11534,6 +19109,10 @@ inline void Tool<TSeq>::set_transmission_reduction_fun(
 )
 {
     transmission_reduction_fun = fun;
+    transmission_reduction_ptr = nullptr;
+
+    if (!fun)
+        transmission_reduction_value = DEFAULT_TOOL_TRANSMISSION_REDUCTION;
 }
 
 template<typename TSeq>
@@ -11542,6 +19121,10 @@ inline void Tool<TSeq>::set_recovery_enhancer_fun(
 )
 {
     recovery_enhancer_fun = fun;
+    recovery_enhancer_ptr = nullptr;
+
+    if (!fun)
+        recovery_enhancer_value = DEFAULT_TOOL_RECOVERY_ENHANCER;
 }
 
 template<typename TSeq>
@@ -11550,65 +19133,41 @@ inline void Tool<TSeq>::set_death_reduction_fun(
 )
 {
     death_reduction_fun = fun;
+    death_reduction_ptr = nullptr;
+
+    if (!fun)
+        death_reduction_value = DEFAULT_TOOL_DEATH_REDUCTION;
 }
 
 template<typename TSeq>
 inline void Tool<TSeq>::set_susceptibility_reduction(epiworld_double * prob)
 {
-
-    ToolFun<TSeq> tmpfun =
-        [prob](Tool<TSeq> &, Agent<TSeq> *, VirusPtr<TSeq>, Model<TSeq> *)
-        {
-            return *prob;
-        };
-
-    susceptibility_reduction_fun = tmpfun;
-
+    susceptibility_reduction_ptr = prob;
+    susceptibility_reduction_fun = nullptr;
 }
 
 // EPIWORLD_SET_LAMBDA(susceptibility_reduction)
 template<typename TSeq>
 inline void Tool<TSeq>::set_transmission_reduction(epiworld_double * prob)
 {
-    
-    ToolFun<TSeq> tmpfun =
-        [prob](Tool<TSeq> &, Agent<TSeq> *, VirusPtr<TSeq>, Model<TSeq> *)
-        {
-            return *prob;
-        };
-
-    transmission_reduction_fun = tmpfun;
-
+    transmission_reduction_ptr = prob;
+    transmission_reduction_fun = nullptr;
 }
 
 // EPIWORLD_SET_LAMBDA(transmission_reduction)
 template<typename TSeq>
 inline void Tool<TSeq>::set_recovery_enhancer(epiworld_double * prob)
 {
-
-    ToolFun<TSeq> tmpfun =
-        [prob](Tool<TSeq> &, Agent<TSeq> *, VirusPtr<TSeq>, Model<TSeq> *)
-        {
-            return *prob;
-        };
-
-    recovery_enhancer_fun = tmpfun;
-
+    recovery_enhancer_ptr = prob;
+    recovery_enhancer_fun = nullptr;
 }
 
 // EPIWORLD_SET_LAMBDA(recovery_enhancer)
 template<typename TSeq>
 inline void Tool<TSeq>::set_death_reduction(epiworld_double * prob)
 {
-
-    ToolFun<TSeq> tmpfun =
-        [prob](Tool<TSeq> &, Agent<TSeq> *, VirusPtr<TSeq>, Model<TSeq> *)
-        {
-            return *prob;
-        };
-
-    death_reduction_fun = tmpfun;
-
+    death_reduction_ptr = prob;
+    death_reduction_fun = nullptr;
 }
 
 // EPIWORLD_SET_LAMBDA(death_reduction)
@@ -11619,15 +19178,9 @@ inline void Tool<TSeq>::set_susceptibility_reduction(
     epiworld_double prob
 )
 {
-
-    ToolFun<TSeq> tmpfun = 
-        [prob](Tool<TSeq> &, Agent<TSeq> *, VirusPtr<TSeq>, Model<TSeq> *)
-        {
-            return prob;
-        };
-
-    susceptibility_reduction_fun = tmpfun;
-
+    susceptibility_reduction_value = prob;
+    susceptibility_reduction_ptr   = nullptr;
+    susceptibility_reduction_fun   = nullptr;
 }
 
 template<typename TSeq>
@@ -11635,15 +19188,9 @@ inline void Tool<TSeq>::set_transmission_reduction(
     epiworld_double prob
 )
 {
-
-    ToolFun<TSeq> tmpfun = 
-        [prob](Tool<TSeq> &, Agent<TSeq> *, VirusPtr<TSeq>, Model<TSeq> *)
-        {
-            return prob;
-        };
-
-    transmission_reduction_fun = tmpfun;
-
+    transmission_reduction_value = prob;
+    transmission_reduction_ptr   = nullptr;
+    transmission_reduction_fun   = nullptr;
 }
 
 template<typename TSeq>
@@ -11651,15 +19198,9 @@ inline void Tool<TSeq>::set_recovery_enhancer(
     epiworld_double prob
 )
 {
-
-    ToolFun<TSeq> tmpfun = 
-        [prob](Tool<TSeq> &, Agent<TSeq> *, VirusPtr<TSeq>, Model<TSeq> *)
-        {
-            return prob;
-        };
-
-    recovery_enhancer_fun = tmpfun;
-
+    recovery_enhancer_value = prob;
+    recovery_enhancer_ptr   = nullptr;
+    recovery_enhancer_fun   = nullptr;
 }
 
 template<typename TSeq>
@@ -11667,15 +19208,9 @@ inline void Tool<TSeq>::set_death_reduction(
     epiworld_double prob
 )
 {
-
-    ToolFun<TSeq> tmpfun = 
-        [prob](Tool<TSeq> &, Agent<TSeq> *, VirusPtr<TSeq>, Model<TSeq> *)
-        {
-            return prob;
-        };
-
-    death_reduction_fun = tmpfun;
-
+    death_reduction_value = prob;
+    death_reduction_ptr   = nullptr;
+    death_reduction_fun   = nullptr;
 }
 
 template<typename TSeq>
@@ -11752,6 +19287,18 @@ inline void Tool<TSeq>::set_queue(
     queue_post = end;
 }
 
+template<typename TSeq>
+inline void Tool<TSeq>::set_time_dependent(bool value)
+{
+    time_dependent = value;
+}
+
+template<typename TSeq>
+inline bool Tool<TSeq>::is_time_dependent() const noexcept
+{
+    return time_dependent;
+}
+
 template<typename TSeq>
 inline void Tool<TSeq>::get_state(
     epiworld_fast_int * init,
@@ -11836,6 +19383,9 @@ inline bool Tool<TSeq>::operator==(const Tool<TSeq> & other) const
     if (queue_post != other.queue_post)
         return false;
 
+    if (time_dependent != other.time_dependent)
+        return false;
+
     return true;
 
 }
@@ -12112,7 +19662,7 @@ inline Agent<TSeq> * Entity<TSeq>::operator[](size_t i)
     if (n_agents <= i)
         throw std::logic_error("There are not that many agents in this entity.");
 
-    return &model->get_agents()[i];
+    return &model->get_agents()[agents[i]];
 }
 
 template<typename TSeq>
@@ -12519,6 +20069,182 @@ inline bool Entities_const<TSeq>::operator==(const Entities_const<TSeq> & other)
  */
 namespace sampler {
 
+/**
+ * @brief Set of states excluded from the sampling frame
+ * 
+ * @details Built once from the list of states passed to
+ * `make_update_susceptible()` and `make_sample_virus_neighbors()`, and
+ * captured by value (read-only) in the resulting samplers, so copies of the
+ * model running in parallel share no mutable state. States beyond the largest
+ * excluded one are not excluded.
+ */
+class StateMask {
+private:
+    std::vector< bool > mask = {};
+
+public:
+
+    StateMask() {};
+    StateMask(const std::vector< epiworld_fast_uint > & states)
+    {
+
+        for (auto s : states)
+        {
+
+            if (s >= mask.size())
+                mask.resize(s + 1u, false);
+
+            mask[s] = true;
+
+        }
+
+    };
+
+    bool empty() const noexcept {return mask.size() == 0u;};
+
+    /**
+     * @brief Throws if an excluded state is not in the model.
+     */
+    void check(size_t n_states) const
+    {
+
+        if (mask.size() > n_states)
+            throw std::logic_error(
+                std::string("You are trying to exclude a state that is out of range: ") +
+                std::to_string(mask.size() - 1u) + std::string(". There are only ") +
+                std::to_string(n_states) + 
+                std::string(" states in the model.")
+                );
+
+    };
+
+    bool operator[](epiworld_fast_uint s) const noexcept
+    {
+        return (s < mask.size()) && mask[s];
+    };
+
+};
+
+/**
+ * @brief Viruses pushed to an agent by its neighbors
+ * 
+ * @details Push version of the scan over the neighbors of the samplers below
+ * (see `Model::set_propagation()`.) Fills `m->array_double_tmp` and
+ * `m->array_virus_tmp` with the probability of getting each virus and the
+ * virus, skipping exposures from agents in excluded states.
+ * 
+ * @param exclude If not null, states excluded from the sampling frame.
+ * @return The number of viruses.
+ */
+template<typename TSeq>
+inline size_t collect_exposures(
+    Agent<TSeq> * p,
+    Model<TSeq> * m,
+    const StateMask * exclude = nullptr
+    )
+{
+
+    size_t nviruses_tmp = 0u;
+    for (const auto & e : m->get_exposures(p->get_id()))
+    {
+
+        if (exclude && exclude->operator[](e.source->get_state()))
+            continue;
+
+        #ifdef EPI_DEBUG
+        if (nviruses_tmp >= m->array_virus_tmp.size())
+            throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
+        #endif
+
+        const VirusPtr<TSeq> & v = *e.virus;
+
+        /* And it is a function of susceptibility_reduction as well */ 
+        m->array_double_tmp[nviruses_tmp] = std::min< epiworld_double >(
+            1.0,
+            (1.0 - p->get_susceptibility_reduction(v, m)) *
+            v->get_prob_infecting(m) *
+            (1.0 - e.source->get_transmission_reduction(v, m)) *
+            e.weight
+            );
+
+        m->array_virus_tmp[nviruses_tmp++] = &(*v);
+
+    }
+
+    return nviruses_tmp;
+
+}
+
+/**
+ * @brief Viruses an agent can get from its neighbors
+ * 
+ * @details Shared by `make_update_susceptible()` and
+ * `make_sample_virus_neighbors()`. Fills `m->array_double_tmp` and
+ * `m->array_virus_tmp` (pull or push, see `Model::set_propagation()`.) The
+ * state check is compiled out of the neighbor loop when `TExclude` is false.
+ * 
+ * @tparam TExclude Whether `exclude` is used.
+ * @return The number of viruses.
+ */
+template<typename TSeq, bool TExclude>
+inline size_t collect_neighbor_viruses(
+    Agent<TSeq> * p,
+    Model<TSeq> * m,
+    const StateMask & exclude
+    )
+{
+
+    if (p->get_n_viruses() > 0u)
+        throw std::logic_error(
+            std::string("Using the -default_update_susceptible- on agents WITH viruses makes no sense! ") +
+            std::string("Agent id ") + std::to_string(p->get_id()) +
+            std::string(" has ") + std::to_string(p->get_n_viruses()) +
+            std::string(" viruses.")
+            );
+
+    if (m->is_propagation_push())
+        return collect_exposures(p, m, TExclude ? &exclude : nullptr);
+
+    // This computes the prob of getting any neighbor variant
+    size_t nviruses_tmp = 0u;
+    auto neighbors = p->get_neighbors_view();
+    for (size_t neighbor_k = 0u; neighbor_k < neighbors.size(); ++neighbor_k)
+    {
+
+        auto * neighbor = neighbors[neighbor_k];
+
+        // If the state is in the list, exclude it
+        if (TExclude && exclude[neighbor->get_state()])
+            continue;
+
+        epiworld_double weight = neighbors.get_weight(neighbor_k);
+            
+        for (const VirusPtr<TSeq> & v : neighbor->get_viruses()) 
+        { 
+
+            #ifdef EPI_DEBUG
+            if (nviruses_tmp >= m->array_virus_tmp.size())
+                throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
+            #endif
+            
+            /* And it is a function of susceptibility_reduction as well */ 
+            m->array_double_tmp[nviruses_tmp] = std::min< epiworld_double >(
+                1.0,
+                (1.0 - p->get_susceptibility_reduction(v, m)) *
+                v->get_prob_infecting(m) *
+                (1.0 - neighbor->get_transmission_reduction(v, m)) *
+                weight
+                );
+    
+            m->array_virus_tmp[nviruses_tmp++] = &(*v);
+        
+        } 
+    }
+
+    return nviruses_tmp;
+
+}
+
 /**
  * @brief Make a function to sample from neighbors
  * 
@@ -12527,12 +20253,16 @@ namespace sampler {
  * frame. For example, individuals who have acquired a virus can be excluded if
  * in incubation state.
  * 
+ * The excluded states are resolved into a `StateMask` here, once; the
+ * returned function holds no mutable state and can be shared by models
+ * running in parallel (e.g., `Model::run_multiple()`.)
+ * 
  * @tparam TSeq 
  * @param exclude unsigned vector of states that need to be excluded from the sampling
  * @return Virus<TSeq>* of the selected virus. If none selected (or none
  * available,) returns a nullptr;
  */
-template<typename TSeq>
+template<typename TSeq = int>
 inline std::function<void(Agent<TSeq>*,Model<TSeq>*)> make_update_susceptible(
     std::vector< epiworld_fast_uint > exclude = {}
     )
@@ -12546,38 +20276,9 @@ inline std::function<void(Agent<TSeq>*,Model<TSeq>*)> make_update_susceptible(
             [](Agent<TSeq> * p, Model<TSeq> * m) -> void
             {
 
-                if (p->get_n_viruses() > 0u)
-                    throw std::logic_error(
-                        std::string("Using the -default_update_susceptible- on agents WITH viruses makes no sense! ") +
-                        std::string("Agent id ") + std::to_string(p->get_id()) +
-                        std::string(" has ") + std::to_string(p->get_n_viruses()) +
-                        std::string(" viruses.")
-                        );
-
-                // This computes the prob of getting any neighbor variant
-                size_t nviruses_tmp = 0u;
-                for (auto & neighbor: p->get_neighbors()) 
-                {
-                            
-                    for (const VirusPtr<TSeq> & v : neighbor->get_viruses()) 
-                    { 
-
-                        #ifdef EPI_DEBUG
-                        if (nviruses_tmp >= static_cast<int>(m->array_virus_tmp.size()))
-                            throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
-                        #endif
-                            
-                        /* And it is a function of susceptibility_reduction as well */ 
-                        m->array_double_tmp[nviruses_tmp] =
-                            (1.0 - p->get_susceptibility_reduction(v, m)) * 
-                            v->get_prob_infecting(m) * 
-                            (1.0 - neighbor->get_transmission_reduction(v, m)) 
-                            ; 
-                    
-                        m->array_virus_tmp[nviruses_tmp++] = &(*v);
-                        
-                    } 
-                }
+                size_t nviruses_tmp = collect_neighbor_viruses<TSeq,false>(
+                    p, m, StateMask()
+                    );
 
                 // No virus to compute
                 if (nviruses_tmp == 0u)
@@ -12598,75 +20299,17 @@ inline std::function<void(Agent<TSeq>*,Model<TSeq>*)> make_update_susceptible(
 
     } else {
 
-        // Making room for the query
-        std::shared_ptr<std::vector<bool>> exclude_agent_bool =
-            std::make_shared<std::vector<bool>>(0);
-
-        std::shared_ptr<std::vector<epiworld_fast_uint>> exclude_agent_bool_idx =
-            std::make_shared<std::vector<epiworld_fast_uint>>(exclude);
+        const StateMask exclude_mask(exclude);
 
         std::function<void(Agent<TSeq>*,Model<TSeq>*)> sampler =
-            [exclude_agent_bool,exclude_agent_bool_idx](Agent<TSeq> * p, Model<TSeq> * m) -> void
+            [exclude_mask](Agent<TSeq> * p, Model<TSeq> * m) -> void
             {
 
-                // The first time we call it, we need to initialize the vector
-                if (exclude_agent_bool->size() == 0u)
-                {
-
-                    exclude_agent_bool->resize(m->get_states().size(), false);
-                    for (auto s : *exclude_agent_bool_idx)
-                    {
-                        if (s >= exclude_agent_bool->size())
-                            throw std::logic_error(
-                                std::string("You are trying to exclude a state that is out of range: ") +
-                                std::to_string(s) + std::string(". There are only ") +
-                                std::to_string(exclude_agent_bool->size()) + 
-                                std::string(" states in the model.")
-                                );
-
-                        exclude_agent_bool->operator[](s) = true;
-
-                    }
-
-                }                    
-
-                if (p->get_n_viruses() > 0u)
-                    throw std::logic_error(
-                        std::string("Using the -default_update_susceptible- on agents WITH viruses makes no sense! ") +
-                        std::string("Agent id ") + std::to_string(p->get_id()) +
-                        std::string(" has ") + std::to_string(p->get_n_viruses()) +
-                        std::string(" viruses.")
-                        );
-
-                // This computes the prob of getting any neighbor variant
-                size_t nviruses_tmp = 0u;
-                for (auto & neighbor: p->get_neighbors()) 
-                {
-
-                    // If the state is in the list, exclude it
-                    if (exclude_agent_bool->operator[](neighbor->get_state()))
-                        continue;
-                            
-                    for (const VirusPtr<TSeq> & v : neighbor->get_viruses()) 
-                    { 
+                exclude_mask.check(m->get_states().size());
 
-                        #ifdef EPI_DEBUG
-                        if (nviruses_tmp >= static_cast<int>(m->array_virus_tmp.size()))
-                            throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
-                            
-                        #endif
-                            
-                        /* And it is a function of susceptibility_reduction as well */ 
-                        m->array_double_tmp[nviruses_tmp] =
-                            (1.0 - p->get_susceptibility_reduction(v, m)) * 
-                            v->get_prob_infecting(m) * 
-                            (1.0 - neighbor->get_transmission_reduction(v, m)) 
-                            ; 
-                    
-                        m->array_virus_tmp[nviruses_tmp++] = &(*v);
-                        
-                    } 
-                }
+                size_t nviruses_tmp = collect_neighbor_viruses<TSeq,true>(
+                    p, m, exclude_mask
+                    );
 
                 // No virus to compute
                 if (nviruses_tmp == 0u)
@@ -12698,6 +20341,9 @@ inline std::function<void(Agent<TSeq>*,Model<TSeq>*)> make_update_susceptible(
  * frame. For example, individuals who have acquired a virus can be excluded if
  * in incubation state.
  * 
+ * As in `make_update_susceptible()`, the excluded states are resolved once
+ * into a `StateMask`.
+ * 
  * @tparam TSeq 
  * @param exclude unsigned vector of states that need to be excluded from the sampling
  * @return Virus<TSeq>* of the selected virus. If none selected (or none
@@ -12714,38 +20360,9 @@ inline std::function<Virus<TSeq>*(Agent<TSeq>*,Model<TSeq>*)> make_sample_virus_
         std::function<Virus<TSeq>*(Agent<TSeq>*,Model<TSeq>*)> res = 
             [](Agent<TSeq> * p, Model<TSeq> * m) -> Virus<TSeq>* {
 
-                if (p->get_n_viruses() > 0u)
-                    throw std::logic_error(
-                        std::string("Using the -default_update_susceptible- on agents WITH viruses makes no sense! ") +
-                        std::string("Agent id ") + std::to_string(p->get_id()) +
-                        std::string(" has ") + std::to_string(p->get_n_viruses()) +
-                        std::string(" viruses.")
-                        );
-
-                // This computes the prob of getting any neighbor variant
-                size_t nviruses_tmp = 0u;
-                for (auto & neighbor: p->get_neighbors()) 
-                {
-                            
-                    for (const VirusPtr<TSeq> & v : neighbor->get_viruses()) 
-                    { 
-
-                        #ifdef EPI_DEBUG
-                        if (nviruses_tmp >= static_cast<int>(m->array_virus_tmp.size()))
-                            throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
-                        #endif
-                            
-                        /* And it is a function of susceptibility_reduction as well */ 
-                        m->array_double_tmp[nviruses_tmp] =
-                            (1.0 - p->get_susceptibility_reduction(v, m)) * 
-                            v->get_prob_infecting(m) * 
-                            (1.0 - neighbor->get_transmission_reduction(v, m)) 
-                            ; 
-                    
-                        m->array_virus_tmp[nviruses_tmp++] = &(*v);
-                        
-                    } 
-                }
+                size_t nviruses_tmp = collect_neighbor_viruses<TSeq,false>(
+                    p, m, StateMask()
+                    );
 
                 // No virus to compute
                 if (nviruses_tmp == 0u)
@@ -12766,74 +20383,16 @@ inline std::function<Virus<TSeq>*(Agent<TSeq>*,Model<TSeq>*)> make_sample_virus_
 
     } else {
 
-        // Making room for the query
-        std::shared_ptr<std::vector<bool>> exclude_agent_bool =
-            std::make_shared<std::vector<bool>>(0);
-
-        std::shared_ptr<std::vector<epiworld_fast_uint>> exclude_agent_bool_idx =
-            std::make_shared<std::vector<epiworld_fast_uint>>(exclude);
-
+        const StateMask exclude_mask(exclude);
 
         std::function<Virus<TSeq>*(Agent<TSeq>*,Model<TSeq>*)> res = 
-            [exclude_agent_bool,exclude_agent_bool_idx](Agent<TSeq> * p, Model<TSeq> * m) -> Virus<TSeq>* {
+            [exclude_mask](Agent<TSeq> * p, Model<TSeq> * m) -> Virus<TSeq>* {
 
-                // The first time we call it, we need to initialize the vector
-                if (exclude_agent_bool->size() == 0u)
-                {
-
-                    exclude_agent_bool->resize(m->get_states().size(), false);
-                    for (auto s : *exclude_agent_bool_idx)
-                    {
-                        if (s >= exclude_agent_bool->size())
-                            throw std::logic_error(
-                                std::string("You are trying to exclude a state that is out of range: ") +
-                                std::to_string(s) + std::string(". There are only ") +
-                                std::to_string(exclude_agent_bool->size()) + 
-                                std::string(" states in the model.")
-                                );
-
-                        exclude_agent_bool->operator[](s) = true;
-
-                    }
-
-                }    
-                
-                if (p->get_n_viruses() > 0u)
-                    throw std::logic_error(
-                        std::string("Using the -default_update_susceptible- on agents WITH viruses makes no sense! ") +
-                        std::string("Agent id ") + std::to_string(p->get_id()) +
-                        std::string(" has ") + std::to_string(p->get_n_viruses()) +
-                        std::string(" viruses.")
-                        );
-
-                // This computes the prob of getting any neighbor variant
-                size_t nviruses_tmp = 0u;
-                for (auto & neighbor: p->get_neighbors()) 
-                {
-
-                    // If the state is in the list, exclude it
-                    if (exclude_agent_bool->operator[](neighbor->get_state()))
-                        continue;
-                            
-                    for (const VirusPtr<TSeq> & v : neighbor->get_viruses()) 
-                    { 
+                exclude_mask.check(m->get_states().size());
 
-                        #ifdef EPI_DEBUG
-                        if (nviruses_tmp >= static_cast<int>(m->array_virus_tmp.size()))
-                            throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
-                        #endif
-                            
-                        /* And it is a function of susceptibility_reduction as well */ 
-                        m->array_double_tmp[nviruses_tmp] =
-                            (1.0 - p->get_susceptibility_reduction(v, m)) * 
-                            v->get_prob_infecting(m) * 
-                            (1.0 - neighbor->get_transmission_reduction(v, m)) 
-                            ; 
-                    
-                        m->array_virus_tmp[nviruses_tmp++] = &(*v);
-                        
-                    } 
-                }
+                size_t nviruses_tmp = collect_neighbor_viruses<TSeq,true>(
+                    p, m, exclude_mask
+                    );
 
                 // No virus to compute
                 if (nviruses_tmp == 0u)
@@ -12885,44 +20444,57 @@ inline Virus<TSeq> * sample_virus_single(Agent<TSeq> * p, Model<TSeq> * m)
 
     // This computes the prob of getting any neighbor variant
     size_t nviruses_tmp = 0u;
-    for (auto & neighbor: p->get_neighbors()) 
-    {   
-        #ifdef EPI_DEBUG
-        int _vcount_neigh = 0;
-        #endif                 
-        for (const VirusPtr<TSeq> & v : neighbor->get_viruses()) 
-        { 
+    if (m->is_propagation_push())
+        nviruses_tmp = collect_exposures(p, m);
+    else
+    {
+
+        auto neighbors = p->get_neighbors_view();
+        for (size_t neighbor_k = 0u; neighbor_k < neighbors.size(); ++neighbor_k)
+        {   
 
+            auto * neighbor = neighbors[neighbor_k];
+            epiworld_double weight = neighbors.get_weight(neighbor_k);
             #ifdef EPI_DEBUG
-            if (nviruses_tmp >= m->array_virus_tmp.size())
-                throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
-            #endif
+            int _vcount_neigh = 0;
+            #endif                 
+            for (const VirusPtr<TSeq> & v : neighbor->get_viruses()) 
+            { 
+
+                #ifdef EPI_DEBUG
+                if (nviruses_tmp >= m->array_virus_tmp.size())
+                    throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
+                #endif
                 
-            /* And it is a function of susceptibility_reduction as well */ 
-            m->array_double_tmp[nviruses_tmp] =
-                (1.0 - p->get_susceptibility_reduction(v, m)) * 
-                v->get_prob_infecting(m) * 
-                (1.0 - neighbor->get_transmission_reduction(v, m)) 
-                ; 
+                /* And it is a function of susceptibility_reduction as well */ 
+                m->array_double_tmp[nviruses_tmp] = std::min< epiworld_double >(
+                    1.0,
+                    (1.0 - p->get_susceptibility_reduction(v, m)) *
+                    v->get_prob_infecting(m) *
+                    (1.0 - neighbor->get_transmission_reduction(v, m)) *
+                    weight
+                    );
         
-            m->array_virus_tmp[nviruses_tmp++] = &(*v);
+                m->array_virus_tmp[nviruses_tmp++] = &(*v);
 
-            #ifdef EPI_DEBUG
-            if (
-                (m->array_double_tmp[nviruses_tmp - 1] < 0.0) |
-                (m->array_double_tmp[nviruses_tmp - 1] > 1.0)
-                )
-            {
-                printf_epiworld(
-                    "[epi-debug] Agent %i's virus %i has transmission prob outside of [0, 1]: %.4f!\n",
-                    static_cast<int>(neighbor->get_id()),
-                    static_cast<int>(_vcount_neigh++),
-                    m->array_double_tmp[nviruses_tmp - 1]
-                    );
-            }
-            #endif
+                #ifdef EPI_DEBUG
+                if (
+                    (m->array_double_tmp[nviruses_tmp - 1] < 0.0) |
+                    (m->array_double_tmp[nviruses_tmp - 1] > 1.0)
+                    )
+                {
+                    printf_epiworld(
+                        "[epi-debug] Agent %i's virus %i has transmission prob outside of [0, 1]: %.4f!\n",
+                        static_cast<int>(neighbor->get_id()),
+                        static_cast<int>(_vcount_neigh++),
+                        m->array_double_tmp[nviruses_tmp - 1]
+                        );
+                }
+                #endif
             
-        } 
+            } 
+        }
+
     }
 
 
@@ -13116,7 +20688,90 @@ inline void default_rm_tool(Action<TSeq> & a, Model<TSeq> * m);
 template<typename TSeq>
 inline void default_rm_entity(Action<TSeq> & a, Model<TSeq> * m);
 
+/**
+ * @brief Cached effect of the tools of an agent on a virus
+ */
+struct ToolEffectCache {
+    int virus = -1; ///< Id of the virus (-1 if empty.)
+    int date  = -1; ///< Day it was computed if a tool is time-dependent (-1 otherwise.)
+    epiworld_double value = 0.0;
+};
+
+/**
+ * @brief Non-owning view of the neighbors of an agent
+ * 
+ * @details Returned by `Agent::get_neighbors_view()`. Unlike
+ * `Agent::get_neighbors()`, it doesn't allocate: it points to the neighbor
+ * ids of the agent and the population of the model, so it is only valid
+ * until the network or the population change (e.g., by rewiring.) The
+ * elements are pointers to the neighbors:
+ * 
+ * ```
+ * for (auto * neighbor : p->get_neighbors_view())
+ *     ...
+ * ```
+ * 
+ * @tparam TSeq 
+ */
+template<typename TSeq>
+class AgentNeighbors {
+private:
+
+    Agent<TSeq> * population = nullptr;
+    const size_t * ids       = nullptr;
+    const epiworld_double * weights = nullptr; ///< `nullptr` if the ties have no weights.
+    size_t n = 0u;
+
+public:
+
+    class iterator {
+        friend class AgentNeighbors<TSeq>;
+    private:
+        Agent<TSeq> * population = nullptr;
+        const size_t * ids       = nullptr;
+        iterator(Agent<TSeq> * population_, const size_t * ids_) :
+            population(population_), ids(ids_) {};
+    public:
+
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Agent<TSeq> * value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Agent<TSeq> ** pointer;
+        typedef Agent<TSeq> * reference;
+
+        iterator() {};
+
+        Agent<TSeq> * operator*() const {return population + *ids;};
+
+        iterator & operator++() {++ids; return *this;};
+        iterator operator++(int) {iterator tmp(*this); ++ids; return tmp;};
 
+        bool operator==(const iterator & other) const {return ids == other.ids;};
+        bool operator!=(const iterator & other) const {return ids != other.ids;};
+
+    };
+
+    AgentNeighbors() {};
+    AgentNeighbors(
+        Agent<TSeq> * population_,
+        const size_t * ids_,
+        const epiworld_double * weights_,
+        size_t n_
+    ) : population(population_), ids(ids_), weights(weights_), n(n_) {};
+
+    size_t size() const noexcept {return n;};
+    bool empty() const noexcept {return n == 0u;};
+
+    Agent<TSeq> * operator[](size_t i) const {return population + ids[i];};
+    size_t get_id(size_t i) const {return ids[i];}; ///< Id of the `i`-th neighbor.
+    epiworld_double get_weight(size_t i) const {
+        return weights ? weights[i] : 1.0;
+    }; ///< Weight of the tie with the `i`-th neighbor (1 if the ties have no weights.)
+
+    iterator begin() const {return iterator(population, ids);};
+    iterator end() const {return iterator(population, ids + n);};
+
+};
 
 /**
  * @brief Agent (agents)
@@ -13135,18 +20790,29 @@ class Agent {
     friend class Queue<TSeq>;
     friend class Entities<TSeq>;
     friend class AgentsSample<TSeq>;
+    friend class DistributedModel<TSeq>;
     friend void default_add_virus<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
     friend void default_add_tool<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
     friend void default_add_entity<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
     friend void default_rm_virus<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
     friend void default_rm_tool<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
     friend void default_rm_entity<TSeq>(Action<TSeq> & a, Model<TSeq> * m);
+    friend bool rewire_draw_swap<TSeq>(
+        const std::vector< Agent<TSeq> > & agents,
+        const std::vector< size_t > & starts,
+        const std::vector< epiworld_fast_uint > & owner,
+        Model<TSeq> * model,
+        size_t * ego,
+        size_t * slot,
+        size_t * alter
+        );
 private:
     
     Model<TSeq> * model;
 
     std::vector< size_t > neighbors;
     std::vector< size_t > neighbors_locations;
+    std::vector< epiworld_double > neighbors_weights; ///< Empty if the ties have no weights.
     size_t n_neighbors = 0u;
 
     std::vector< size_t > entities;
@@ -13181,6 +20847,12 @@ private:
     size_t sampled_agents_left_n = 0u;
     int date_last_build_sample   = -99;
 
+    ToolEffectCache susceptibility_reduction_cache; ///< See `Tool::set_time_dependent()`.
+    ToolEffectCache transmission_reduction_cache;
+    bool tool_effects_hit(const ToolEffectCache & cache, int virus_id) const;
+    void tool_effects_store(ToolEffectCache & cache, int virus_id, epiworld_double value);
+    void tool_effects_clear();
+
 public:
 
     Agent();
@@ -13320,9 +20992,19 @@ public:
     void add_neighbor(
         Agent<TSeq> & p,
         bool check_source = true,
-        bool check_target = true
+        bool check_target = true,
+        epiworld_double weight = 1.0 ///< Only used if the ties have weights.
         );
 
+    /**
+     * @brief Removes the tie between the current agent and `p` (if any)
+     * 
+     * @details The last neighbor of each agent takes the place of the
+     * removed one, so the locations of the neighbors are kept consistent in
+     * O(1) after finding the tie. `p` can be the agent itself (self-tie.)
+     */
+    void rm_neighbor(Agent<TSeq> & p);
+
     /**
      * @brief Swaps neighbors between the current agent and agent `other`
      * 
@@ -13337,7 +21019,9 @@ public:
     );
 
     std::vector< Agent<TSeq> * > get_neighbors();
+    AgentNeighbors<TSeq> get_neighbors_view(); ///< Same as `get_neighbors()`, but without allocating (see `AgentNeighbors`.)
     size_t get_n_neighbors() const;
+    epiworld_double get_neighbor_weight(size_t i) const; ///< Weight of the tie with the `i`-th neighbor (1 if the ties have no weights.)
 
     void change_state(
         Model<TSeq> * model,
@@ -13492,6 +21176,8 @@ inline void default_add_virus(Action<TSeq> & a, Model<TSeq> * m)
     m->get_db().today_virus[v->get_id()][p->state]++;
     #endif
 
+    m->virus_holders_update(*p);
+
 }
 
 template<typename TSeq>
@@ -13518,6 +21204,8 @@ inline void default_add_tool(Action<TSeq> & a, Model<TSeq> * m)
     p->tools[n_tools]->set_date(m->today());
     p->tools[n_tools]->set_agent(p, n_tools);
 
+    p->tool_effects_clear();
+
     m->get_db().today_tool[t->get_id()][p->state]++;
 
 }
@@ -13542,6 +21230,8 @@ inline void default_rm_virus(Action<TSeq> & a, Model<TSeq> * model)
             );
     }
     
+    model->virus_holders_update(*p);
+
     // Calling the virus action over the removed virus
     v->post_recovery(model);
 
@@ -13568,6 +21258,8 @@ inline void default_rm_tool(Action<TSeq> & a, Model<TSeq> * /*m*/)
             );
     }
 
+    p->tool_effects_clear();
+
     return;
 
 }
@@ -13712,6 +21404,7 @@ inline Agent<TSeq>::Agent(Agent<TSeq> && p) :
     model(p.model),
     neighbors(std::move(p.neighbors)),
     neighbors_locations(std::move(p.neighbors_locations)),
+    neighbors_weights(std::move(p.neighbors_weights)),
     n_neighbors(p.n_neighbors),
     entities(std::move(p.entities)),
     entities_locations(std::move(p.entities_locations)),
@@ -13767,6 +21460,7 @@ inline Agent<TSeq>::Agent(const Agent<TSeq> & p) :
     model(p.model),
     neighbors(p.neighbors),
     neighbors_locations(p.neighbors_locations),
+    neighbors_weights(p.neighbors_weights),
     n_neighbors(p.n_neighbors),
     entities(p.entities),
     entities_locations(p.entities_locations),
@@ -13822,6 +21516,7 @@ inline Agent<TSeq> & Agent<TSeq>::operator=(
 
     neighbors = other_agent.neighbors;
     neighbors_locations = other_agent.neighbors_locations;
+    neighbors_weights = other_agent.neighbors_weights;
     n_neighbors = other_agent.n_neighbors;
 
     entities = other_agent.entities;
@@ -13833,6 +21528,8 @@ inline Agent<TSeq> & Agent<TSeq>::operator=(
     sampled_agents_left_n = 0;
     date_last_build_sample = -99;
 
+    tool_effects_clear();
+
     // neighbors           = other_agent.neighbors;
     // entities            = other_agent.entities;
     // entities_locations  = other_agent.entities_locations;
@@ -14189,13 +21886,65 @@ inline void Agent<TSeq>::rm_agent_by_virus(
 
 }
 
+template<typename TSeq>
+inline bool Agent<TSeq>::tool_effects_hit(
+    const ToolEffectCache & cache,
+    int virus_id
+) const
+{
+
+    return (cache.virus == virus_id) &&
+        ((cache.date < 0) || (cache.date == model->today()));
+
+}
+
+template<typename TSeq>
+inline void Agent<TSeq>::tool_effects_store(
+    ToolEffectCache & cache,
+    int virus_id,
+    epiworld_double value
+)
+{
+
+    // Time-dependent tools are recomputed once a day
+    cache.date = -1;
+    for (size_t i = 0u; i < n_tools; ++i)
+        if (tools[i]->time_dependent)
+        {
+            cache.date = model->today();
+            break;
+        }
+
+    cache.virus = virus_id;
+    cache.value = value;
+
+}
+
+template<typename TSeq>
+inline void Agent<TSeq>::tool_effects_clear()
+{
+    susceptibility_reduction_cache.virus = -1;
+    transmission_reduction_cache.virus   = -1;
+}
+
 template<typename TSeq>
 inline epiworld_double Agent<TSeq>::get_susceptibility_reduction(
     VirusPtr<TSeq> v,
     Model<TSeq> * model
 ) {
 
-    return model->susceptibility_reduction_mixer(this, v, model);
+    if (!model->susceptibility_reduction_cached)
+        return model->susceptibility_reduction_mixer(this, v, model);
+
+    int vid = v->get_id();
+    if (!tool_effects_hit(susceptibility_reduction_cache, vid))
+        tool_effects_store(
+            susceptibility_reduction_cache, vid,
+            model->susceptibility_reduction_mixer(this, v, model)
+            );
+
+    return susceptibility_reduction_cache.value;
+
 }
 
 template<typename TSeq>
@@ -14203,7 +21952,19 @@ inline epiworld_double Agent<TSeq>::get_transmission_reduction(
     VirusPtr<TSeq> v,
     Model<TSeq> * model
 ) {
-    return model->transmission_reduction_mixer(this, v, model);
+
+    if (!model->transmission_reduction_cached)
+        return model->transmission_reduction_mixer(this, v, model);
+
+    int vid = v->get_id();
+    if (!tool_effects_hit(transmission_reduction_cache, vid))
+        tool_effects_store(
+            transmission_reduction_cache, vid,
+            model->transmission_reduction_mixer(this, v, model)
+            );
+
+    return transmission_reduction_cache.value;
+
 }
 
 template<typename TSeq>
@@ -14288,8 +22049,12 @@ template<typename TSeq>
 inline void Agent<TSeq>::add_neighbor(
     Agent<TSeq> & p,
     bool check_source,
-    bool check_target
+    bool check_target,
+    epiworld_double weight
 ) {
+
+    bool weighted = (model != nullptr) && model->weighted;
+
     // Can we find the neighbor?
     bool found = false;
     if (check_source)
@@ -14315,6 +22080,9 @@ inline void Agent<TSeq>::add_neighbor(
         neighbors.push_back(p.get_id());
         n_neighbors++;
 
+        if (weighted)
+            neighbors_weights.push_back(weight);
+
     }
 
 
@@ -14337,12 +22105,70 @@ inline void Agent<TSeq>::add_neighbor(
         p.neighbors_locations.push_back(n_neighbors - 1);
         p.neighbors.push_back(id);
         p.n_neighbors++;
+
+        if (weighted)
+            p.neighbors_weights.push_back(weight);
         
     }
     
 
 }
 
+template<typename TSeq>
+inline void Agent<TSeq>::rm_neighbor(Agent<TSeq> & p)
+{
+
+    // Finding the tie
+    size_t loc_this = n_neighbors;
+    for (size_t k = 0u; k < n_neighbors; ++k)
+        if (static_cast< int >(neighbors[k]) == p.id)
+        {
+            loc_this = k;
+            break;
+        }
+
+    if (loc_this == n_neighbors)
+        return;
+
+    size_t loc_p = neighbors_locations[loc_this];
+
+    // Moves the last neighbor of `a` to `loc`, fixing the location stored
+    // by that neighbor.
+    auto remove = [](Agent<TSeq> & a, size_t loc) -> void {
+
+        size_t last = a.n_neighbors - 1u;
+        if (loc != last)
+        {
+
+            a.neighbors[loc]           = a.neighbors[last];
+            a.neighbors_locations[loc] = a.neighbors_locations[last];
+
+            if (a.neighbors_weights.size() > 0u)
+                a.neighbors_weights[loc] = a.neighbors_weights[last];
+
+            a.model->population[a.neighbors[loc]].neighbors_locations[
+                a.neighbors_locations[loc]
+            ] = loc;
+
+        }
+
+        a.neighbors.pop_back();
+        a.neighbors_locations.pop_back();
+        if (a.neighbors_weights.size() > 0u)
+            a.neighbors_weights.pop_back();
+
+        a.n_neighbors--;
+
+    };
+
+    // A self-tie is a single entry (pointing to itself), so it is removed
+    // only once
+    remove(*this, loc_this);
+    if (&p != this)
+        remove(p, loc_p);
+
+}
+
 template<typename TSeq>
 inline void Agent<TSeq>::swap_neighbors(
     Agent<TSeq> & other,
@@ -14377,6 +22203,13 @@ inline void Agent<TSeq>::swap_neighbors(
             neigh_this.neighbors_locations[loc_this_in_neigh],
             neigh_other.neighbors_locations[loc_other_in_neigh]
             );
+
+        // Each ego keeps the weight of its slot, so the alters swap theirs
+        if (model->weighted)
+            std::swap(
+                neigh_this.neighbors_weights[loc_this_in_neigh],
+                neigh_other.neighbors_weights[loc_other_in_neigh]
+                );
     }
 
 }
@@ -14391,12 +22224,34 @@ inline std::vector< Agent<TSeq> *> Agent<TSeq>::get_neighbors()
     return res;
 }
 
+template<typename TSeq>
+inline AgentNeighbors<TSeq> Agent<TSeq>::get_neighbors_view()
+{
+    return AgentNeighbors<TSeq>(
+        model->population.data(),
+        neighbors.data(),
+        (neighbors_weights.size() > 0u) ? neighbors_weights.data() : nullptr,
+        n_neighbors
+    );
+}
+
 template<typename TSeq>
 inline size_t Agent<TSeq>::get_n_neighbors() const
 {
     return n_neighbors;
 }
 
+template<typename TSeq>
+inline epiworld_double Agent<TSeq>::get_neighbor_weight(size_t i) const
+{
+
+    if (neighbors_weights.size() == 0u)
+        return 1.0;
+
+    return neighbors_weights[i];
+
+}
+
 template<typename TSeq>
 inline void Agent<TSeq>::change_state(
     Model<TSeq> * model,
@@ -14428,6 +22283,8 @@ inline void Agent<TSeq>::reset()
     this->tools.clear();
     n_tools = 0u;
 
+    tool_effects_clear();
+
     this->state = 0u;
     this->state_prev = 0u;
 
@@ -14941,137 +22798,735 @@ inline AgentsSample<TSeq>::AgentsSample(
                 break;
             }
 
-        }
-    }
+        }
+    }
+
+    return; 
+
+}
+
+template<typename TSeq>
+inline AgentsSample<TSeq>::~AgentsSample() {}
+
+template<typename TSeq>
+inline size_t AgentsSample<TSeq>::size() const noexcept
+{ 
+    return this->sample_size;
+}
+
+template<typename TSeq>
+inline Agent<TSeq> * AgentsSample<TSeq>::operator[](size_t i)
+{
+
+    return agents->operator[](i);
+
+}
+
+template<typename TSeq>
+inline Agent<TSeq> * AgentsSample<TSeq>::operator()(size_t i)
+{
+
+    if (i >= this->sample_size)
+        throw std::range_error("The requested agent is out of range.");
+
+    return agents->operator[](i);
+
+}
+
+template<typename TSeq>
+inline typename std::vector< Agent<TSeq> * >::iterator AgentsSample<TSeq>::begin()
+{
+
+    if (sample_size > 0u)
+        return agents->begin();
+    else
+        return agents->end();
+
+}
+
+template<typename TSeq>
+inline typename std::vector< Agent<TSeq> * >::iterator AgentsSample<TSeq>::end()
+{
+
+    return agents->begin() + sample_size;
+
+}
+
+template<typename TSeq>
+inline void AgentsSample<TSeq>::sample_n(size_t n)
+{
+
+    // Checking if the size of the entity has changed (or hasn't been initialized)
+    if (sample_type == SAMPLETYPE::MODEL)
+    {
+
+        if (model->size() != agents_left->size())
+        {
+            agents_left->resize(model->size(), 0u);
+            std::iota(agents_left->begin(), agents_left->end(), 0u);
+        }
+
+
+    } else if (sample_type == SAMPLETYPE::ENTITY) {
+
+        if (entity->size() != agents_left->size())
+        {
+
+            agents_left->resize(entity->size(), 0u);
+            std::iota(agents_left->begin(), agents_left->end(), 0u);
+
+        }
+
+    } 
+
+    // Restart the counter of agents left
+    *agents_left_n = agents_left->size();
+
+    if (agents->size() < sample_size)
+        agents->resize(sample_size, nullptr);
+
+    if (sample_type == SAMPLETYPE::MODEL)
+    {
+
+        for (size_t i = 0u; i < n; ++i)
+        {
+
+            size_t ith = agents_left->operator[](model->runif() * ((*agents_left_n)--));
+            agents->operator[](i) = &model->population[ith];
+
+            // Updating list
+            std::swap(agents_left->operator[](ith), agents_left->operator[](*agents_left_n));
+
+        }
+
+    } else if (sample_type == SAMPLETYPE::ENTITY) {
+
+        for (size_t i = 0u; i < n; ++i)
+        {
+
+            size_t ith = agents_left->operator[](model->runif() * (--(*agents_left_n)));
+            agents->operator[](i) = entity->agents[ith];
+
+            // Updating list
+            std::swap(agents_left->operator[](ith), agents_left->operator[](*agents_left_n));
+
+        }
+
+    }
+
+    return;
+
+}
+
+#endif
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ End of -include/epiworld/agentssample-bones.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+
+/*//////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+ Start of -include/epiworld/distributed.hpp-
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////*/
+
+
+#ifndef EPIWORLD_DISTRIBUTED_HPP
+#define EPIWORLD_DISTRIBUTED_HPP
+
+#ifdef EPIWORLD_USE_MPI
+
+/**
+ * @brief Packs bytes into a vector of integers (see `HaloSequence`.)
+ * 
+ * @details Stores the number of bytes followed by the bytes themselves,
+ * padded to a whole number of integers.
+ */
+inline void halo_pack(
+    const void * data,
+    size_t nbytes,
+    std::vector< int > & buffer
+)
+{
+
+    size_t at = buffer.size();
+    buffer.push_back(static_cast< int >(nbytes));
+    buffer.resize(at + 1u + (nbytes + sizeof(int) - 1u) / sizeof(int), 0);
+
+    if (nbytes > 0u)
+        std::memcpy(buffer.data() + at + 1u, data, nbytes);
+
+}
+
+/**
+ * @brief Number of bytes packed at `buffer` by `halo_pack()`
+ */
+inline size_t halo_packed_size(const int * buffer)
+{
+    return static_cast< size_t >(*buffer);
+}
+
+/**
+ * @brief Reads the bytes packed by `halo_pack()`
+ * 
+ * @return Pointer past the packed bytes.
+ */
+inline const int * halo_unpack(const int * buffer, void * data)
+{
+
+    size_t nbytes = halo_packed_size(buffer++);
+    if (nbytes > 0u)
+        std::memcpy(data, buffer, nbytes);
+
+    return buffer + (nbytes + sizeof(int) - 1u) / sizeof(int);
+
+}
+
+/**
+ * @brief Sends sequences between processes (see `DistributedModel`.)
+ * 
+ * @details Supports trivially copyable sequences and vectors of them.
+ * Other types of sequences need a specialization with the same members.
+ */
+template<typename TSeq>
+struct HaloSequence {
+
+    static_assert(
+        std::is_trivially_copyable< TSeq >::value,
+        "HaloSequence needs a specialization for this type of sequence."
+        );
+
+    static void write(const TSeq & seq, std::vector< int > & buffer)
+    {
+        halo_pack(&seq, sizeof(TSeq), buffer);
+    }
+
+    static const int * read(const int * buffer, TSeq & seq)
+    {
+        return halo_unpack(buffer, &seq);
+    }
+
+};
+
+template<typename T>
+struct HaloSequence< std::vector< T > > {
+
+    static_assert(
+        std::is_trivially_copyable< T >::value,
+        "HaloSequence needs a specialization for this type of sequence."
+        );
+
+    static void write(const std::vector< T > & seq, std::vector< int > & buffer)
+    {
+
+        // Element by element, so std::vector<bool> works too
+        std::vector< unsigned char > bytes(seq.size() * sizeof(T));
+        for (size_t i = 0u; i < seq.size(); ++i)
+        {
+            T value = seq[i];
+            std::memcpy(bytes.data() + i * sizeof(T), &value, sizeof(T));
+        }
+
+        halo_pack(bytes.data(), bytes.size(), buffer);
+
+    }
+
+    static const int * read(const int * buffer, std::vector< T > & seq)
+    {
+
+        std::vector< unsigned char > bytes(halo_packed_size(buffer));
+        buffer = halo_unpack(buffer, bytes.data());
+
+        seq.resize(bytes.size() / sizeof(T));
+        for (size_t i = 0u; i < seq.size(); ++i)
+        {
+            T value;
+            std::memcpy(&value, bytes.data() + i * sizeof(T), sizeof(T));
+            seq[i] = value;
+        }
+
+        return buffer;
+
+    }
+
+};
+
+/**
+ * @brief Single replicate split across MPI processes
+ * 
+ * @details Each process holds the agents of one part of the network (see
+ * `GraphPartition`) plus ghost copies of their neighbors owned by other
+ * processes. `model` should have its states, viruses, tools, and global
+ * actions set, but no agents: the constructor loads the local network.
+ * 
+ * Only the owned agents update their state, get the initial viruses and
+ * tools, and mutate their viruses; actions over ghosts are dropped (see
+ * `Model::set_halo_exchange()`.) Once per day, after all the changes of the
+ * day are applied, each process sends the state, viruses, and tools of its
+ * boundary agents to the processes where they are ghosts:
+ * 
+ * - Viruses registered in the model are sent by id. Mutated viruses are
+ * sent as the virus of the model they descend from plus their sequence (see
+ * `HaloSequence`), and registered in the database of the receiver as
+ * variants of it.
+ * - Tools registered in the model are sent by id. Other tools (e.g., those
+ * added by `Virus::set_post_immunity()`) are sent by name and value: their
+ * effects are evaluated by the owner against the first virus of the agent.
+ * 
+ * The database of `model` only counts the owned agents, and sums the counts
+ * by state and the transitions across processes before recording them (see
+ * `DataBase::set_reduce()`), so `get_hist_total()` and
+ * `get_hist_transition_matrix()` are global. Today's counts, the virus and
+ * tool histories, and the transmissions are local and use local ids (see
+ * `get_global_id()`.) Initial prevalences are applied by each process over
+ * its own agents, so they should be given as proportions. Compile with
+ * `-DEPIWORLD_USE_MPI`, and run with, e.g., `mpirun -np 4`.
+ * 
+ * @tparam TSeq 
+ */
+template<typename TSeq>
+class DistributedModel {
+private:
+
+    Model<TSeq> * model;
+    GraphPartition partition;
+    MPI_Comm comm;
+
+    std::vector< int > send_counts, send_displs;
+    std::vector< int > recv_counts, recv_displs;
+    std::vector< int > send_buffer, recv_buffer;
+
+    std::vector< int > virus_index; ///< Database id -> virus of the model (-1 if none).
+    std::vector< int > tool_index;  ///< Database id -> tool of the model (-1 if none).
+
+    void pack_agent(Agent<TSeq> & p, std::vector< int > & buffer);
+    const int * unpack_agent(const int * buffer, Agent<TSeq> & p);
+
+    int get_comm_rank(int * nprocs) const; ///< Rank and size of `comm`.
+    void setup(); ///< Loads the local network and hooks into the model.
+
+public:
+
+    /**
+     * @brief Loads the local network from a file
+     * 
+     * @details Each process reads its part of `fn`, a network in binary
+     * format, without loading the global network (see
+     * `GraphPartition::GraphPartition(std::string, ...)`.) A text edgelist
+     * can be converted once with `CSRGraph::write_binary()`.
+     * 
+     * @param model Model (without agents) to run in this process.
+     * @param fn Path to the network in binary format.
+     * @param part Part (process) of each agent (e.g., from
+     * `graph_partition_block()`, or computed beforehand.)
+     * @param comm MPI communicator, with as many processes as parts.
+     */
+    DistributedModel(
+        Model<TSeq> & model,
+        std::string fn,
+        const std::vector< int > & part,
+        MPI_Comm comm = MPI_COMM_WORLD
+        );
+
+    /**
+     * @brief Takes the local network from the global one
+     * 
+     * @details Mostly for testing, since every process needs the global
+     * network in memory.
+     * 
+     * @param g Global network.
+     */
+    DistributedModel(
+        Model<TSeq> & model,
+        const CSRGraph & g,
+        const std::vector< int > & part,
+        MPI_Comm comm = MPI_COMM_WORLD
+        );
+
+    DistributedModel(const DistributedModel<TSeq> &) = delete;
+    DistributedModel<TSeq> & operator=(const DistributedModel<TSeq> &) = delete;
+
+    ~DistributedModel();
+
+    /**
+     * @brief Runs the replicate
+     * 
+     * @param ndays Number of days.
+     * @param seed Seed (if non-negative, each process uses a different
+     * stream derived from it.)
+     */
+    void run(epiworld_fast_uint ndays, int seed = -1);
+
+    void halo_exchange(); ///< Refreshes the ghosts.
+
+    int get_rank() const noexcept {return partition.get_rank();};
+    const GraphPartition & get_partition() const noexcept {return partition;};
+    int get_global_id(size_t i) const {return partition.get_global_id(i);};
+
+};
+
+template<typename TSeq>
+inline DistributedModel<TSeq>::DistributedModel(
+    Model<TSeq> & model,
+    std::string fn,
+    const std::vector< int > & part,
+    MPI_Comm comm
+) : model(&model), comm(comm)
+{
+
+    int nprocs;
+    int rank = get_comm_rank(&nprocs);
 
-    return; 
+    partition = GraphPartition(fn, part, rank, nprocs);
+    setup();
 
 }
 
 template<typename TSeq>
-inline AgentsSample<TSeq>::~AgentsSample() {}
+inline DistributedModel<TSeq>::DistributedModel(
+    Model<TSeq> & model,
+    const CSRGraph & g,
+    const std::vector< int > & part,
+    MPI_Comm comm
+) : model(&model), comm(comm)
+{
+
+    int nprocs;
+    int rank = get_comm_rank(&nprocs);
+
+    partition = GraphPartition(g, part, rank, nprocs);
+    setup();
 
-template<typename TSeq>
-inline size_t AgentsSample<TSeq>::size() const noexcept
-{ 
-    return this->sample_size;
 }
 
 template<typename TSeq>
-inline Agent<TSeq> * AgentsSample<TSeq>::operator[](size_t i)
+inline int DistributedModel<TSeq>::get_comm_rank(int * nprocs) const
 {
 
-    return agents->operator[](i);
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, nprocs);
+
+    return rank;
 
 }
 
 template<typename TSeq>
-inline Agent<TSeq> * AgentsSample<TSeq>::operator()(size_t i)
+inline void DistributedModel<TSeq>::setup()
 {
 
-    if (i >= this->sample_size)
-        throw std::range_error("The requested agent is out of range.");
+    Model<TSeq> & model = *this->model;
+    int nprocs = partition.get_nparts();
 
-    return agents->operator[](i);
+    if (model.get_agents_order() != "none")
+        throw std::logic_error(
+            "Distributed models cannot relabel the agents. " +
+            std::string("Use -set_agents_order(\"none\")- and relabel the network instead.")
+            );
+
+    model.agents_from_adjlist(partition.get_graph());
+
+    send_counts.assign(nprocs, 0);
+    send_displs.assign(nprocs, 0);
+    recv_counts.assign(nprocs, 0);
+    recv_displs.assign(nprocs, 0);
+
+    // The viruses and tools of the model have the same ids in all processes
+    for (size_t k = 0u; k < model.get_viruses().size(); ++k)
+    {
+        size_t id = static_cast< size_t >(model.get_viruses()[k]->get_id());
+        if (id >= virus_index.size())
+            virus_index.resize(id + 1u, -1);
+        virus_index[id] = static_cast< int >(k);
+    }
+
+    for (size_t k = 0u; k < model.get_tools().size(); ++k)
+    {
+        size_t id = static_cast< size_t >(model.get_tools()[k]->get_id());
+        if (id >= tool_index.size())
+            tool_index.resize(id + 1u, -1);
+        tool_index[id] = static_cast< int >(k);
+    }
+
+    model.get_db().set_reduce(
+        [this](std::vector< int > & counts) -> void {
+            MPI_Allreduce(
+                MPI_IN_PLACE, counts.data(), static_cast< int >(counts.size()),
+                MPI_INT, MPI_SUM, this->comm
+                );
+        });
+
+    model.set_halo_exchange(
+        [this](Model<TSeq> *) -> void {this->halo_exchange();},
+        partition.n_owned()
+        );
 
 }
 
 template<typename TSeq>
-inline typename std::vector< Agent<TSeq> * >::iterator AgentsSample<TSeq>::begin()
+inline DistributedModel<TSeq>::~DistributedModel()
 {
+    model->set_halo_exchange(nullptr, 0u);
+    model->get_db().set_reduce(nullptr);
+}
 
-    if (sample_size > 0u)
-        return agents->begin();
-    else
-        return agents->end();
+template<typename TSeq>
+inline void DistributedModel<TSeq>::run(
+    epiworld_fast_uint ndays,
+    int seed
+)
+{
+
+    if (seed >= 0)
+        seed = static_cast< int >(hash_combine64(
+            static_cast< std::uint64_t >(seed),
+            static_cast< std::uint64_t >(partition.get_rank())
+            ) >> 33);
+
+    model->run(ndays, seed);
 
 }
 
 template<typename TSeq>
-inline typename std::vector< Agent<TSeq> * >::iterator AgentsSample<TSeq>::end()
+inline void DistributedModel<TSeq>::pack_agent(
+    Agent<TSeq> & p,
+    std::vector< int > & buffer
+)
 {
 
-    return agents->begin() + sample_size;
+    Model<TSeq> & m = *model;
+    const auto & parents = m.get_db().virus_parent_id;
+
+    buffer.push_back(static_cast< int >(p.state));
+
+    // Viruses: virus of the model, and the sequence if it mutated
+    buffer.push_back(static_cast< int >(p.n_viruses));
+    for (size_t k = 0u; k < p.n_viruses; ++k)
+    {
+
+        const auto & v = p.viruses[k];
+        int id = v->get_id();
+        while ((id >= 0) &&
+            ((static_cast< size_t >(id) >= virus_index.size()) ||
+             (virus_index[id] < 0)))
+            id = parents[id];
+
+        if (id < 0)
+            throw std::logic_error(
+                "The virus \"" + v->get_name() + "\" does not descend from " +
+                "a virus of the model, so it cannot be sent to other processes."
+                );
+
+        buffer.push_back(virus_index[id]);
+        buffer.push_back(id != v->get_id() ? 1 : 0);
+        if (id != v->get_id())
+            HaloSequence< TSeq >::write(*v->get_sequence(), buffer);
+
+    }
+
+    // Tools: tool of the model, or name and effects
+    VirusPtr<TSeq> v0 = (p.n_viruses > 0u) ? p.viruses[0u] : nullptr;
+    buffer.push_back(static_cast< int >(p.n_tools));
+    for (size_t k = 0u; k < p.n_tools; ++k)
+    {
+
+        auto & t = p.tools[k];
+        int id   = t->get_id();
+        int key  = ((id >= 0) && (static_cast< size_t >(id) < tool_index.size())) ?
+            tool_index[id] : -1;
+
+        buffer.push_back(key);
+        if (key >= 0)
+            continue;
+
+        const std::string & name = t->get_name();
+        halo_pack(name.data(), name.size(), buffer);
+
+        float effects[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        if (v0 != nullptr)
+        {
+            effects[0] = static_cast< float >(t->get_susceptibility_reduction(v0, &m));
+            effects[1] = static_cast< float >(t->get_transmission_reduction(v0, &m));
+            effects[2] = static_cast< float >(t->get_recovery_enhancer(v0, &m));
+            effects[3] = static_cast< float >(t->get_death_reduction(v0, &m));
+        }
+
+        halo_pack(effects, sizeof(effects), buffer);
+
+    }
 
 }
 
 template<typename TSeq>
-inline void AgentsSample<TSeq>::sample_n(size_t n)
+inline const int * DistributedModel<TSeq>::unpack_agent(
+    const int * buffer,
+    Agent<TSeq> & p
+)
 {
 
-    // Checking if the size of the entity has changed (or hasn't been initialized)
-    if (sample_type == SAMPLETYPE::MODEL)
+    Model<TSeq> & m = *model;
+
+    p.state = static_cast< epiworld_fast_uint >(*(buffer++));
+
+    // Viruses (reusing the ones the ghost already has, if equal)
+    size_t nviruses = static_cast< size_t >(*(buffer++));
+    if (p.viruses.size() < nviruses)
+        p.viruses.resize(nviruses, nullptr);
+
+    TSeq seq;
+    for (size_t k = 0u; k < nviruses; ++k)
     {
 
-        if (model->size() != agents_left->size())
+        const auto & base = m.get_viruses()[*(buffer++)];
+        bool mutated      = *(buffer++) != 0;
+        auto & v          = p.viruses[k];
+
+        if (!mutated)
         {
-            agents_left->resize(model->size(), 0u);
-            std::iota(agents_left->begin(), agents_left->end(), 0u);
+
+            if ((v == nullptr) || (v->get_id() != base->get_id()))
+                v = std::make_shared< Virus<TSeq> >(*base);
+
         }
+        else
+        {
 
+            buffer = HaloSequence< TSeq >::read(buffer, seq);
 
-    } else if (sample_type == SAMPLETYPE::ENTITY) {
+            if ((v == nullptr) || (v->get_sequence() == nullptr) ||
+                !(*v->get_sequence() == seq))
+            {
 
-        if (entity->size() != agents_left->size())
-        {
+                // Registered as a variant of the virus of the model
+                v = std::make_shared< Virus<TSeq> >(*base);
+                v->set_sequence(seq);
+                m.get_db().record_virus(*v);
 
-            agents_left->resize(entity->size(), 0u);
-            std::iota(agents_left->begin(), agents_left->end(), 0u);
+            }
 
         }
 
-    } 
+        v->set_agent(&p, k);
 
-    // Restart the counter of agents left
-    *agents_left_n = agents_left->size();
+    }
 
-    if (agents->size() < sample_size)
-        agents->resize(sample_size, nullptr);
+    p.n_viruses = nviruses;
 
-    if (sample_type == SAMPLETYPE::MODEL)
+    // Tools (same)
+    size_t ntools = static_cast< size_t >(*(buffer++));
+    if (p.tools.size() < ntools)
+        p.tools.resize(ntools, nullptr);
+
+    for (size_t k = 0u; k < ntools; ++k)
     {
 
-        for (size_t i = 0u; i < n; ++i)
+        int key  = *(buffer++);
+        auto & t = p.tools[k];
+
+        if (key >= 0)
         {
 
-            size_t ith = agents_left->operator[](model->runif() * ((*agents_left_n)--));
-            agents->operator[](i) = &model->population[ith];
+            const auto & base = m.get_tools()[key];
+            if ((t == nullptr) || (t->get_id() != base->get_id()))
+                t = std::make_shared< Tool<TSeq> >(*base);
 
-            // Updating list
-            std::swap(agents_left->operator[](ith), agents_left->operator[](*agents_left_n));
+        }
+        else
+        {
+
+            std::string name(halo_packed_size(buffer), '\0');
+            buffer = halo_unpack(buffer, &name[0u]);
+
+            float effects[4];
+            buffer = halo_unpack(buffer, effects);
+
+            t = std::make_shared< Tool<TSeq> >(name);
+            t->set_susceptibility_reduction(effects[0]);
+            t->set_transmission_reduction(effects[1]);
+            t->set_recovery_enhancer(effects[2]);
+            t->set_death_reduction(effects[3]);
 
         }
 
-    } else if (sample_type == SAMPLETYPE::ENTITY) {
+        t->set_agent(&p, k);
 
-        for (size_t i = 0u; i < n; ++i)
-        {
+    }
 
-            size_t ith = agents_left->operator[](model->runif() * (--(*agents_left_n)));
-            agents->operator[](i) = entity->agents[ith];
+    p.n_tools = ntools;
+    p.tool_effects_clear();
 
-            // Updating list
-            std::swap(agents_left->operator[](ith), agents_left->operator[](*agents_left_n));
+    m.virus_holders_update(p);
 
-        }
+    return buffer;
+
+}
+
+template<typename TSeq>
+inline void DistributedModel<TSeq>::halo_exchange()
+{
+
+    Model<TSeq> & m = *model;
+    auto & population = m.population;
+    int nprocs = partition.get_nparts();
+
+    // Packing the boundary agents, one process after the other
+    send_buffer.clear();
+    for (int r = 0; r < nprocs; ++r)
+    {
+
+        send_displs[r] = static_cast< int >(send_buffer.size());
+        for (auto i : partition.get_send_ids(r))
+            pack_agent(population[i], send_buffer);
+
+        send_counts[r] = static_cast< int >(send_buffer.size()) - send_displs[r];
 
     }
 
-    return;
+    MPI_Alltoall(
+        send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm
+        );
+
+    for (int r = 1; r < nprocs; ++r)
+        recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+
+    recv_buffer.resize(recv_displs.back() + recv_counts.back());
+
+    MPI_Alltoallv(
+        send_buffer.data(), send_counts.data(), send_displs.data(), MPI_INT,
+        recv_buffer.data(), recv_counts.data(), recv_displs.data(), MPI_INT,
+        comm
+        );
+
+    for (int r = 0; r < nprocs; ++r)
+    {
+
+        const int * buff = recv_buffer.data() + recv_displs[r];
+        for (auto i : partition.get_recv_ids(r))
+            buff = unpack_agent(buff, population[i]);
+
+    }
 
 }
 
+#endif
+
 #endif
 /*//////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
- End of -include/epiworld/agentssample-bones.hpp-
+ End of -include/epiworld/distributed.hpp-
 
 ////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////*/
 
 
-
 /*//////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -15232,6 +23687,221 @@ inline std::function<void(Model<TSeq>*)> globalaction_set_param(
 
     return fun;
 
+}
+
+/**
+ * @brief Global action that transmits viruses through entity mixing.
+ * 
+ * @details Every day, each agent in `susceptible_state` makes `contact_rate`
+ * contacts, each with a member of its entities drawn uniformly (with
+ * replacement) from the union of its entities. Members in any of `infectious_states`
+ * transmit their virus `v` with probability
+ * (1 - susceptibility_reduction) * prob_infecting(v) * (1 - transmission_reduction).
+ * 
+ * Instead of sampling the contacts of each susceptible agent, the action
+ * sums the infectiousness of each virus within each entity once per day. The
+ * probability of infection of an agent follows from the sums of its entities,
+ * and the source (thus, the virus) is drawn only if the agent gets infected.
+ * The daily cost is O(members + entities) instead of O(susceptible x contacts).
+ * 
+ * @tparam TSeq Sequence type (should match `TSeq` across the model)
+ * @param contact_rate Number of contacts per agent per day.
+ * @param susceptible_state State of the agents that can be infected.
+ * @param infectious_states States of the agents that can transmit.
+ * @return std::function<void(Model<TSeq>*)> 
+ */
+template<typename TSeq>
+inline std::function<void(Model<TSeq>*)> globalaction_entity_mixing(
+    epiworld_double contact_rate,
+    epiworld_fast_uint susceptible_state,
+    std::vector< epiworld_fast_uint > infectious_states
+) {
+
+    const sampler::StateMask infectious(infectious_states);
+
+    // Per-model buffers: each copy of the model owns a copy of the action
+    std::vector< epiworld_double > infectiousness; ///< Entity x virus
+    std::vector< const VirusPtr<TSeq> * > viruses; ///< Any instance of each virus
+    std::vector< epiworld_double > probs;
+    std::vector< size_t > probs_virus;
+
+    std::function<void(Model<TSeq>*)> fun = [
+        contact_rate,susceptible_state,infectious,
+        infectiousness,viruses,probs,probs_virus
+        ](
+        Model<TSeq> * model
+        ) mutable -> void {
+
+        infectious.check(model->get_states().size());
+
+        auto & entities  = model->get_entities();
+        size_t n_viruses = model->get_n_viruses();
+
+        infectiousness.assign(entities.size() * n_viruses, 0.0);
+        viruses.assign(n_viruses, nullptr);
+
+        // Step 1: Infectiousness of each virus in each entity
+        bool any = false;
+        for (auto & e : entities)
+        {
+
+            epiworld_double * e_infectiousness =
+                &infectiousness[e.get_id() * n_viruses];
+
+            for (size_t k = 0u; k < e.size(); ++k)
+            {
+
+                Agent<TSeq> * member = e[k];
+                if (!infectious[member->get_state()])
+                    continue;
+
+                for (const VirusPtr<TSeq> & v : member->get_viruses())
+                {
+
+                    int v_id = v->get_id();
+                    if (viruses[v_id] == nullptr)
+                        viruses[v_id] = &v;
+
+                    e_infectiousness[v_id] +=
+                        v->get_prob_infecting(model) *
+                        (1.0 - member->get_transmission_reduction(v, model));
+
+                    any = true;
+
+                }
+
+            }
+
+        }
+
+        if (!any)
+            return;
+
+        // Step 2: Probability of infection of each susceptible agent
+        for (auto & agent : model->get_agents())
+        {
+
+            if (agent.get_state() != susceptible_state)
+                continue;
+
+            size_t n_mates = 0u;
+            for (size_t i = 0u; i < agent.get_n_entities(); ++i)
+                n_mates += agent.get_entity(i).size() - 1u;
+
+            if (n_mates == 0u)
+                continue;
+
+            // Probability that a single contact transmits each virus
+            probs.clear();
+            probs_virus.clear();
+            epiworld_double p_contact = 0.0;
+            for (size_t v_id = 0u; v_id < n_viruses; ++v_id)
+            {
+
+                if (viruses[v_id] == nullptr)
+                    continue;
+
+                epiworld_double total = 0.0;
+                for (size_t i = 0u; i < agent.get_n_entities(); ++i)
+                    total += infectiousness[
+                        agent.get_entity(i).get_id() * n_viruses + v_id
+                    ];
+
+                if (total <= 0.0)
+                    continue;
+
+                total *= (1.0 - agent.get_susceptibility_reduction(
+                    *viruses[v_id], model
+                    )) / static_cast< epiworld_double >(n_mates);
+
+                probs.push_back(total);
+                probs_virus.push_back(v_id);
+                p_contact += total;
+
+            }
+
+            if (p_contact <= 0.0)
+                continue;
+
+            // Contacts are drawn with replacement, so there can be more
+            // contacts than mates
+            epiworld_double p_infection = 1.0 - std::pow(
+                1.0 - std::min(p_contact, static_cast< epiworld_double >(1.0)),
+                contact_rate
+                );
+
+            if (model->runif() >= p_infection)
+                continue;
+
+            // Step 3: Drawing the virus, the entity, and the source
+            epiworld_double r = model->runif() * p_contact;
+            size_t which = 0u;
+            while ((which < probs.size() - 1u) && (r >= probs[which]))
+                r -= probs[which++];
+
+            size_t v_id = probs_virus[which];
+
+            epiworld_double total = 0.0;
+            for (size_t i = 0u; i < agent.get_n_entities(); ++i)
+                total += infectiousness[
+                    agent.get_entity(i).get_id() * n_viruses + v_id
+                ];
+
+            r = model->runif() * total;
+            size_t entity_i = 0u;
+            for (; entity_i < agent.get_n_entities() - 1u; ++entity_i)
+            {
+
+                epiworld_double e_total = infectiousness[
+                    agent.get_entity(entity_i).get_id() * n_viruses + v_id
+                ];
+
+                if (r < e_total)
+                    break;
+
+                r -= e_total;
+
+            }
+
+            auto & e = agent.get_entity(entity_i);
+            r = model->runif() * infectiousness[e.get_id() * n_viruses + v_id];
+
+            const VirusPtr<TSeq> * source_virus = nullptr;
+            for (size_t k = 0u; k < e.size(); ++k)
+            {
+
+                Agent<TSeq> * member = e[k];
+                if (!infectious[member->get_state()])
+                    continue;
+
+                for (const VirusPtr<TSeq> & v : member->get_viruses())
+                {
+
+                    if (v->get_id() != static_cast< int >(v_id))
+                        continue;
+
+                    source_virus = &v;
+                    r -= v->get_prob_infecting(model) *
+                        (1.0 - member->get_transmission_reduction(v, model));
+
+                }
+
+                if (r < 0.0)
+                    break;
+
+            }
+
+            if (source_virus != nullptr)
+                agent.add_virus(**source_virus, model);
+
+        }
+
+        return;
+
+    };
+
+    return fun;
+
 }
 #endif
 /*//////////////////////////////////////////////////////////////////////////////
@@ -15748,8 +24418,12 @@ inline ModelSURV<TSeq>::ModelSURV(
 
         // This computes the prob of getting any neighbor variant
         epiworld_fast_uint nviruses_tmp = 0u;
-        for (auto & neighbor: p->get_neighbors()) 
+        auto neighbors = p->get_neighbors_view();
+        for (size_t neighbor_k = 0u; neighbor_k < neighbors.size(); ++neighbor_k)
         {
+
+            auto * neighbor = neighbors[neighbor_k];
+            epiworld_double weight = neighbors.get_weight(neighbor_k);
                     
             for (size_t i = 0u; i < neighbor->get_n_viruses(); ++i) 
             { 
@@ -15757,11 +24431,13 @@ inline ModelSURV<TSeq>::ModelSURV(
                 auto & v = neighbor->get_virus(i);
                     
                 /* And it is a function of susceptibility_reduction as well */ 
-                epiworld_double tmp_transmission = 
-                    (1.0 - p->get_susceptibility_reduction(v, m)) * 
-                    v->get_prob_infecting(m) * 
-                    (1.0 - neighbor->get_transmission_reduction(v, m)) 
-                    ; 
+                epiworld_double tmp_transmission = std::min< epiworld_double >(
+                    1.0,
+                    (1.0 - p->get_susceptibility_reduction(v, m)) *
+                    v->get_prob_infecting(m) *
+                    (1.0 - neighbor->get_transmission_reduction(v, m)) *
+                    weight
+                    );
             
                 m->array_double_tmp[nviruses_tmp]  = tmp_transmission;
                 m->array_virus_tmp[nviruses_tmp++] = &(*v);
@@ -18118,8 +26794,12 @@ inline ModelSIRLogit<TSeq>::ModelSIRLogit(
             for (size_t k = 0u; k < _m->coef_infect_cols.size(); ++k)
                 baseline += p->operator[](k) * _m->coefs_infect[k + 1u];
 
-            for (auto & neighbor: p->get_neighbors()) 
+            auto neighbors = p->get_neighbors_view();
+            for (size_t neighbor_k = 0u; neighbor_k < neighbors.size(); ++neighbor_k)
             {
+
+                auto * neighbor = neighbors[neighbor_k];
+                epiworld_double weight = neighbors.get_weight(neighbor_k);
                 
                 for (const VirusPtr<TSeq> & v : neighbor->get_viruses()) 
                 { 
@@ -18135,7 +26815,7 @@ inline ModelSIRLogit<TSeq>::ModelSIRLogit(
                         (1.0 - p->get_susceptibility_reduction(v, m)) * 
                         v->get_prob_infecting(m) * 
                         (1.0 - neighbor->get_transmission_reduction(v, m))  *
-                        coef_exposure
+                        coef_exposure * weight
                         ; 
 
                     // Applying the plogis function
@@ -18360,9 +27040,16 @@ inline ModelDiffNet<TSeq>::ModelDiffNet(
 
         // For each one of the possible innovations, we have to compute
         // the adoption probability, which is a function of exposure
-        for (auto & neighbor: agent.get_neighbors())
+        // (weighted by the ties, if they have weights)
+        auto neighbors = agent.get_neighbors_view();
+        double total_weight = 0.0;
+        for (size_t neighbor_k = 0u; neighbor_k < neighbors.size(); ++neighbor_k)
         {
 
+            auto * neighbor = neighbors[neighbor_k];
+            epiworld_double weight = neighbors.get_weight(neighbor_k);
+            total_weight += weight;
+
             if (neighbor->get_state() == ModelDiffNet<TSeq>::ADOPTER)
             {
 
@@ -18381,7 +27068,7 @@ inline ModelDiffNet<TSeq>::ModelDiffNet(
                         stored[vid] = true;
                         innovations[vid] = &(*v);
                     }
-                    exposure[vid] += p_i;
+                    exposure[vid] += p_i * weight;
                     
                 } 
 
@@ -18389,12 +27076,17 @@ inline ModelDiffNet<TSeq>::ModelDiffNet(
 
         }
 
+        // Without (weighted) ties there is no exposure to normalize nor
+        // neighbor to adopt from
+        if (total_weight <= 0.0)
+            return;
+
         // Computing probability of adoption
         for (size_t i = 0u; i < nviruses; ++i)
         {
 
             if (diffmodel->normalize_exposure)
-                exposure.at(i) /= agent.get_n_neighbors();
+                exposure.at(i) /= total_weight;
 
             for (auto & j: diffmodel->data_cols)
                 exposure.at(i) += agent(j) * diffmodel->params.at(j);
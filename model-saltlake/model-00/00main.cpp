@@ -134,63 +134,6 @@ EPI_NEW_TOOL(vax_death, int)
             std::pow(1/days, m->par("Vax Efficacy decay"));
 }
 
-EPI_NEW_GLOBALFUN(contact, int)
-{
-    for (auto & a : *(m->get_agents()))
-    {
-        // Will it get it from the entities?
-        if (a.get_status() == Status::Susceptible)
-        {
-
-            AgentsSample<int> neighbors(a, 5, true);
-            size_t nvariants_tmp = 0u;
-            for (auto & neighbor: neighbors) 
-            {
-
-                // Only infected individuals can pass the virus
-                epiworld_fast_uint neighbor_status = neighbor->get_status();
-                if ((neighbor_status != Status::InfectedSymp) & (neighbor_status != Status::InfectedAsymp))
-                    continue;
-                        
-                for (const VirusPtr<int> & v : neighbor->get_viruses()) 
-                { 
-
-                    #ifdef EPI_DEBUG
-                    if (nvariants_tmp >= m->array_virus_tmp.size())
-                        throw std::logic_error("Trying to add an extra element to a temporal array outside of the range.");
-                        // printf_epiworld("N used %d\n", v.use_count());
-                    #endif
-                        
-                    /* And it is a function of susceptibility_reduction as well */ 
-                    m->array_double_tmp[nvariants_tmp] =
-                        (1.0 - a.get_susceptibility_reduction(v)) * 
-                        v->get_prob_infecting() * 
-                        (1.0 - neighbor->get_transmission_reduction(v)) 
-                        ; 
-                
-                    m->array_virus_tmp[nvariants_tmp++] = &(*v);
-                    
-                } 
-            }
-
-            // No virus to compute
-            if (nvariants_tmp == 0u)
-                continue;
-
-            // Running the roulette
-            int which = roulette(nvariants_tmp, m);
-
-            if (which < 0)
-                continue;
-
-            a.add_virus(*(m->array_virus_tmp[which]), Status::Exposed, QueueValues::OnlySelf); 
-
-        }
-
-
-    }
-}
-
 int main()
 {
 
@@ -243,6 +186,9 @@ int main()
     vax.set_susceptibility_reduction_fun(vax_efficacy);
     vax.set_recovery_enhancer_fun(vax_recovery);
     vax.set_death_reduction_fun(vax_death);
+
+    // The efficacy decays, so it is recomputed every day
+    vax.set_time_dependent();
     
     model.add_tool(vax, .3);
 
@@ -254,8 +200,16 @@ int main()
         model.add_entity_n(e, 500);
     }
 
-    // This will act through the global
-    model.add_global_action(contact, -99);
+    // This will act through the global: each susceptible has 5 contacts
+    // a day with members of its entities
+    model.add_global_action(
+        epimodels::globalaction_entity_mixing<int>(
+            5.0, Status::Susceptible,
+            {Status::InfectedSymp, Status::InfectedAsymp}
+            ),
+        "Entity mixing",
+        -99
+        );
 
     model.init(100, 223); 
 